@@ -83,6 +83,12 @@ void main()
 		m_odepth += m_odstep;
 
         vec3 sray = normalize(-light_dir);
+#ifdef _ATMO_LUT
+        vec4 lut = sampleAtmoLut(ipos, sray);
+        float sr_odepth = lut.x * atmo_radius;
+        float sm_odepth = lut.y;
+        float shadow = lut.z;
+#else
         vec2 sintersect = raySphereIntersect(ipos, sray, 1.0);
 
         float sdr = sintersect.y; // intersect.x doesn't make sense here as we start inside the atmo
@@ -105,6 +111,7 @@ void main()
             shadow += softSphereShadow(spos, sray, planet_radius, 1.0);
 		}
 		shadow *= SUB_STEPS_INVERSE;
+#endif
 
         float r_combdepth = r_odepth * 2e4 + sr_odepth * 3e6;
         float m_combdepth = m_odepth * 2e4 + sm_odepth * 3e4;
@@ -3,13 +3,13 @@ out vec4 FragColor;
 
 
 in vec2 vTex;
+in vec4 vColor;
 
 uniform sampler2D tex;
-uniform vec4 color;
 
 void main()
 {
 	float val = texture(tex, vTex).a;
 
-	FragColor = color * val;
+	FragColor = vColor * val;
 }
@@ -7,12 +7,10 @@ in vec3 vNrm;
 
 in float flogz;
 
-uniform float f_coef;
+#include <core:/shaders/uniform_blocks.fsi>
 
 uniform vec3 color;
 
-uniform vec3 camera_relative;
-
 const vec3 light_dir = vec3(1.0, 0.0, 0.0);
 
 const float rim_start = 0.0;
@@ -3,12 +3,7 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNrm;
 
-uniform mat3 normal_model;
-uniform mat4 final_tform;
-uniform mat4 deferred_tform;
-uniform vec3 camera_relative;
-
-uniform float f_coef;
+#include <core:/shaders/uniform_blocks.fsi>
 
 out vec3 vNrm;
 out vec3 vPos;
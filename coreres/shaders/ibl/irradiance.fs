@@ -3,8 +3,13 @@ out vec4 FragColor;
 in vec3 WorldPos;
 
 uniform samplerCube tex;
+uniform float tex_size;
+
+// Cosine weighted directions in tangent space
+uniform sampler1D sample_positions;
 
 const float PI = 3.14159265359;
+const int SAMPLE_COUNT = 64;
 
 void main()
 {
@@ -15,30 +20,27 @@ void main()
     // we use in the PBR shader to sample irradiance.
     vec3 N = normalize(WorldPos);
 
-    vec3 irradiance = vec3(0.0);
-
     // tangent space calculation from origin point
-    vec3 up    = vec3(0.0, 1.0, 0.0);
-    vec3 right = cross(up, N);
-    up            = cross(N, right);
-
-    float sampleDelta = 0.1;
-    float nrSamples = 0.0;
-    for(float phi = 0.0; phi < 2.0 * PI; phi += sampleDelta)
+    vec3 up        = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent   = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    mat3 tangentToWorld = mat3(tangent, bitangent, N);
+
+    // Samples are importance sampled (pdf = cos(theta) / PI), so the cosine term cancels
+    // out and the (irradiance / PI) the PBR shader expects is just the average. Each sample
+    // reads from the mip whose texels cover its solid angle, which avoids noise.
+    float OmegaP = 4.0 * PI / (6.0 * tex_size * tex_size);
+    vec3 irradiance = vec3(0.0);
+    for(int i = 0; i < SAMPLE_COUNT; i++)
     {
-        for(float theta = 0.0; theta < 0.5 * PI; theta += sampleDelta)
-        {
-            // spherical to cartesian (in tangent space)
-            vec3 tangentSample = vec3(sin(theta) * cos(phi),  sin(theta) * sin(phi), cos(theta));
-            // tangent space to world
-            vec3 sampleVec = tangentSample.x * right + tangentSample.y * up + tangentSample.z * N;
-
-            irradiance += texture(tex, sampleVec).rgb * cos(theta) * sin(theta);
-            nrSamples++;
-        }
+        vec3 tangentSample = texelFetch(sample_positions, i, 0).rgb;
+        vec3 sampleVec = tangentToWorld * tangentSample;
+
+        float OmegaS = PI / (float(SAMPLE_COUNT) * max(tangentSample.z, 0.01));
+        float MipLevel = max(0.5 * log2(OmegaS / OmegaP) + 1.0, 0.0);
+        irradiance += textureLod(tex, sampleVec, MipLevel).rgb;
     }
-    irradiance = PI * irradiance * (1.0 / float(nrSamples));
+    irradiance = irradiance * (1.0 / float(SAMPLE_COUNT));
 
     FragColor = vec4(irradiance, 1.0);
 }
-
@@ -47,8 +47,7 @@ void main()
         vec3 prefilteredColor = vec3(0.0);
         for(uint i = 0u; i < SAMPLE_COUNT; ++i)
         {
-            // We must decode the data as textures cannot store negatives
-            vec3 Hi  = (texelFetch(sample_positions, int(i), 0).rgb - 0.5) * 2.0;
+            vec3 Hi  = texelFetch(sample_positions, int(i), 0).rgb;
             vec3 H = normalize(tangentToWorld * Hi);
             float VdotH = clamp(dot(V, H), 0.0, 1.0);
             vec3 L  = normalize(2.0 * VdotH * H - V);
@@ -0,0 +1,82 @@
+#version 430 core
+out vec4 FragColor;
+
+uniform sampler2D gPosition;
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gPbr;
+
+#include <core:/shaders/uniform_blocks.fsi>
+#include "point.fsi"
+
+// Must match ClusteredLighting::GPULight
+struct ClusterLight
+{
+    vec4 pos_radius;
+    vec4 color;
+    vec4 spec_color;
+    vec4 attenuation;
+};
+
+layout (std430, binding = 0) readonly buffer ClusterLights
+{
+    ClusterLight lights[];
+};
+
+// x = offset into indices, y = light count
+layout (std430, binding = 1) readonly buffer ClusterGrid
+{
+    uvec2 clusters[];
+};
+
+layout (std430, binding = 2) readonly buffer ClusterIndices
+{
+    uint indices[];
+};
+
+uniform ivec3 cluster_count;
+uniform vec4 viewport;
+// x = depth of the first slice, y = log(far / near) of the clustered range
+uniform vec2 cluster_depth;
+
+// All point lights at once, each pixel only evaluates the lights of its cluster
+void main()
+{
+    ivec2 px = ivec2(gl_FragCoord.xy);
+    vec3 Normal = texelFetch(gNormal, px, 0).rgb;
+    if(dot(Normal, Normal) < 0.001)
+    {
+        // Nothing was drawn here
+        discard;
+    }
+
+    vec3 FragPos = texelFetch(gPosition, px, 0).rgb;
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = int(floor(log(max(depth, cluster_depth.x) / cluster_depth.x) / cluster_depth.y * cluster_count.z));
+    if(slice >= cluster_count.z)
+    {
+        // Further than any light reaches
+        discard;
+    }
+
+    vec2 uv = (gl_FragCoord.xy - viewport.xy) / viewport.zw;
+    ivec2 tile = clamp(ivec2(uv * vec2(cluster_count.xy)), ivec2(0), cluster_count.xy - 1);
+    uvec2 cluster = clusters[(slice * cluster_count.y + tile.y) * cluster_count.x + tile.x];
+    if(cluster.y == 0u)
+    {
+        discard;
+    }
+
+    vec3 Albedo = texelFetch(gAlbedo, px, 0).rgb;
+    float Specular = 1.0 - texelFetch(gPbr, px, 0).g;
+
+    vec3 total = vec3(0.0);
+    for(uint i = 0u; i < cluster.y; i++)
+    {
+        ClusterLight l = lights[indices[cluster.x + i]];
+        total += point_light(FragPos, Normal, Albedo, Specular,
+            l.pos_radius.xyz, l.color.rgb, l.spec_color.rgb, l.attenuation.x, l.attenuation.y, l.attenuation.z);
+    }
+
+    FragColor = vec4(total, 1.0);
+}
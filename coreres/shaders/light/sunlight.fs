@@ -10,42 +10,65 @@ uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedo;
 uniform sampler2D gPbr;
-uniform sampler2D near_shadow_map;
-uniform mat4 near_shadow_tform;
+uniform sampler2DArray near_shadow_maps;
+uniform sampler2DArray far_shadow_maps;
+// Must match SunLight::CASCADE_COUNT, the first two are near cascades
+#define CASCADE_COUNT 4
+#define NEAR_CASCADES 2
+uniform mat4 shadow_tform[CASCADE_COUNT];
+uniform float cascade_end[CASCADE_COUNT];
+uniform vec3 camera_fw;
 
 #include <core:shaders/light/pbr.fsi>
 
-float calculate_shadow(vec4 FragPosLightSpace, float diff_fac)
+float sample_shadow(sampler2DArray shadow_map, float layer, vec3 shadow_proj, float bias)
 {
+	float current_depth = shadow_proj.z;
+	float shadow = 0.0;
+	vec2 texel_size = 1.0 / textureSize(shadow_map, 0).xy;
+	for(int x = -1; x <= 1; ++x)
+	{
+		for(int y = -1; y <= 1; ++y)
+		{
+			float pcf_depth = texture(shadow_map, vec3(shadow_proj.xy + vec2(x, y) * texel_size, layer)).r;
+			shadow += current_depth - bias > pcf_depth ? 0.0 : 1.0;
+		}
+	}
+	return shadow / 9.0;
+}
+
+float calculate_shadow(vec3 FragPos, float diff_fac)
+{
+	float depth = dot(FragPos, camera_fw);
+	int cascade = 0;
+	while(cascade < CASCADE_COUNT && depth > cascade_end[cascade])
+	{
+		cascade++;
+	}
+
+	if(cascade == CASCADE_COUNT)
+	{
+		return 1.0;
+	}
+
+	vec4 FragPosLightSpace = shadow_tform[cascade] * vec4(FragPos, 1.0f);
 	vec3 shadow_proj = FragPosLightSpace.xyz / FragPosLightSpace.w;
 	shadow_proj = shadow_proj * 0.5 + 0.5;
-	
-	float bias = max(0.01 * (1.0 - diff_fac), 0.005);  
+
+	float bias = max(0.01 * (1.0 - diff_fac), 0.005);
 
 	if(shadow_proj.z > 1.0)
-	{	
+	{
 		return 1.0;
 	}
+	else if(cascade < NEAR_CASCADES)
+	{
+		return sample_shadow(near_shadow_maps, float(cascade), shadow_proj, bias);
+	}
 	else
 	{
-		float closest_depth = texture(near_shadow_map, shadow_proj.xy).r;
-		float current_depth = shadow_proj.z;
-		//float shadow = current_depth - bias > closest_depth ? 0.0f : 1.0f;
-		//return shadow;
-
-		float shadow = 0.0;
-		vec2 texel_size = 1.0 / textureSize(near_shadow_map, 0);
-		for(int x = -1; x <= 1; ++x)
-		{
-    		for(int y = -1; y <= 1; ++y)
-    		{
-       			float pcf_depth = texture(near_shadow_map, shadow_proj.xy + vec2(x, y) * texel_size).r; 
-        		shadow += current_depth - bias > pcf_depth ? 0.0 : 1.0;        
-    		}    
-		}
-		shadow /= 9.0;
-		return shadow;
-	}	
+		return sample_shadow(far_shadow_maps, float(cascade - NEAR_CASCADES), shadow_proj, bias);
+	}
 }
 
 
@@ -69,8 +92,7 @@ void main()
 
     vec3 lo = get_pbr(sun_dir, FragPos, Normal, Albedo, Roughness, Metallic);
 
-	vec4 FragPosLightSpace = near_shadow_tform * vec4(FragPos, 1.0f);
-	float shadow = calculate_shadow(FragPosLightSpace, dot(Normal, sun_dir));
+	float shadow = calculate_shadow(FragPos, dot(Normal, sun_dir));
 
 	vec3 fcolor = lo * shadow * color + emit;
 
@@ -12,7 +12,8 @@ in mat3 TBN;
 in vec3 vTgt;
 
 in float flogz;
-uniform float f_coef;
+
+#include <core:/shaders/uniform_blocks.fsi>
 
 uniform sampler2D base_color_tex;
 uniform sampler2D metallic_roughness_tex;
@@ -20,15 +21,17 @@ uniform sampler2D ambient_occlusion_tex;
 uniform sampler2D normal_map;
 uniform sampler2D emissive_tex;
 
-uniform vec3 base_color;
-uniform float metallic;
-uniform float roughness;
-uniform vec3 emissive;
-uniform float normal_scale;
-uniform float occlusion_strength;
-uniform float transparency;
-
-uniform int drawable_id;
+// Packed once when the material is loaded
+layout (std140) uniform MaterialBlock
+{
+	vec3 base_color;
+	float metallic;
+	vec3 emissive;
+	float roughness;
+	float normal_scale;
+	float occlusion_strength;
+	float transparency;
+};
 
 #include <core:/shaders/screen_door.fsi>
 
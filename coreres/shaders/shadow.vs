@@ -3,8 +3,11 @@ layout (location = 0) in vec3 aPos;
 
 uniform mat4 tform;
 
+layout (location = 8) in mat4 inst_tform;
+uniform bool instanced;
+
 
 void main()
 {
-    gl_Position = tform * vec4(aPos, 1.0);
+    gl_Position = (instanced ? inst_tform : tform) * vec4(aPos, 1.0);
 }  
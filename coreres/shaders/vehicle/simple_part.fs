@@ -9,12 +9,16 @@ in vec3 vNrm;
 in vec2 vTex;
 
 in float flogz;
-uniform float f_coef;
+
+#include <core:/shaders/uniform_blocks.fsi>
 
 uniform sampler2D diffuse;
-uniform int drawable_id;
 
-uniform float transparency;
+// Packed once when the material is loaded
+layout (std140) uniform MaterialBlock
+{
+	float transparency;
+};
 
 #include <core:/shaders/screen_door.fsi>
 
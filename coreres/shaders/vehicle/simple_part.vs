@@ -5,12 +5,12 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNrm;
 layout (location = 2) in vec2 aTex;
 
-uniform mat3 normal_model;
-uniform mat4 final_tform;
-uniform mat4 deferred_tform;
-uniform vec3 camera_relative;
+// Per-instance transforms, used instead of DrawBlock when instanced is set
+layout (location = 8) in mat4 inst_final_tform;
+layout (location = 12) in mat4 inst_deferred_tform;
+uniform bool instanced;
 
-uniform float f_coef;
+#include <core:/shaders/uniform_blocks.fsi>
 
 out vec3 vPos;
 out vec3 vNrm;
@@ -19,12 +19,17 @@ out float flogz;
 
 void main()
 {
-    gl_Position = final_tform * vec4(aPos, 1.0f);
+	mat4 f_tform = instanced ? inst_final_tform : final_tform;
+	mat4 d_tform = instanced ? inst_deferred_tform : deferred_tform;
+	// The camera model is a translation, so this equals the normal matrix of the model
+	mat3 n_model = instanced ? transpose(inverse(mat3(inst_deferred_tform))) : normal_model;
+
+    gl_Position = f_tform * vec4(aPos, 1.0f);
 	gl_Position.z = log2(max(1e-6, 1.0 + gl_Position.w)) * f_coef - 1.0;
 	flogz = 1.0 + gl_Position.w;
 
-	vPos = (deferred_tform * vec4(aPos, 1.0f)).xyz;
-	vNrm = normal_model * aNrm;
+	vPos = (d_tform * vec4(aPos, 1.0f)).xyz;
+	vNrm = n_model * aNrm;
 	vTex = aTex;
 
 }
@@ -42,7 +42,7 @@ typedef struct NVGcontext NVGcontext;
 
 typedef struct NVGEXTcontext
 {
-	// Points to a std::vector<AssetHandle<BitmapFont>>, managed from C++, so the C code can store it 
+	// Points to the fonts and atlas images used this frame (ExtFonts), managed from C++, so the C code can store it
 	void* fonts;
 
 } NVGEXTcontext;
@@ -9,22 +9,47 @@ extern "C"
 #include <assets/BitmapFont.h>
 #include <renderer/util/TextDrawer.h>
 
-using VecType = std::vector<AssetHandle<BitmapFont>>;
+#include <unordered_map>
+
+struct ExtFonts
+{
+	// Keeps the fonts used this frame alive until it's rendered
+	std::vector<AssetHandle<BitmapFont>> fonts;
+	// nanovg images wrapping the font atlases, created once per frame, so all the
+	// text of an atlas shares the same paint and may be merged into a single call
+	std::unordered_map<GLuint, int> images;
+};
+
+static int get_atlas_image(NVGcontext* ctx, ExtFonts* ext, BitmapFont* font)
+{
+	auto it = ext->images.find(font->img->id);
+	if(it != ext->images.end())
+	{
+		return it->second;
+	}
+
+	int image = nvglCreateImageFromHandleGL3(ctx, font->img->id, font->img->get_width(), font->img->get_height(),
+		NVG_IMAGE_NODELETE);
+	ext->images[font->img->id] = image;
+	return image;
+}
 
 float nvgBitmapText(NVGcontext* ctx, AssetHandle<BitmapFont> bfont, int alig, float x, float y, 
 	const char* string)
 {
 	TextDrawer::Alignment alignment = (TextDrawer::Alignment)alig;
-	VecType* vec = (VecType*)ctx->ext_ctx.fonts;
+	ExtFonts* ext = (ExtFonts*)ctx->ext_ctx.fonts;
 	BitmapFont* font = bfont.data;
-	vec->push_back(std::move(bfont));	
+	ext->fonts.push_back(std::move(bfont));
 
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state);
 	scale = 1.0f;
 	float invscale = 1.0f / scale;
 	
-	auto[glyphs, x_off] = TextDrawer::get_glyphs_and_size(std::string(string), font, glm::vec2(scale, scale)); 
+	const TextDrawer::ShapedText& shaped = text_drawer->shape(std::string(string), font);
+	const std::vector<BitmapFont::Glyph>& glyphs = shaped.glyphs;
+	float x_off = (float)shaped.width * scale;
 	glm::vec2 npos = glm::vec2(x, y);
 
 	if (alignment == TextDrawer::CENTER)
@@ -81,7 +106,7 @@ float nvgBitmapText(NVGcontext* ctx, AssetHandle<BitmapFont> bfont, int alig, fl
 	}
 
 	NVGpaint paint = state->fill;
-	paint.image = nvglCreateImageFromHandleGL3(ctx, font->img->id, font->img->get_width(), font->img->get_height(), 0);
+	paint.image = get_atlas_image(ctx, ext, font);
 	paint.innerColor.a *= state->alpha;
 	paint.outerColor.a *= state->alpha;
 	
@@ -97,14 +122,20 @@ float nvgBitmapText(NVGcontext* ctx, AssetHandle<BitmapFont> bfont, int alig, fl
 
 void nvgCreateExt(NVGcontext* ctx)
 {
-	ctx->ext_ctx.fonts = (void*)(new VecType());
+	ctx->ext_ctx.fonts = (void*)(new ExtFonts());
 }
 
 void nvgEndFrameExt(NVGcontext* ctx)
 {
-	VecType* vec = (VecType*)ctx->ext_ctx.fonts;
+	ExtFonts* ext = (ExtFonts*)ctx->ext_ctx.fonts;
 
-	vec->clear();
+	// The atlases are owned by the fonts (NVG_IMAGE_NODELETE), this only frees the nanovg slots
+	for(const auto& pair : ext->images)
+	{
+		nvgDeleteImage(ctx, pair.second);
+	}
+	ext->images.clear();
+	ext->fonts.clear();
 }
 
 
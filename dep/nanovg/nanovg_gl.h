@@ -77,6 +77,10 @@ void nvgDeleteGL3(NVGcontext* ctx);
 
 int nvglCreateImageFromHandleGL3(NVGcontext* ctx, GLuint textureId, int w, int h, int flags);
 GLuint nvglImageHandleGL3(NVGcontext* ctx, int image);
+// [OSPGL] Images unknown to ctx are looked up in source, so images created in source can be
+// drawn from ctx (used for offscreen contexts). Images of ctx are numbered from a high base
+// so they never collide with the ones of source.
+void nvglShareImagesGL3(NVGcontext* ctx, NVGcontext* source);
 
 #endif
 
@@ -241,6 +245,8 @@ struct GLNVGcontext {
 	int ntextures;
 	int ctextures;
 	int textureId;
+	// [OSPGL] See nvglShareImagesGL3
+	struct GLNVGcontext* shared;
 	GLuint vertBuf;
 #if defined NANOVG_GL3
 	GLuint vertArr;
@@ -386,6 +392,8 @@ static GLNVGtexture* glnvg__findTexture(GLNVGcontext* gl, int id)
 	for (i = 0; i < gl->ntextures; i++)
 		if (gl->textures[i].id == id)
 			return &gl->textures[i];
+	if (gl->shared != NULL)
+		return glnvg__findTexture(gl->shared, id);
 	return NULL;
 }
 
@@ -1501,14 +1509,37 @@ static void glnvg__renderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOper
 								   const NVGvertex* verts, int nverts, float fringe)
 {
 	GLNVGcontext* gl = (GLNVGcontext*)uptr;
-	GLNVGcall* call = glnvg__allocCall(gl);
+	GLNVGcall* call;
 	GLNVGfragUniforms* frag;
+	GLNVGfragUniforms conv;
+	GLNVGblend blend = glnvg__blendCompositeOperation(compositeOperation);
+	int offset;
+
+	glnvg__convertPaint(gl, &conv, paint, scissor, 1.0f, fringe, -1.0f);
+	conv.type = NSVG_SHADER_IMG;
 
+	// Consecutive triangles with the same paint (for example, bitmap text of the same
+	// atlas) are merged into the previous call, as its vertices are contiguous
+	if (gl->ncalls > 0) {
+		call = &gl->calls[gl->ncalls-1];
+		if (call->type == GLNVG_TRIANGLES && call->image == paint->image &&
+			memcmp(&call->blendFunc, &blend, sizeof(GLNVGblend)) == 0 &&
+			call->triangleOffset + call->triangleCount == gl->nverts &&
+			memcmp(nvg__fragUniformPtr(gl, call->uniformOffset), &conv, sizeof(GLNVGfragUniforms)) == 0) {
+			offset = glnvg__allocVerts(gl, nverts);
+			if (offset == -1) return;
+			memcpy(&gl->verts[offset], verts, sizeof(NVGvertex) * nverts);
+			call->triangleCount += nverts;
+			return;
+		}
+	}
+
+	call = glnvg__allocCall(gl);
 	if (call == NULL) return;
 
 	call->type = GLNVG_TRIANGLES;
 	call->image = paint->image;
-	call->blendFunc = glnvg__blendCompositeOperation(compositeOperation);
+	call->blendFunc = blend;
 
 	// Allocate vertices for all the paths.
 	call->triangleOffset = glnvg__allocVerts(gl, nverts);
@@ -1521,8 +1552,7 @@ static void glnvg__renderTriangles(void* uptr, NVGpaint* paint, NVGcompositeOper
 	call->uniformOffset = glnvg__allocFragUniforms(gl, 1);
 	if (call->uniformOffset == -1) goto error;
 	frag = nvg__fragUniformPtr(gl, call->uniformOffset);
-	glnvg__convertPaint(gl, frag, paint, scissor, 1.0f, fringe, -1.0f);
-	frag->type = NSVG_SHADER_IMG;
+	memcpy(frag, &conv, sizeof(GLNVGfragUniforms));
 
 	return;
 
@@ -1663,4 +1693,14 @@ GLuint nvglImageHandleGLES3(NVGcontext* ctx, int image)
 	return tex->tex;
 }
 
+#if defined NANOVG_GL3
+void nvglShareImagesGL3(NVGcontext* ctx, NVGcontext* source)
+{
+	GLNVGcontext* gl = (GLNVGcontext*)nvgInternalParams(ctx)->userPtr;
+	gl->shared = (GLNVGcontext*)nvgInternalParams(source)->userPtr;
+	if (gl->textureId < (1 << 24))
+		gl->textureId = 1 << 24;
+}
+#endif
+
 #endif /* NANOVG_GL_IMPLEMENTATION */
@@ -30,6 +30,8 @@
 // beginning of sol/config.hpp
 
 #define SOL_LUAJIT 1
+// Used by src/lua/LuaGlmInterop.h
+#define SOL_USE_INTEROP 1
 
 /* Base, empty configuration file!
 
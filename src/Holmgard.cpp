@@ -1,6 +1,7 @@
 #include "Holmgard.h"
 #include "rang.hpp"
 #include <renderer/util/TextDrawer.h>
+#include <renderer/util/TextureStreamer.h>
 #include <util/Profiler.h>
 #include <assets/AssetManager.h>
 #include <audio/AudioEngine.h>
@@ -185,6 +186,7 @@ void Holmgard::init(int argc, char** argv)
 		audio = new AudioEngine(*config);
 		create_global_debug_drawer();
 		create_global_texture_drawer();
+		create_global_texture_streamer();
 		create_global_text_drawer();
 		create_global_lua_core();
 		create_global_profiler();
@@ -209,6 +211,7 @@ void Holmgard::finish()
 	delete renderer;
 	delete audio;
 	delete assets;
+	destroy_global_texture_streamer();
 	destroy_global_logger();
 }
 
@@ -230,6 +233,8 @@ void Holmgard::start_frame()
 		float w = (float)renderer->get_width();
 		float h = (float)renderer->get_height();
 		nvgBeginFrame(renderer->vg, w, h, w / h);
+
+		texture_streamer->update();
 	}
 }
 
@@ -237,6 +242,11 @@ void Holmgard::update()
 {
 	PROFILE_FUNC();
 	game_state->update();
+
+	if(audio != nullptr)
+	{
+		audio->update();
+	}
 }
 
 void Holmgard::render()
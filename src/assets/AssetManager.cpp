@@ -8,8 +8,9 @@
 #include "Cubemap.h"
 #include "PhysicalMaterial.h"
 #include "AudioClip.h"
+#include "HRTFSet.h"
 
-#include "sol/sol.hpp"
+#include "lua/LuaGlmInterop.h"
 
 #include <istream>
 #include <fstream>
@@ -37,6 +38,7 @@ AssetManager::AssetManager(const std::string &res_path, const std::string &udata
 	create_asset_type<Cubemap>("Cubemap", load_cubemap);
 	create_asset_type<PhysicalMaterial>("Physical Material", load_physical_material);
 	create_asset_type<AudioClip>("Audio Clip", load_audio_clip);
+	create_asset_type<HRTFSet>("HRTF Set", load_hrtf_set);
 
 	check_packages();
 }
@@ -66,21 +68,21 @@ std::string AssetManager::load_string_raw(const std::string& path)
 std::vector<uint8_t> AssetManager::load_binary_raw(const std::string& path)
 {
 	std::ifstream file(path, std::ios::binary);
-	file.unsetf(std::ios::skipws);
-	std::streampos file_size;
 
 	file.seekg(0, std::ios::end);
-	file_size = file.tellg();
+	std::streampos file_size = file.tellg();
 	file.seekg(0, std::ios::beg);
 
-	// reserve capacity
 	std::vector<uint8_t> vec;
-	vec.reserve(file_size);
+	if(file_size <= 0)
+	{
+		return vec;
+	}
 
-	// read the data:
-	vec.insert(vec.begin(),
-		std::istream_iterator<uint8_t>(file),
-		std::istream_iterator<uint8_t>());
+	// A single read, byte by byte iterators are very slow for big files
+	vec.resize((size_t)file_size);
+	file.read((char*)vec.data(), file_size);
+	vec.resize((size_t)file.gcount());
 
 	return vec;
 }
@@ -2,83 +2,132 @@
 #include <miniaudio/miniaudio.h>
 #include <Holmgard.h>
 #include <audio/AudioEngine.h>
+#include <audio/StreamingSampleSource.h>
 
-AudioClip* load_audio_clip(ASSET_INFO, const cpptoml::table &cfg)
+static AudioClip* decode_audio_clip(ASSET_INFO, ma_decoder& decoder, size_t output_channels)
 {
-	ma_decoder decoder;
-	ma_result result = ma_decoder_init_file(path.c_str(), NULL, &decoder);
-
-	if(result != MA_SUCCESS)
-	{
-		logger->error("Miniaudio failed to decode", path);
-		return nullptr;
-	}
-
 	// We load the frames in arbitrary chunks
 	constexpr size_t CHUNK_SIZE = 100000;
 
-	size_t output_channels = std::min(decoder.outputChannels, (ma_uint32)2);
 	size_t input_frame_size = ma_get_bytes_per_frame(decoder.outputFormat, decoder.outputChannels);
 	size_t output_frame_size = ma_get_bytes_per_frame(ma_format_f32, output_channels);
 
-	// frames_buffer stores the data as read from the file IN CHUNKS
-	void* frames_buffer = malloc(CHUNK_SIZE * input_frame_size);
-	// total_buffer stores the full data that is converted to the proper format
-	void* total_buffer = nullptr;
-
 	// The converter we use to unify all sample types
 	ma_data_converter_config converter_cfg = ma_data_converter_config_init_default();
 	converter_cfg.formatIn = decoder.outputFormat;
 	converter_cfg.formatOut = ma_format_f32;
 	converter_cfg.channelsIn = decoder.outputChannels;
 	converter_cfg.channelsOut = output_channels;
+	// Clips keep their own sample rate, they are resampled in real time if needed
 	converter_cfg.sampleRateIn = decoder.outputSampleRate;
-	converter_cfg.sampleRateOut = hgr->audio->get_sample_rate();
+	converter_cfg.sampleRateOut = decoder.outputSampleRate;
 
 	ma_data_converter converter;
-	result = ma_data_converter_init(&converter_cfg, &converter);
-	if(result != MA_SUCCESS)
+	if(ma_data_converter_init(&converter_cfg, &converter) != MA_SUCCESS)
 	{
-		logger->error("Miniaudio failed to initialize the converter", path);
+		logger->error("Miniaudio failed to initialize the converter ({})", path);
 		return nullptr;
 	}
 
+	// frames_buffer stores the data as read from the file IN CHUNKS
+	std::vector<uint8_t> frames_buffer(CHUNK_SIZE * input_frame_size);
+	// total_buffer stores the full data that is converted to the proper format. If the length
+	// is known we can allocate it once, otherwise it grows geometrically
+	size_t capacity = (size_t)ma_data_converter_get_expected_output_frame_count(&converter,
+		ma_decoder_get_length_in_pcm_frames(&decoder)) + 1;
+	void* total_buffer = malloc(capacity * output_frame_size);
+
 	ma_uint64 read;
 	size_t total_written = 0;
-	size_t last_total_written = 0;
 	do
 	{
-		read = ma_decoder_read_pcm_frames(&decoder, frames_buffer, CHUNK_SIZE);
-		// Convert the frames using the supplied function
+		read = ma_decoder_read_pcm_frames(&decoder, frames_buffer.data(), CHUNK_SIZE);
 		ma_uint64 frames_in = read;
 		ma_uint64 frames_out = ma_data_converter_get_expected_output_frame_count(&converter, read);
-		total_buffer = realloc(total_buffer, (total_written + frames_out) * output_frame_size);
-		// Offset points to the freely allocated space
-		size_t offset = (last_total_written) * output_frame_size;
+		if(total_written + frames_out > capacity)
+		{
+			capacity = std::max(capacity * 2, total_written + (size_t)frames_out);
+			total_buffer = realloc(total_buffer, capacity * output_frame_size);
+		}
 		// TODO: What happens when it skips a frame? Not sure if this has to be handled
-		ma_data_converter_process_pcm_frames(&converter, frames_buffer, &frames_in, (char*)total_buffer + offset, &frames_out);
-		last_total_written = total_written;
+		ma_data_converter_process_pcm_frames(&converter, frames_buffer.data(), &frames_in,
+											 (char*)total_buffer + total_written * output_frame_size, &frames_out);
 		total_written += frames_out;
 	}
 	while(read == CHUNK_SIZE);
 
+	ma_data_converter_uninit(&converter);
+
+	return new AudioClip(ASSET_INFO_P, total_buffer, total_written, output_channels, decoder.outputSampleRate);
+}
+
+AudioClip* load_audio_clip(ASSET_INFO, const cpptoml::table &cfg)
+{
+	AudioClipConfig config;
+	auto sub_ptr = cfg.get_table_qualified("audio_clip");
+	::deserialize(config, sub_ptr ? *sub_ptr : *cpptoml::make_table());
+
+	ma_decoder decoder;
+	ma_result result = ma_decoder_init_file(path.c_str(), NULL, &decoder);
+
+	if(result != MA_SUCCESS)
+	{
+		logger->error("Miniaudio failed to decode {}", path);
+		return nullptr;
+	}
+
+	size_t output_channels = std::min(decoder.outputChannels, (ma_uint32)2);
+	// Some formats don't know their length without decoding, these are fully decoded
+	// unless streaming is forced
+	ma_uint64 length = ma_decoder_get_length_in_pcm_frames(&decoder);
+	double seconds = (double)length / (double)decoder.outputSampleRate;
+
+	bool stream = config.stream == AudioClipConfig::ALWAYS ||
+		(config.stream == AudioClipConfig::AUTO && seconds > config.stream_threshold);
+
+	AudioClip* out;
+	if(stream)
+	{
+		size_t frame_count = (size_t)(length * hgr->audio->get_sample_rate() / decoder.outputSampleRate);
+		out = new AudioClip(ASSET_INFO_P, frame_count, output_channels);
+	}
+	else
+	{
+		out = decode_audio_clip(ASSET_INFO_P, decoder, output_channels);
+	}
 
-	free(frames_buffer);
 	ma_decoder_uninit(&decoder);
-	ma_data_converter_uninit(&converter);
+	return out;
+}
 
-	return new AudioClip(ASSET_INFO_P, total_buffer, total_written, output_channels);
+std::unique_ptr<SampleSource> AudioClip::create_stream() const
+{
+	logger->check(streamed, "Tried to stream a fully decoded clip");
+	return std::make_unique<StreamingSampleSource>(stream_path, channel_count, frame_count);
 }
 
-AudioClip::AudioClip(ASSET_INFO, void *samples, size_t frame_count, size_t channel_count) : Asset(ASSET_INFO_P)
+AudioClip::AudioClip(ASSET_INFO, void *samples, size_t frame_count, size_t channel_count, uint32_t sample_rate)
+	: Asset(ASSET_INFO_P)
 {
 	this->samples = samples;
 	this->frame_count = frame_count;
 	this->channel_count = channel_count;
+	this->sample_rate = sample_rate;
+	streamed = false;
+}
+
+AudioClip::AudioClip(ASSET_INFO, size_t frame_count, size_t channel_count) : Asset(ASSET_INFO_P)
+{
+	this->samples = nullptr;
+	this->frame_count = frame_count;
+	this->channel_count = channel_count;
+	// Streams are decoded at the device rate
+	this->sample_rate = (uint32_t)hgr->audio->get_sample_rate();
+	streamed = true;
+	stream_path = path;
 }
 
 AudioClip::~AudioClip()
 {
 	free(samples);
 }
-
@@ -2,20 +2,81 @@
 #include "Asset.h"
 #include <util/SerializeUtil.h>
 #include <audio/SimpleSampleSource.h>
+#include <memory>
+
+struct AudioClipConfig
+{
+	enum StreamMode
+	{
+		// Streams clips longer than stream_threshold
+		AUTO,
+		ALWAYS,
+		NEVER
+	};
+
+	StreamMode stream;
+	// In seconds
+	double stream_threshold;
+};
 
 // Audio clips. We support only mono and stereo sounds, higher channels are ignored, with a warning.
-// This loads the full audio file into memory and does no streaming
+// Short clips (effects) are fully decoded into memory on load, at their own sample rate, and resampled
+// in real time when played if it doesn't match the device. Long ones (music, ambience) are
+// streamed: each AudioSource playing them decodes in chunks on the AudioEngine stream thread.
 // Stereo sounds may be played in 3D sources BUT only their first channel (left) will be mixed.
 // All audio types are eventually converted to f32 samples
 class AudioClip : public Asset, public SimpleSampleSource
 {
 private:
 
+	bool streamed;
+	std::string stream_path;
+
 public:
 
-	AudioClip(ASSET_INFO, void* samples, size_t frame_count, size_t channel_count);
+	bool is_streamed() const { return streamed; }
+
+	// Creates the decoding state for a source playing a streamed clip
+	std::unique_ptr<SampleSource> create_stream() const;
+
+	AudioClip(ASSET_INFO, void* samples, size_t frame_count, size_t channel_count, uint32_t sample_rate);
+	// Streamed clip, frame_count may be 0 if the length is not known
+	AudioClip(ASSET_INFO, size_t frame_count, size_t channel_count);
 	~AudioClip() override;
 };
 
 
 AudioClip* load_audio_clip(ASSET_INFO, const cpptoml::table& cfg);
+
+template<>
+class GenericSerializer<AudioClipConfig>
+{
+public:
+
+	static void serialize(const AudioClipConfig& what, cpptoml::table& target)
+	{
+		const char* stream_str[] = {"auto", "always", "never"};
+		target.insert("stream", std::string(stream_str[what.stream]));
+		target.insert("stream_threshold", what.stream_threshold);
+	}
+
+	static void deserialize(AudioClipConfig& to, const cpptoml::table& from)
+	{
+		std::string stream_str;
+		SAFE_TOML_GET_OR(stream_str, "stream", std::string, "auto");
+		SAFE_TOML_GET_OR(to.stream_threshold, "stream_threshold", double, 10.0);
+
+		if(stream_str == "always")
+		{
+			to.stream = AudioClipConfig::ALWAYS;
+		}
+		else if(stream_str == "never")
+		{
+			to.stream = AudioClipConfig::NEVER;
+		}
+		else
+		{
+			to.stream = AudioClipConfig::AUTO;
+		}
+	}
+};
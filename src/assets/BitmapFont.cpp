@@ -128,6 +128,11 @@ BitmapFont::BitmapFont(const std::vector<uint8_t>& fnt, Image* image, ASSET_INFO
 
 BitmapFont::~BitmapFont()
 {
+	// Shaped text keeps a pointer to the font
+	if(text_drawer != nullptr)
+	{
+		text_drawer->forget_font(this);
+	}
 }
 
 BitmapFont* load_bitmap_font(ASSET_INFO, const cpptoml::table& cfg)
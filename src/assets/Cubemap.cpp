@@ -1,5 +1,6 @@
 #include "Cubemap.h"
 #include "Image.h"
+#include "TextureContainer.h"
 #include <util/Logger.h>
 #include "AssetManager.h"
 #include <stb/stb_image.h>
@@ -51,6 +52,21 @@ Cubemap::Cubemap(std::vector<std::string> &images, ASSET_INFO) : id(0), Asset(AS
 	glGenTextures(1, &id);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, id);
 
+	if(TextureContainer::is_container_path(images[0]))
+	{
+		if(load_containers(images))
+		{
+			glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			return;
+		}
+
+		// Unsupported by the driver, try the uncompressed images
+		for(std::string& image : images)
+		{
+			image = image.substr(0, image.find_last_of('.')) + ".png";
+		}
+	}
+
 	std::string ext = images[0].substr(images[0].find_last_of('.'));
 	bool is_hdr = ext == ".hdr";
 
@@ -83,165 +99,296 @@ Cubemap::Cubemap(std::vector<std::string> &images, ASSET_INFO) : id(0), Asset(AS
 
 }
 
-void Cubemap::generate_ibl_irradiance(size_t res, size_t spec_res, int face, bool bind)
+bool Cubemap::load_containers(const std::vector<std::string>& images)
 {
-
-	if(irradiance == nullptr)
+	std::array<TextureContainer, 6> faces;
+	for(size_t side = 0; side < 6; side++)
 	{
-		irradiance = new Cubemap(res);
-		specular = new Cubemap(spec_res, true);
-		irradiance_shader = AssetHandle<Shader>("core:shaders/ibl/irradiance.vs");
-		specular_shader = AssetHandle<Shader>("core:shaders/ibl/specular.vs");
-		blit_shader = AssetHandle<Shader>("core:shaders/skybox.vs");
-		brdf_lut = AssetHandle<Image>("core:shaders/ibl/brdf.png");
-		glGenFramebuffers(1, &capture_fbo);
-		glGenRenderbuffers(1, &capture_rbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-    	glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-    	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, capture_rbo);
-
-    	CubeGeometry::generate_cubemap(&cubemap_vao, &cubemap_vbo);
-
-		old_resolution = resolution;
-
-		// Precompute the sample directions (this also prevents jitter)
-		// (Copyed from the shader)
-		std::array<glm::vec3, SAMPLE_COUNT> sample_dirs;
-		for(size_t mip = 1; mip < MAX_MIP; mip++)
+		if(!faces[side].load(images[side]))
 		{
-			float roughness = (float) mip / (float) (MAX_MIP - 1);
-			for (uint32_t i = 0; i < SAMPLE_COUNT; i++)
-			{
-				// Radical_Inverse_VdC
-				uint32_t bits = (i << 16u) | (i >> 16u);
-				bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
-				bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
-				bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
-				bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-				float VdC = float(bits) * 2.3283064365386963e-10f;
-
-				// Hammersley
-				glm::vec2 Xi = glm::vec2(float(i)/float(SAMPLE_COUNT), VdC);
-
-				// ImportanceSampleGGX
-				float a = roughness * roughness;
-				float phi = 2.0f * glm::pi<float>() * Xi.x;
-				float cosTheta = glm::sqrt((1.0f - Xi.y) / (1.0f + (a*a - 1.0f) * Xi.y));
-				float sinTheta = glm::sqrt(1.0f - cosTheta*cosTheta);
-
-				// from spherical coordinates to cartesian coordinates
-				glm::vec3 H;
-				H.x = glm::cos(phi) * sinTheta;
-				H.y = glm::sin(phi) * sinTheta;
-				H.z = cosTheta;
-
-				// TODO: Investigate a better way to do this without
-				// losing too much precision. This method may be too loosy!
-				// It causes small discrepancy of about 0.00393
-				// (We could use a non-normalized format? Investigate a bit)
-				sample_dirs[i] = H * 0.5f + 0.5f;
-
-			}
-
-			// Upload it to a texture
-			glGenTextures(1, &pcomp_sample_dir_tex[mip - 1]);
-			glBindTexture(GL_TEXTURE_1D, pcomp_sample_dir_tex[mip - 1]);
-			glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, SAMPLE_COUNT, 0, GL_RGB, GL_FLOAT, (float*)sample_dirs.data());
-			glGenerateMipmap(GL_TEXTURE_1D);
-			glBindTexture(GL_TEXTURE_1D, 0);
+			return false;
 		}
 
+		logger->check(faces[side].get_width() == faces[side].get_height(), "Cubemap faces must be squares");
+		logger->check(faces[side].gl_format == faces[0].gl_format &&
+			faces[side].levels.size() == faces[0].levels.size() &&
+			faces[side].get_width() == faces[0].get_width(), "Cubemap faces must have the same format and size");
+	}
+
+	if(!TextureContainer::is_format_supported(faces[0].gl_format))
+	{
+		logger->warn("Texture format {:#x} of cubemap {} is not supported by the driver, using fallback",
+			faces[0].gl_format, get_asset_id());
+		return false;
 	}
 
-	logger->check(resolution == old_resolution, "Cannot change IBL resolution after it has been created");
+	resolution = faces[0].get_width();
+	GLsizei level_count = (GLsizei)faces[0].levels.size();
 
-	if(face < 0)
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, level_count, faces[0].gl_format, resolution, resolution);
+	for(size_t side = 0; side < 6; side++)
 	{
-		for(size_t side = 0; side < 6; side++)
+		for(GLsizei level = 0; level < level_count; level++)
 		{
-			generate_ibl_irradiance(res, spec_res, side, false);
+			faces[side].upload_rows(level, 0, faces[side].get_rows(level), GL_TEXTURE_CUBE_MAP_POSITIVE_X + side);
 		}
+	}
 
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+		level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	return true;
+}
+
+// Radical inverse, used to build an Hammersley sequence
+static float radical_inverse_vdc(uint32_t bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return float(bits) * 2.3283064365386963e-10f;
+}
+
+static GLuint upload_sample_dirs(const std::vector<glm::vec3>& dirs)
+{
+	// Float texture, so directions are stored without loss
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_1D, tex);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB16F, (GLsizei)dirs.size(), 0, GL_RGB, GL_FLOAT, (float*)dirs.data());
+	// texelFetch needs the texture to be complete
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_1D, 0);
+	return tex;
+}
+
+void Cubemap::prepare_ibl(size_t res, size_t spec_res)
+{
+	if(irradiance != nullptr)
+	{
+		logger->check(resolution == old_resolution && res == irradiance_res && spec_res == specular_res,
+			"Cannot change IBL resolution after it has been created");
 		return;
 	}
 
-	// Copyed from learnopengl.com
-	glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 view[] =
-    {
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
-
-    if(face == 0 || bind)
+	irradiance = new Cubemap(res);
+	specular = new Cubemap(spec_res, true);
+	irradiance_res = res;
+	specular_res = spec_res;
+	irradiance_shader = AssetHandle<Shader>("core:shaders/ibl/irradiance.vs");
+	specular_shader = AssetHandle<Shader>("core:shaders/ibl/specular.vs");
+	blit_shader = AssetHandle<Shader>("core:shaders/skybox.vs");
+	brdf_lut = AssetHandle<Image>("core:shaders/ibl/brdf.png");
+	glGenFramebuffers(1, &capture_fbo);
+	glGenFramebuffers(2, mip_fbo);
+
+	CubeGeometry::generate_cubemap(&cubemap_vao, &cubemap_vbo);
+
+	old_resolution = resolution;
+
+	// Precompute the sample directions (this also prevents jitter)
+	std::vector<glm::vec3> sample_dirs(SAMPLE_COUNT);
+	for(size_t mip = 1; mip < MAX_MIP; mip++)
 	{
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, id);
-		// We need to restore previous conditions, so store them
-		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_fbo);
-		glGetIntegerv(GL_VIEWPORT, old_vport);
+		float roughness = (float) mip / (float) (MAX_MIP - 1);
+		for (uint32_t i = 0; i < SAMPLE_COUNT; i++)
+		{
+			glm::vec2 Xi = glm::vec2(float(i)/float(SAMPLE_COUNT), radical_inverse_vdc(i));
+
+			// ImportanceSampleGGX
+			float a = roughness * roughness;
+			float phi = 2.0f * glm::pi<float>() * Xi.x;
+			float cosTheta = glm::sqrt((1.0f - Xi.y) / (1.0f + (a*a - 1.0f) * Xi.y));
+			float sinTheta = glm::sqrt(1.0f - cosTheta*cosTheta);
+
+			// from spherical coordinates to cartesian coordinates
+			sample_dirs[i] = glm::vec3(glm::cos(phi) * sinTheta, glm::sin(phi) * sinTheta, cosTheta);
+		}
+
+		pcomp_sample_dir_tex[mip - 1] = upload_sample_dirs(sample_dirs);
+	}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
+	// Cosine weighted hemisphere, so the irradiance is just the average of the samples
+	sample_dirs.resize(IRRADIANCE_SAMPLE_COUNT);
+	for (uint32_t i = 0; i < IRRADIANCE_SAMPLE_COUNT; i++)
+	{
+		glm::vec2 Xi = glm::vec2(float(i)/float(IRRADIANCE_SAMPLE_COUNT), radical_inverse_vdc(i));
+		float phi = 2.0f * glm::pi<float>() * Xi.x;
+		float cosTheta = glm::sqrt(1.0f - Xi.y);
+		float sinTheta = glm::sqrt(Xi.y);
+		sample_dirs[i] = glm::vec3(glm::cos(phi) * sinTheta, glm::sin(phi) * sinTheta, cosTheta);
 	}
 
-	glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution, resolution);
-	glViewport(0, 0, res, res);
-	irradiance_shader->use();
-	irradiance_shader->setInt("tex", 0);
-	irradiance_shader->setMat4("tform", proj * view[face]);
+	pcomp_irradiance_dir_tex = upload_sample_dirs(sample_dirs);
+}
 
+void Cubemap::generate_face_mipmap(size_t face)
+{
+	// glGenerateMipmap would regenerate all the faces
+	GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mip_fbo[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mip_fbo[1]);
+	for(size_t level = 1; (resolution >> level) > 0; level++)
+	{
+		GLint src = (GLint)(resolution >> (level - 1));
+		GLint dst = (GLint)(resolution >> level);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, id, level - 1);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, id, level);
+		glBlitFramebuffer(0, 0, src, src, 0, 0, dst, dst, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+}
 
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
-				irradiance->id, 0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDepthFunc(GL_LESS);
+bool Cubemap::filter_rows(Shader* shader, Cubemap* target, size_t size, size_t mip, size_t samples, size_t& budget)
+{
+	// Copyed from learnopengl.com
+	glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+	static const glm::mat4 view[] =
+	{
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+		glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+	};
+
+	size_t row_cost = size * samples;
+	size_t rows = glm::clamp(budget / row_cost, (size_t)1, size - ibl_row);
+
+	shader->use();
+	shader->setInt("tex", 0);
+	shader->setFloat("tex_size", (float)resolution);
+	shader->setMat4("tform", proj * view[ibl_face]);
+	shader->setInt("sample_positions", 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + ibl_face,
+		target->id, (GLint)mip);
+	glViewport(0, 0, (GLsizei)size, (GLsizei)size);
+	glScissor(0, (GLint)ibl_row, (GLsizei)size, (GLsizei)rows);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+
+	ibl_row += rows;
+	budget -= glm::min(budget, rows * row_cost);
+
+	if(ibl_row >= size)
+	{
+		ibl_row = 0;
+		return true;
+	}
 
-	glBindVertexArray(cubemap_vao);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+	return false;
+}
 
-	// Specular pass
-	specular_shader->use();
- 	specular_shader->setInt("tex", 0);
- 	specular_shader->setFloat("tex_size", this->resolution);
- 	specular_shader->setMat4("tform", proj * view[face]);
+void Cubemap::start_ibl_face(size_t face, size_t res, size_t spec_res)
+{
+	prepare_ibl(res, spec_res);
+	ibl_face = face;
+	ibl_mip = 0;
+	ibl_row = 0;
+	ibl_stage = regenerate_mips ? IBLStage::MIPMAP : IBLStage::IRRADIANCE;
+}
 
+bool Cubemap::step_ibl(size_t& budget)
+{
+	if(ibl_stage == IBLStage::DONE)
+	{
+		return true;
+	}
 
-	 for(size_t mip = 0; mip < 5; mip++)
-	 {
-		 size_t msize = spec_res * glm::pow(0.5f, mip);
-		 glViewport(0, 0, msize, msize);
-		 glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, msize, msize);
+	// We need to restore previous conditions, so store them
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_fbo);
+	glGetIntegerv(GL_VIEWPORT, old_vport);
+	GLboolean old_depth_test = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
 
-		 float roughness = (float)mip / (float)(MAX_MIP - 1);
-		 specular_shader->setFloat("roughness", roughness);
-		 if(mip != 0)
-		 {
-			 glActiveTexture(GL_TEXTURE1);
-			 glBindTexture(GL_TEXTURE_1D, pcomp_sample_dir_tex[mip - 1]);
-			 specular_shader->setInt("sample_positions", 1);
-		 }
-		 glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-						  GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, specular->id, mip);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, id);
+	glBindVertexArray(cubemap_vao);
 
-		 glClear(GL_DEPTH_BUFFER_BIT);
+	bool first = true;
+	while(ibl_stage != IBLStage::DONE && (first || budget > 0))
+	{
+		first = false;
+		if(ibl_stage == IBLStage::MIPMAP)
+		{
+			generate_face_mipmap(ibl_face);
+			budget -= glm::min(budget, resolution * resolution);
+			ibl_stage = IBLStage::IRRADIANCE;
+			continue;
+		}
 
-		 glDrawArrays(GL_TRIANGLES, 0, 36);
-	 }
+		glEnable(GL_SCISSOR_TEST);
+		glActiveTexture(GL_TEXTURE1);
+		if(ibl_stage == IBLStage::IRRADIANCE)
+		{
+			glBindTexture(GL_TEXTURE_1D, pcomp_irradiance_dir_tex);
+			if(filter_rows(irradiance_shader.get_noconst(), irradiance, irradiance_res, 0,
+				IRRADIANCE_SAMPLE_COUNT, budget))
+			{
+				ibl_stage = IBLStage::SPECULAR;
+			}
+		}
+		else
+		{
+			// The first mip is a copy, the rest use the GGX tables
+			size_t samples = 1;
+			if(ibl_mip != 0)
+			{
+				glBindTexture(GL_TEXTURE_1D, pcomp_sample_dir_tex[ibl_mip - 1]);
+				samples = SAMPLE_COUNT;
+			}
+			specular_shader->use();
+			specular_shader->setFloat("roughness", (float)ibl_mip / (float)(MAX_MIP - 1));
+			size_t msize = glm::max(specular_res >> ibl_mip, (size_t)1);
+			if(filter_rows(specular_shader.get_noconst(), specular, msize, ibl_mip, samples, budget))
+			{
+				ibl_mip++;
+				if(ibl_mip == MAX_MIP)
+				{
+					ibl_stage = IBLStage::DONE;
+				}
+			}
+		}
+		glActiveTexture(GL_TEXTURE0);
+		glDisable(GL_SCISSOR_TEST);
+	}
 
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, old_fbo);
+	glViewport(old_vport[0], old_vport[1], old_vport[2], old_vport[3]);
+	if(old_depth_test)
+	{
+		glEnable(GL_DEPTH_TEST);
+	}
 
-    glBindVertexArray(0);
+	return ibl_stage == IBLStage::DONE;
+}
 
-    if(face == 5 || bind)
+void Cubemap::generate_ibl_irradiance(size_t res, size_t spec_res, int face)
+{
+	if(face < 0)
 	{
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		glBindFramebuffer(GL_FRAMEBUFFER, old_fbo);
-		glViewport(old_vport[0], old_vport[1], old_vport[2], old_vport[3]);
+		for(size_t side = 0; side < 6; side++)
+		{
+			generate_ibl_irradiance(res, spec_res, side);
+		}
+
+		return;
 	}
+
+	start_ibl_face(face, res, spec_res);
+	size_t budget = SIZE_MAX;
+	step_ibl(budget);
 }
 
 Cubemap::Cubemap(size_t nresolution, bool mipmap) : Asset(GENERATED_ASSET_INFO)
@@ -263,6 +410,7 @@ Cubemap::Cubemap(size_t nresolution, bool mipmap) : Asset(GENERATED_ASSET_INFO)
 	{
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+		regenerate_mips = true;
 	}
 	else
 	{
@@ -280,9 +428,11 @@ Cubemap::~Cubemap()
 		delete irradiance;
 		delete specular;
 		glDeleteFramebuffers(1, &capture_fbo);
-		glDeleteRenderbuffers(1, &capture_rbo);
+		glDeleteFramebuffers(2, mip_fbo);
 		glDeleteVertexArrays(1, &cubemap_vao);
 		glDeleteBuffers(1, &cubemap_vbo);
+		glDeleteTextures(MAX_MIP - 1, pcomp_sample_dir_tex);
+		glDeleteTextures(1, &pcomp_irradiance_dir_tex);
 	}
 
 	glDeleteTextures(1, &id);
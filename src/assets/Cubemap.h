@@ -12,6 +12,8 @@
 // These are OpenGL only, they could also bmagee accesible from RAM, though
 // These are loaded from a folder with images named:
 // px, py, pz, nx, ny, nz [. folder extension]
+// Faces may be .dds / .ktx2 files with offline generated mipmaps, in which case
+// .png faces with the same names are used if the driver lacks the format
 class Cubemap : public Asset
 {
 private:
@@ -20,19 +22,51 @@ private:
 	AssetHandle<Shader> specular_shader;
 	AssetHandle<Shader> blit_shader;
 	AssetHandle<Image> brdf_lut;
-	GLuint capture_fbo = 0, capture_rbo = 0;
+	GLuint capture_fbo = 0;
+	// Read and draw framebuffers used to generate the mipmaps of a single face
+	GLuint mip_fbo[2] = {0, 0};
 	GLuint cubemap_vao = 0, cubemap_vbo = 0;
 	size_t old_resolution = 0;
+	size_t irradiance_res = 0;
+	size_t specular_res = 0;
 
 	static const size_t MAX_MIP = 5;
 	static const size_t SAMPLE_COUNT = 32;
+	static const size_t IRRADIANCE_SAMPLE_COUNT = 64;
 
-	std::vector<float> pcomp_mip_levels;
-
+	// Importance sampled directions, in tangent space. GGX for each specular mip
+	// (except the first, which is a copy) and cosine weighted for irradiance
 	GLuint pcomp_sample_dir_tex[MAX_MIP - 1];
+	GLuint pcomp_irradiance_dir_tex = 0;
 
 	GLint old_fbo, old_vport[4];
 
+	// Only render targets with mipmaps regenerate them when filtering
+	bool regenerate_mips = false;
+
+	enum class IBLStage
+	{
+		MIPMAP,
+		IRRADIANCE,
+		SPECULAR,
+		DONE
+	};
+
+	// State of the face being filtered
+	IBLStage ibl_stage = IBLStage::DONE;
+	size_t ibl_face = 0;
+	size_t ibl_mip = 0;
+	size_t ibl_row = 0;
+
+	// Returns false if the faces could not be loaded or are not supported
+	bool load_containers(const std::vector<std::string>& images);
+
+	void prepare_ibl(size_t res, size_t spec_res);
+	void generate_face_mipmap(size_t face);
+	// Filters as many rows of the current face as the budget allows (at least one), returns
+	// true once the whole face is done
+	bool filter_rows(Shader* shader, Cubemap* target, size_t size, size_t mip, size_t samples, size_t& budget);
+
 public:
 
 	size_t resolution = 0;
@@ -42,8 +76,18 @@ public:
 	Cubemap* irradiance = nullptr;
 	Cubemap* specular = nullptr;
 
-	// If face is < 0 then all faces are generated
-	void generate_ibl_irradiance(size_t res = 32, size_t spec_res = 32, int face = -1, bool bind = true);
+	// Filtering is split into slices so it can be spread over many frames. Start a face once
+	// it's rendered and call step_ibl every frame until it returns true. Starting a face
+	// abandons the previous one if it was not finished.
+	// Resolutions cannot change after the first call
+	void start_ibl_face(size_t face, size_t res = 32, size_t spec_res = 32);
+	// Does at most budget texture samples worth of work (at least one slice), and subtracts
+	// the work done. Returns true once the face is done
+	bool step_ibl(size_t& budget);
+	bool is_ibl_done() const { return ibl_stage == IBLStage::DONE; }
+
+	// Blocking version. If face is < 0 then all faces are generated
+	void generate_ibl_irradiance(size_t res = 32, size_t spec_res = 32, int face = -1);
 
 
 	Cubemap(std::vector<std::string>& images, ASSET_INFO);
@@ -0,0 +1,56 @@
+#include "HRTFSet.h"
+#include <util/SerializeUtil.h>
+#include <util/Logger.h>
+#include <glm/gtc/constants.hpp>
+
+HRTFSet* load_hrtf_set(ASSET_INFO, const cpptoml::table& cfg)
+{
+	auto root = SerializeUtil::load_file(path);
+
+	HRTFSet* set = new HRTFSet(ASSET_INFO_P);
+	set->sampling_rate = (uint32_t)root->get_as<int64_t>("sampling_rate").value_or(48000);
+	set->ir_length = 0;
+
+	auto measurements = root->get_table_array("measurement");
+	if(!measurements)
+	{
+		logger->error("HRTF set {} has no measurements", path);
+		return set;
+	}
+
+	for(const auto& m : *measurements)
+	{
+		auto position = m->get_array_of<double>("source_position");
+		auto left = m->get_array_of<double>("left");
+		auto right = m->get_array_of<double>("right");
+		if(!position || position->size() < 2 || !left || !right)
+		{
+			logger->warn("Skipping invalid HRTF measurement in {}", path);
+			continue;
+		}
+
+		double azimuth = glm::radians((*position)[0]);
+		double elevation = glm::radians((*position)[1]);
+
+		HRTFSet::Measurement meas;
+		meas.direction = glm::vec3(
+			-glm::sin(azimuth) * glm::cos(elevation),
+			glm::sin(elevation),
+			glm::cos(azimuth) * glm::cos(elevation));
+		meas.left.assign(left->begin(), left->end());
+		meas.right.assign(right->begin(), right->end());
+		set->ir_length = glm::max(set->ir_length, glm::max(meas.left.size(), meas.right.size()));
+		set->measurements.push_back(std::move(meas));
+	}
+
+	for(auto& m : set->measurements)
+	{
+		m.left.resize(set->ir_length, 0.0f);
+		m.right.resize(set->ir_length, 0.0f);
+	}
+
+	logger->info("Loaded HRTF set {} with {} measurements of {} samples", path, set->measurements.size(),
+		set->ir_length);
+
+	return set;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "Asset.h"
+#include <cpptoml.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+// Head related impulse responses, measured around a listener. Follows the SOFA
+// SimpleFreeFieldHRIR convention, but stored as toml instead of netCDF:
+//
+// sampling_rate = 48000
+// [[measurement]]
+//	# Degrees, azimuth is counter-clockwise from the front (90 is left), elevation is up
+//	source_position = [azimuth, elevation, distance]
+//	left = [...]
+//	right = [...]
+//
+// All impulse responses should have the same length (shorter ones are zero-padded)
+class HRTFSet : public Asset
+{
+public:
+
+	struct Measurement
+	{
+		// Unit vector, x right, y up, z forward
+		glm::vec3 direction;
+		std::vector<float> left;
+		std::vector<float> right;
+	};
+
+	uint32_t sampling_rate;
+	size_t ir_length;
+	std::vector<Measurement> measurements;
+
+	HRTFSet(ASSET_INFO) : Asset(ASSET_INFO_P) {}
+};
+
+HRTFSet* load_hrtf_set(ASSET_INFO, const cpptoml::table& cfg);
@@ -1,10 +1,19 @@
 #include "Image.h"
 #include "AssetManager.h"
+#include "TextureContainer.h"
+#include <renderer/util/TextureStreamer.h>
 #include <stb/stb_image.h>
 #include <sstream>
 #include "../util/MathUtil.h"
 #include <nanovg/nanovg.h>
 #include <nanovg/nanovg_gl.h>
+#include <glm/gtc/packing.hpp>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define IMAGE_USE_SSE
+#endif
 
 int Image::get_index(int x, int y)
 {
@@ -13,68 +22,157 @@ int Image::get_index(int x, int y)
 	return y * width + x;
 }
 
-glm::vec4 Image::sample_bilinear(float x, float y)
+// Decodes texel i of the given storage type to normalized RGBA
+template<ImageConfig::StorageFormat F>
+static inline glm::vec4 fetch_texel(const uint8_t* pdata, int channels, int i)
 {
-	logger->check(config.in_memory, "Image must be present in RAM for CPU sampling");
-
-	int w = get_width();
-	int h = get_height();
-
-	glm::vec2 cf = glm::vec2(x * w, y * h);
-
-	float x1 = floor(x * (float)w);
-	float x2 = ceil(x * (float)w);
-	float y1 = floor(y * (float)h);
-	float y2 = ceil(y * (float)h);
-
-
-
-	glm::vec2 tl = glm::vec2(x1, y1);
-	glm::vec2 tr = glm::vec2(x2, y1);
-	glm::vec2 bl = glm::vec2(x1, y2);
-	glm::vec2 br = glm::vec2(x2, y2);
-
-	int tli = get_index(MathUtil::int_repeat((int)tl.x, w - 1), MathUtil::int_clamp((int)tl.y, h - 1));
-	int tri = get_index(MathUtil::int_repeat((int)tr.x, w - 1), MathUtil::int_clamp((int)tr.y, h - 1));
-	int bli = get_index(MathUtil::int_repeat((int)bl.x, w - 1), MathUtil::int_clamp((int)bl.y, h - 1));
-	int bri = get_index(MathUtil::int_repeat((int)br.x, w - 1), MathUtil::int_clamp((int)br.y, h - 1));
-
-	glm::vec4 tls = get_rgba(tli);
-	glm::vec4 trs = get_rgba(tri);
-	glm::vec4 bls = get_rgba(bli);
-	glm::vec4 brs = get_rgba(bri);
-
-	// Interpolate in X, which we use as the base interp
-	float x_point = (cf.x - x1) / (x2 - x1);
-
-	glm::vec4 xtop = glm::mix(tls, trs, x_point);
-	glm::vec4 xbot = glm::mix(bls, brs, x_point);
-
-	// Interpolate in Y, between xtop and xbot
-	float y_point = (cf.y - y1) / (y2 - y1);
-	glm::vec4 interp;
-
-	if (x1 == x2 && y1 == y2)
+	float v[4];
+	if constexpr (F == ImageConfig::U8)
 	{
-		// Return any of them
-		interp = tls;
+		const uint8_t* p = pdata + (size_t)i * channels;
+		for(int c = 0; c < channels; c++)
+			v[c] = (float)p[c] * (1.0f / 255.0f);
 	}
-	else if (x1 == x2)
+	else if constexpr (F == ImageConfig::U16)
 	{
-		// Interpolate in y
-		interp = glm::mix(tls, bls, y_point);
+		const uint16_t* p = (const uint16_t*)pdata + (size_t)i * channels;
+		for(int c = 0; c < channels; c++)
+			v[c] = (float)p[c] * (1.0f / 65535.0f);
 	}
-	else if (y1 == y2)
+	else if constexpr (F == ImageConfig::HALF)
 	{
-		// Interpolate in x
-		interp = glm::mix(tls, trs, x_point);
+		const uint16_t* p = (const uint16_t*)pdata + (size_t)i * channels;
+		for(int c = 0; c < channels; c++)
+			v[c] = glm::unpackHalf1x16(p[c]);
 	}
 	else
 	{
-		interp = glm::mix(xtop, xbot, y_point);
+		const float* p = (const float*)pdata + (size_t)i * channels;
+		for(int c = 0; c < channels; c++)
+			v[c] = p[c];
+	}
+
+	switch(channels)
+	{
+		case 1: return glm::vec4(v[0], v[0], v[0], 1.0f);
+		case 2: return glm::vec4(v[0], v[0], v[0], v[1]);
+		case 3: return glm::vec4(v[0], v[1], v[2], 1.0f);
+		default: return glm::vec4(v[0], v[1], v[2], v[3]);
+	}
+}
+
+#ifdef IMAGE_USE_SSE
+static inline __m128 load_vec4(const glm::vec4& v)
+{
+	return _mm_loadu_ps(&v.x);
+}
+
+// The most common case (8 bit RGBA) is decoded directly into SSE registers
+static inline __m128 fetch_rgba8_sse(const uint8_t* pdata, int i)
+{
+	int32_t packed;
+	memcpy(&packed, pdata + (size_t)i * 4, 4);
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_cvtsi32_si128(packed);
+	v = _mm_unpacklo_epi8(v, zero);
+	v = _mm_unpacklo_epi16(v, zero);
+	return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / 255.0f));
+}
+#endif
+
+template<ImageConfig::StorageFormat F>
+static void sample_batch_impl(const uint8_t* pdata, int channels, int w, int h,
+							  const glm::vec2* uvs, glm::vec4* out, size_t count)
+{
+	for(size_t s = 0; s < count; s++)
+	{
+		float cx = uvs[s].x * (float)w;
+		float cy = uvs[s].y * (float)h;
+		float x0 = std::floor(cx);
+		float y0 = std::floor(cy);
+		float tx = cx - x0;
+		float ty = cy - y0;
+
+		int xa = MathUtil::int_repeat((int)x0, w - 1);
+		int xb = MathUtil::int_repeat((int)x0 + 1, w - 1);
+		int ya = MathUtil::int_clamp((int)y0, h - 1) * w;
+		int yb = MathUtil::int_clamp((int)y0 + 1, h - 1) * w;
+
+#ifdef IMAGE_USE_SSE
+		__m128 tl, tr, bl, br;
+		if constexpr (F == ImageConfig::U8)
+		{
+			if(channels == 4)
+			{
+				tl = fetch_rgba8_sse(pdata, ya + xa);
+				tr = fetch_rgba8_sse(pdata, ya + xb);
+				bl = fetch_rgba8_sse(pdata, yb + xa);
+				br = fetch_rgba8_sse(pdata, yb + xb);
+			}
+			else
+			{
+				tl = load_vec4(fetch_texel<F>(pdata, channels, ya + xa));
+				tr = load_vec4(fetch_texel<F>(pdata, channels, ya + xb));
+				bl = load_vec4(fetch_texel<F>(pdata, channels, yb + xa));
+				br = load_vec4(fetch_texel<F>(pdata, channels, yb + xb));
+			}
+		}
+		else
+		{
+			tl = load_vec4(fetch_texel<F>(pdata, channels, ya + xa));
+			tr = load_vec4(fetch_texel<F>(pdata, channels, ya + xb));
+			bl = load_vec4(fetch_texel<F>(pdata, channels, yb + xa));
+			br = load_vec4(fetch_texel<F>(pdata, channels, yb + xb));
+		}
+
+		// a + (b - a) * t, all four channels at once
+		__m128 vtx = _mm_set1_ps(tx);
+		__m128 top = _mm_add_ps(tl, _mm_mul_ps(_mm_sub_ps(tr, tl), vtx));
+		__m128 bot = _mm_add_ps(bl, _mm_mul_ps(_mm_sub_ps(br, bl), vtx));
+		__m128 res = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bot, top), _mm_set1_ps(ty)));
+		_mm_storeu_ps(&out[s].x, res);
+#else
+		glm::vec4 tl = fetch_texel<F>(pdata, channels, ya + xa);
+		glm::vec4 tr = fetch_texel<F>(pdata, channels, ya + xb);
+		glm::vec4 bl = fetch_texel<F>(pdata, channels, yb + xa);
+		glm::vec4 br = fetch_texel<F>(pdata, channels, yb + xb);
+		out[s] = glm::mix(glm::mix(tl, tr, tx), glm::mix(bl, br, tx), ty);
+#endif
 	}
+}
 
-	return interp;
+void Image::sample_bilinear_batch(const glm::vec2* uvs, glm::vec4* out, size_t count)
+{
+	logger->check(config.in_memory && pdata != nullptr, "Image must be present in RAM for CPU sampling");
+
+	switch(storage)
+	{
+		case ImageConfig::U8:
+			sample_batch_impl<ImageConfig::U8>(pdata, channels, width, height, uvs, out, count);
+			break;
+		case ImageConfig::U16:
+			sample_batch_impl<ImageConfig::U16>(pdata, channels, width, height, uvs, out, count);
+			break;
+		case ImageConfig::HALF:
+			sample_batch_impl<ImageConfig::HALF>(pdata, channels, width, height, uvs, out, count);
+			break;
+		default:
+			sample_batch_impl<ImageConfig::FLOAT>(pdata, channels, width, height, uvs, out, count);
+			break;
+	}
+}
+
+void Image::sample_bilinear_batch(ImageSampleBatch& batch)
+{
+	sample_bilinear_batch(batch.uvs.data(), batch.results.data(), batch.uvs.size());
+}
+
+glm::vec4 Image::sample_bilinear(float x, float y)
+{
+	glm::vec2 uv = glm::vec2(x, y);
+	glm::vec4 out;
+	sample_bilinear_batch(&uv, &out, 1);
+	return out;
 }
 
 glm::vec4 Image::sample_bilinear(glm::vec2 px)
@@ -94,7 +192,13 @@ glm::dvec4 Image::sample_bilinear_double(double x, double y)
 
 glm::vec4 Image::get_rgba(int i)
 {
-	return glm::vec4(fdata[i * 4 + 0], fdata[i * 4 + 1], fdata[i * 4 + 2], fdata[i * 4 + 3]);
+	switch(storage)
+	{
+		case ImageConfig::U8: return fetch_texel<ImageConfig::U8>(pdata, channels, i);
+		case ImageConfig::U16: return fetch_texel<ImageConfig::U16>(pdata, channels, i);
+		case ImageConfig::HALF: return fetch_texel<ImageConfig::HALF>(pdata, channels, i);
+		default: return fetch_texel<ImageConfig::FLOAT>(pdata, channels, i);
+	}
 }
 
 glm::vec4 Image::get_rgba(int x, int y)
@@ -102,6 +206,25 @@ glm::vec4 Image::get_rgba(int x, int y)
 	return get_rgba(get_index(x, y));
 }
 
+size_t Image::component_size(ImageConfig::StorageFormat format)
+{
+	if(format == ImageConfig::U8)
+		return 1;
+	else if(format == ImageConfig::U16 || format == ImageConfig::HALF)
+		return 2;
+	return 4;
+}
+
+size_t Image::get_memory_size() const
+{
+	if(pdata == nullptr)
+	{
+		return 0;
+	}
+
+	return (size_t)width * height * channels * component_size(storage);
+}
+
 int Image::get_nvg_image(NVGcontext* vg)
 {
 	logger->check(this->config.upload, "Image must be uploaded to be used by NanoVG");
@@ -119,7 +242,281 @@ Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
 	this->nanovg_image = 0;
 	this->in_vg = nullptr;
 	this->config = config;
+	this->container = nullptr;
+	this->stream_level = -1;
+	this->stream_row = 0;
+	this->pdata = nullptr;
+	this->storage = ImageConfig::U8;
+	this->channels = 4;
+	this->id = 0;
+
+	std::string source = path;
+	bool upload = config.upload;
+
+	if(TextureContainer::is_container_path(path))
+	{
+		if(upload && upload_container(path))
+		{
+			upload = false;
+			if(!config.in_memory)
+			{
+				return;
+			}
+		}
+
+		// Either the driver lacks the format, or we need the data on RAM
+		source = get_fallback_path(path);
+		if(source.empty())
+		{
+			logger->error("Image {} has no uncompressed fallback, and it's needed", path);
+			this->config.in_memory = false;
+			return;
+		}
+	}
+
+	load_uncompressed(source, upload);
+}
+
+bool Image::upload_container(const std::string& path)
+{
+	container = new TextureContainer();
+	if(!container->load(path))
+	{
+		delete container;
+		container = nullptr;
+		return false;
+	}
+
+	if(config.is_srgb)
+	{
+		container->gl_format = container->get_srgb_format();
+	}
+
+	if(!TextureContainer::is_format_supported(container->gl_format))
+	{
+		logger->warn("Texture format {:#x} of {} is not supported by the driver, using fallback",
+			container->gl_format, path);
+		delete container;
+		container = nullptr;
+		return false;
+	}
+
+	width = container->get_width();
+	height = container->get_height();
+	GLsizei level_count = (GLsizei)container->levels.size();
+
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	bool mips = level_count > 1;
+	if(config.filter == ImageConfig::NEAREST)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	else
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// Mipmaps come from the file, we never generate them
+	glTexStorage2D(GL_TEXTURE_2D, level_count, container->gl_format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+
+	// Find the first level that must be resident right away
+	int resident = 0;
+	if(config.stream)
+	{
+		resident = level_count - 1;
+		while(resident > 0 && std::max(container->levels[resident - 1].width,
+			container->levels[resident - 1].height) <= config.stream_resident_size)
+		{
+			resident--;
+		}
+	}
 
+	// Low mips first, so the texture is usable as soon as possible
+	for(int level = level_count - 1; level >= resident; level--)
+	{
+		container->upload_rows(level, 0, container->get_rows(level));
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, resident);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(resident > 0 && texture_streamer != nullptr)
+	{
+		stream_level = resident - 1;
+		stream_row = 0;
+		texture_streamer->add(this);
+	}
+	else
+	{
+		if(resident > 0)
+		{
+			// No streamer available (early load), upload everything now
+			glBindTexture(GL_TEXTURE_2D, id);
+			for(int level = resident - 1; level >= 0; level--)
+			{
+				container->upload_rows(level, 0, container->get_rows(level));
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		delete container;
+		container = nullptr;
+	}
+
+	return true;
+}
+
+size_t Image::stream_step(size_t budget)
+{
+	if(stream_level < 0)
+	{
+		return 0;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, id);
+
+	size_t uploaded = 0;
+	while(stream_level >= 0 && uploaded < budget)
+	{
+		size_t row_bytes = container->get_row_bytes(stream_level);
+		int total_rows = container->get_rows(stream_level);
+		int rows = (int)((budget - uploaded) / row_bytes);
+		rows = std::max(1, std::min(rows, total_rows - stream_row));
+
+		container->upload_rows(stream_level, stream_row, rows);
+		uploaded += rows * row_bytes;
+		stream_row += rows;
+
+		if(stream_row >= total_rows)
+		{
+			// The level is complete, it can now be sampled
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream_level);
+			stream_level--;
+			stream_row = 0;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(stream_level < 0)
+	{
+		delete container;
+		container = nullptr;
+	}
+
+	return uploaded;
+}
+
+int Image::get_stream_level_width() const
+{
+	if(stream_level < 0)
+	{
+		return 0;
+	}
+
+	return container->levels[stream_level].width;
+}
+
+std::string Image::get_fallback_path(const std::string& path) const
+{
+	if(!config.fallback.empty())
+	{
+		// We are loaded with our package as the current one
+		return hgr->assets->resolve_path(config.fallback);
+	}
+
+	std::string png = path.substr(0, path.find_last_of('.')) + ".png";
+	if(AssetManager::file_exists(png))
+	{
+		return png;
+	}
+
+	return "";
+}
+
+void Image::load_to_memory(const std::string& path)
+{
+	int source_channels;
+	stbi_info(path.c_str(), &width, &height, &source_channels);
+
+	ImageConfig::StorageFormat source;
+	void* raw;
+	if(stbi_is_hdr(path.c_str()))
+	{
+		source = ImageConfig::FLOAT;
+		raw = stbi_loadf(path.c_str(), &width, &height, &source_channels, source_channels);
+	}
+	else if(stbi_is_16_bit(path.c_str()))
+	{
+		source = ImageConfig::U16;
+		raw = stbi_load_16(path.c_str(), &width, &height, &source_channels, source_channels);
+	}
+	else
+	{
+		source = ImageConfig::U8;
+		raw = stbi_load(path.c_str(), &width, &height, &source_channels, source_channels);
+	}
+
+	if(raw == nullptr)
+	{
+		logger->error("Could not load image {} to memory: {}", path, stbi_failure_reason());
+		return;
+	}
+
+	ImageConfig::StorageFormat target = config.storage;
+	if(target == ImageConfig::AUTO)
+	{
+		target = source == ImageConfig::FLOAT ? ImageConfig::HALF : source;
+	}
+
+	store_in_memory((const uint8_t*)raw, source, source_channels, target);
+	stbi_image_free(raw);
+}
+
+void Image::store_in_memory(const uint8_t* raw, ImageConfig::StorageFormat source, int nchannels,
+							ImageConfig::StorageFormat target)
+{
+	storage = target;
+	channels = nchannels;
+	size_t count = (size_t)width * height * channels;
+	// Not get_memory_size, as pdata is not allocated yet
+	size_t size = count * component_size(target);
+
+	pdata = (uint8_t*)malloc(size);
+	if(source == target)
+	{
+		memcpy(pdata, raw, size);
+		return;
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		float v;
+		if(source == ImageConfig::U8)
+			v = (float)raw[i] / 255.0f;
+		else if(source == ImageConfig::U16)
+			v = (float)((const uint16_t*)raw)[i] / 65535.0f;
+		else
+			v = ((const float*)raw)[i];
+
+		if(target == ImageConfig::U8)
+			pdata[i] = (uint8_t)(glm::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+		else if(target == ImageConfig::U16)
+			((uint16_t*)pdata)[i] = (uint16_t)(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		else if(target == ImageConfig::HALF)
+			((uint16_t*)pdata)[i] = glm::packHalf1x16(v);
+		else
+			((float*)pdata)[i] = v;
+	}
+}
+
+void Image::load_uncompressed(const std::string& path, bool upload)
+{
 	int c_dump;
 
 	uint8_t* u8data;
@@ -144,13 +541,17 @@ Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
 		}
 
 	}
-	else
+	else if(upload)
 	{
 		u8data = stbi_load(path.c_str(), &width, &height, &c_dump, 4);
-		fdata = nullptr;
+	}
+	else
+	{
+		// The in-memory copy is loaded in its own format below
+		u8data = nullptr;
 	}
 
-	if (config.upload)
+	if (upload)
 	{
 		glGenTextures(1, &id);
 		glBindTexture(GL_TEXTURE_2D, id);
@@ -185,14 +586,14 @@ Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
 
 	if (config.in_memory)
 	{
-		// We must convert image data to floats
-		fdata = (float*)malloc(width * height * 4 * sizeof(float));
-		for (size_t i = 0; i < width * height; i++)
+		if(config.is_font)
 		{
-			fdata[i * 4 + 0] = (float)u8data[i * 4 + 0] / 255.0f;
-			fdata[i * 4 + 1] = (float)u8data[i * 4 + 1] / 255.0f;
-			fdata[i * 4 + 2] = (float)u8data[i * 4 + 2] / 255.0f;
-			fdata[i * 4 + 3] = (float)u8data[i * 4 + 3] / 255.0f;
+			// Already expanded to RGBA
+			store_in_memory(u8data, ImageConfig::U8, 4, ImageConfig::U8);
+		}
+		else
+		{
+			load_to_memory(path);
 		}
 	}
 
@@ -210,20 +611,26 @@ Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
 
 Image::~Image()
 {
-	if (config.in_memory)
+	if (pdata != nullptr)
 	{
-		if (fdata != nullptr)
-		{
-			free(fdata);
-			fdata = nullptr;
-		}
+		free(pdata);
+		pdata = nullptr;
 	}
 
-	if (config.upload && id != 0)
+	if (id != 0)
 	{
 		glDeleteTextures(1, &id);
 	}
 
+	if (container != nullptr)
+	{
+		if (texture_streamer != nullptr)
+		{
+			texture_streamer->remove(this);
+		}
+		delete container;
+	}
+
 	if(nanovg_image != 0)
 	{
 		nvgDeleteImage(in_vg, nanovg_image);
@@ -233,6 +640,14 @@ Image::~Image()
 Image::Image(const unsigned char* data, int width, int height, int bits, int component, int mag_filter, int min_filter,
 			 int wrapS, int wrapT, bool srgb, ASSET_INFO) : Asset(ASSET_INFO_P)
 {
+	nanovg_image = 0;
+	in_vg = nullptr;
+	pdata = nullptr;
+	storage = ImageConfig::U8;
+	channels = 4;
+	container = nullptr;
+	stream_level = -1;
+	stream_row = 0;
 	glGenTextures(1, &id);
 	glBindTexture(GL_TEXTURE_2D, id);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
@@ -13,6 +13,17 @@ struct ImageConfig
 		LINEAR
 	};
 
+	// How the image is stored in RAM (in_memory = true)
+	// AUTO keeps the format of the source file (u8, u16 or half for HDR images)
+	enum StorageFormat
+	{
+		AUTO,
+		U8,
+		U16,
+		HALF,
+		FLOAT
+	};
+
 	bool upload;
 	bool in_memory;
 	// This converts the image from 1 channel to 4 with alpha for 
@@ -21,16 +32,45 @@ struct ImageConfig
 	// This applies linear correction to the image
 	bool is_srgb;
 	FilterMode filter;
+	StorageFormat storage;
+
+	// Only for .dds / .ktx2 images:
+	// Uploads only the mip levels smaller or equal than stream_resident_size
+	// during load, and the rest are progressively uploaded by the TextureStreamer
+	bool stream;
+	int stream_resident_size;
+	// Uncompressed image used if the driver does not support the compressed format,
+	// or if the image must be present in RAM. If empty, an image with same name
+	// and .png extension is tried.
+	std::string fallback;
 };
 
 struct NVGcontext;
+struct TextureContainer;
+
+// Storage for batched sampling from lua, reused across calls so no
+// allocation is done per sample (indices are 1-based in lua)
+struct ImageSampleBatch
+{
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> results;
 
-// Images are always RGBA, stored as float, for perfomance reasons
+	void resize(size_t count) { uvs.resize(count); results.resize(count); }
+
+	ImageSampleBatch(size_t count) { resize(count); }
+	ImageSampleBatch() = default;
+};
+
+// Images in RAM are stored in the format (and channel count) of the source file
+// by default, and expanded to RGBA floats while sampling. Grayscale images return
+// (v, v, v, a), and missing alpha is returned as 1.
 class Image : public Asset
 {
 private:
 
-	float* fdata;
+	uint8_t* pdata;
+	ImageConfig::StorageFormat storage;
+	int channels;
 
 	ImageConfig config;
 
@@ -41,6 +81,23 @@ private:
 	int nanovg_image;
 	NVGcontext* in_vg;
 
+	// Only kept while streaming a compressed image
+	TextureContainer* container;
+	// Next level to upload and how many rows of it were already uploaded
+	int stream_level;
+	int stream_row;
+
+	// Returns false if the image could not be uploaded (unsupported format, etc...)
+	bool upload_container(const std::string& path);
+	void load_uncompressed(const std::string& path, bool upload);
+	// Loads the image in RAM, in the format given by config.storage
+	void load_to_memory(const std::string& path);
+	void store_in_memory(const uint8_t* raw, ImageConfig::StorageFormat source, int nchannels,
+						 ImageConfig::StorageFormat target);
+	// Bytes per channel of a storage format (not AUTO)
+	static size_t component_size(ImageConfig::StorageFormat format);
+	std::string get_fallback_path(const std::string& path) const;
+
 public:
 
 	// This automatically creates the nanoVG image ONLY once
@@ -61,6 +118,11 @@ public:
 	glm::vec4 sample_bilinear(float x, float y);
 	glm::vec4 sample_bilinear(glm::vec2 px);
 
+	// Samples count coordinates in one go, without any per-sample validation
+	// Much faster than individual calls for big amounts of samples
+	void sample_bilinear_batch(const glm::vec2* uvs, glm::vec4* out, size_t count);
+	void sample_bilinear_batch(ImageSampleBatch& batch);
+
 	// Functions for lua, they simply cast to floats
 	glm::dvec4 sample_bilinear_double(glm::dvec2 px);
 	glm::dvec4 sample_bilinear_double(double x, double y);
@@ -69,6 +131,18 @@ public:
 	glm::vec4 get_rgba(int i);
 	glm::vec4 get_rgba(int x, int y);
 
+	ImageConfig::StorageFormat get_storage() const { return storage; }
+	int get_channels() const { return channels; }
+	// Bytes used by the in-memory copy
+	size_t get_memory_size() const;
+
+	// Uploads the next mip rows of a streaming image, returns bytes uploaded
+	// Always uploads at least one row of blocks so progress is guaranteed
+	size_t stream_step(size_t budget);
+	bool is_streaming() const { return stream_level >= 0; }
+	// Width of the level being streamed, used to prioritize low mips
+	int get_stream_level_width() const;
+
 	GLuint id;
 
 	Image(ImageConfig config, ASSET_INFO);
@@ -98,6 +172,14 @@ public:
 			filter_str = "nearest";
 		}
 		target.insert("filter", filter_str);
+		const char* storage_str[] = {"auto", "u8", "u16", "half", "float"};
+		target.insert("storage", std::string(storage_str[what.storage]));
+		target.insert("stream", what.stream);
+		target.insert("stream_resident_size", what.stream_resident_size);
+		if(!what.fallback.empty())
+		{
+			target.insert("fallback", what.fallback);
+		}
 	}
 
 	static void deserialize(ImageConfig& to, const cpptoml::table& from)
@@ -117,5 +199,22 @@ public:
 		{
 			to.filter = ImageConfig::NEAREST;
 		}
+
+		std::string storage_str;
+		SAFE_TOML_GET_OR(storage_str, "storage", std::string, "auto");
+		if(storage_str == "u8")
+			to.storage = ImageConfig::U8;
+		else if(storage_str == "u16")
+			to.storage = ImageConfig::U16;
+		else if(storage_str == "half")
+			to.storage = ImageConfig::HALF;
+		else if(storage_str == "float")
+			to.storage = ImageConfig::FLOAT;
+		else
+			to.storage = ImageConfig::AUTO;
+
+		SAFE_TOML_GET_OR(to.stream, "stream", bool, false);
+		SAFE_TOML_GET_OR(to.stream_resident_size, "stream_resident_size", int, 128);
+		SAFE_TOML_GET_OR(to.fallback, "fallback", std::string, "");
 	}
 };
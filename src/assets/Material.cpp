@@ -1,5 +1,7 @@
 #include "Material.h"
 #include <assets/Cubemap.h>
+#include <renderer/Renderer.h>
+#include <cstring>
 
 void Uniform::set(Shader* sh, const std::string& name, int* gl_tex) const
 {
@@ -38,6 +40,75 @@ void Uniform::set(Shader* sh, const std::string& name, int* gl_tex) const
 	}
 }
 
+void Uniform::set(Shader* sh, GLint loc, int* gl_tex) const
+{
+	if (type == FLOAT)
+	{
+		sh->setFloat(loc, value.as_float);
+	}
+	else if (type == INT)
+	{
+		sh->setInt(loc, value.as_int);
+	}
+	else if (type == VEC2)
+	{
+		sh->setVec2(loc, value.as_vec2);
+	}
+	else if (type == VEC3)
+	{
+		sh->setVec3(loc, value.as_vec3);
+	}
+	else if (type == VEC4)
+	{
+		sh->setVec4(loc, value.as_vec4);
+	}
+	else if (type == TEX)
+	{
+		glActiveTexture(GL_TEXTURE0 + *gl_tex);
+		glBindTexture(GL_TEXTURE_2D, value.as_tex->get()->id);
+
+		sh->setInt(loc, *gl_tex);
+
+		(*gl_tex)++;
+	}
+	else
+	{
+		logger->warn("Attempted to set empty uniform");
+	}
+}
+
+bool Uniform::write(uint8_t* dst, GLenum gl_type) const
+{
+	if (gl_type == GL_FLOAT && (type == FLOAT || type == INT))
+	{
+		float v = type == FLOAT ? value.as_float : (float)value.as_int;
+		memcpy(dst, &v, sizeof(float));
+	}
+	else if ((gl_type == GL_INT || gl_type == GL_BOOL) && (type == FLOAT || type == INT))
+	{
+		int v = type == INT ? value.as_int : (int)value.as_float;
+		memcpy(dst, &v, sizeof(int));
+	}
+	else if (gl_type == GL_FLOAT_VEC2 && type == VEC2)
+	{
+		memcpy(dst, &value.as_vec2, sizeof(glm::vec2));
+	}
+	else if (gl_type == GL_FLOAT_VEC3 && type == VEC3)
+	{
+		memcpy(dst, &value.as_vec3, sizeof(glm::vec3));
+	}
+	else if (gl_type == GL_FLOAT_VEC4 && type == VEC4)
+	{
+		memcpy(dst, &value.as_vec4, sizeof(glm::vec4));
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
 Uniform::Uniform(float v)
 {
 	type = FLOAT;
@@ -88,39 +159,63 @@ int Material::set(const std::vector<ModelTexture>& assimp_textures, const Materi
 {
 	int gl_tex = 0;
 
-	std::unordered_map<std::string, const Uniform*> final_uniforms;
-
-	for(const auto& uniform : uniforms)
+	// Overrides only replace uniforms we already have, so there's no need to merge them
+	for (const LooseUniform& uniform : loose_uniforms)
 	{
-		final_uniforms[uniform.first] = &uniform.second;
+		const Uniform* final_uniform = uniform.uniform;
+		if(!over.uniforms.empty())
+		{
+			auto pos = over.uniforms.find(*uniform.name);
+			if(pos != over.uniforms.end())
+			{
+				final_uniform = &pos->second;
+			}
+		}
+
+		final_uniform->set(shader, uniform.loc, &gl_tex);
 	}
 
-	for(const auto& uniform : over.uniforms)
+	if(block)
 	{
-		auto pos = final_uniforms.find(uniform.first);
-		if(pos != final_uniforms.end())
+		// Overriden block members need their own copy of the block, these are rare
+		// (highlights and the like) so it's simply streamed for this draw
+		std::vector<uint8_t> overriden;
+		if(!over.uniforms.empty())
 		{
-			pos->second = &uniform.second;
+			for(const BlockUniform& uniform : block_uniforms)
+			{
+				auto pos = over.uniforms.find(*uniform.name);
+				if(pos != over.uniforms.end())
+				{
+					if(overriden.empty())
+					{
+						overriden = block_data;
+					}
+					pos->second.write(overriden.data() + uniform.offset, uniform.gl_type);
+				}
+			}
 		}
-	}
 
-	for (auto& final_uniform : final_uniforms)
-	{
-		final_uniform.second->set(shader, final_uniform.first, &gl_tex);
+		if(overriden.empty())
+		{
+			block->bind(UniformBlocks::MATERIAL);
+		}
+		else
+		{
+			hgr->renderer->stream_uniforms->stream(overriden.data(), overriden.size(), UniformBlocks::MATERIAL);
+		}
 	}
 
 	for (const auto& assimp_texture : assimp_textures)
 	{
 		ModelTexture::TextureType type = assimp_texture.first;
-		auto translates = model_texture_type_to_uniform.find(type);
-		if (translates != model_texture_type_to_uniform.end())
+		auto translates = model_texture_locs.find(type);
+		if (translates != model_texture_locs.end())
 		{
-			std::string uniform = translates->second;
-
 			glActiveTexture(GL_TEXTURE0 + gl_tex);
 			glBindTexture(GL_TEXTURE_2D, assimp_texture.get_image()->id);
 
-			shader->setInt(uniform, gl_tex);
+			shader->setInt(translates->second, gl_tex);
 
 			gl_tex++;
 		}
@@ -132,84 +227,147 @@ int Material::set(const std::vector<ModelTexture>& assimp_textures, const Materi
 
 void Material::set_core(int* gl_tex, const CameraUniforms& cu, glm::dmat4 model, GLint drawable_id) const
 {
-
-	if (!core_uniforms.mat4_proj.empty())
+	shader->setMat4(core_locs.proj, cu.proj);
+	shader->setMat4(core_locs.view, cu.view);
+	shader->setMat4(core_locs.camera_model, cu.c_model);
+	shader->setMat4(core_locs.proj_view, cu.proj_view);
+	shader->setMat4(core_locs.camera_tform, cu.tform);
+	shader->setMat4(core_locs.model, model);
+	shader->setFloat(core_locs.far_plane, cu.far_plane);
+	shader->setFloat(core_locs.f_coef, 2.0f / glm::log2(cu.far_plane + 1.0f));
+	shader->setVec3(core_locs.camera_relative, cu.cam_pos);
+	shader->setInt(core_locs.drawable_id, drawable_id);
+
+	bool wants_final = shader->uses_draw_block || core_locs.final_tform >= 0;
+	bool wants_deferred = shader->uses_draw_block || core_locs.deferred_tform >= 0;
+	bool wants_normal = shader->uses_draw_block || core_locs.normal_model >= 0;
+
+	glm::mat4 final_tform(1.0f), deferred_tform(1.0f);
+	glm::mat3 normal_model(1.0f);
+	if(wants_final)
 	{
-		shader->setMat4(core_uniforms.mat4_proj, cu.proj);
+		final_tform = cu.tform * model;
 	}
-
-	if (!core_uniforms.mat4_view.empty())
+	if(wants_deferred)
 	{
-		shader->setMat4(core_uniforms.mat4_view, cu.view);
+		// This transform simply brings the vertices to camera coordinates, and also applies the model
+		// but not view or projection
+		deferred_tform = cu.c_model * model;
 	}
-
-	if (!core_uniforms.mat4_camera_model.empty())
+	if(wants_normal)
 	{
-		shader->setMat4(core_uniforms.mat4_camera_model, cu.c_model);
+		normal_model = glm::mat3(transpose(inverse(model)));
 	}
 
-	if (!core_uniforms.mat4_proj_view.empty())
+	if(shader->uses_draw_block)
 	{
-		shader->setMat4(core_uniforms.mat4_proj_view, cu.proj_view);
+		UniformBlocks::DrawBlock draw;
+		draw.final_tform = final_tform;
+		draw.deferred_tform = deferred_tform;
+		for(int i = 0; i < 3; i++)
+		{
+			draw.normal_model[i] = glm::vec4(normal_model[i], 0.0f);
+		}
+		draw.drawable_id = drawable_id;
+		hgr->renderer->stream_uniforms->stream(&draw, sizeof(draw), UniformBlocks::DRAW);
 	}
 
-	if (!core_uniforms.mat4_camera_tform.empty())
-	{
-		shader->setMat4(core_uniforms.mat4_camera_tform, cu.tform);
-	}
+	shader->setMat4(core_locs.final_tform, final_tform);
+	shader->setMat4(core_locs.deferred_tform, deferred_tform);
+	shader->setMat3(core_locs.normal_model, normal_model);
 
-	if (!core_uniforms.mat4_final_tform.empty())
+	if(!core_uniforms.int_irradiance.empty())
 	{
-		glm::dmat4 final_tform = cu.tform * model;
-		shader->setMat4(core_uniforms.mat4_final_tform, final_tform);
+		glActiveTexture(GL_TEXTURE0 + *gl_tex);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cu.irradiance);
+		shader->setInt(core_locs.irradiance, *gl_tex);
+		(*gl_tex)++;
 	}
 
-	if (!core_uniforms.mat4_model.empty())
-	{
-		shader->setMat4(core_uniforms.mat4_model, model);
-	}
+}
 
-	if (!core_uniforms.mat3_normal_model.empty())
-	{
-		shader->setMat3(core_uniforms.mat3_normal_model, glm::mat3(transpose(inverse(model))));
-	}
+void Material::prepare()
+{
+	loose_uniforms.clear();
+	block_uniforms.clear();
+	block_data.clear();
+	block = nullptr;
+	model_texture_locs.clear();
 
-	if (!core_uniforms.float_far_plane.empty())
+	auto loc = [this](const std::string& name)
 	{
-		shader->setFloat(core_uniforms.float_far_plane, cu.far_plane);
-	}
-
-	if (!core_uniforms.float_f_coef.empty())
+		return name.empty() ? -1 : shader->get_uniform_location(name);
+	};
+
+	core_locs.proj = loc(core_uniforms.mat4_proj);
+	core_locs.view = loc(core_uniforms.mat4_view);
+	core_locs.camera_model = loc(core_uniforms.mat4_camera_model);
+	core_locs.proj_view = loc(core_uniforms.mat4_proj_view);
+	core_locs.camera_tform = loc(core_uniforms.mat4_camera_tform);
+	core_locs.model = loc(core_uniforms.mat4_model);
+	core_locs.deferred_tform = loc(core_uniforms.mat4_deferred_tform);
+	core_locs.final_tform = loc(core_uniforms.mat4_final_tform);
+	core_locs.normal_model = loc(core_uniforms.mat3_normal_model);
+	core_locs.far_plane = loc(core_uniforms.float_far_plane);
+	core_locs.f_coef = loc(core_uniforms.float_f_coef);
+	core_locs.camera_relative = loc(core_uniforms.vec3_camera_relative);
+	core_locs.drawable_id = loc(core_uniforms.int_drawable_id);
+	core_locs.irradiance = loc(core_uniforms.int_irradiance);
+
+	for(const auto& entry : model_texture_type_to_uniform)
 	{
-		shader->setFloat(core_uniforms.float_f_coef, 2.0f / glm::log2(cu.far_plane + 1.0f));
+		model_texture_locs[entry.first] = loc(entry.second);
 	}
 
-	if (!core_uniforms.vec3_camera_relative.empty())
+	GLint block_size = 0;
+	GLuint block_index = GL_INVALID_INDEX;
+	if(shader->uses_material_block)
 	{
-		shader->setVec3(core_uniforms.vec3_camera_relative, cu.cam_pos);
+		block_index = glGetUniformBlockIndex(shader->id, "MaterialBlock");
+		glGetActiveUniformBlockiv(shader->id, block_index, GL_UNIFORM_BLOCK_DATA_SIZE, &block_size);
 	}
 
-	if (!core_uniforms.mat4_deferred_tform.empty())
+	for(const auto& uniform : uniforms)
 	{
-		// This transform simply brings the vertices to camera coordinates, and also applies the model
-		// but not view or projection
-		glm::dmat4 final_mat = cu.c_model * model;
-		shader->setMat4(core_uniforms.mat4_deferred_tform, (glm::mat4)final_mat);
-	}
+		if(block_size > 0 && !uniform.second.is_texture())
+		{
+			const char* name = uniform.first.c_str();
+			GLuint index = GL_INVALID_INDEX;
+			glGetUniformIndices(shader->id, 1, &name, &index);
+
+			if(index != GL_INVALID_INDEX)
+			{
+				GLint in_block, offset, type;
+				glGetActiveUniformsiv(shader->id, 1, &index, GL_UNIFORM_BLOCK_INDEX, &in_block);
+				glGetActiveUniformsiv(shader->id, 1, &index, GL_UNIFORM_OFFSET, &offset);
+				glGetActiveUniformsiv(shader->id, 1, &index, GL_UNIFORM_TYPE, &type);
+
+				if(in_block == (GLint)block_index)
+				{
+					block_uniforms.push_back(BlockUniform{&uniform.first, &uniform.second, offset, (GLenum)type});
+					continue;
+				}
+			}
+		}
 
-	if(!core_uniforms.int_drawable_id.empty())
-	{
-		shader->setInt(core_uniforms.int_drawable_id, drawable_id);
+		loose_uniforms.push_back(LooseUniform{&uniform.first, &uniform.second, loc(uniform.first)});
 	}
 
-	if(!core_uniforms.int_irradiance.empty())
+	if(block_size > 0)
 	{
-		glActiveTexture(GL_TEXTURE0 + *gl_tex);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cu.irradiance);
-		shader->setInt(core_uniforms.int_irradiance, *gl_tex);
-		(*gl_tex)++;
-	}
+		// Members not given by the material stay zero, same as unset uniforms
+		block_data.resize((size_t)block_size, 0);
+		for(const BlockUniform& uniform : block_uniforms)
+		{
+			if(!uniform.uniform->write(block_data.data() + uniform.offset, uniform.gl_type))
+			{
+				logger->warn("Material uniform '{}' does not match its type in MaterialBlock", *uniform.name);
+			}
+		}
 
+		block = std::make_unique<UniformBuffer>(block_data.size());
+		block->set(block_data.data(), block_data.size());
+	}
 }
 
 Material* load_material(ASSET_INFO, const cpptoml::table& cfg)
@@ -256,6 +414,21 @@ size_t MeshConfig::get_vertex_floats() const
 	return out;
 }
 
+uint32_t MeshConfig::get_layout() const
+{
+	uint32_t out = 0;
+	out |= has_pos ? 1 << 0 : 0;
+	out |= has_nrm ? 1 << 1 : 0;
+	out |= has_uv0 ? 1 << 2 : 0;
+	out |= has_uv1 ? 1 << 3 : 0;
+	out |= has_tgt ? 1 << 4 : 0;
+	out |= has_cl3 ? 1 << 5 : 0;
+	out |= has_cl4 ? 1 << 6 : 0;
+	out |= flip_uv ? 1 << 7 : 0;
+
+	return out;
+}
+
 size_t MeshConfig ::get_vertex_size()
 {
 	return get_vertex_floats() * sizeof(float);
@@ -6,11 +6,13 @@
 #include "Config.h"
 #include <util/SerializeUtil.h>
 #include <renderer/camera/CameraUniforms.h>
+#include <renderer/util/UniformBuffer.h>
 #include <tiny_gltf/tiny_gltf.h>
 
 #include <glm/gtx/matrix_decompose.hpp>
 #include <algorithm>
 #include <iostream>
+#include <memory>
 #include "Asset.h"
 
 struct MeshConfig
@@ -43,6 +45,9 @@ struct MeshConfig
 
 	size_t get_vertex_floats() const;
 
+	// Bitmask of the flags that affect vertex interleaving, used to validate cooked models
+	uint32_t get_layout() const;
+
 	size_t get_vertex_size();
 
 };
@@ -83,6 +88,14 @@ private:
 public:
 
 	void set(Shader* sh, const std::string& name, int* gl_tex) const;
+	// Same but with a location obtained from the shader
+	void set(Shader* sh, GLint loc, int* gl_tex) const;
+
+	// Writes the value with std140 layout, converting between int and float if
+	// needed. Returns false if gl_type (as reported by GL_UNIFORM_TYPE) doesn't match
+	bool write(uint8_t* dst, GLenum gl_type) const;
+
+	bool is_texture() const { return type == TEX; }
 
 	Uniform(float v);
 	Uniform(int v);
@@ -272,8 +285,47 @@ struct Material : public Asset
 	int set(const std::vector<ModelTexture>& model_textures, const MaterialOverride& over) const;
 	void set_core(int* gl_tex, const CameraUniforms& cu, glm::dmat4 model, GLint drawable_id) const;
 
+	// Resolves all uniform locations against the shader and packs the MaterialBlock
+	// (if the shader has one). Called once the material has been deserialized.
+	void prepare();
+
 	Material(ASSET_INFO) : Asset(ASSET_INFO_P) {}
 
+private:
+
+	struct LooseUniform
+	{
+		const std::string* name;
+		const Uniform* uniform;
+		GLint loc;
+	};
+
+	struct BlockUniform
+	{
+		const std::string* name;
+		const Uniform* uniform;
+		GLint offset;
+		GLenum gl_type;
+	};
+
+	// Everything not in the MaterialBlock (textures, and all uniforms for shaders without it)
+	std::vector<LooseUniform> loose_uniforms;
+	std::vector<BlockUniform> block_uniforms;
+	std::vector<uint8_t> block_data;
+	std::unique_ptr<UniformBuffer> block;
+
+	std::unordered_map<ModelTexture::TextureType, GLint> model_texture_locs;
+
+	// Locations of the core uniforms, -1 if not bound or not present in the shader
+	// (for example because the shader reads them from FrameBlock / DrawBlock)
+	struct CoreLocations
+	{
+		GLint proj, view, camera_model, proj_view, camera_tform, model, deferred_tform,
+			final_tform, normal_model, far_plane, f_coef, camera_relative, drawable_id, irradiance;
+	};
+
+	CoreLocations core_locs;
+
 };
 
 Material* load_material(ASSET_INFO, const cpptoml::table& cfg);
@@ -426,6 +478,7 @@ public:
 			}
 		}
 
+		to.prepare();
 	}
 };
 
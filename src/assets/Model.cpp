@@ -1,67 +1,19 @@
 #include "Model.h"
+#include "ModelCache.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/quaternion.hpp>
+#include <map>
 
 #pragma warning(push, 0)
 #include "btBulletCollisionCommon.h"
 #pragma warning(pop)
 
-static void* get_buffer_ptr(const tinygltf::Model& model, const tinygltf::Accessor& acc)
+static const uint8_t* get_ptr_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, size_t idx)
 {
 	const tinygltf::BufferView& bv = model.bufferViews[acc.bufferView];
-	const tinygltf::Buffer& b = model.buffers[bv.buffer];
-
-	void* ptr = (void*)((uint8_t*)b.data.data() + bv.byteOffset + acc.byteOffset);
-	return ptr;
-}
-
-static size_t get_accessor_unit_size(const tinygltf::Model& model, const tinygltf::Accessor& acc)
-{
-	return tinygltf::GetComponentSizeInBytes(acc.componentType) * tinygltf::GetNumComponentsInType(acc.type);
-}
-
-static size_t get_accessor_size(const tinygltf::Model& model, const tinygltf::Accessor& acc)
-{
-	return acc.count * get_accessor_unit_size(model, acc);
-}
-
-static const uint8_t* get_ptr_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, int idx)
-{
-	size_t byte_offset = acc.byteOffset + model.bufferViews[acc.bufferView].byteOffset;
-	const uint8_t* base = model.buffers[model.bufferViews[acc.bufferView].buffer].data.data() + byte_offset;
-	return base + get_accessor_unit_size(model, acc) * idx;
-}
-
-// This is used to extract single floats, not whole units
-static const uint8_t* get_subptr_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, int idx)
-{
-	size_t byte_offset = acc.byteOffset + model.bufferViews[acc.bufferView].byteOffset;
-	const uint8_t* base = model.buffers[model.bufferViews[acc.bufferView].buffer].data.data() + byte_offset;
-	return base + tinygltf::GetComponentSizeInBytes(acc.componentType) * idx;
-}
-
-static glm::vec2 get_vec2_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, int idx)
-{
-	void* ptr = (void*)get_ptr_from_accessor(model, acc, idx);
-	switch (acc.componentType)
-	{
-		case(TINYGLTF_COMPONENT_TYPE_BYTE):
-			return glm::vec2(*((int8_t*)ptr + 0), *((int8_t*)ptr + 1));
-		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE):
-			return glm::vec2(*((uint8_t*)ptr + 0), *((uint8_t*)ptr + 1));
-		case(TINYGLTF_COMPONENT_TYPE_SHORT):
-			return glm::vec2(*((int16_t*)ptr + 0), *((int16_t*)ptr + 1));
-		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT):
-			return glm::vec2(*((uint16_t*)ptr + 0), *((uint16_t*)ptr + 1));
-		case(TINYGLTF_COMPONENT_TYPE_INT):
-			return glm::vec2(*((int32_t*)ptr + 0), *((int32_t*)ptr + 1));
-		case(TINYGLTF_COMPONENT_TYPE_FLOAT):
-			return glm::vec2(*((float*)ptr + 0), *((float*)ptr + 1));
-		default:
-			logger->fatal("Unknown component type: {}", acc.componentType);
-			return glm::vec2(0.0);
-	}
+	const uint8_t* base = model.buffers[bv.buffer].data.data() + bv.byteOffset + acc.byteOffset;
+	return base + (size_t)acc.ByteStride(bv) * idx;
 }
 
 static glm::vec3 get_vec3_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, int idx)
@@ -102,6 +54,8 @@ static int get_index_from_accessor(const tinygltf::Model& model, const tinygltf:
 			return (int)(*(uint16_t*)ptr);
 		case(TINYGLTF_COMPONENT_TYPE_INT):
 			return (int)(*(int32_t*)ptr);
+		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT):
+			return (int)(*(uint32_t*)ptr);
 		case(TINYGLTF_COMPONENT_TYPE_FLOAT):
 			return (int)(*(float*)ptr);
 		default:
@@ -110,26 +64,48 @@ static int get_index_from_accessor(const tinygltf::Model& model, const tinygltf:
 	}
 }
 
-static float get_subfloat_from_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc, int idx)
+template<typename T>
+static void interleave_components(const uint8_t* src, size_t src_stride, size_t comps,
+								  float* dst, size_t dst_stride, size_t count)
 {
-	void* ptr = (void*)get_subptr_from_accessor(model, acc, idx);
+	for(size_t i = 0; i < count; i++)
+	{
+		const T* s = (const T*)(src + i * src_stride);
+		float* d = dst + i * dst_stride;
+		for(size_t j = 0; j < comps; j++)
+		{
+			d[j] = (float)s[j];
+		}
+	}
+}
+
+// Converts the accessor to floats and writes them every dst_stride floats. Only up to
+// dst_comps components are written, missing ones are left untouched
+static void interleave_accessor(const tinygltf::Model& model, const tinygltf::Accessor& acc,
+								float* dst, size_t dst_stride, size_t dst_comps)
+{
+	const uint8_t* src = get_ptr_from_accessor(model, acc, 0);
+	size_t src_stride = acc.ByteStride(model.bufferViews[acc.bufferView]);
+	size_t comps = std::min((size_t)tinygltf::GetNumComponentsInType(acc.type), dst_comps);
+
 	switch (acc.componentType)
 	{
 		case(TINYGLTF_COMPONENT_TYPE_BYTE):
-			return (float)(*(int8_t*)ptr);
+			interleave_components<int8_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE):
-			return (float)(*(uint8_t*)ptr);
+			interleave_components<uint8_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		case(TINYGLTF_COMPONENT_TYPE_SHORT):
-			return (float)(*(int16_t*)ptr);
+			interleave_components<int16_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT):
-			return (float)(*(uint16_t*)ptr);
+			interleave_components<uint16_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		case(TINYGLTF_COMPONENT_TYPE_INT):
-			return (float)(*(int32_t*)ptr);
+			interleave_components<int32_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
+		case(TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT):
+			interleave_components<uint32_t>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		case(TINYGLTF_COMPONENT_TYPE_FLOAT):
-			return (float)(*(float*)ptr);
+			interleave_components<float>(src, src_stride, comps, dst, dst_stride, acc.count); break;
 		default:
 			logger->fatal("Unknown component type: {}", acc.componentType);
-			return 0;
 	}
 }
 
@@ -176,275 +152,279 @@ bool Mesh::is_drawable() const
 }
 
 
-void Mesh::upload()
+void Mesh::bind_uniforms(const CameraUniforms& uniforms, glm::dmat4 model, GLint did) const
 {
-	if (drawable)
-	{
-		glGenVertexArrays(1, &vao);
-		glGenBuffers(1, &ebo);
-
+	logger->check(drawable, "Cannot draw a non-drawable mesh!");
 
-		tinygltf::Primitive prim = in_model->gltf.meshes[mesh_idx].primitives[prim_idx];
-		logger->check(prim.indices >= 0, "We don't support non-indexed drawing");
+	material->shader->use();
 
-		tinygltf::Accessor index_acc = in_model->gltf.accessors[prim.indices];
+	int gl_tex = material->set(textures, mat_override);
+	material->set_core(&gl_tex, uniforms, model, did);
+}
 
+void Mesh::draw_command() const
+{
+	logger->check(drawable, "Cannot draw a non-drawable mesh!");
+	logger->check(vao != 0, "Tried to render a non-loaded mesh");
 
-		glBindVertexArray(vao);
+	glBindVertexArray(vao);
+	draw_elements();
+	glBindVertexArray(0);
 
-		// Index data
-		auto size = get_accessor_size(in_model->gltf, index_acc);
-		auto ptr = get_buffer_ptr(in_model->gltf, index_acc);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			   (GLsizeiptr)get_accessor_size(in_model->gltf, index_acc),
-			   get_buffer_ptr(in_model->gltf, index_acc), GL_STATIC_DRAW);
+}
 
+void Mesh::draw_elements(GLsizei instances) const
+{
+	if(instances == 1)
+	{
+		glDrawElementsBaseVertex(GL_TRIANGLES, index_count, index_type, (void*)index_offset, base_vertex);
+	}
+	else
+	{
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, index_count, index_type, (void*)index_offset,
+										  instances, base_vertex);
+	}
+}
 
-		// All other buffers
-		// (name, gltf_has_attribute, count)
-		std::vector<std::tuple<std::string, tinygltf::Accessor*, size_t>> order;
+std::vector<glm::vec3> Mesh::get_verts() const
+{
+	// Position is always the first attribute, and non-drawables only have positions
+	logger->check(!drawable || material->cfg.has_pos, "Cannot get vertices of a mesh without positions");
 
-		auto get_accessor_fnc = [&prim, this](const std::string& name) -> tinygltf::Accessor*
-		{
-			auto it = prim.attributes.find(name);
-			if(it == prim.attributes.end())
-			{
-				return nullptr;
-			}
-			else
-			{
-				return &this->in_model->gltf.accessors[it->second];
-			}
+	std::vector<glm::vec3> out;
+	out.reserve(index_count);
 
-		};
-
-		size_t stride = material->cfg.get_vertex_floats();
-		tinygltf::Accessor *nrm_acc;
-
-		if(material->cfg.has_pos)
-			order.emplace_back("POSITION", get_accessor_fnc("POSITION"), 3);
-		if (material->cfg.has_nrm)
-			order.emplace_back("NORMAL", get_accessor_fnc("NORMAL"), 3);
-		if (material->cfg.has_uv0)
-			order.emplace_back("TEXCOORD_0", get_accessor_fnc("TEXCOORD_0"), 2);
-		if (material->cfg.has_uv1)
-			order.emplace_back("TEXCOORD_1", get_accessor_fnc("TEXCOORD_1"), 2);
-		if (material->cfg.has_tgt)
-			order.emplace_back("TANGENT", get_accessor_fnc("TANGENT"), 6);
-		if (material->cfg.has_cl3)
-			order.emplace_back("COLOR_0", get_accessor_fnc("COLOR_0"), 3);
-		if (material->cfg.has_cl4)
-			order.emplace_back("COLOR_0", get_accessor_fnc("COLOR_0"), 4);
-		if (material->cfg.has_tgt)
+	for(GLsizei i = 0; i < index_count; i++)
+	{
+		uint32_t index;
+		if(index_type == GL_UNSIGNED_INT)
 		{
-			logger->check(material->cfg.has_nrm, "Cannot have a mesh with tangents and no normal");
-			nrm_acc = get_accessor_fnc("NORMAL");
-			logger->check(nrm_acc, "Cannot have null normals in a material with tangents");
-
-			if (prim.attributes.find("TANGENT") == prim.attributes.end())
-			{
-				logger->warn("Could not find tangents on the model. Note for blender users:");
-				logger->warn(" - Try triangulating your mesh, there's a bug in the gltf exporter which");
-				logger->warn("   prevents tangents from being generated on non-triangulated meshes.");
-
-			}
+			index = ((const uint32_t*)index_data.data())[i];
 		}
-
-		size_t vert_count = in_model->gltf.accessors[prim.attributes["POSITION"]].count;
-
-		std::vector<float> tmp_buffer = std::vector<float>();
-		tmp_buffer.resize(stride * vert_count);
-
-		// We manually interleave the data and send it to a single VBO for perfomance reasons,
-		// convert everything to the float type and calculate the bitangents
-		size_t buff_ptr = 0;
-		for(size_t i = 0; i < vert_count; i++)
+		else
 		{
-			for(const auto& tuple : order)
-			{
-				tinygltf::Accessor* acc = std::get<1>(tuple);
-				for(size_t j = 0; j < std::get<2>(tuple); j++)
-				{
-					if (acc)
-					{
-						// Obtain data from gltf
-						size_t float_count = 1;
-						if(acc->type != TINYGLTF_TYPE_SCALAR) { float_count = acc->type; }
-
-						float val = 0.0f;
-						if(j < float_count)
-						{
-							val = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + j));
-						}
-
-						tmp_buffer[buff_ptr] = val;
-
-						if(std::get<0>(tuple) == "TEXCOORD_0" && j == 1 && material->cfg.flip_uv)
-						{
-							tmp_buffer[buff_ptr] = -tmp_buffer[buff_ptr];
-						}
-
-						if(std::get<0>(tuple) == "TANGENT" && j == 3)
-						{
-							// Calculate the bitangent for indices 3, 4, 5 and skip to the end
-							glm::vec3 normal;
-							glm::vec4 tangent;
-
-							for(size_t ti = 0; ti < 4; ti++)
-								tangent[ti] = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + ti));
-							for(size_t tn = 0; tn < 3; tn++)
-								normal[tn] = get_subfloat_from_accessor(in_model->gltf, *nrm_acc, (i * 3 + tn));
-
-							glm::vec3 bitangent = glm::cross(normal, glm::vec3(tangent)) * tangent.w;
-							tmp_buffer[buff_ptr + 0] = bitangent.x;
-							tmp_buffer[buff_ptr + 1] = bitangent.y;
-							tmp_buffer[buff_ptr + 2] = bitangent.z;
-
-							buff_ptr += 3;
-							break;
-						}
-					}
-					else
-					{
-						// Default data (zeroes)
-						tmp_buffer[buff_ptr] = 0.0f;
-					}
-
-					buff_ptr++;
-				}
-			}
+			index = ((const uint16_t*)index_data.data())[i];
 		}
 
-		// Upload the buffer to the GPU
-		GLuint vbo;
-		glGenBuffers(1, &vbo);
-		vbos.push_back(vbo);
-
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * stride * vert_count, tmp_buffer.data(), GL_STATIC_DRAW);
-
-		// And bind the vertex attributes in the order they appear
-		int idx = 0;
-		size_t off = 0;
-		for(const auto& tuple : order)
-		{
-			if(std::get<0>(tuple) == "TANGENT")
-			{
-				// We bind two attributes
-				glVertexAttribPointer(idx, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float),
-									  (void *) ((float *) nullptr + off));
-				glEnableVertexAttribArray(idx);
-				off += 3;
-				glVertexAttribPointer(idx + 1, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float),
-									  (void *) ((float *) nullptr + off));
-				glEnableVertexAttribArray(idx + 1);
-				off += 3;
-				idx++;
-			}
-			else
-			{
-				glVertexAttribPointer(idx, std::get<2>(tuple), GL_FLOAT, GL_FALSE, stride * sizeof(float),
-									  (void *) ((float *) nullptr + off));
-				glEnableVertexAttribArray(idx);
-				idx++;
-				off += std::get<2>(tuple);
-			}
-		}
+		const float* pos = &vertex_data[index * stride];
+		out.emplace_back(pos[0], pos[1], pos[2]);
+	}
 
+	return out;
+}
 
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+// Binds the vertex attributes in the order they appear in the cooked data
+static void setup_vertex_attributes(const MeshConfig& cfg)
+{
+	std::vector<GLint> order;
+	if(cfg.has_pos) order.push_back(3);
+	if(cfg.has_nrm) order.push_back(3);
+	if(cfg.has_uv0) order.push_back(2);
+	if(cfg.has_uv1) order.push_back(2);
+	// Tangent and bitangent are bound as two attributes
+	if(cfg.has_tgt) { order.push_back(3); order.push_back(3); }
+	if(cfg.has_cl3) order.push_back(3);
+	if(cfg.has_cl4) order.push_back(4);
 
-		material.get();
+	GLsizei byte_stride = (GLsizei)(cfg.get_vertex_floats() * sizeof(float));
+	size_t off = 0;
+	for(size_t idx = 0; idx < order.size(); idx++)
+	{
+		glVertexAttribPointer(idx, order[idx], GL_FLOAT, GL_FALSE, byte_stride,
+							  (void *) ((float *) nullptr + off));
+		glEnableVertexAttribArray(idx);
+		off += order[idx];
 	}
 }
 
-void Mesh::unload()
+static void gather_draws(const Node* n, glm::dmat4 tform, GLint did_offset, std::vector<PreparedDraw>& out)
 {
-	if (drawable)
+	for(const Mesh& mesh : n->meshes)
 	{
-		glDeleteBuffers(1, &ebo);
-		glDeleteVertexArrays(1, &vao);
-
-		vao = 0;
-		ebo = 0;
+		if(mesh.is_drawable())
+		{
+			PreparedDraw d;
+			d.mesh = &mesh;
+			d.material = mesh.get_material();
+			d.sub_transform = tform;
+			d.did_offset = did_offset;
+			out.push_back(d);
+		}
+	}
 
-		material.unload();
+	// Same as the recursive drawing used to do, every child increases the id
+	for(const Node* child : n->children)
+	{
+		did_offset++;
+		gather_draws(child, tform * child->sub_transform, did_offset, out);
 	}
 }
 
-void Mesh::bind_uniforms(const CameraUniforms& uniforms, glm::dmat4 model, GLint did) const
+void Model::upload()
 {
-	logger->check(drawable, "Cannot draw a non-drawable mesh!");
+	std::vector<Node*> all_nodes;
+	if(root != nullptr)
+	{
+		all_nodes = root->get_children_recursive();
+		all_nodes.push_back(root);
+	}
 
-	material->shader->use();
+	glGenBuffers(1, &instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	// Never empty, as non-instanced draws still have the attributes enabled
+	instance_capacity = INSTANCE_STRIDE;
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)instance_capacity, nullptr, GL_STREAM_DRAW);
 
-	int gl_tex = material->set(textures, mat_override);
-	material->set_core(&gl_tex, uniforms, model, did);
-}
+	// Group the meshes by layout
+	std::map<uint32_t, std::vector<Mesh*>> by_layout;
+	for(Node* n : all_nodes)
+	{
+		for(Mesh& mesh : n->meshes)
+		{
+			if(!mesh.drawable)
+			{
+				continue;
+			}
 
-void Mesh::draw_command() const
-{
-	logger->check(drawable, "Cannot draw a non-drawable mesh!");
-	logger->check(vao != 0, "Tried to render a non-loaded mesh");
+			// The material is released on unload, so get it back
+			if(mesh.material.data == nullptr && !mesh.material.raw)
+			{
+				mesh.material = AssetHandle<Material>(mesh.material.pkg, mesh.material.name);
+			}
 
-	glBindVertexArray(vao);
+			by_layout[mesh.material->cfg.get_layout()].push_back(&mesh);
+		}
+	}
 
-	tinygltf::Primitive prim = in_model->gltf.meshes[mesh_idx].primitives[prim_idx];
-	tinygltf::Accessor index_acc = in_model->gltf.accessors[prim.indices];
-	glDrawElements(GL_TRIANGLES, (GLsizei)index_acc.count, index_acc.componentType, nullptr);
+	for(const auto& [layout, meshes] : by_layout)
+	{
+		const MeshConfig& cfg = meshes[0]->material->cfg;
+		size_t vertex_bytes = 0, index_bytes = 0;
+		for(const Mesh* mesh : meshes)
+		{
+			vertex_bytes += mesh->vertex_data.size() * sizeof(float);
+			// Keep indices aligned to 4 bytes
+			index_bytes += (mesh->index_data.size() + 3) & ~(size_t)3;
+		}
 
-	glBindVertexArray(0);
+		LayoutBuffers buf;
+		buf.layout = layout;
+		glGenVertexArrays(1, &buf.vao);
+		glGenBuffers(1, &buf.vbo);
+		glGenBuffers(1, &buf.ebo);
+
+		glBindVertexArray(buf.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buf.vbo);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertex_bytes, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buf.ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)index_bytes, nullptr, GL_STATIC_DRAW);
+
+		// Data is already interleaved, so this is a straight copy
+		size_t vertex_off = 0, index_off = 0;
+		for(Mesh* mesh : meshes)
+		{
+			size_t vsize = mesh->vertex_data.size() * sizeof(float);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)vertex_off, (GLsizeiptr)vsize, mesh->vertex_data.data());
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)index_off, (GLsizeiptr)mesh->index_data.size(),
+							mesh->index_data.data());
 
-}
+			mesh->vao = buf.vao;
+			mesh->base_vertex = (GLint)(vertex_off / (mesh->stride * sizeof(float)));
+			mesh->index_offset = index_off;
 
-std::vector<glm::vec3> Mesh::get_verts()
-{
-	std::vector<glm::vec3> out;
+			vertex_off += vsize;
+			index_off += (mesh->index_data.size() + 3) & ~(size_t)3;
+		}
 
-	tinygltf::Primitive prim = in_model->gltf.meshes[mesh_idx].primitives[prim_idx];
-	logger->check(prim.indices >= 0, "We don't support non-indexed drawing");
-	tinygltf::Accessor index_acc = in_model->gltf.accessors[prim.indices];
-	tinygltf::Accessor pos_acc = in_model->gltf.accessors[prim.attributes["POSITION"]];
+		setup_vertex_attributes(cfg);
 
-	for(int i = 0; i < index_acc.count; i++)
-	{
-		int index = get_index_from_accessor(in_model->gltf, index_acc, i);
-		out.push_back(get_vec3_from_accessor(in_model->gltf, pos_acc, index));
-	}
+		// Per-instance transforms, two mat4 (4 vec4 each)
+		for(GLuint i = 0; i < 8; i++)
+		{
+			glVertexAttribFormat(INSTANCE_ATTRIB + i, 4, GL_FLOAT, GL_FALSE, i * sizeof(glm::vec4));
+			glVertexAttribBinding(INSTANCE_ATTRIB + i, INSTANCE_ATTRIB);
+			glEnableVertexAttribArray(INSTANCE_ATTRIB + i);
+		}
+		glVertexBindingDivisor(INSTANCE_ATTRIB, 1);
+		glBindVertexBuffer(INSTANCE_ATTRIB, instance_vbo, 0, INSTANCE_STRIDE);
 
-	return out;
-}
+		glBindVertexArray(0);
+		buffers.push_back(buf);
+	}
 
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-void Model::upload()
-{
-	for (auto it = node_by_name.begin(); it != node_by_name.end(); it++)
+	// Prepare the draw lists
+	for(Node* n : all_nodes)
 	{
-		for (size_t i = 0; i < it->second->meshes.size(); i++)
+		n->draw_list.clear();
+		gather_draws(n, glm::dmat4(1.0), 0, n->draw_list);
+		std::stable_sort(n->draw_list.begin(), n->draw_list.end(), [](const PreparedDraw& a, const PreparedDraw& b)
 		{
-			it->second->meshes[i].upload();
-		}
+			if(a.material->shader != b.material->shader)
+				return a.material->shader < b.material->shader;
+			if(a.material != b.material)
+				return a.material < b.material;
+			return a.mesh->vao < b.mesh->vao;
+		});
 	}
-	
+
 	uploaded = true;
 }
 
 void Model::unload()
 {
-	for (auto it = node_by_name.begin(); it != node_by_name.end(); it++)
+	std::vector<Node*> all_nodes;
+	if(root != nullptr)
 	{
-		for (size_t i = 0; i < it->second->meshes.size(); i++)
+		all_nodes = root->get_children_recursive();
+		all_nodes.push_back(root);
+	}
+
+	for(Node* n : all_nodes)
+	{
+		n->draw_list.clear();
+		for(Mesh& mesh : n->meshes)
 		{
-			it->second->meshes[i].unload();
+			if(mesh.drawable)
+			{
+				mesh.vao = 0;
+				mesh.material.unload();
+			}
 		}
 	}
+
+	for(const LayoutBuffers& buf : buffers)
+	{
+		glDeleteBuffers(1, &buf.ebo);
+		glDeleteBuffers(1, &buf.vbo);
+		glDeleteVertexArrays(1, &buf.vao);
+	}
+	buffers.clear();
+
+	glDeleteBuffers(1, &instance_vbo);
+	instance_vbo = 0;
+	instance_capacity = 0;
+
 	uploaded = false;
 }
 
+void Model::upload_instances(const std::vector<glm::mat4>& data)
+{
+	size_t size = data.size() * sizeof(glm::mat4);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+	if(size > instance_capacity)
+	{
+		instance_capacity = size;
+	}
+	// Orphan so we don't stall on draws still using the old contents
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)instance_capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)size, data.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void Model::get_gpu()
 {
 	gpu_users++;
@@ -464,55 +444,252 @@ void Model::free_gpu()
 	}
 }
 
-void Model::generic_load()
-{
-	const tinygltf::Scene scene = gltf.scenes[gltf.defaultScene];
-	// Load recursively all the nodes
-	Node* scene_node = new Node();
-	scene_node->name = scene.name;
-	scene_node->sub_transform = glm::dmat4(1.0);
+// Key is (gltf texture index, srgb), so meshes sharing a texture share the image
+using EmbeddedImageMap = std::map<std::pair<int, bool>, int>;
 
-	for(int node : scene.nodes)
+static void cook_textures(const tinygltf::Model& model, const tinygltf::Material& gltf_mat,
+						  CookedModel& cooked, EmbeddedImageMap& embedded, CookedModel::Mesh& m)
+{
+	auto load_texture = [&](ModelTexture::TextureType type, int index) -> void
 	{
-		load_node(gltf, node, scene_node, this, true);
-	}
+		if(index < 0)
+		{
+			return;
+		}
+
+		const tinygltf::Texture& tex = model.textures[index];
+		const tinygltf::Image& img = model.images[tex.source];
+		CookedModel::Texture mtex;
+		mtex.type = type;
+		mtex.image = -1;
+
+		if(img.uri.empty())
+		{
+			mtex.is_asset = false;
+			bool srgb = type == ModelTexture::BASE_COLOR;
+
+			auto it = embedded.find(std::make_pair(index, srgb));
+			if(it != embedded.end())
+			{
+				mtex.image = it->second;
+			}
+			else
+			{
+				CookedModel::Image cimg;
+				cimg.width = img.width;
+				cimg.height = img.height;
+				cimg.bits = img.bits;
+				cimg.component = img.component;
+				cimg.wrap_s = GL_REPEAT;
+				cimg.wrap_t = GL_REPEAT;
+				cimg.min_filter = GL_LINEAR;
+				cimg.mag_filter = GL_LINEAR;
+				if(tex.sampler >= 0)
+				{
+					const tinygltf::Sampler &samp = model.samplers[tex.sampler];
+					cimg.wrap_s = samp.wrapS;
+					cimg.wrap_t = samp.wrapT;
+					cimg.min_filter = samp.minFilter;
+					cimg.mag_filter = samp.magFilter;
+				}
+				cimg.srgb = srgb;
+				cimg.pixels = img.image;
+
+				mtex.image = (int)cooked.images.size();
+				embedded[std::make_pair(index, srgb)] = mtex.image;
+				cooked.images.push_back(std::move(cimg));
+			}
+		}
+		else
+		{
+			mtex.is_asset = true;
+			// TODO: Solve the path
+			mtex.uri = img.uri;
+		}
 
-	root = scene_node;
+		m.textures.push_back(std::move(mtex));
+	};
 
+	// Load model textures (they must be embedded) and PBR stuff
+	load_texture(ModelTexture::BASE_COLOR, gltf_mat.pbrMetallicRoughness.baseColorTexture.index);
+	load_texture(ModelTexture::METALLIC_ROUGHNESS, gltf_mat.pbrMetallicRoughness.metallicRoughnessTexture.index);
+	load_texture(ModelTexture::EMISSIVE, gltf_mat.emissiveTexture.index);
+	load_texture(ModelTexture::NORMAL_MAP, gltf_mat.normalTexture.index);
+	load_texture(ModelTexture::AMBIENT_OCCLUSION, gltf_mat.occlusionTexture.index);
 }
 
-Model::Model(const tinygltf::Model& model, ASSET_INFO) : Asset(ASSET_INFO_P)
+// Builds the final interleaved vertex buffer, index buffer and bounds of a primitive
+// Drawables are interleaved for their material, non-drawables only keep positions (for colliders)
+static void cook_primitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const MeshConfig& cfg,
+						   const std::string& node_name, CookedModel::Mesh& m)
 {
-	this->gltf = model;
-	gpu_users = 0;
-	uploaded = false;
+	// TODO: Support non-indexed meshes
+	logger->check(primitive.indices >= 0, "Cannot load a non indexed mesh. Make sure you enable it in the 3d export");
 
-	generic_load();
-}
+	auto get_accessor = [&model, &primitive](const std::string& name) -> const tinygltf::Accessor*
+	{
+		auto it = primitive.attributes.find(name);
+		if(it == primitive.attributes.end())
+		{
+			return nullptr;
+		}
+		return &model.accessors[it->second];
+	};
 
+	const tinygltf::Accessor* pos_acc = get_accessor("POSITION");
+	logger->check(pos_acc != nullptr, "Mesh in '{}' doesn't have positions", node_name);
+	size_t vert_count = pos_acc->count;
 
-Model::Model(tinygltf::Model&& model, ASSET_INFO) : Asset(ASSET_INFO_P)
-{
-	this->gltf = std::move(model);
-	gpu_users = 0;
-	uploaded = false;
+	if(pos_acc->minValues.size() >= 3 && pos_acc->maxValues.size() >= 3)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			m.min_bound[i] = pos_acc->minValues[i];
+			m.max_bound[i] = pos_acc->maxValues[i];
+		}
+	}
+	else
+	{
+		logger->warn("Mesh in '{}' doesn't have max/min values, computing them", node_name);
+		m.min_bound = glm::vec3(HUGE_VALF);
+		m.max_bound = glm::vec3(-HUGE_VALF);
+		for(size_t i = 0; i < vert_count; i++)
+		{
+			glm::vec3 pos = get_vec3_from_accessor(model, *pos_acc, i);
+			m.min_bound = glm::min(m.min_bound, pos);
+			m.max_bound = glm::max(m.max_bound, pos);
+		}
+	}
 
-	generic_load();
-}
+	// (name, float count) in the order given by MeshConfig
+	std::vector<std::pair<std::string, size_t>> order;
+	if(m.drawable)
+	{
+		if(cfg.has_pos)
+			order.emplace_back("POSITION", 3);
+		if (cfg.has_nrm)
+			order.emplace_back("NORMAL", 3);
+		if (cfg.has_uv0)
+			order.emplace_back("TEXCOORD_0", 2);
+		if (cfg.has_uv1)
+			order.emplace_back("TEXCOORD_1", 2);
+		if (cfg.has_tgt)
+			order.emplace_back("TANGENT", 6);
+		if (cfg.has_cl3)
+			order.emplace_back("COLOR_0", 3);
+		if (cfg.has_cl4)
+			order.emplace_back("COLOR_0", 4);
+		if (cfg.has_tgt)
+		{
+			logger->check(cfg.has_nrm, "Cannot have a mesh with tangents and no normal");
+			logger->check(get_accessor("NORMAL"), "Cannot have null normals in a material with tangents");
 
-Model::Model(ASSET_INFO) : Asset(ASSET_INFO_P)
-{
-	gpu_users = 0;
-	uploaded = false;
+			if (get_accessor("TANGENT") == nullptr)
+			{
+				logger->warn("Could not find tangents on the model. Note for blender users:");
+				logger->warn(" - Try triangulating your mesh, there's a bug in the gltf exporter which");
+				logger->warn("   prevents tangents from being generated on non-triangulated meshes.");
+			}
+		}
+	}
+	else
+	{
+		order.emplace_back("POSITION", 3);
+	}
+	// TODO: Implement joints and weights
+
+	m.stride = 0;
+	for(const auto& attr : order)
+	{
+		m.stride += attr.second;
+	}
 
+	// Missing attributes are left as zeroes
+	m.vertices.assign(m.stride * vert_count, 0.0f);
+
+	size_t off = 0;
+	for(const auto& [name, count] : order)
+	{
+		const tinygltf::Accessor* acc = get_accessor(name);
+		if(acc == nullptr)
+		{
+			logger->warn("Mesh in '{}' doesn't have required attribute '{}'", node_name, name);
+		}
+		else if(acc->count != vert_count)
+		{
+			logger->warn("Attribute '{}' of mesh in '{}' has a wrong vertex count", name, node_name);
+		}
+		else if(name == "TANGENT")
+		{
+			// First the tangent, then the bitangent which we calculate here
+			std::vector<float> tangents(vert_count * 4, 0.0f);
+			std::vector<float> normals(vert_count * 3, 0.0f);
+			interleave_accessor(model, *acc, tangents.data(), 4, 4);
+			interleave_accessor(model, *get_accessor("NORMAL"), normals.data(), 3, 3);
+
+			for(size_t i = 0; i < vert_count; i++)
+			{
+				glm::vec3 tangent = glm::vec3(tangents[i * 4 + 0], tangents[i * 4 + 1], tangents[i * 4 + 2]);
+				glm::vec3 normal = glm::vec3(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]);
+				glm::vec3 bitangent = glm::cross(normal, tangent) * tangents[i * 4 + 3];
+
+				float* dst = &m.vertices[i * m.stride + off];
+				dst[0] = tangent.x; dst[1] = tangent.y; dst[2] = tangent.z;
+				dst[3] = bitangent.x; dst[4] = bitangent.y; dst[5] = bitangent.z;
+			}
+		}
+		else
+		{
+			interleave_accessor(model, *acc, &m.vertices[off], m.stride, count);
+
+			if(name == "TEXCOORD_0" && cfg.flip_uv)
+			{
+				for(size_t i = 0; i < vert_count; i++)
+				{
+					float& v = m.vertices[i * m.stride + off + 1];
+					v = -v;
+				}
+			}
+		}
+
+		off += count;
+	}
+
+	// Byte indices are widened, as they are poorly supported by drivers
+	const tinygltf::Accessor& index_acc = model.accessors[primitive.indices];
+	m.index_count = index_acc.count;
+	if(index_acc.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)
+	{
+		m.index_type = GL_UNSIGNED_INT;
+		m.indices.resize(index_acc.count * sizeof(uint32_t));
+		uint32_t* dst = (uint32_t*)m.indices.data();
+		for(size_t i = 0; i < index_acc.count; i++)
+		{
+			dst[i] = (uint32_t)get_index_from_accessor(model, index_acc, i);
+		}
+	}
+	else
+	{
+		m.index_type = GL_UNSIGNED_SHORT;
+		m.indices.resize(index_acc.count * sizeof(uint16_t));
+		uint16_t* dst = (uint16_t*)m.indices.data();
+		for(size_t i = 0; i < index_acc.count; i++)
+		{
+			dst[i] = (uint16_t)get_index_from_accessor(model, index_acc, i);
+		}
+	}
 }
 
-void Model::load_node(const tinygltf::Model &model, int node_idx, Node *parent, Model* rmodel, bool parent_draw)
+static void cook_node(const tinygltf::Model& model, int node_idx, int parent, bool parent_draw,
+					  CookedModel& cooked, EmbeddedImageMap& embedded)
 {
-	const tinygltf::Node node = model.nodes[node_idx];
+	const tinygltf::Node& node = model.nodes[node_idx];
 
-	Node* n_node = new Node();
-	n_node->name = node.name;
+	int our_idx = (int)cooked.nodes.size();
+	cooked.nodes.emplace_back();
+	CookedModel::Node& n = cooked.nodes.back();
+	n.name = node.name;
+	n.parent = parent;
 
 	if(node.extras.IsObject())
 	{
@@ -525,7 +702,7 @@ void Model::load_node(const tinygltf::Model &model, int node_idx, Node *parent,
 			}
 			else
 			{
-				n_node->properties[key] = sub.Get<std::string>();
+				n.properties.emplace_back(key, sub.Get<std::string>());
 			}
 		}
 	}
@@ -534,7 +711,7 @@ void Model::load_node(const tinygltf::Model &model, int node_idx, Node *parent,
 	{
 		for(int i = 0; i < 16; i++)
 		{
-			n_node->sub_transform[i % 4][i / 4] = node.matrix[i];
+			n.sub_transform[i % 4][i / 4] = node.matrix[i];
 		}
 	}
 	else
@@ -562,20 +739,16 @@ void Model::load_node(const tinygltf::Model &model, int node_idx, Node *parent,
 			}
 		}
 
-		n_node->sub_transform =
+		n.sub_transform =
 				glm::translate(glm::dmat4(1.0), trans) *
 				glm::toMat4(rot) *
 				glm::scale(glm::dmat4(1.0), scale);
 
 	}
 
-
-	node_by_name[n_node->name] = n_node;
-
-
 	bool drawable = parent_draw;
-	if (n_node->name.rfind(Model::COLLIDER_PREFIX, 0) == 0
-		|| n_node->name.rfind(Model::MARK_PREFIX, 0) == 0)
+	if (n.name.rfind(Model::COLLIDER_PREFIX, 0) == 0
+		|| n.name.rfind(Model::MARK_PREFIX, 0) == 0)
 	{
 		drawable = false;
 	}
@@ -585,186 +758,217 @@ void Model::load_node(const tinygltf::Model &model, int node_idx, Node *parent,
 		for(size_t i = 0; i < model.meshes[node.mesh].primitives.size(); i++)
 		{
 			const auto& primitive = model.meshes[node.mesh].primitives[i];
-			load_mesh(model, primitive, rmodel, n_node, drawable, node.mesh, i);
-		}
-	}
 
-	// Generate bounds
-	n_node->min_bound = glm::vec3(HUGE_VALF);
-	n_node->max_bound = glm::vec3(-HUGE_VALF);
-	for(const Mesh& m : n_node->meshes)
-	{
-		// As both are in same coordiante space, two checks are enough
-		n_node->min_bound = glm::min(n_node->min_bound, m.min_bound);
-		n_node->max_bound = glm::max(n_node->max_bound, m.max_bound);
-	}
+			tinygltf::Material gltf_mat = tinygltf::Material();
+			// We use PBR by default
+			gltf_mat.name = "core:mat_pbr.toml";
+			if(primitive.material >= 0)
+			{
+				gltf_mat = model.materials[primitive.material];
+			}
+
+			std::string mat_name = gltf_mat.name;
+			size_t pos = mat_name.find_last_of('.');
 
+			AssetPointer mat_ptr;
+			if (pos < mat_name.size() && mat_name.substr(pos) == ".toml")
+			{
+				mat_ptr = AssetPointer(mat_name);
+			}
+			else
+			{
+				// PBR material
+				mat_ptr = AssetPointer("core:mat_pbr.toml");
+			}
 
+			AssetHandle<Material> mat = AssetHandle<Material>(mat_ptr);
 
-	if(parent != nullptr)
-	{
-		parent->children.push_back(n_node);
-	}
+			CookedModel::Mesh m;
+			m.material = mat_ptr.to_path();
+			m.layout = mat->cfg.get_layout();
+			m.drawable = drawable;
+			m.mesh_idx = node.mesh;
+			m.prim_idx = (int)i;
 
-	for(int child : node.children)
-	{
-		load_node(model, child, n_node, rmodel, drawable);
+			cook_textures(model, gltf_mat, cooked, embedded, m);
+			cook_primitive(model, primitive, mat->cfg, n.name, m);
+
+			// n may be invalidated by the recursion, but not here
+			cooked.nodes[our_idx].meshes.push_back(std::move(m));
+		}
 	}
 
-	auto all_children = n_node->get_children_recursive();
-	for(Node* n : all_children)
+	for(int child : node.children)
 	{
-		n_node->child_names[n->name] = n;
+		cook_node(model, child, our_idx, drawable, cooked, embedded);
 	}
 }
 
-Model::~Model()
+CookedModel Model::cook(const tinygltf::Model& gltf)
 {
-}
+	CookedModel cooked;
+	cooked.source_hash = 0;
 
-void Model::load_mesh(const tinygltf::Model& model, const tinygltf::Primitive &primitive, Model* rmodel, Node *node,
-					  bool drawable, int mesh_idx, int prim_idx)
-{
-	AssetPointer mat_ptr;
+	const tinygltf::Scene& scene = gltf.scenes[gltf.defaultScene < 0 ? 0 : gltf.defaultScene];
+	cooked.root_name = scene.name;
 
-	tinygltf::Material gltf_mat = tinygltf::Material();
-	// We use PBR by default
-	gltf_mat.name = "core:mat_pbr.toml";
-	if(primitive.material >= 0)
-	{
-		gltf_mat = model.materials[primitive.material];
-	}
-
-
-	std::string mat_name = gltf_mat.name;
-	size_t pos = mat_name.find_last_of('.');
-
-	if (pos < mat_name.size() && mat_name.substr(pos) == ".toml")
-	{
-		mat_ptr = AssetPointer(mat_name);
-	}
-	else
+	EmbeddedImageMap embedded;
+	for(int node : scene.nodes)
 	{
-		// PBR material
-		mat_ptr = AssetPointer("core:mat_pbr.toml");
+		cook_node(gltf, node, -1, true, cooked, embedded);
 	}
 
+	return cooked;
+}
 
-	AssetHandle<Material> mat = AssetHandle<Material>(mat_ptr);
-
-	node->meshes.emplace_back(std::move(mat), rmodel);
-	Mesh* m = &node->meshes[node->meshes.size() - 1];
-	m->drawable = drawable;
-
-	m->prim_idx = prim_idx;
-	m->mesh_idx = mesh_idx;
-
-
-	auto load_texture = [&model, &m](ModelTexture::TextureType type, int index) -> void
+bool Model::is_cooked_valid(const CookedModel& cooked)
+{
+	for(const CookedModel::Node& n : cooked.nodes)
 	{
-		if(index >= 0)
+		for(const CookedModel::Mesh& m : n.meshes)
 		{
-			const tinygltf::Texture& tex = model.textures[index];
-			const tinygltf::Image& img = model.images[tex.source];
-			ModelTexture mtex;
-			mtex.first = type;
-
-			if(img.uri.empty())
+			if(!m.drawable)
 			{
-				mtex.is_asset = false;
-				GLuint wrapS = GL_REPEAT, wrapT = GL_REPEAT, min_filter = GL_LINEAR, mag_filter = GL_LINEAR;
-				if(tex.sampler >= 0)
-				{
-					const tinygltf::Sampler &samp = model.samplers[tex.sampler];
-					wrapS = samp.wrapS;
-					wrapT = samp.wrapT;
-					min_filter = samp.minFilter;
-					mag_filter = samp.magFilter;
-				}
-
-				mtex.second_ptr = std::make_shared<Image>(img.image.data(), img.width, img.height, img.bits, img.component,
-											mag_filter, min_filter, wrapS, wrapT,
-											type == ModelTexture::BASE_COLOR, GENERATED_ASSET_INFO);
+				continue;
 			}
-			else
+
+			AssetHandle<Material> mat = AssetHandle<Material>(AssetPointer(m.material));
+			if(mat->cfg.get_layout() != m.layout)
 			{
-				mtex.is_asset = true;
-				// TODO: Solve the path
-				mtex.second = AssetHandle<Image>(img.uri);
+				return false;
 			}
-
-			m->textures.emplace_back(std::move(mtex));
 		}
-	};
-	// Load model textures (they must be embedded) and PBR stuff
-	load_texture(ModelTexture::BASE_COLOR, gltf_mat.pbrMetallicRoughness.baseColorTexture.index);
-	load_texture(ModelTexture::METALLIC_ROUGHNESS, gltf_mat.pbrMetallicRoughness.metallicRoughnessTexture.index);
-	load_texture(ModelTexture::EMISSIVE, gltf_mat.emissiveTexture.index);
-	load_texture(ModelTexture::NORMAL_MAP, gltf_mat.normalTexture.index);
-	load_texture(ModelTexture::AMBIENT_OCCLUSION, gltf_mat.occlusionTexture.index);
-
-
-
-	// Load the mesh itself, depending on the mesh configuration and the material
-	// TODO: Support non-indexed meshes
-	logger->check(primitive.indices >= 0, "Cannot load a non indexed mesh. Make sure you enable it in the 3d export");
-
-	const tinygltf::Accessor& index_accessor = model.accessors[primitive.indices];
-	const tinygltf::BufferView& index_bview = model.bufferViews[index_accessor.bufferView];
+	}
 
+	return true;
+}
 
-	if(drawable)
+void Model::build(CookedModel&& cooked)
+{
+	std::vector<std::shared_ptr<Image>> images;
+	images.reserve(cooked.images.size());
+	for(CookedModel::Image& img : cooked.images)
 	{
+		images.push_back(std::make_shared<Image>(img.pixels.data(), img.width, img.height, img.bits, img.component,
+								img.mag_filter, img.min_filter, img.wrap_s, img.wrap_t,
+								img.srgb, GENERATED_ASSET_INFO));
+		// Already in the GPU
+		img.pixels = std::vector<uint8_t>();
 	}
 
-	std::vector<std::string> needed;
-	if(m->material->cfg.has_pos){ needed.emplace_back("POSITION"); }
-	if( m->is_drawable())
-	{
-		if (m->material->cfg.has_nrm)
-			needed.emplace_back("NORMAL");
-		if (m->material->cfg.has_tgt)
-			needed.emplace_back("TANGENT");
-		if (m->material->cfg.has_uv0)
-			needed.emplace_back("TEXCOORD_0");
-		if (m->material->cfg.has_uv1)
-			needed.emplace_back("TEXCOORD_1");
-		if (m->material->cfg.has_cl3)
-			needed.emplace_back("COLOR_0");
-		if (m->material->cfg.has_cl4)
-			needed.emplace_back("COLOR_0");
-	}
-	// TODO: Implement joints and weights
+	root = new Node();
+	root->name = cooked.root_name;
+	root->sub_transform = glm::dmat4(1.0);
 
-	for(const std::string& need : needed)
+	std::vector<Node*> nodes;
+	nodes.reserve(cooked.nodes.size());
+	for(CookedModel::Node& cn : cooked.nodes)
 	{
-		auto it = primitive.attributes.find(need);
-		if(it == primitive.attributes.end())
+		Node* n_node = new Node();
+		n_node->name = cn.name;
+		n_node->sub_transform = cn.sub_transform;
+		for(auto& prop : cn.properties)
 		{
-			logger->warn("Mesh in '{}' doesn't have required attribute '{}'", node->name, need);
+			n_node->properties[prop.first] = std::move(prop.second);
 		}
-		else
+
+		n_node->meshes.reserve(cn.meshes.size());
+		for(CookedModel::Mesh& cm : cn.meshes)
 		{
-			if(it->first == "POSITION")
+			AssetHandle<Material> mat = AssetHandle<Material>(AssetPointer(cm.material));
+			n_node->meshes.emplace_back(std::move(mat), this);
+			Mesh* m = &n_node->meshes.back();
+			m->drawable = cm.drawable;
+			m->mesh_idx = cm.mesh_idx;
+			m->prim_idx = cm.prim_idx;
+			m->min_bound = cm.min_bound;
+			m->max_bound = cm.max_bound;
+			m->stride = cm.stride;
+			m->vertex_data = std::move(cm.vertices);
+			m->index_type = cm.index_type;
+			m->index_count = (GLsizei)cm.index_count;
+			m->index_data = std::move(cm.indices);
+
+			for(CookedModel::Texture& ct : cm.textures)
 			{
-				if(model.accessors[it->second].minValues.empty())
+				ModelTexture mtex;
+				mtex.first = (ModelTexture::TextureType)ct.type;
+				mtex.is_asset = ct.is_asset;
+				if(ct.is_asset)
 				{
-					logger->warn("Mesh in '{}' doesn't have max/min values, may cause issues", node->name);
+					mtex.second = AssetHandle<Image>(ct.uri);
 				}
 				else
 				{
-					for (int i = 0; i < 3; i++)
-					{
-						m->min_bound[i] = model.accessors[it->second].minValues[i];
-						m->max_bound[i] = model.accessors[it->second].maxValues[i];
-					}
+					mtex.second_ptr = images[ct.image];
 				}
+				m->textures.emplace_back(std::move(mtex));
 			}
 		}
+
+		// Generate bounds
+		n_node->min_bound = glm::vec3(HUGE_VALF);
+		n_node->max_bound = glm::vec3(-HUGE_VALF);
+		for(const Mesh& m : n_node->meshes)
+		{
+			// As both are in same coordiante space, two checks are enough
+			n_node->min_bound = glm::min(n_node->min_bound, m.min_bound);
+			n_node->max_bound = glm::max(n_node->max_bound, m.max_bound);
+		}
+
+		node_by_name[n_node->name] = n_node;
+
+		// Parents always go before their children
+		Node* parent = cn.parent < 0 ? root : nodes[cn.parent];
+		parent->children.push_back(n_node);
+
+		nodes.push_back(n_node);
+	}
+
+	// Children are complete now
+	for(Node* n_node : nodes)
+	{
+		auto all_children = n_node->get_children_recursive();
+		for(Node* n : all_children)
+		{
+			n_node->child_names[n->name] = n;
+		}
 	}
+}
+
+Model::Model(CookedModel&& cooked, ASSET_INFO) : Asset(ASSET_INFO_P)
+{
+	gpu_users = 0;
+	uploaded = false;
+	instance_vbo = 0;
+	instance_capacity = 0;
+
+	build(std::move(cooked));
+}
+
+Model::Model(const tinygltf::Model& model, ASSET_INFO) : Asset(ASSET_INFO_P)
+{
+	gpu_users = 0;
+	uploaded = false;
+	instance_vbo = 0;
+	instance_capacity = 0;
+
+	build(cook(model));
+}
+
+Model::Model(ASSET_INFO) : Asset(ASSET_INFO_P)
+{
+	gpu_users = 0;
+	uploaded = false;
+	instance_vbo = 0;
+	instance_capacity = 0;
+	root = nullptr;
 
 }
 
+Model::~Model()
+{
+}
 
 glm::dmat4 Node::get_tform(const Node* n) const
 {
@@ -813,21 +1017,44 @@ std::vector<const Node*> Node::get_path(const Node* to, const Node* from) const
 Model* load_model(ASSET_INFO, const cpptoml::table& cfg)
 {
 	std::string extension = name.substr(name.find_last_of('.'));
+	if(extension != ".glb" && extension != ".gltf")
+	{
+		logger->error("Model format {} not supported: {}:{}", extension, pkg, name);
+		return nullptr;
+	}
+
+	ModelConfig config;
+	if(cfg.get_table_qualified("model"))
+	{
+		::deserialize(config, *cfg.get_table_qualified("model"));
+	}
+
+	std::vector<uint8_t> source = AssetManager::load_binary_raw(path);
+	uint64_t hash = CookedModel::hash_source(source, path);
+	std::string cache_path = CookedModel::get_cache_path(pkg, name);
+
+	// The fast path, no need to even parse the glTF
+	if(config.cache && !config.keep_gltf)
+	{
+		CookedModel cooked;
+		if(cooked.load(cache_path, hash) && Model::is_cooked_valid(cooked))
+		{
+			return new Model(std::move(cooked), ASSET_INFO_P);
+		}
+	}
+
 	tinygltf::Model model;
 	tinygltf::TinyGLTF loader;
 	std::string err, wrn;
+	std::string base_dir = path.substr(0, path.find_last_of('/') + 1);
 
 	if(extension == ".glb")
 	{
-		loader.LoadBinaryFromFile(&model, &err, &wrn, path);
-	}
-	else if(extension == ".gltf")
-	{
-		loader.LoadASCIIFromFile(&model, &err, &wrn, path);
+		loader.LoadBinaryFromMemory(&model, &err, &wrn, source.data(), (unsigned int)source.size(), base_dir);
 	}
 	else
 	{
-		logger->error("Model format {} not supported: {}:{}", extension, pkg, name);
+		loader.LoadASCIIFromString(&model, &err, &wrn, (const char*)source.data(), (unsigned int)source.size(), base_dir);
 	}
 
 	if(!err.empty())
@@ -835,16 +1062,26 @@ Model* load_model(ASSET_INFO, const cpptoml::table& cfg)
 		logger->error("Error loading model {}:{}\n{}", pkg, name, err);
 		return nullptr;
 	}
-	else
+
+	if(!wrn.empty())
 	{
-		if(!wrn.empty())
-		{
-			logger->warn("Warning loading model {}:{}\n{}", pkg, name, wrn);
-		}
+		logger->warn("Warning loading model {}:{}\n{}", pkg, name, wrn);
+	}
 
+	CookedModel cooked = Model::cook(model);
+	cooked.source_hash = hash;
+	if(config.cache)
+	{
+		cooked.save(cache_path);
+	}
 
-		return new Model(std::move(model), ASSET_INFO_P);
+	Model* n_model = new Model(std::move(cooked), ASSET_INFO_P);
+	if(config.keep_gltf)
+	{
+		n_model->gltf = std::move(model);
 	}
+
+	return n_model;
 }
 
 
@@ -878,68 +1115,64 @@ GPUModelPointer::~GPUModelPointer()
 	}
 }
 
-void Node::draw_all_meshes(const CameraUniforms& uniforms, GLint did, glm::dmat4 model) const
+static bool same_textures(const std::vector<ModelTexture>& a, const std::vector<ModelTexture>& b)
 {
-	for (const Mesh& mesh : meshes)
+	if(a.size() != b.size())
 	{
-		if (mesh.is_drawable())
-		{
-			mesh.bind_uniforms(uniforms, model, did);
-			mesh.draw_command();
-		}
+		return false;
 	}
 
-}
-
-void Node::draw_all_meshes_shadow(const ShadowCamera& sh_cam, glm::dmat4 model) const
-{
-	for(const Mesh& mesh : meshes)
+	for(size_t i = 0; i < a.size(); i++)
 	{
-		if(mesh.is_drawable())
+		if(a[i].first != b[i].first || a[i].get_image() != b[i].get_image())
 		{
-			glm::dmat4 tform = sh_cam.tform * model;
-
-			// We can safely use data here as materials are loaded as long as we are
-			Shader* sh = mesh.material->shadow_shader;
-			sh->use();
-			sh->setMat4("tform", tform);
-
-			mesh.draw_command();
+			return false;
 		}
 	}
+
+	return true;
 }
 
-void Node::draw_all_meshes_override(const CameraUniforms& uniforms, const Material* mat, const MaterialOverride* mat_over,
-		GLint did, glm::dmat4 model) const
+void Node::draw_list_common(const CameraUniforms& uniforms, const Material* mat, const MaterialOverride* mat_over,
+		glm::dmat4 model, GLint did, bool increase_did) const
 {
-	for (const Mesh& mesh : meshes)
+	// The list is sorted, so we only set material state when it changes
+	const Material* last_mat = nullptr;
+	const MaterialOverride* last_over = nullptr;
+	const std::vector<ModelTexture>* last_textures = nullptr;
+	GLuint last_vao = 0;
+	int state_tex = 0;
+
+	for(const PreparedDraw& d : draw_list)
 	{
-		if (mesh.is_drawable())
+		const Material* dmat = mat ? mat : d.material;
+		const MaterialOverride* over = mat_over ? mat_over : &d.mesh->mat_override;
+
+		if(dmat != last_mat || over != last_over || !last_textures || !same_textures(*last_textures, d.mesh->textures))
 		{
-			const Material* def = mat;
-			if(mat == nullptr)
+			if(last_mat == nullptr || dmat->shader != last_mat->shader)
 			{
-				mat = mesh.material.get();
+				dmat->shader->use();
 			}
+			state_tex = dmat->set(d.mesh->textures, *over);
+			last_mat = dmat;
+			last_over = over;
+			last_textures = &d.mesh->textures;
+		}
 
-			mat->shader->use();
-			int gl_tex;
-			if(mat_over)
-			{
-				gl_tex = mat->set(mesh.textures, *mat_over);
-			}
-			else
-			{
-				gl_tex = mat->set(mesh.textures, mesh.mat_override);
-			}
-			mat->set_core(&gl_tex, uniforms, model, did);
-			mesh.draw_command();
+		int gl_tex = state_tex;
+		dmat->set_core(&gl_tex, uniforms, model * d.sub_transform, increase_did ? did + d.did_offset : did);
 
-			mat = def;
+		if(d.mesh->vao != last_vao)
+		{
+			glBindVertexArray(d.mesh->vao);
+			last_vao = d.mesh->vao;
 		}
+		d.mesh->draw_elements();
 	}
-}
 
+	glBindVertexArray(0);
+}
 
 void Node::draw(const CameraUniforms& uniforms, glm::dmat4 model, GLint did,
 				bool ignore_our_subtform, bool increase_did) const
@@ -954,17 +1187,7 @@ void Node::draw(const CameraUniforms& uniforms, glm::dmat4 model, GLint did,
 		n_model = model * sub_transform; //< Transformations apply in reverse
 	}
 
-	draw_all_meshes(uniforms, did, n_model);
-
-	for (Node* node : children)
-	{
-		if(increase_did)
-		{
-			// We increase the drawable id
-			did++;
-		}
-		node->draw(uniforms, n_model, did, false, increase_did);
-	}
+	draw_list_common(uniforms, nullptr, nullptr, n_model, did, increase_did);
 }
 
 void Node::draw_override(const CameraUniforms& uniforms, const Material* mat, glm::dmat4 model, GLint did,
@@ -980,19 +1203,7 @@ void Node::draw_override(const CameraUniforms& uniforms, const Material* mat, gl
 		n_model = model * sub_transform; //< Transformations apply in reverse
 	}
 
-	draw_all_meshes_override(uniforms, mat, mat_override, did, n_model);
-
-	for (Node* node : children)
-	{
-		if(increase_did)
-		{
-			// We increase the drawable id
-			did++;
-		}
-
-		node->draw_override(uniforms, mat, n_model, did, mat_override, false, increase_did);
-	}
-
+	draw_list_common(uniforms, mat, mat_override, n_model, did, increase_did);
 }
 
 
@@ -1008,12 +1219,164 @@ void Node::draw_shadow(const ShadowCamera& sh_cam, glm::dmat4 model, bool ignore
 		n_model = model * sub_transform;
 	}
 
-	draw_all_meshes_shadow(sh_cam, n_model);
+	const Shader* last_sh = nullptr;
+	GLuint last_vao = 0;
+	for(const PreparedDraw& d : draw_list)
+	{
+		// We can safely use data here as materials are loaded as long as we are
+		Shader* sh = d.material->shadow_shader;
+		if(sh != last_sh)
+		{
+			sh->use();
+			last_sh = sh;
+		}
+		sh->setMat4("tform", sh_cam.tform * n_model * d.sub_transform);
+
+		if(d.mesh->vao != last_vao)
+		{
+			glBindVertexArray(d.mesh->vao);
+			last_vao = d.mesh->vao;
+		}
+		d.mesh->draw_elements();
+	}
+
+	glBindVertexArray(0);
+}
+
+void Node::draw_instanced(const CameraUniforms& uniforms, const std::vector<glm::dmat4>& models, GLint did,
+						  bool ignore_our_subtform, const std::vector<glm::vec4>* params) const
+{
+	if(draw_list.empty() || models.empty())
+	{
+		return;
+	}
+
+	Model* model = draw_list[0].mesh->in_model;
+	size_t count = models.size();
+
+	// Transforms are combined in double precision so they are still precise near the camera,
+	// layout is [draw][instance] = (final_tform, deferred_tform)
+	std::vector<glm::mat4> data;
+	data.reserve(draw_list.size() * count * 2);
+	for(const PreparedDraw& d : draw_list)
+	{
+		for(size_t j = 0; j < count; j++)
+		{
+			glm::dmat4 n_model = (ignore_our_subtform ? models[j] : models[j] * sub_transform) * d.sub_transform;
+			data.emplace_back(uniforms.tform * n_model);
+			glm::mat4 deferred = uniforms.c_model * n_model;
+			// The transform is affine, so the shader never reads this row and it carries
+			// the parameters instead (zero if there are none)
+			glm::vec4 p = params && j < params->size() ? (*params)[j] : glm::vec4(0.0f);
+			deferred[0][3] = p.x; deferred[1][3] = p.y; deferred[2][3] = p.z; deferred[3][3] = p.w;
+			data.push_back(deferred);
+		}
+	}
+	model->upload_instances(data);
+
+	const Material* last_mat = nullptr;
+	const std::vector<ModelTexture>* last_textures = nullptr;
+	int state_tex = 0;
+
+	for(size_t i = 0; i < draw_list.size(); i++)
+	{
+		const PreparedDraw& d = draw_list[i];
+		const Material* dmat = d.material;
+		if(dmat != last_mat || !last_textures || !same_textures(*last_textures, d.mesh->textures))
+		{
+			if(last_mat == nullptr || dmat->shader != last_mat->shader)
+			{
+				dmat->shader->use();
+			}
+			state_tex = dmat->set(d.mesh->textures, d.mesh->mat_override);
+			last_mat = dmat;
+			last_textures = &d.mesh->textures;
+		}
+
+		glBindVertexArray(d.mesh->vao);
+
+		if(dmat->shader->get_uniform_location("instanced") >= 0)
+		{
+			// Still set the rest of the core uniforms (f_coef, ...), the matrices are ignored
+			int gl_tex = state_tex;
+			dmat->set_core(&gl_tex, uniforms, models[0], did);
+
+			glBindVertexBuffer(Model::INSTANCE_ATTRIB, model->get_instance_vbo(),
+							   (GLintptr)(i * count * Model::INSTANCE_STRIDE), Model::INSTANCE_STRIDE);
+			dmat->shader->setBool("instanced", true);
+			d.mesh->draw_elements((GLsizei)count);
+			dmat->shader->setBool("instanced", false);
+			glBindVertexBuffer(Model::INSTANCE_ATTRIB, model->get_instance_vbo(), 0, Model::INSTANCE_STRIDE);
+		}
+		else
+		{
+			for(const glm::dmat4& m : models)
+			{
+				int gl_tex = state_tex;
+				glm::dmat4 n_model = ignore_our_subtform ? m : m * sub_transform;
+				dmat->set_core(&gl_tex, uniforms, n_model * d.sub_transform, did);
+				d.mesh->draw_elements();
+			}
+		}
+	}
+
+	glBindVertexArray(0);
+}
 
-	for(Node* node : children)
+void Node::draw_shadow_instanced(const ShadowCamera& sh_cam, const std::vector<glm::dmat4>& models,
+								 bool ignore_our_subtform) const
+{
+	if(draw_list.empty() || models.empty())
 	{
-		node->draw_shadow(sh_cam, model, false);
+		return;
 	}
+
+	Model* model = draw_list[0].mesh->in_model;
+	size_t count = models.size();
+
+	// Same layout as draw_instanced, the shadow shader only uses the first matrix
+	std::vector<glm::mat4> data;
+	data.reserve(draw_list.size() * count * 2);
+	for(const PreparedDraw& d : draw_list)
+	{
+		for(const glm::dmat4& m : models)
+		{
+			glm::dmat4 n_model = (ignore_our_subtform ? m : m * sub_transform) * d.sub_transform;
+			data.emplace_back(sh_cam.tform * n_model);
+			data.emplace_back(1.0f);
+		}
+	}
+	model->upload_instances(data);
+
+	for(size_t i = 0; i < draw_list.size(); i++)
+	{
+		const PreparedDraw& d = draw_list[i];
+		Shader* sh = d.material->shadow_shader;
+		sh->use();
+		glBindVertexArray(d.mesh->vao);
+
+		if(sh->get_uniform_location("instanced") >= 0)
+		{
+			glBindVertexBuffer(Model::INSTANCE_ATTRIB, model->get_instance_vbo(),
+							   (GLintptr)(i * count * Model::INSTANCE_STRIDE), Model::INSTANCE_STRIDE);
+			sh->setBool("instanced", true);
+			d.mesh->draw_elements((GLsizei)count);
+			sh->setBool("instanced", false);
+			glBindVertexBuffer(Model::INSTANCE_ATTRIB, model->get_instance_vbo(), 0, Model::INSTANCE_STRIDE);
+		}
+		else
+		{
+			// Same as draw_shadow for each model
+			for(const glm::dmat4& m : models)
+			{
+				glm::dmat4 n_model = ignore_our_subtform ? m : m * sub_transform;
+				sh->setMat4("tform", sh_cam.tform * n_model * d.sub_transform);
+				d.mesh->draw_elements();
+			}
+		}
+	}
+
+	glBindVertexArray(0);
 }
 
 std::vector<Node*> Node::get_children_recursive() const
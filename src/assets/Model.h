@@ -12,6 +12,16 @@
 #include "Asset.h"
 
 class Model;
+struct CookedModel;
+
+struct ModelConfig
+{
+	// Write and use the cooked binary cache (see ModelCache.h)
+	bool cache = true;
+	// Keep the tinygltf::Model in memory after loading, only needed if you want to
+	// access the raw glTF data, colliders don't need it
+	bool keep_gltf = false;
+};
 
 class Mesh
 {
@@ -20,8 +30,20 @@ class Mesh
 
 private:
 
-	GLuint vao, ebo;
-	std::vector<GLuint> vbos;
+	// Owned by the Model, meshes with the same layout share it
+	GLuint vao;
+	// Into the shared buffers, in bytes and vertices
+	size_t index_offset;
+	GLint base_vertex;
+
+	// Cooked geometry, kept in RAM for fast uploading. Drawables are interleaved for
+	// the material, non-drawables only have positions
+	std::vector<float> vertex_data;
+	std::vector<uint8_t> index_data;
+	// In floats
+	size_t stride;
+	GLenum index_type;
+	GLsizei index_count;
 
 	// It's only loaded while we are uploaded
 	AssetHandle<Material> material;
@@ -38,7 +60,8 @@ public:
 	glm::vec3 min_bound;
 	glm::vec3 max_bound;
 	
-	std::vector<glm::vec3> get_verts();
+	// Triangle soup of positions, as used by colliders
+	std::vector<glm::vec3> get_verts() const;
 	std::unordered_set<std::string> has_attributes;
 	int mesh_idx;
 	int prim_idx;
@@ -48,26 +71,41 @@ public:
 	// Non-drawable stuff gets the aditional vertex positions loaded
 	bool is_drawable() const;
 
-	void upload();
-	void unload();
-
+	const Material* get_material() const { return material.get(); }
 
 	// Binds core uniforms and material uniforms
 	void bind_uniforms(const CameraUniforms& uniforms, glm::dmat4 model, GLint drawable_id) const;
 
 	// Only issues the draw command, does absolutely nothing else
 	void draw_command() const;
+	// Same as draw_command but doesn't bind the VAO, it must be already bound
+	void draw_elements(GLsizei instances = 1) const;
 
 	// We take ownership of the handle
 	Mesh(AssetHandle<Material>&& mat, Model* rmodel) : material(std::move(mat))
 	{
 		in_model = rmodel;
 		vao = 0;
-		ebo = 0;
+		index_offset = 0;
+		base_vertex = 0;
+		stride = 0;
+		index_type = GL_UNSIGNED_SHORT;
+		index_count = 0;
 	}
 
 };
 
+// A mesh ready to be drawn, with everything resolved so drawing requires no lookups
+struct PreparedDraw
+{
+	const Mesh* mesh;
+	const Material* material;
+	// Relative to the node owning the list (its own sub_transform is not included)
+	glm::dmat4 sub_transform;
+	// Added to the drawable id if increase_did is used
+	GLint did_offset;
+};
+
 struct Node
 {
 	std::string name;
@@ -83,6 +121,10 @@ struct Node
 	glm::vec3 min_bound;
 	glm::vec3 max_bound;
 
+	// All drawable meshes of us and our children, sorted by shader and material
+	// to minimize state changes. Only valid while the model is uploaded
+	std::vector<PreparedDraw> draw_list;
+
 	std::vector<const Mesh*> get_all_meshes_recursive(bool include_ours = true) const;
 
 	std::vector<Node*> get_children_recursive() const;
@@ -96,10 +138,8 @@ struct Node
 	// n must be a children / ourselves
 	std::pair<glm::dvec3, glm::dvec3> get_bounds(const Node* n) const;
 
-	void draw_all_meshes(const CameraUniforms& uniforms, GLint drawable_id, glm::dmat4 model) const;
-	void draw_all_meshes_shadow(const ShadowCamera& sh_cam, glm::dmat4 model) const;
-	void draw_all_meshes_override(const CameraUniforms& uniforms, const Material* mat, const MaterialOverride* mat_override,
-		GLint drawable_id, glm::dmat4 model) const;
+	void draw_list_common(const CameraUniforms& uniforms, const Material* mat, const MaterialOverride* mat_over,
+		glm::dmat4 model, GLint drawable_id, bool increase_did) const;
 
 	// Draws all meshes, and call sthe same on all children,
 	// accumulating sub transforms
@@ -115,6 +155,17 @@ struct Node
 	// If mat is null then default materials are used, but the material override is applied
 	void draw_override(const CameraUniforms& uniforms, const Material* mat, glm::dmat4 model, GLint drawable_id,
 		const MaterialOverride* mat_over, bool ignore_our_subtform, bool increase_did = false) const;
+
+	// Draws many copies of ourselves in a single draw call per mesh, using the per-instance
+	// transform buffer of the model. All instances share the drawable id.
+	// Materials whose shader doesn't have the "instanced" uniform are drawn one by one
+	// If given, params (one per instance) are passed in the unused last row of inst_deferred_tform,
+	// pbr.vs forwards them to the fragment shader as vInstParams
+	void draw_instanced(const CameraUniforms& uniforms, const std::vector<glm::dmat4>& models, GLint drawable_id,
+		bool ignore_our_subtform, const std::vector<glm::vec4>* params = nullptr) const;
+
+	void draw_shadow_instanced(const ShadowCamera& sh_cam, const std::vector<glm::dmat4>& models,
+		bool ignore_our_subtform = false) const;
 };
 
 // An empty mesh is a node, it contains only a transform
@@ -129,22 +180,40 @@ private:
 
 	bool uploaded;
 
+	// Meshes with the same vertex layout share buffers, so consecutive
+	// draws don't need to bind anything
+	struct LayoutBuffers
+	{
+		uint32_t layout;
+		GLuint vao, vbo, ebo;
+	};
+	std::vector<LayoutBuffers> buffers;
 
+	// Per-instance transforms used by Node::draw_instanced, its bound to every VAO
+	GLuint instance_vbo;
+	size_t instance_capacity;
 
 	void upload();
 	void unload();
 
-	void load_node(const tinygltf::Model& model, int node, Node* parent, Model* rmodel, bool parent_draw);
-	void load_mesh(const tinygltf::Model& model, const tinygltf::Primitive& primitive, Model* rmodel, Node* node,
-				bool drawable, int mesh_idx, int prim_idx);
-
-	void generic_load();
+	void build(CookedModel&& cooked);
 public:
 	Node* root;
 
-	// Here lives all the data which needs to be uploaded to the GPU
+	// Only kept if the model has keep_gltf = true, all data needed for drawing
+	// and colliders lives in the meshes
 	tinygltf::Model gltf;
 
+	// Interleaves everything for the materials the glTF references
+	static CookedModel cook(const tinygltf::Model& gltf);
+	// Checks that the materials still have the layout the vertices were cooked for
+	static bool is_cooked_valid(const CookedModel& cooked);
+
+	// Per-instance attributes go in locations 8 to 15 (two mat4, final_tform and deferred_tform)
+	// so they don't collide with any vertex layout
+	static constexpr GLuint INSTANCE_ATTRIB = 8;
+	static constexpr GLsizei INSTANCE_STRIDE = sizeof(glm::mat4) * 2;
+
 	static constexpr const char* COLLIDER_PREFIX = "col_";
 	static constexpr const char* MARK_PREFIX = "m_";
 
@@ -153,19 +222,40 @@ public:
 	void get_gpu();
 	void free_gpu();
 
+	// Orphans and fills the instance buffer, data is INSTANCE_STRIDE bytes per instance
+	void upload_instances(const std::vector<glm::mat4>& data);
+	GLuint get_instance_vbo() const { return instance_vbo; }
+
 
 
 	// For creating from code
 	Model(ASSET_INFO);
-	// Moves the model
-	Model(tinygltf::Model&& model, ASSET_INFO);
-	// Copies the model, slightly less efficient, used for generative geometry
+	Model(CookedModel&& cooked, ASSET_INFO);
+	// Cooks the model, used for generative geometry. The glTF is not kept
 	Model(const tinygltf::Model& model, ASSET_INFO);
 	~Model();
 };
 
 Model* load_model(const std::string& path, const std::string& name, const std::string& pkg, const cpptoml::table& cfg);
 
+template<>
+class GenericSerializer<ModelConfig>
+{
+public:
+
+	static void serialize(const ModelConfig& what, cpptoml::table& target)
+	{
+		target.insert("cache", what.cache);
+		target.insert("keep_gltf", what.keep_gltf);
+	}
+
+	static void deserialize(ModelConfig& to, const cpptoml::table& from)
+	{
+		SAFE_TOML_GET_OR(to.cache, "cache", bool, true);
+		SAFE_TOML_GET_OR(to.keep_gltf, "keep_gltf", bool, false);
+	}
+};
+
 // As models CAN BE pretty heavy on the GPU memory there is 
 // code to allow you to upload and unload them using the
 // GPUModelPointer, which is basically a RAII over the 
@@ -0,0 +1,378 @@
+#include "ModelCache.h"
+#include "AssetManager.h"
+#include <Holmgard.h>
+#include <util/Logger.h>
+#include <util/HashUtil.h>
+#include <tiny_gltf/document.h>
+#include <fstream>
+#include <cstring>
+#include <type_traits>
+
+static constexpr char MAGIC[4] = {'H', 'M', 'D', 'L'};
+
+// Everything is written in native endianness, caches are not meant to be shared
+// between machines anyway
+struct CacheWriter
+{
+	std::vector<uint8_t> out;
+
+	void write(const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	template<typename T>
+	void pod(const T& v)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		write(&v, sizeof(T));
+	}
+
+	void str(const std::string& s)
+	{
+		pod((uint32_t)s.size());
+		write(s.data(), s.size());
+	}
+
+	template<typename T>
+	void vec(const std::vector<T>& v)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		pod((uint64_t)v.size());
+		write(v.data(), v.size() * sizeof(T));
+	}
+};
+
+// All reads fail (and keep failing) once we run out of data, so the caller only
+// has to check at the end
+struct CacheReader
+{
+	const std::vector<uint8_t>& in;
+	size_t ptr = 0;
+	bool ok = true;
+
+	explicit CacheReader(const std::vector<uint8_t>& data) : in(data) {}
+
+	bool read(void* data, size_t size)
+	{
+		if(!ok || size > in.size() - ptr)
+		{
+			ok = false;
+			return false;
+		}
+		memcpy(data, in.data() + ptr, size);
+		ptr += size;
+		return true;
+	}
+
+	template<typename T>
+	T pod()
+	{
+		T v{};
+		read(&v, sizeof(T));
+		return v;
+	}
+
+	// Element counts, every element takes at least a byte, so this catches garbage sizes
+	// before we try to allocate them
+	uint32_t count()
+	{
+		uint32_t c = pod<uint32_t>();
+		if(!ok || c > in.size() - ptr)
+		{
+			ok = false;
+			return 0;
+		}
+		return c;
+	}
+
+	std::string str()
+	{
+		uint32_t size = pod<uint32_t>();
+		if(!ok || size > in.size() - ptr)
+		{
+			ok = false;
+			return "";
+		}
+		std::string out((const char*)in.data() + ptr, size);
+		ptr += size;
+		return out;
+	}
+
+	template<typename T>
+	void vec(std::vector<T>& v)
+	{
+		uint64_t size = pod<uint64_t>();
+		if(!ok || size > (in.size() - ptr) / sizeof(T))
+		{
+			ok = false;
+			return;
+		}
+		v.resize(size);
+		read(v.data(), size * sizeof(T));
+	}
+};
+
+uint64_t CookedModel::hash_source(const std::vector<uint8_t>& data, const std::string& path)
+{
+	uint64_t hash = HashUtil::fnv1a(data.data(), data.size());
+
+	// Only the JSON is parsed, so the fast path doesn't load the whole model
+	const char* json = nullptr;
+	size_t json_size = 0;
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+	if(extension == ".gltf")
+	{
+		json = (const char*)data.data();
+		json_size = data.size();
+	}
+	else if(extension == ".glb" && data.size() >= 20)
+	{
+		// 12 byte header, then the JSON chunk (length, type, data)
+		uint32_t chunk_length;
+		memcpy(&chunk_length, data.data() + 12, sizeof(uint32_t));
+		if(chunk_length <= data.size() - 20)
+		{
+			json = (const char*)data.data() + 20;
+			json_size = chunk_length;
+		}
+	}
+
+	if(json == nullptr)
+	{
+		return hash;
+	}
+
+	rapidjson::Document doc;
+	doc.Parse(json, json_size);
+	if(doc.HasParseError() || !doc.IsObject())
+	{
+		// The loader will report the error
+		return hash;
+	}
+
+	std::string base_dir = path.substr(0, path.find_last_of('/') + 1);
+	for(const char* array : {"buffers", "images"})
+	{
+		auto it = doc.FindMember(array);
+		if(it == doc.MemberEnd() || !it->value.IsArray())
+		{
+			continue;
+		}
+
+		for(const auto& entry : it->value.GetArray())
+		{
+			if(!entry.IsObject() || !entry.HasMember("uri") || !entry["uri"].IsString())
+			{
+				continue;
+			}
+
+			// Embedded data is already hashed with the source
+			std::string uri = entry["uri"].GetString();
+			if(uri.rfind("data:", 0) == 0)
+			{
+				continue;
+			}
+
+			std::string ext_path = base_dir + uri;
+			if(AssetManager::file_exists(ext_path))
+			{
+				std::vector<uint8_t> ext = AssetManager::load_binary_raw(ext_path);
+				hash = HashUtil::fnv1a(ext.data(), ext.size(), hash);
+			}
+		}
+	}
+
+	return hash;
+}
+
+std::string CookedModel::get_cache_path(const std::string& pkg, const std::string& name)
+{
+	return hgr->assets->udata_path + "cache/models/" + pkg + "/" + name + ".hmdl";
+}
+
+bool CookedModel::load(const std::string& path, uint64_t expected_hash)
+{
+	if(!AssetManager::file_exists(path))
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> data = AssetManager::load_binary_raw(path);
+	CacheReader r(data);
+
+	char magic[4];
+	r.read(magic, 4);
+	uint32_t version = r.pod<uint32_t>();
+	source_hash = r.pod<uint64_t>();
+	if(!r.ok || memcmp(magic, MAGIC, 4) != 0 || version != VERSION || source_hash != expected_hash)
+	{
+		return false;
+	}
+
+	root_name = r.str();
+
+	images.resize(r.count());
+	for(Image& img : images)
+	{
+		if(!r.ok)
+			break;
+
+		img.width = r.pod<int32_t>();
+		img.height = r.pod<int32_t>();
+		img.bits = r.pod<int32_t>();
+		img.component = r.pod<int32_t>();
+		img.mag_filter = r.pod<int32_t>();
+		img.min_filter = r.pod<int32_t>();
+		img.wrap_s = r.pod<int32_t>();
+		img.wrap_t = r.pod<int32_t>();
+		img.srgb = r.pod<uint8_t>() != 0;
+		r.vec(img.pixels);
+	}
+
+	nodes.resize(r.count());
+	for(Node& n : nodes)
+	{
+		if(!r.ok)
+			break;
+
+		n.name = r.str();
+		n.parent = r.pod<int32_t>();
+		n.sub_transform = r.pod<glm::dmat4>();
+
+		n.properties.resize(r.count());
+		for(auto& prop : n.properties)
+		{
+			prop.first = r.str();
+			prop.second = r.str();
+		}
+
+		n.meshes.resize(r.count());
+		for(Mesh& m : n.meshes)
+		{
+			if(!r.ok)
+				break;
+
+			m.material = r.str();
+			m.layout = r.pod<uint32_t>();
+			m.drawable = r.pod<uint8_t>() != 0;
+			m.mesh_idx = r.pod<int32_t>();
+			m.prim_idx = r.pod<int32_t>();
+			m.min_bound = r.pod<glm::vec3>();
+			m.max_bound = r.pod<glm::vec3>();
+			m.stride = r.pod<uint32_t>();
+			r.vec(m.vertices);
+			m.index_type = r.pod<uint32_t>();
+			m.index_count = r.pod<uint32_t>();
+			r.vec(m.indices);
+
+			m.textures.resize(r.count());
+			for(Texture& t : m.textures)
+			{
+				t.type = r.pod<int32_t>();
+				t.is_asset = r.pod<uint8_t>() != 0;
+				t.uri = r.str();
+				t.image = r.pod<int32_t>();
+			}
+		}
+	}
+
+	if(!r.ok)
+	{
+		logger->warn("Model cache {} is truncated or malformed, it will be rebuilt", path);
+		return false;
+	}
+
+	return true;
+}
+
+bool CookedModel::save(const std::string& path) const
+{
+	CacheWriter w;
+	w.write(MAGIC, 4);
+	w.pod(VERSION);
+	w.pod(source_hash);
+	w.str(root_name);
+
+	w.pod((uint32_t)images.size());
+	for(const Image& img : images)
+	{
+		w.pod((int32_t)img.width);
+		w.pod((int32_t)img.height);
+		w.pod((int32_t)img.bits);
+		w.pod((int32_t)img.component);
+		w.pod((int32_t)img.mag_filter);
+		w.pod((int32_t)img.min_filter);
+		w.pod((int32_t)img.wrap_s);
+		w.pod((int32_t)img.wrap_t);
+		w.pod((uint8_t)img.srgb);
+		w.vec(img.pixels);
+	}
+
+	w.pod((uint32_t)nodes.size());
+	for(const Node& n : nodes)
+	{
+		w.str(n.name);
+		w.pod((int32_t)n.parent);
+		w.pod(n.sub_transform);
+
+		w.pod((uint32_t)n.properties.size());
+		for(const auto& prop : n.properties)
+		{
+			w.str(prop.first);
+			w.str(prop.second);
+		}
+
+		w.pod((uint32_t)n.meshes.size());
+		for(const Mesh& m : n.meshes)
+		{
+			w.str(m.material);
+			w.pod(m.layout);
+			w.pod((uint8_t)m.drawable);
+			w.pod((int32_t)m.mesh_idx);
+			w.pod((int32_t)m.prim_idx);
+			w.pod(m.min_bound);
+			w.pod(m.max_bound);
+			w.pod(m.stride);
+			w.vec(m.vertices);
+			w.pod(m.index_type);
+			w.pod(m.index_count);
+			w.vec(m.indices);
+
+			w.pod((uint32_t)m.textures.size());
+			for(const Texture& t : m.textures)
+			{
+				w.pod((int32_t)t.type);
+				w.pod((uint8_t)t.is_asset);
+				w.str(t.uri);
+				w.pod((int32_t)t.image);
+			}
+		}
+	}
+
+	std::error_code code;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), code);
+
+	// Write to a temporary file first so a crash never leaves a half-written cache behind
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		if(!file.write((const char*)w.out.data(), (std::streamsize)w.out.size()))
+		{
+			logger->warn("Could not write model cache to {}", tmp_path);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, code);
+	if(code)
+	{
+		logger->warn("Could not write model cache to {} ({})", path, code.message());
+		std::filesystem::remove(tmp_path, code);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Cooked (pre-processed) representation of a Model. It holds the final interleaved
+// vertex buffers, the index buffers, the node hierarchy and material bindings, so that
+// building a Model from it requires no glTF parsing. It's written to the user data
+// folder the first time a model is loaded and reused while the source file hash matches.
+// Vertices are interleaved for the material layout they were cooked with, if the
+// material changes its layout the cache is considered stale (see MeshConfig::get_layout)
+struct CookedModel
+{
+	// Bump this whenever the format or the cooking process changes
+	static constexpr uint32_t VERSION = 1;
+
+	struct Texture
+	{
+		// ModelTexture::TextureType
+		int type;
+		bool is_asset;
+		// Only for asset textures
+		std::string uri;
+		// Only for embedded textures, index into images
+		int image;
+	};
+
+	// Embedded image, already decoded (8 bit per channel)
+	struct Image
+	{
+		int width, height, bits, component;
+		int mag_filter, min_filter, wrap_s, wrap_t;
+		bool srgb;
+		std::vector<uint8_t> pixels;
+	};
+
+	struct Mesh
+	{
+		std::string material;
+		// MeshConfig::get_layout() of the material the vertices were interleaved for
+		uint32_t layout;
+		bool drawable;
+		int mesh_idx, prim_idx;
+
+		glm::vec3 min_bound, max_bound;
+
+		// Floats per vertex. Non-drawable meshes only store positions (stride 3)
+		uint32_t stride;
+		std::vector<float> vertices;
+		// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		uint32_t index_type;
+		uint32_t index_count;
+		std::vector<uint8_t> indices;
+
+		std::vector<Texture> textures;
+	};
+
+	struct Node
+	{
+		std::string name;
+		// Index of the parent node, parents always go before children. -1 is the scene root
+		int parent;
+		glm::dmat4 sub_transform;
+		std::vector<std::pair<std::string, std::string>> properties;
+		std::vector<Mesh> meshes;
+	};
+
+	uint64_t source_hash;
+	std::string root_name;
+	std::vector<Node> nodes;
+	std::vector<Image> images;
+
+	// Hash of the source file and of every external file its buffers and images
+	// reference (by uri, relative to the model), as they are cooked into the model too
+	static uint64_t hash_source(const std::vector<uint8_t>& data, const std::string& path);
+
+	static std::string get_cache_path(const std::string& pkg, const std::string& name);
+
+	// Returns false if the file does not exist, is malformed, or was cooked from
+	// a different source (or with a different VERSION)
+	bool load(const std::string& path, uint64_t expected_hash);
+	// Returns false and logs a warning if the file could not be written
+	bool save(const std::string& path) const;
+};
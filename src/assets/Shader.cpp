@@ -1,12 +1,53 @@
 #include "Shader.h"
 #include "AssetManager.h"
 #include <renderer/Renderer.h>
+#include <renderer/util/UniformBuffer.h>
+#include <util/HashUtil.h>
 #include <string>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+static constexpr char BINARY_MAGIC[4] = {'H', 'S', 'H', 'B'};
+// Bump this whenever the binary cache format changes
+static constexpr uint32_t BINARY_VERSION = 1;
+
+// Preprocessed sources shared by all shaders, see Shader::preprocessor
+static std::unordered_map<uint64_t, std::string> preprocess_cache;
+// Raw contents of included files, by package path
+static std::unordered_map<std::string, std::string> include_cache;
+
+static const std::string& get_driver_string()
+{
+	static std::string driver;
+	if(driver.empty())
+	{
+		driver = std::string((const char*)glGetString(GL_VENDOR)) + ";" +
+				 std::string((const char*)glGetString(GL_RENDERER)) + ";" +
+				 std::string((const char*)glGetString(GL_VERSION));
+	}
+	return driver;
+}
+
+static std::string hash_to_hex(uint64_t hash)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+	return std::string(buf);
+}
 
 std::string Shader::preprocessor(const std::string& file)
 {
-	std::unordered_map<std::string, std::string> defines;
-	
+	// Relative includes are resolved from the directory of the shader being loaded
+	std::string dir = get_asset_pkg() + ":" + get_asset_name().substr(0, get_asset_name().find_last_of('/') + 1);
+	uint64_t key = HashUtil::fnv1a(file, HashUtil::fnv1a(dir, HashUtil::fnv1a(hgr->renderer->quality.get_shader_defines())));
+
+	auto cached = preprocess_cache.find(key);
+	if(cached != preprocess_cache.end())
+	{
+		return cached->second;
+	}
+
 	std::stringstream ss(file);
 	
 	std::string line;
@@ -111,13 +152,19 @@ std::string Shader::preprocessor(const std::string& file)
 				}
 			}
 
-			if(!AssetManager::file_exists(hgr->assets->resolve_path(path)))
+			auto included = include_cache.find(path);
+			if(included == include_cache.end() && AssetManager::file_exists(hgr->assets->resolve_path(path)))
+			{
+				included = include_cache.emplace(path, hgr->assets->load_string(path)).first;
+			}
+
+			if(included == include_cache.end())
 			{
 				logger->error("Could not include: {}", path);
 			}
 			else
 			{
-				std::string sfile = hgr->assets->load_string(path);
+				std::string sfile = included->second;
 				// Postprocess the file too
 				sfile = preprocessor(sfile);
 				final_file += sfile;
@@ -138,6 +185,7 @@ std::string Shader::preprocessor(const std::string& file)
 		line_num++;
 	}
 
+	preprocess_cache[key] = final_file;
 	return final_file;
 }
 
@@ -147,11 +195,8 @@ void Shader::use() const
 	glUseProgram(id);
 }
 
-Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(ASSET_INFO_P)
+bool Shader::compile(const std::string& vproc, const std::string& fproc)
 {
-	std::string vproc = preprocessor(v);
-	std::string fproc = preprocessor(f);
-
 	int success = true;
 	char infoLog[1024];
 
@@ -185,6 +230,8 @@ Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(A
 	id = glCreateProgram();
 	glAttachShader(id, vs);
 	glAttachShader(id, fs);
+	// Must be set before linking so the driver keeps the binary around
+	glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(id);
 
 	glGetProgramiv(id, GL_LINK_STATUS, &success);
@@ -197,6 +244,120 @@ Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(A
 	glDeleteShader(vs);
 	glDeleteShader(fs);
 
+	return success;
+}
+
+bool Shader::load_binary(const std::string& path, uint64_t key)
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if(formats <= 0 || !AssetManager::file_exists(path))
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> data = AssetManager::load_binary_raw(path);
+	constexpr size_t header_size = 4 + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+	if(data.size() <= header_size)
+	{
+		return false;
+	}
+
+	uint32_t version, format;
+	uint64_t file_key;
+	memcpy(&version, data.data() + 4, sizeof(uint32_t));
+	memcpy(&file_key, data.data() + 8, sizeof(uint64_t));
+	memcpy(&format, data.data() + 16, sizeof(uint32_t));
+	if(memcmp(data.data(), BINARY_MAGIC, 4) != 0 || version != BINARY_VERSION || file_key != key)
+	{
+		return false;
+	}
+
+	id = glCreateProgram();
+	glProgramBinary(id, (GLenum)format, data.data() + header_size, (GLsizei)(data.size() - header_size));
+
+	// Drivers may reject binaries at any time (for example after an update), this is not an error
+	GLint success = GL_FALSE;
+	glGetProgramiv(id, GL_LINK_STATUS, &success);
+	if(!success)
+	{
+		logger->info("Cached binary for shader {} was rejected by the driver, recompiling", get_asset_id());
+		glDeleteProgram(id);
+		id = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void Shader::save_binary(const std::string& path, uint64_t key) const
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	GLint length = 0;
+	glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(formats <= 0 || length <= 0)
+	{
+		return;
+	}
+
+	std::vector<uint8_t> binary((size_t)length);
+	GLenum format;
+	glGetProgramBinary(id, length, &length, &format, binary.data());
+
+	std::error_code code;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), code);
+
+	// Write to a temporary file first so a crash never leaves a half-written binary behind
+	std::string tmp_path = path + ".tmp";
+	{
+		uint32_t version = BINARY_VERSION;
+		uint32_t format32 = (uint32_t)format;
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		file.write(BINARY_MAGIC, 4);
+		file.write((const char*)&version, sizeof(uint32_t));
+		file.write((const char*)&key, sizeof(uint64_t));
+		file.write((const char*)&format32, sizeof(uint32_t));
+		if(!file.write((const char*)binary.data(), length))
+		{
+			logger->warn("Could not write shader binary to {}", tmp_path);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, code);
+	if(code)
+	{
+		logger->warn("Could not write shader binary to {} ({})", path, code.message());
+		std::filesystem::remove(tmp_path, code);
+	}
+}
+
+std::string Shader::get_binary_path(uint64_t defines_hash) const
+{
+	// One file per quality setting, so switching back and forth does not recompile
+	return hgr->assets->udata_path + "cache/shaders/" + get_asset_pkg() + "/" + get_asset_name() + "." +
+		hash_to_hex(defines_hash) + ".glbin";
+}
+
+Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(ASSET_INFO_P)
+{
+	std::string vproc = preprocessor(v);
+	std::string fproc = preprocessor(f);
+
+	// Preprocessed sources already contain the quality defines
+	uint64_t defines_hash = HashUtil::fnv1a(hgr->renderer->quality.get_shader_defines());
+	uint64_t key = HashUtil::fnv1a(vproc, HashUtil::fnv1a(fproc, HashUtil::fnv1a(get_driver_string())));
+	std::string binary_path = get_binary_path(defines_hash);
+
+	if(!load_binary(binary_path, key))
+	{
+		if(compile(vproc, fproc))
+		{
+			save_binary(binary_path, key);
+		}
+	}
+
 	// Cache all uniforms
 	GLint count, length, size;
 	GLenum type;
@@ -216,6 +377,21 @@ Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(A
 	}
 
 	logger->info("Shader {} has {} uniforms", get_asset_name(), count);
+
+	auto bind_block = [this](const char* block_name, GLuint binding)
+	{
+		GLuint index = glGetUniformBlockIndex(id, block_name);
+		if(index == GL_INVALID_INDEX)
+		{
+			return false;
+		}
+		glUniformBlockBinding(id, index, binding);
+		return true;
+	};
+
+	uses_frame_block = bind_block("FrameBlock", UniformBlocks::FRAME);
+	uses_material_block = bind_block("MaterialBlock", UniformBlocks::MATERIAL);
+	uses_draw_block = bind_block("DrawBlock", UniformBlocks::DRAW);
 }
 
 
@@ -22,8 +22,17 @@ private:
 	// (#define is already done by the GLSL compiler)
 	// There MUST be an space after the macro name (#include<test> is INVALID) 
 	// Relative paths are very strict, always use ../ for going back, etc...
+	// Results are cached (keyed by the source hash, the shader directory and the quality
+	// defines) and included files are only read once, as many shaders share includes
 	std::string preprocessor(const std::string& file);
 
+	// Program binaries are cached in udata/cache/shaders/, keyed by the preprocessed
+	// sources and the driver. If the driver rejects a binary we compile from source
+	bool compile(const std::string& vproc, const std::string& fproc);
+	bool load_binary(const std::string& path, uint64_t key);
+	void save_binary(const std::string& path, uint64_t key) const;
+	std::string get_binary_path(uint64_t defines_hash) const;
+
 
 	// Decent improvement on some drivers as for some reason the glGetUniformLocation
 	// stalls the whole thing
@@ -33,6 +42,12 @@ public:
 
 	GLuint id;
 
+	// Which of the shared uniform blocks (UniformBlocks) this shader declares,
+	// they are bound to their binding points on link
+	bool uses_frame_block;
+	bool uses_material_block;
+	bool uses_draw_block;
+
 	inline GLint get_uniform_location(const std::string& name) const
 	{
 		auto it = uniform_locations.find(name);
@@ -98,6 +113,25 @@ public:
 		glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(value));
 	}
 
+	// Versions taking a location obtained from get_uniform_location, to avoid
+	// the lookup on hot paths. Negative locations are ignored
+	inline void setInt(GLint loc, int value) const { if(loc >= 0) glUniform1i(loc, value); }
+	inline void setFloat(GLint loc, float value) const { if(loc >= 0) glUniform1f(loc, value); }
+	inline void setVec2(GLint loc, glm::vec2 value) const { if(loc >= 0) glUniform2f(loc, value.x, value.y); }
+	inline void setVec3(GLint loc, glm::vec3 value) const { if(loc >= 0) glUniform3f(loc, value.x, value.y, value.z); }
+	inline void setVec4(GLint loc, glm::vec4 value) const
+	{
+		if(loc >= 0) glUniform4f(loc, value.x, value.y, value.z, value.w);
+	}
+	inline void setMat4(GLint loc, glm::mat4 value) const
+	{
+		if(loc >= 0) glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	inline void setMat3(GLint loc, glm::mat3 value) const
+	{
+		if(loc >= 0) glUniformMatrix3fv(loc, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
 	Shader(const std::string& vertexData, const std::string& fragmentData, ASSET_INFO);
 	~Shader();
 };
@@ -0,0 +1,450 @@
+#include "TextureContainer.h"
+#include <util/Logger.h>
+#include <fstream>
+#include <cstring>
+#include <unordered_set>
+#include <algorithm>
+
+// Formats as given in the DX10 header of DDS files (DXGI_FORMAT)
+enum DXGIFormat : uint32_t
+{
+	DXGI_R8G8B8A8_UNORM = 28,
+	DXGI_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_BC1_UNORM = 71,
+	DXGI_BC1_UNORM_SRGB = 72,
+	DXGI_BC2_UNORM = 74,
+	DXGI_BC2_UNORM_SRGB = 75,
+	DXGI_BC3_UNORM = 77,
+	DXGI_BC3_UNORM_SRGB = 78,
+	DXGI_BC4_UNORM = 80,
+	DXGI_BC4_SNORM = 81,
+	DXGI_BC5_UNORM = 83,
+	DXGI_BC5_SNORM = 84,
+	DXGI_BC6H_UF16 = 95,
+	DXGI_BC6H_SF16 = 96,
+	DXGI_BC7_UNORM = 98,
+	DXGI_BC7_UNORM_SRGB = 99,
+};
+
+// Formats as given in the header of KTX2 files (VkFormat)
+enum VkFormat : uint32_t
+{
+	VK_R8G8B8A8_UNORM = 37,
+	VK_R8G8B8A8_SRGB = 43,
+	VK_BC1_RGB_UNORM = 131,
+	VK_BC1_RGB_SRGB = 132,
+	VK_BC1_RGBA_UNORM = 133,
+	VK_BC1_RGBA_SRGB = 134,
+	VK_BC2_UNORM = 135,
+	VK_BC2_SRGB = 136,
+	VK_BC3_UNORM = 137,
+	VK_BC3_SRGB = 138,
+	VK_BC4_UNORM = 139,
+	VK_BC4_SNORM = 140,
+	VK_BC5_UNORM = 141,
+	VK_BC5_SNORM = 142,
+	VK_BC6H_UFLOAT = 143,
+	VK_BC6H_SFLOAT = 144,
+	VK_BC7_UNORM = 145,
+	VK_BC7_SRGB = 146,
+	VK_ETC2_R8G8B8_UNORM = 147,
+	VK_ETC2_R8G8B8_SRGB = 148,
+	VK_ETC2_R8G8B8A1_UNORM = 149,
+	VK_ETC2_R8G8B8A1_SRGB = 150,
+	VK_ETC2_R8G8B8A8_UNORM = 151,
+	VK_ETC2_R8G8B8A8_SRGB = 152,
+};
+
+static GLenum dxgi_to_gl(uint32_t fmt)
+{
+	switch(fmt)
+	{
+		case DXGI_R8G8B8A8_UNORM: return GL_RGBA8;
+		case DXGI_R8G8B8A8_UNORM_SRGB: return GL_SRGB8_ALPHA8;
+		case DXGI_BC1_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case DXGI_BC1_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		case DXGI_BC2_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		case DXGI_BC2_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+		case DXGI_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case DXGI_BC3_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+		case DXGI_BC4_UNORM: return GL_COMPRESSED_RED_RGTC1;
+		case DXGI_BC4_SNORM: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+		case DXGI_BC5_UNORM: return GL_COMPRESSED_RG_RGTC2;
+		case DXGI_BC5_SNORM: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+		case DXGI_BC6H_UF16: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		case DXGI_BC6H_SF16: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+		case DXGI_BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case DXGI_BC7_UNORM_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		default: return 0;
+	}
+}
+
+static GLenum vk_to_gl(uint32_t fmt)
+{
+	switch(fmt)
+	{
+		case VK_R8G8B8A8_UNORM: return GL_RGBA8;
+		case VK_R8G8B8A8_SRGB: return GL_SRGB8_ALPHA8;
+		case VK_BC1_RGB_UNORM: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case VK_BC1_RGB_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+		case VK_BC1_RGBA_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case VK_BC1_RGBA_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		case VK_BC2_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		case VK_BC2_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+		case VK_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case VK_BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+		case VK_BC4_UNORM: return GL_COMPRESSED_RED_RGTC1;
+		case VK_BC4_SNORM: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+		case VK_BC5_UNORM: return GL_COMPRESSED_RG_RGTC2;
+		case VK_BC5_SNORM: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+		case VK_BC6H_UFLOAT: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+		case VK_BC6H_SFLOAT: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+		case VK_BC7_UNORM: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case VK_BC7_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		case VK_ETC2_R8G8B8_UNORM: return GL_COMPRESSED_RGB8_ETC2;
+		case VK_ETC2_R8G8B8_SRGB: return GL_COMPRESSED_SRGB8_ETC2;
+		case VK_ETC2_R8G8B8A1_UNORM: return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+		case VK_ETC2_R8G8B8A1_SRGB: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+		case VK_ETC2_R8G8B8A8_UNORM: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+		case VK_ETC2_R8G8B8A8_SRGB: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+		default: return 0;
+	}
+}
+
+// Returns 0 for uncompressed formats
+static size_t get_block_bytes(GLenum fmt)
+{
+	switch(fmt)
+	{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_SRGB8_ETC2:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+			return 8;
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+			return 0;
+		default:
+			return 16;
+	}
+}
+
+template<typename T>
+static T read_le(const std::vector<uint8_t>& data, size_t offset)
+{
+	T out;
+	memcpy(&out, data.data() + offset, sizeof(T));
+	return out;
+}
+
+static uint32_t make_fourcc(const char* str)
+{
+	return (uint32_t)str[0] | ((uint32_t)str[1] << 8) | ((uint32_t)str[2] << 16) | ((uint32_t)str[3] << 24);
+}
+
+size_t TextureContainer::get_row_bytes(size_t level) const
+{
+	const Level& l = levels[level];
+	if(compressed)
+	{
+		return (size_t)std::max(1, (l.width + 3) / 4) * block_bytes;
+	}
+	else
+	{
+		return (size_t)l.width * block_bytes;
+	}
+}
+
+int TextureContainer::get_rows(size_t level) const
+{
+	const Level& l = levels[level];
+	return compressed ? std::max(1, (l.height + 3) / 4) : l.height;
+}
+
+GLenum TextureContainer::get_srgb_format() const
+{
+	switch(gl_format)
+	{
+		case GL_RGBA8: return GL_SRGB8_ALPHA8;
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+		case GL_COMPRESSED_RGB8_ETC2: return GL_COMPRESSED_SRGB8_ETC2;
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2: return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+		case GL_COMPRESSED_RGBA8_ETC2_EAC: return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+		default: return gl_format;
+	}
+}
+
+void TextureContainer::upload_rows(size_t level, int first_row, int row_count, GLenum target) const
+{
+	const Level& l = levels[level];
+	const uint8_t* ptr = get_level_data(level) + first_row * get_row_bytes(level);
+	int y = first_row * get_row_height();
+	int h = std::min(row_count * get_row_height(), l.height - y);
+
+	if(compressed)
+	{
+		glCompressedTexSubImage2D(target, (GLint)level, 0, y, l.width, h, gl_format,
+							(GLsizei)(row_count * get_row_bytes(level)), ptr);
+	}
+	else
+	{
+		glTexSubImage2D(target, (GLint)level, 0, y, l.width, h, GL_RGBA, GL_UNSIGNED_BYTE, ptr);
+	}
+}
+
+bool TextureContainer::is_format_supported(GLenum format)
+{
+	static std::unordered_set<std::string> extensions;
+	if(extensions.empty())
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for(GLint i = 0; i < count; i++)
+		{
+			extensions.insert((const char*)glGetStringi(GL_EXTENSIONS, i));
+		}
+		// Prevents querying again on contexts without extensions
+		extensions.insert("");
+	}
+
+	switch(format)
+	{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			return extensions.count("GL_EXT_texture_compression_s3tc") != 0;
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			return extensions.count("GL_EXT_texture_compression_s3tc") != 0 &&
+				(extensions.count("GL_EXT_texture_sRGB") != 0 ||
+				extensions.count("GL_EXT_texture_compression_s3tc_srgb") != 0);
+		default:
+			// RGTC (3.0), BPTC (4.2) and ETC2 (4.3) are core in the version we request
+			return true;
+	}
+}
+
+bool TextureContainer::is_container_path(const std::string& path)
+{
+	size_t last_dot = path.find_last_of('.');
+	if(last_dot == std::string::npos)
+	{
+		return false;
+	}
+
+	std::string ext = path.substr(last_dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == ".dds" || ext == ".ktx2";
+}
+
+bool TextureContainer::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if(!file.good())
+	{
+		logger->error("Could not open texture container {}", path);
+		return false;
+	}
+
+	size_t size = (size_t)file.tellg();
+	file.seekg(0, std::ios::beg);
+	data.resize(size);
+	file.read((char*)data.data(), size);
+
+	bool result;
+	if(size >= 4 && read_le<uint32_t>(data, 0) == make_fourcc("DDS "))
+	{
+		result = parse_dds();
+	}
+	else
+	{
+		result = parse_ktx2();
+	}
+
+	if(!result)
+	{
+		logger->error("Invalid or unsupported texture container {}", path);
+		return false;
+	}
+
+	// Make sure no level points outside the file
+	for(const Level& l : levels)
+	{
+		if(l.offset + l.size > data.size())
+		{
+			logger->error("Texture container {} is truncated", path);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TextureContainer::build_levels(int width, int height, size_t count, size_t first_offset)
+{
+	size_t offset = first_offset;
+	levels.clear();
+	for(size_t i = 0; i < count; i++)
+	{
+		Level l;
+		l.width = std::max(1, width >> i);
+		l.height = std::max(1, height >> i);
+		l.offset = offset;
+		levels.push_back(l);
+		levels.back().size = get_row_bytes(i) * get_rows(i);
+		offset += levels.back().size;
+	}
+}
+
+bool TextureContainer::parse_dds()
+{
+	constexpr size_t HEADER_END = 128;
+	constexpr size_t DX10_HEADER_END = 148;
+	constexpr uint32_t DDPF_FOURCC = 0x4;
+	constexpr uint32_t DDPF_RGB = 0x40;
+	constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+
+	if(data.size() < HEADER_END || read_le<uint32_t>(data, 4) != 124)
+	{
+		return false;
+	}
+
+	int height = (int)read_le<uint32_t>(data, 12);
+	int width = (int)read_le<uint32_t>(data, 16);
+	size_t mip_count = std::max(read_le<uint32_t>(data, 28), 1u);
+	uint32_t pf_flags = read_le<uint32_t>(data, 80);
+	uint32_t fourcc = read_le<uint32_t>(data, 84);
+	uint32_t caps2 = read_le<uint32_t>(data, 112);
+
+	if(caps2 & DDSCAPS2_CUBEMAP)
+	{
+		logger->error("DDS cubemaps are not supported, use six images instead");
+		return false;
+	}
+
+	size_t data_start = HEADER_END;
+	gl_format = 0;
+
+	if(pf_flags & DDPF_FOURCC)
+	{
+		if(fourcc == make_fourcc("DX10"))
+		{
+			if(data.size() < DX10_HEADER_END)
+			{
+				return false;
+			}
+			gl_format = dxgi_to_gl(read_le<uint32_t>(data, 128));
+			data_start = DX10_HEADER_END;
+		}
+		else if(fourcc == make_fourcc("DXT1"))
+			gl_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		else if(fourcc == make_fourcc("DXT3"))
+			gl_format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		else if(fourcc == make_fourcc("DXT5"))
+			gl_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		else if(fourcc == make_fourcc("ATI1") || fourcc == make_fourcc("BC4U"))
+			gl_format = GL_COMPRESSED_RED_RGTC1;
+		else if(fourcc == make_fourcc("ATI2") || fourcc == make_fourcc("BC5U"))
+			gl_format = GL_COMPRESSED_RG_RGTC2;
+	}
+	else if(pf_flags & DDPF_RGB)
+	{
+		// Only plain RGBA8 in memory order is supported
+		if(read_le<uint32_t>(data, 88) == 32 && read_le<uint32_t>(data, 92) == 0x000000ff &&
+			read_le<uint32_t>(data, 96) == 0x0000ff00 && read_le<uint32_t>(data, 100) == 0x00ff0000)
+		{
+			gl_format = GL_RGBA8;
+		}
+	}
+
+	if(gl_format == 0)
+	{
+		return false;
+	}
+
+	block_bytes = get_block_bytes(gl_format);
+	compressed = block_bytes != 0;
+	if(!compressed)
+	{
+		block_bytes = 4;
+	}
+
+	build_levels(width, height, mip_count, data_start);
+	return true;
+}
+
+bool TextureContainer::parse_ktx2()
+{
+	static const uint8_t identifier[12] =
+		{0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+	constexpr size_t LEVEL_INDEX_START = 80;
+	constexpr size_t LEVEL_INDEX_STRIDE = 24;
+
+	if(data.size() < LEVEL_INDEX_START || memcmp(data.data(), identifier, sizeof(identifier)) != 0)
+	{
+		return false;
+	}
+
+	uint32_t vk_format = read_le<uint32_t>(data, 12);
+	int width = (int)read_le<uint32_t>(data, 20);
+	int height = (int)read_le<uint32_t>(data, 24);
+	uint32_t depth = read_le<uint32_t>(data, 28);
+	uint32_t layers = read_le<uint32_t>(data, 32);
+	uint32_t faces = read_le<uint32_t>(data, 36);
+	size_t level_count = std::max(read_le<uint32_t>(data, 40), 1u);
+	uint32_t supercompression = read_le<uint32_t>(data, 44);
+
+	if(depth > 1 || layers > 1 || faces != 1)
+	{
+		logger->error("Only 2D KTX2 textures are supported");
+		return false;
+	}
+
+	if(supercompression != 0)
+	{
+		logger->error("Supercompressed KTX2 textures (basis, zstd) are not supported");
+		return false;
+	}
+
+	gl_format = vk_to_gl(vk_format);
+	if(gl_format == 0 || data.size() < LEVEL_INDEX_START + level_count * LEVEL_INDEX_STRIDE)
+	{
+		return false;
+	}
+
+	block_bytes = get_block_bytes(gl_format);
+	compressed = block_bytes != 0;
+	if(!compressed)
+	{
+		block_bytes = 4;
+	}
+
+	// KTX2 stores level offsets explicitly (and smallest first in the file), so
+	// we build the sizes and then override offsets
+	build_levels(width, height, level_count, 0);
+	for(size_t i = 0; i < level_count; i++)
+	{
+		size_t idx = LEVEL_INDEX_START + i * LEVEL_INDEX_STRIDE;
+		levels[i].offset = (size_t)read_le<uint64_t>(data, idx);
+		size_t length = (size_t)read_le<uint64_t>(data, idx + 8);
+		if(length < levels[i].size)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// S3TC is not core in OpenGL (it's an extension, albeit an ubiquitous one), so
+// glad does not define these for us
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// Parsed contents of a GPU texture container file (.dds or .ktx2)
+// The mip chain is generated offline (by texconv, toktx, compressonator...) so we
+// never have to call glGenerateMipmap on these. Data is kept as a single blob read
+// from disk, and levels simply point into it, so loading is a single read.
+// Only 2D textures without supercompression are supported (no cubemaps / arrays,
+// load cubemaps as 6 separate images)
+struct TextureContainer
+{
+	struct Level
+	{
+		int width, height;
+		size_t offset;
+		size_t size;
+	};
+
+	std::vector<uint8_t> data;
+	// Level 0 is the biggest one
+	std::vector<Level> levels;
+
+	// Already adjusted to sRGB if the file requested it
+	GLenum gl_format;
+	bool compressed;
+	// Bytes per 4x4 block if compressed, bytes per pixel otherwise
+	size_t block_bytes;
+
+	int get_width() const { return levels.empty() ? 0 : levels[0].width; }
+	int get_height() const { return levels.empty() ? 0 : levels[0].height; }
+
+	// Pointer to the first byte of given level
+	const uint8_t* get_level_data(size_t level) const { return data.data() + levels[level].offset; }
+
+	// Size in bytes of a row of blocks (or pixels if uncompressed) of given level
+	size_t get_row_bytes(size_t level) const;
+	// Number of rows of blocks (or pixels if uncompressed) in given level
+	int get_rows(size_t level) const;
+	// Pixel height of a row, 4 for block compressed formats
+	int get_row_height() const { return compressed ? 4 : 1; }
+
+	// Returns the sRGB variant of gl_format, or the same format if there is none
+	GLenum get_srgb_format() const;
+
+	// Uploads a range of rows of given level to the currently bound texture
+	// The texture must have been allocated with glTexStorage2D
+	void upload_rows(size_t level, int first_row, int row_count, GLenum target = GL_TEXTURE_2D) const;
+
+	// Does the current context support the given format? Needs a current GL context
+	static bool is_format_supported(GLenum format);
+	static bool is_container_path(const std::string& path);
+
+	// Returns false and logs the error if the file could not be parsed
+	bool load(const std::string& path);
+
+private:
+
+	bool parse_dds();
+	bool parse_ktx2();
+	void build_levels(int width, int height, size_t count, size_t first_offset);
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+class AudioSource;
+class SampleSource;
+
+// A change requested from the main thread, applied by the audio thread at the start
+// of each callback. Only the fields used by each type are set
+struct AudioCommand
+{
+	enum Type : uint8_t
+	{
+		ADD_SOURCE,
+		REMOVE_SOURCE,
+		SET_PLAYING,
+		SET_3D_SOURCE,
+		SET_POSITION,
+		SET_GAIN,
+		SET_PITCH,
+		SET_LOOPING,
+		SET_PRIORITY,
+		SET_DESTROY_WHEN_FINISHED,
+		SET_SAMPLE_SOURCE,
+		SET_LISTENER,
+		SET_IS_INSIDE,
+		SET_MASTER_GAIN,
+		SET_CHANNEL_GAIN
+	};
+
+	Type type;
+	AudioSource* source = nullptr;
+	SampleSource* sample_source = nullptr;
+	bool b = false;
+	uint32_t u = 0;
+	int32_t i = 0;
+	float f = 0.0f;
+	double d = 0.0;
+	// Position, or listener pos, fwd, up and vel
+	glm::dvec3 v[4];
+};
+
+// Single-producer single-consumer ring of commands, neither side ever blocks or allocates.
+// Commands are numbered in push order, get_consumed returns how many the consumer
+// has finished applying, so the producer knows when data referenced by a command is
+// not used anymore
+class AudioCommandRing
+{
+private:
+
+	std::vector<AudioCommand> buffer;
+	uint64_t mask;
+
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+
+public:
+
+	// Producer side, returns false if the ring is full
+	bool push(const AudioCommand& cmd)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) > mask)
+		{
+			return false;
+		}
+
+		buffer[h & mask] = cmd;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, returns false if the ring is empty. The command stays in the
+	// ring until release is called
+	bool pop(AudioCommand& out)
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		out = buffer[t & mask];
+		return true;
+	}
+
+	// Consumer side, call once the command returned by pop has been applied
+	void release()
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	uint64_t get_pushed() const { return head.load(std::memory_order_relaxed); }
+	uint64_t get_consumed() const { return tail.load(std::memory_order_acquire); }
+
+	// Capacity is rounded up to a power of two
+	explicit AudioCommandRing(size_t capacity)
+	{
+		size_t size = 1;
+		while(size < capacity)
+		{
+			size *= 2;
+		}
+
+		buffer.resize(size);
+		mask = size - 1;
+		head = 0;
+		tail = 0;
+	}
+};
@@ -3,9 +3,14 @@
 #include <util/Logger.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cstring>
 #include "AudioSource.h"
+#include "StreamingSampleSource.h"
+#include "AudioMix.h"
+#include <assets/HRTFSet.h>
 
-AudioEngine::AudioEngine(const cpptoml::table &settings)
+AudioEngine::AudioEngine(const cpptoml::table &settings) : commands(4096)
 {
 
 	if(ma_context_init(nullptr, 0, nullptr, &context) != MA_SUCCESS)
@@ -20,6 +25,8 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 	{
 		channels[i].use_hdr = i != 0;
 		channels[i].gain = 1.0f;
+		channels[i].mix_gain = 1.0f;
+		channels[i].sources = nullptr;
 		std::string ch = "audio.channel_";
 		ch += std::to_string(i);
 		channels[i].external_gain = settings.get_qualified_as<double>(ch + "_ext_gain").value_or(1.0f);
@@ -27,6 +34,19 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 	}
 	master_gain = settings.get_qualified_as<double>("audio.gain").value_or(1.0f);
 	simple_panning = settings.get_qualified_as<bool>("audio.simple_panning").value_or(false);
+	mix_master_gain = master_gain;
+	max_voices = (size_t)settings.get_qualified_as<int64_t>("audio.max_voices").value_or(48);
+	audibility_threshold = settings.get_qualified_as<double>("audio.audibility_threshold").value_or(0.0005);
+	voices.resize(1024);
+	mix_is_inside = is_inside;
+
+	listener.pos = glm::dvec3(0.0);
+	listener.fwd = glm::dvec3(0.0, 0.0, 1.0);
+	listener.up = glm::dvec3(0.0, 1.0, 0.0);
+	listener.right = glm::cross(listener.fwd, listener.up);
+	listener.vel = glm::dvec3(0.0);
+	listener.speed_of_sound = 343.0;
+	mix_listener = listener;
 
 	// We retrieve all devices to allow configuration to use the device by string. We store this for
 	// the settings interface
@@ -78,11 +98,24 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 
 	this->sample_rate = device.sampleRate;
 
-	// This may be an unnecesarly HUGE buffer. We could reduce it if perfomance is affected
-	mix_buffer_size = sample_rate;
+	// Filters are prepared for the device sample rate, so this must happen after the device is created
+	std::string hrtf_path = settings.get_qualified_as<std::string>("audio.hrtf").value_or("");
+	hrtf_voices = (size_t)settings.get_qualified_as<int64_t>("audio.hrtf_voices").value_or(16);
+	if(!hrtf_path.empty() && hrtf_voices > 0)
+	{
+		AssetHandle<HRTFSet> set = AssetHandle<HRTFSet>(hrtf_path);
+		hrtf = std::make_unique<HRTFSpatializer>(*set, (uint32_t)sample_rate, hrtf_voices);
+		logger->info("Using HRTF '{}' for up to {} voices", hrtf_path, hrtf_voices);
+	}
+
+	mix_buffer_size = MIX_BLOCK_FRAMES;
 
 	mix_buffer = (float*)calloc(mix_buffer_size, sizeof(float) * 2);
 	chmix_buffer = (float*)calloc(mix_buffer_size, sizeof(float) * 2);
+	hrtf_buffer = (float*)calloc(mix_buffer_size, sizeof(float) * 2);
+
+	stream_thread_run = true;
+	stream_thread = std::thread(&AudioEngine::stream_thread_func, this);
 
 	// From here on, the thread is running
 	ma_device_start(&device);
@@ -92,6 +125,51 @@ AudioEngine::~AudioEngine()
 {
 	ma_device_uninit(&device);
 	ma_context_uninit(&context);
+
+	free(mix_buffer);
+	free(chmix_buffer);
+	free(hrtf_buffer);
+
+	stream_mtx.lock();
+	stream_thread_run = false;
+	stream_mtx.unlock();
+	stream_cv.notify_all();
+	stream_thread.join();
+}
+
+void AudioEngine::stream_thread_func()
+{
+	std::vector<std::shared_ptr<AudioStream>> to_fill;
+	while(true)
+	{
+		{
+			std::unique_lock lock(stream_mtx);
+			// Streams hold at least a second of audio, so this is plenty often
+			stream_cv.wait_for(lock, std::chrono::milliseconds(20), [this](){ return !stream_thread_run; });
+			if(!stream_thread_run)
+			{
+				break;
+			}
+
+			streams.erase(std::remove_if(streams.begin(), streams.end(),
+				[](const std::shared_ptr<AudioStream>& s){ return s->released.load(); }), streams.end());
+			to_fill = streams;
+		}
+
+		// Decoding happens without holding the lock, so adding streams never waits on it
+		for(auto& stream : to_fill)
+		{
+			stream->fill();
+		}
+		to_fill.clear();
+	}
+}
+
+void AudioEngine::add_stream(std::shared_ptr<AudioStream> stream)
+{
+	stream_mtx.lock();
+	streams.push_back(std::move(stream));
+	stream_mtx.unlock();
 }
 
 std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos)
@@ -99,17 +177,17 @@ std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos)
 	float left = 1.0f, right = 1.0f;
 	// We project the sound source through up into the plane of the camera, and obtain
 	// the angle. Then we either do simple panning or our custom, better sounding algorithm for headphones
-	glm::dvec3 from_to = pos - listener_pos;
-	double dist_along_normal = glm::dot(from_to, listener_up);
-	glm::dvec3 proy_point = pos - listener_up * dist_along_normal;
-	glm::dvec3 from_to_proy = glm::normalize(proy_point - listener_pos);
+	glm::dvec3 from_to = pos - mix_listener.pos;
+	double dist_along_normal = glm::dot(from_to, mix_listener.up);
+	glm::dvec3 proy_point = pos - mix_listener.up * dist_along_normal;
+	glm::dvec3 from_to_proy = glm::normalize(proy_point - mix_listener.pos);
 	// Right handed coordinate system!
 
 	// We now find the angle between the proyected point and forward
 	// (1 means it's forward, 0.0 means it's 90º right / left, -1.0 means it's behind)
 	// (Left or right is determined by cangle_right)
-	double cangle = glm::dot(listener_fwd, from_to_proy) * glm::half_pi<float>();
-	bool cangle_right = glm::dot(from_to_proy, listener_right) > 0.0;
+	double cangle = glm::dot(mix_listener.fwd, from_to_proy) * glm::half_pi<float>();
+	bool cangle_right = glm::dot(from_to_proy, mix_listener.right) > 0.0;
 
 	if(simple_panning)
 	{
@@ -142,124 +220,533 @@ std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos)
 
 void AudioEngine::set_listener(glm::dvec3 pos, glm::dvec3 fwd, glm::dvec3 up, glm::dvec3 vel, double sos)
 {
-	mtx.lock();
-	listener_pos = pos;
-	listener_fwd = fwd;
-	listener_up = up;
-	listener_right = glm::cross(listener_fwd, listener_up);
-	listener_vel = vel;
-	speed_of_sound = sos;
-	mtx.unlock();
+	listener.pos = pos;
+	listener.fwd = fwd;
+	listener.up = up;
+	listener.right = glm::cross(fwd, up);
+	listener.vel = vel;
+	listener.speed_of_sound = sos;
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_LISTENER;
+	cmd.v[0] = pos;
+	cmd.v[1] = fwd;
+	cmd.v[2] = up;
+	cmd.v[3] = vel;
+	cmd.d = sos;
+	push_command(cmd);
 }
 
-// As a little guide, this is expected to be called a few times per frame, although it could greatly
-// depend on platform. We are not a realtime audio application so it's no big deal
-// For example, on my (tatjam's) linux system it's called at around 350FPS
-// TODO: We could use many optimizations, such as SIMD if possible
-void AudioEngine::data_callback(ma_device* device, void* output, const void* input, ma_uint32 frames)
+void AudioEngine::set_is_inside(bool val)
 {
+	is_inside = val;
 
-	auto* engine = (AudioEngine*)device->pUserData;
-	float* foutput = (float*)output;
-	float* fmix = engine->mix_buffer;
-	float* fmixch = engine->chmix_buffer;
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_IS_INSIDE;
+	cmd.b = val;
+	push_command(cmd);
+}
+
+void AudioEngine::set_master_gain(float val)
+{
+	master_gain = val;
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_MASTER_GAIN;
+	cmd.f = val;
+	push_command(cmd);
+}
+
+void AudioEngine::set_channel_gain(int channel, float val)
+{
+	channels[channel].gain = val;
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_CHANNEL_GAIN;
+	cmd.u = (uint32_t)channel;
+	cmd.f = val;
+	push_command(cmd);
+}
+
+uint64_t AudioEngine::get_next_command_tag()
+{
+	// Overflowing commands will be numbered after the ones in the ring
+	return commands.get_pushed() + overflow.size();
+}
 
-	if(frames > engine->mix_buffer_size)
+void AudioEngine::flush_overflow()
+{
+	size_t i = 0;
+	while(i < overflow.size() && commands.push(overflow[i]))
+	{
+		i++;
+	}
+	overflow.erase(overflow.begin(), overflow.begin() + i);
+}
+
+void AudioEngine::push_command(const AudioCommand& cmd)
+{
+	if(cmd.source != nullptr && cmd.source->destroyed)
 	{
-		logger->warn("Could not mix audio, request too big!");
 		return;
 	}
 
-	engine->mtx.lock();
+	std::lock_guard<std::mutex> lock(push_mtx);
+	if(!overflow.empty())
+	{
+		flush_overflow();
+	}
 
-	// Channels are mixed channel by channel and then master gain applied
-	for(size_t ch_i = 0; ch_i < engine->channels.size(); ch_i++)
+	// Keeps order, as nothing may skip ahead of the overflowing commands
+	if(!overflow.empty() || !commands.push(cmd))
+	{
+		overflow.push_back(cmd);
+	}
+}
+
+void AudioEngine::retire(std::unique_ptr<SampleSource> sample_source, AssetHandle<AudioClip> clip)
+{
+	std::lock_guard<std::mutex> lock(push_mtx);
+	Retired r;
+	r.tag = get_next_command_tag();
+	r.sample_source = std::move(sample_source);
+	r.clip = std::move(clip);
+	retired.push_back(std::move(r));
+}
+
+void AudioEngine::destroy_source(AudioSource* source)
+{
+	if(source->destroyed)
 	{
-		AudioChannel* ch = &engine->channels[ch_i];
-		float gain = ch->gain *
-				(engine->is_inside ? ch->internal_gain : ch->external_gain) *
-				(ch->use_hdr ? engine->hdr_gain : 1.0f);
+		return;
+	}
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::REMOVE_SOURCE;
+	cmd.source = source;
+	push_command(cmd);
+	source->destroyed = true;
 
-		if(gain == 0.0f)
+	std::lock_guard<std::mutex> lock(push_mtx);
+	for(auto it = sources.begin(); it != sources.end(); it++)
+	{
+		if(it->get() == source)
 		{
-			continue;
+			Retired r;
+			r.tag = get_next_command_tag();
+			r.source = std::move(*it);
+			retired.push_back(std::move(r));
+			sources.erase(it);
+			break;
 		}
+	}
+}
 
+void AudioEngine::update()
+{
+	// Sources which finished with destroy_when_finished were already removed by the audio thread
+	for(size_t i = 0; i < sources.size(); )
+	{
+		if(sources[i]->finished_destroy)
+		{
+			destroy_source(sources[i].get());
+		}
+		else
+		{
+			i++;
+		}
+	}
 
-		bool any = false;
-		bool first = true;
-		for(auto it = ch->sources.begin(); it != ch->sources.end(); )
+	std::lock_guard<std::mutex> lock(push_mtx);
+	if(!overflow.empty())
+	{
+		flush_overflow();
+	}
+
+	uint64_t consumed = commands.get_consumed();
+	retired.erase(std::remove_if(retired.begin(), retired.end(),
+		[consumed](const Retired& r){ return r.tag <= consumed; }), retired.end());
+}
+
+void AudioEngine::link_source(AudioSource* source)
+{
+	if(source->mix.linked)
+	{
+		return;
+	}
+
+	AudioChannel& ch = channels[source->in_channel];
+	source->mix.prev = nullptr;
+	source->mix.next = ch.sources;
+	if(ch.sources != nullptr)
+	{
+		ch.sources->mix.prev = source;
+	}
+	ch.sources = source;
+	source->mix.linked = true;
+}
+
+void AudioEngine::unlink_source(AudioSource* source)
+{
+	if(!source->mix.linked)
+	{
+		return;
+	}
+
+	AudioChannel& ch = channels[source->in_channel];
+	if(source->mix.prev != nullptr)
+	{
+		source->mix.prev->mix.next = source->mix.next;
+	}
+	else
+	{
+		ch.sources = source->mix.next;
+	}
+
+	if(source->mix.next != nullptr)
+	{
+		source->mix.next->mix.prev = source->mix.prev;
+	}
+
+	source->mix.prev = nullptr;
+	source->mix.next = nullptr;
+	source->mix.linked = false;
+
+	if(source->mix.hrtf_slot >= 0)
+	{
+		hrtf->release_voice(source->mix.hrtf_slot);
+		source->mix.hrtf_slot = -1;
+		source->mix.use_hrtf = false;
+		source->mix.hrtf_fade = 0.0f;
+	}
+}
+
+void AudioEngine::apply_command(const AudioCommand& cmd)
+{
+	AudioSource* src = cmd.source;
+	switch(cmd.type)
+	{
+	case AudioCommand::ADD_SOURCE:
+		link_source(src);
+		break;
+	case AudioCommand::REMOVE_SOURCE:
+		unlink_source(src);
+		break;
+	case AudioCommand::SET_PLAYING:
+		src->mix.playing = cmd.b;
+		if(cmd.b)
 		{
-			auto source = (*it);
-			if(source->marked_for_deletion)
+			src->mix.play_id = cmd.u;
+		}
+		break;
+	case AudioCommand::SET_3D_SOURCE:
+		src->mix.source_3d = cmd.b;
+		break;
+	case AudioCommand::SET_POSITION:
+		src->mix.pos = cmd.v[0];
+		break;
+	case AudioCommand::SET_GAIN:
+		src->mix.gain = cmd.f;
+		break;
+	case AudioCommand::SET_PITCH:
+		src->mix.pitch = cmd.f;
+		break;
+	case AudioCommand::SET_LOOPING:
+		src->mix.loops = cmd.b;
+		break;
+	case AudioCommand::SET_PRIORITY:
+		src->mix.priority = cmd.i;
+		break;
+	case AudioCommand::SET_DESTROY_WHEN_FINISHED:
+		src->mix.destroy_when_finished = true;
+		break;
+	case AudioCommand::SET_SAMPLE_SOURCE:
+		src->mix.sample_source = cmd.sample_source;
+		src->mix.cur_frame = 0.0;
+		break;
+	case AudioCommand::SET_LISTENER:
+		mix_listener.pos = cmd.v[0];
+		mix_listener.fwd = cmd.v[1];
+		mix_listener.up = cmd.v[2];
+		mix_listener.right = glm::cross(cmd.v[1], cmd.v[2]);
+		mix_listener.vel = cmd.v[3];
+		mix_listener.speed_of_sound = cmd.d;
+		break;
+	case AudioCommand::SET_IS_INSIDE:
+		mix_is_inside = cmd.b;
+		break;
+	case AudioCommand::SET_MASTER_GAIN:
+		mix_master_gain = cmd.f;
+		break;
+	case AudioCommand::SET_CHANNEL_GAIN:
+		channels[cmd.u].mix_gain = cmd.f;
+		break;
+	}
+}
+
+void AudioEngine::apply_commands()
+{
+	AudioCommand cmd;
+	while(commands.pop(cmd))
+	{
+		apply_command(cmd);
+		commands.release();
+	}
+}
+
+float AudioEngine::get_mix_gain(const AudioChannel& ch) const
+{
+	return ch.mix_gain *
+		(mix_is_inside ? ch.internal_gain : ch.external_gain) *
+		(ch.use_hdr ? hdr_gain : 1.0f);
+}
+
+void AudioEngine::select_voices()
+{
+	size_t count = 0;
+	for(AudioChannel& ch : channels)
+	{
+		float gain = get_mix_gain(ch);
+		for(AudioSource* source = ch.sources; source != nullptr; source = source->mix.next)
+		{
+			source->mix.is_virtual = true;
+			source->mix.use_hrtf = false;
+			if(!source->mix.playing || !source->mix.sample_source)
 			{
-				it = ch->sources.erase(it);
+				continue;
 			}
-			else
+
+			float left = 1.0f, right = 1.0f;
+			if(source->mix.source_3d)
 			{
-				float attenuation = 1.0f, left = 1.0f, right = 1.0f;
-				if (source->is_3d_source())
-				{
-					auto [nleft, nright] = engine->get_panning(source->get_position());
-					left = nleft;
-					right = nright;
-					float distance = (float) glm::distance(source->get_position(), engine->listener_pos);
-				}
+				auto [nleft, nright] = get_panning(source->mix.pos);
+				left = nleft;
+				right = nright;
+			}
+			source->mix.lgain = left * source->mix.gain;
+			source->mix.rgain = right * source->mix.gain;
 
-				// Source will NOT apply their own gain
-				bool written = source->mix_samples(fmix, frames);
-				any |= written;
+			float audibility = gain * glm::max(source->mix.lgain, source->mix.rgain);
+			if(audibility < audibility_threshold || count == voices.size())
+			{
+				continue;
+			}
 
-				// Apply directionality and attenuation, mixing into the channel
-				if (written)
-				{
-					float lgain = left * attenuation * source->get_gain();
-					float rgain = right * attenuation * source->get_gain();
-					for (ma_uint32 i = 0; i < frames; i++)
-					{
-						if (first)
-						{
-							// We must overwrite fmixch as it contains data from previous channels / audio requests
-							fmixch[i * 2 + 0] = fmix[i * 2 + 0] * lgain;
-							fmixch[i * 2 + 1] = fmix[i * 2 + 1] * rgain;
-						}
-						else
-						{
-							fmixch[i * 2 + 0] += fmix[i * 2 + 0] * lgain;
-							fmixch[i * 2 + 1] += fmix[i * 2 + 1] * rgain;
-						}
-					}
-					first = false;
-				}
-				it++;
+			voices[count].source = source;
+			voices[count].audibility = audibility;
+			voices[count].priority = source->mix.priority;
+			count++;
+		}
+	}
+
+	if(count > max_voices)
+	{
+		// Only need the most important ones in front, not sorted
+		std::nth_element(voices.begin(), voices.begin() + max_voices, voices.begin() + count,
+			[](const Voice& a, const Voice& b)
+			{
+				if(a.priority != b.priority)
+					return a.priority > b.priority;
+				return a.audibility > b.audibility;
+			});
+		count = max_voices;
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		voices[i].source->mix.is_virtual = false;
+	}
+
+	if(hrtf)
+	{
+		select_hrtf_voices(count);
+	}
+}
+
+glm::vec3 AudioEngine::get_listener_direction(glm::dvec3 pos) const
+{
+	glm::dvec3 from_to = pos - mix_listener.pos;
+	double dist = glm::length(from_to);
+	if(dist < 1e-6)
+	{
+		return glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+	from_to /= dist;
+
+	return glm::vec3(
+		glm::dot(from_to, mix_listener.right),
+		glm::dot(from_to, mix_listener.up),
+		glm::dot(from_to, mix_listener.fwd));
+}
+
+void AudioEngine::select_hrtf_voices(size_t count)
+{
+	// The mixed 3D voices go first, and of those the most important get the HRTF
+	auto end_3d = std::partition(voices.begin(), voices.begin() + count,
+		[](const Voice& v){ return v.source->mix.source_3d; });
+	size_t count_3d = end_3d - voices.begin();
+	size_t used = glm::min(count_3d, hrtf->get_voice_count());
+
+	// Hysteresis, so sources close to the cut don't keep switching
+	for(size_t i = 0; i < count_3d; i++)
+	{
+		if(voices[i].source->mix.hrtf_slot >= 0)
+		{
+			voices[i].audibility *= HRTF_KEEP_MARGIN;
+		}
+	}
+
+	if(count_3d > used)
+	{
+		std::nth_element(voices.begin(), voices.begin() + used, end_3d,
+			[](const Voice& a, const Voice& b)
+			{
+				if(a.priority != b.priority)
+					return a.priority > b.priority;
+				return a.audibility > b.audibility;
+			});
+	}
+
+	for(size_t i = 0; i < used; i++)
+	{
+		voices[i].source->mix.use_hrtf = true;
+	}
+
+	// Voices which finished fading out are freed first, so they can be given to the new sources.
+	// Virtual sources are not mixed, so they would never finish the fade
+	for(AudioChannel& ch : channels)
+	{
+		for(AudioSource* source = ch.sources; source != nullptr; source = source->mix.next)
+		{
+			if(source->mix.use_hrtf || source->mix.hrtf_slot < 0)
+			{
+				continue;
+			}
+
+			if(source->mix.is_virtual || source->mix.hrtf_fade <= 0.0f)
+			{
+				hrtf->release_voice(source->mix.hrtf_slot);
+				source->mix.hrtf_slot = -1;
+				source->mix.hrtf_fade = 0.0f;
+			}
+			else
+			{
+				hrtf->set_direction(source->mix.hrtf_slot, get_listener_direction(source->mix.pos));
 			}
+		}
+	}
 
+	for(size_t i = 0; i < used; i++)
+	{
+		AudioSource* source = voices[i].source;
+		if(source->mix.hrtf_slot < 0)
+		{
+			source->mix.hrtf_slot = hrtf->acquire_voice();
+			if(source->mix.hrtf_slot < 0)
+			{
+				// All voices are still fading out, try again next time
+				source->mix.use_hrtf = false;
+				continue;
+			}
 		}
 
-		if(any)
+		// The HRTF replaces the panning (lgain and rgain are kept for fading), the distance
+		// is already in the source gain
+		hrtf->set_direction(source->mix.hrtf_slot, get_listener_direction(source->mix.pos));
+	}
+}
+
+void AudioEngine::mix_block(float* output, uint32_t frames)
+{
+	// Channels are mixed channel by channel and then master gain applied
+	for(AudioChannel& ch : channels)
+	{
+		float gain = get_mix_gain(ch);
+
+		bool first = true;
+		for(AudioSource* source = ch.sources; source != nullptr; )
 		{
-			// Apply filters to fmixch
+			// The source may unlink itself while mixing
+			AudioSource* next = source->mix.next;
+
+			// Source will NOT apply their own gain. Virtual sources only advance
+			bool written = source->mix_samples(mix_buffer, frames, source->mix.is_virtual);
 
-			// Apply gain and HDR (*2 because we use stereo), and mix into the output
-			for (ma_uint32 i = 0; i < frames; i++)
+			// Apply directionality and attenuation, mixing into the channel
+			// We must overwrite chmix_buffer first, as it contains data from previous channels / audio requests
+			if(written)
 			{
-				foutput[i * 2 + 0] += fmixch[i * 2 + 0] * gain;
-				foutput[i * 2 + 1] += fmixch[i * 2 + 1] * gain;
+				AudioSource::MixState& m = source->mix;
+				if(m.hrtf_slot >= 0 && m.use_hrtf && m.hrtf_fade >= 1.0f)
+				{
+					hrtf->process(m.hrtf_slot, mix_buffer, frames);
+					AudioMix::mix_stereo(chmix_buffer, mix_buffer, frames, m.gain, m.gain, !first);
+				}
+				else if(m.hrtf_slot >= 0)
+				{
+					// Crossfade between panning and HRTF. The HRTF keeps processing while
+					// fading out so its convolution tail is not cut
+					float target = m.use_hrtf ? 1.0f : 0.0f;
+					float step = (float)frames / (float)HRTF_FADE_FRAMES;
+					float fade = m.use_hrtf ? glm::min(m.hrtf_fade + step, target) : glm::max(m.hrtf_fade - step, target);
+
+					memcpy(hrtf_buffer, mix_buffer, frames * sizeof(float) * 2);
+					hrtf->process(m.hrtf_slot, hrtf_buffer, frames);
+					AudioMix::mix_stereo_ramp(chmix_buffer, mix_buffer, frames,
+						m.lgain * (1.0f - m.hrtf_fade), m.rgain * (1.0f - m.hrtf_fade),
+						m.lgain * (1.0f - fade), m.rgain * (1.0f - fade), !first);
+					AudioMix::mix_stereo_ramp(chmix_buffer, hrtf_buffer, frames,
+						m.gain * m.hrtf_fade, m.gain * m.hrtf_fade, m.gain * fade, m.gain * fade, true);
+					m.hrtf_fade = fade;
+				}
+				else
+				{
+					AudioMix::mix_stereo(chmix_buffer, mix_buffer, frames, m.lgain, m.rgain, !first);
+				}
+				first = false;
 			}
+
+			source = next;
 		}
 
+		if(!first)
+		{
+			// Apply filters to chmix_buffer
+
+			// Apply gain and HDR, and mix into the output
+			AudioMix::add_scaled(output, chmix_buffer, frames, gain);
+		}
 	}
+}
 
-	engine->mtx.unlock();
+// As a little guide, this is expected to be called a few times per frame, although it could greatly
+// depend on platform. We are not a realtime audio application so it's no big deal
+// For example, on my (tatjam's) linux system it's called at around 350FPS
+void AudioEngine::data_callback(ma_device* device, void* output, const void* input, ma_uint32 frames)
+{
+	auto* engine = (AudioEngine*)device->pUserData;
+	float* foutput = (float*)output;
 
+	engine->apply_commands();
+	engine->select_voices();
+
+	for(ma_uint32 offset = 0; offset < frames; offset += engine->mix_buffer_size)
+	{
+		ma_uint32 block = glm::min(frames - offset, engine->mix_buffer_size);
+		engine->mix_block(foutput + offset * 2, block);
+	}
 }
 
 std::weak_ptr<AudioSource> AudioEngine::create_audio_source(uint32_t in_channel)
 {
-	mtx.lock();
-	auto src = std::make_shared<AudioSource>(AudioSource(this, in_channel));
-	channels[in_channel].sources.push_back(src);
-	mtx.unlock();
+	auto src = std::make_shared<AudioSource>(this, in_channel);
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::ADD_SOURCE;
+	cmd.source = src.get();
+	push_command(cmd);
+
+	std::lock_guard<std::mutex> lock(push_mtx);
+	sources.push_back(src);
 	return src;
 }
-
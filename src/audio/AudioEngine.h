@@ -3,9 +3,19 @@
 #include <miniaudio/miniaudio.h>
 #include <mutex>
 #include <array>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <glm/glm.hpp>
+#include "AudioCommand.h"
+#include "SampleSource.h"
+#include "HRTFSpatializer.h"
+#include <assets/AssetManager.h>
+#include <assets/AudioClip.h>
 
 class AudioSource;
+class AudioStream;
 
 struct AudioChannel
 {
@@ -19,38 +29,84 @@ struct AudioChannel
 	// Should this audio channel affect the HDR simulation?
 	bool use_hdr;
 
-	// We handle the lifetime of the sources, which must be created by the engine
-	std::vector<std::shared_ptr<AudioSource>> sources;
+	// Audio thread copy of gain
+	float mix_gain;
+
+	// First source of the channel, audio thread only. The AudioEngine owns the sources
+	AudioSource* sources;
 
 };
 
 // TODO: The AudioEngine should allow disabling audio, and then it will simulate playback
 // We always use f32 audio, as it seems to be convenient, if this supposes a big perfomance hit
 // it could be changed to s16, which is the typical internal format, at the cost of mixing precision!
-// We always use the native sample rate and resample loaded audio
+// We always use the native sample rate, audio at other rates is resampled in real time as it is mixed
 // We have a fixed number of channels, each with the possibility of applying effects
 // This is more or less fixed, as having arbitrary channels feels unnecesary. We clearly separate the
 // UI from real sounds, which are affected by HDR and effects.
 // TODO: Maybe AudioEngine should be lower level and care less about the game? Probably unnecesary
-// TODO: We could implement HRTF as this game could easily benefit from the 3D effects
+// 3D sources may be rendered through a HRTF (audio.hrtf in the config), which sounds much better
+// on headphones. It's expensive, so only the audio.hrtf_voices most important sources use it,
+// the rest use the cheaper panning. Sources keep their HRTF voice until they are clearly less
+// important than others, and switching between both is crossfaded
 class AudioEngine
 {
 private:
 
 	// We use two mixing buffers to allow stereo sounds and effects
+	// Requests bigger than the buffers are mixed in blocks
+	static constexpr uint32_t MIX_BLOCK_FRAMES = 1024;
 	float* mix_buffer;
 	float* chmix_buffer;
 	uint32_t mix_buffer_size;
 
+	// Voice virtualization: only the max_voices most important sources (by priority, and then
+	// by how loud they are) whose gain is over audibility_threshold are mixed. The rest are
+	// virtual, their playback advances but they are not mixed
+	struct Voice
+	{
+		AudioSource* source;
+		float audibility;
+		int priority;
+	};
+	// Fixed size, so the audio thread doesn't allocate. Sources past it are always virtual
+	std::vector<Voice> voices;
+	size_t max_voices;
+	float audibility_threshold;
+
+	// Null if HRTF is disabled
+	std::unique_ptr<HRTFSpatializer> hrtf;
+	size_t hrtf_voices;
+	// Sources using the HRTF are this many times more audible when selecting the HRTF voices
+	static constexpr float HRTF_KEEP_MARGIN = 2.0f;
+	// Length of the crossfade between panning and HRTF
+	static constexpr uint32_t HRTF_FADE_FRAMES = 2048;
+	// Sources using the HRTF while fading are processed here, so the panned input is kept
+	float* hrtf_buffer;
+
+	// Audio thread
+	float get_mix_gain(const AudioChannel& ch) const;
+	void select_voices();
+	void select_hrtf_voices(size_t count);
+	glm::vec3 get_listener_direction(glm::dvec3 pos) const;
+	void mix_block(float* output, uint32_t frames);
+
 	friend class AudioSource;
 
-	glm::dvec3 listener_pos;
-	glm::dvec3 listener_fwd;
-	glm::dvec3 listener_vel;
-	double speed_of_sound;
-	// Precomputed
-	glm::dvec3 listener_right;
-	glm::dvec3 listener_up;
+	struct Listener
+	{
+		glm::dvec3 pos;
+		glm::dvec3 fwd;
+		glm::dvec3 vel;
+		double speed_of_sound;
+		// Precomputed
+		glm::dvec3 right;
+		glm::dvec3 up;
+	};
+
+	// Main thread copy (for the getters) and audio thread copy
+	Listener listener;
+	Listener mix_listener;
 
 
 
@@ -60,6 +116,7 @@ private:
 
 	// Are we inside the cockpit?
 	bool is_inside;
+	bool mix_is_inside;
 
 	// For the settings interface, and to store in the config. We compare
 	// the raw strings, and if missing, use the default device
@@ -70,6 +127,7 @@ private:
 
 	// Gain applied after mixing
 	float master_gain;
+	float mix_master_gain;
 
 	// Channel layout:
 	// Channel 0: UI, Music, etc... (No effects, no HDR)
@@ -79,35 +137,83 @@ private:
 	std::array<AudioChannel, 4> channels;
 
 
-	// Remember that audio is in a different thread!
-	std::mutex mtx;
+	// Remember that audio is in a different thread! The audio thread never takes a lock,
+	// all changes go through the command ring and are applied at the start of the callback
+	AudioCommandRing commands;
+	// Commands which didn't fit in the ring, pushed on the next push_command or update
+	std::vector<AudioCommand> overflow;
+	// Only between threads pushing commands, the audio thread never takes it
+	std::mutex push_mtx;
+
+	// Owned sources, in the main thread
+	std::vector<std::shared_ptr<AudioSource>> sources;
+
+	// Things the audio thread may still be using, freed by update once it consumed
+	// all commands pushed before they were retired
+	struct Retired
+	{
+		uint64_t tag;
+		std::shared_ptr<AudioSource> source;
+		std::unique_ptr<SampleSource> sample_source;
+		AssetHandle<AudioClip> clip;
+	};
+	std::vector<Retired> retired;
+
+	void flush_overflow();
+	uint64_t get_next_command_tag();
+	// Audio thread
+	void apply_commands();
+	void apply_command(const AudioCommand& cmd);
+	void link_source(AudioSource* source);
+	void unlink_source(AudioSource* source);
+	void destroy_source(AudioSource* source);
 
 	bool simple_panning;
 
+	// Streamed clips are decoded in this thread, away from the audio thread
+	std::thread stream_thread;
+	std::mutex stream_mtx;
+	std::condition_variable stream_cv;
+	std::vector<std::shared_ptr<AudioStream>> streams;
+	bool stream_thread_run;
+
+	void stream_thread_func();
+
 public:
 
-	// Returns left, right pair.
-	// TODO: HRTF filter? Could be CPU expensive but sounds awesome
+	// Returns left, right pair. Audio thread only
 	std::pair<float, float> get_panning(glm::dvec3 pos);
 
 	size_t get_sample_rate() const { return sample_rate; }
 
 	bool get_is_inside() const { return is_inside; }
-	void set_is_inside(bool val) {mtx.lock(); is_inside = val; mtx.unlock(); }
+	void set_is_inside(bool val);
 
 	float get_master_gain() const { return master_gain; }
-	void set_master_gain(float val) {mtx.lock(); master_gain = val; mtx.unlock(); }
+	void set_master_gain(float val);
 
 	float get_channel_gain(int channel) const { return channels[channel].gain; }
-	void set_channel_gain(int channel, float val) { mtx.lock(); channels[channel].gain = val; mtx.unlock(); }
+	void set_channel_gain(int channel, float val);
 
 	void set_listener(glm::dvec3 pos, glm::dvec3 fwd, glm::dvec3 up, glm::dvec3 vel, double speed_of_sound);
-	glm::dvec3 get_listener_pos() const { return listener_pos; }
-	glm::dvec3 get_listener_fwd() const { return listener_fwd; }
-	glm::dvec3 get_listener_up() const { return listener_up; }
+	glm::dvec3 get_listener_pos() const { return listener.pos; }
+	glm::dvec3 get_listener_fwd() const { return listener.fwd; }
+	glm::dvec3 get_listener_up() const { return listener.up; }
 
 	std::weak_ptr<AudioSource> create_audio_source(uint32_t in_channel);
 
+	// Sends a change to the audio thread, never waits for it. Commands for destroyed
+	// sources are ignored
+	void push_command(const AudioCommand& cmd);
+	// The objects are freed once the audio thread can't be using them anymore
+	void retire(std::unique_ptr<SampleSource> sample_source, AssetHandle<AudioClip> clip);
+
+	// Call once per frame from the main thread, frees destroyed sources
+	void update();
+
+	// The stream will be kept filled until it's released
+	void add_stream(std::shared_ptr<AudioStream> stream);
+
 	static void data_callback(ma_device* device, void* output, const void* input, ma_uint32 frames);
 
 	explicit AudioEngine(const cpptoml::table& settings);
@@ -0,0 +1,88 @@
+#include "AudioMix.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AUDIO_MIX_SSE
+#include <xmmintrin.h>
+#endif
+
+void AudioMix::mix_stereo(float* dst, const float* src, size_t frames, float lgain, float rgain, bool accumulate)
+{
+	size_t i = 0;
+#ifdef AUDIO_MIX_SSE
+	// Two frames per iteration
+	__m128 g = _mm_setr_ps(lgain, rgain, lgain, rgain);
+	if(accumulate)
+	{
+		for(; i + 2 <= frames; i += 2)
+		{
+			__m128 s = _mm_loadu_ps(src + i * 2);
+			__m128 d = _mm_loadu_ps(dst + i * 2);
+			_mm_storeu_ps(dst + i * 2, _mm_add_ps(d, _mm_mul_ps(s, g)));
+		}
+	}
+	else
+	{
+		for(; i + 2 <= frames; i += 2)
+		{
+			__m128 s = _mm_loadu_ps(src + i * 2);
+			_mm_storeu_ps(dst + i * 2, _mm_mul_ps(s, g));
+		}
+	}
+#endif
+
+	for(; i < frames; i++)
+	{
+		if(accumulate)
+		{
+			dst[i * 2 + 0] += src[i * 2 + 0] * lgain;
+			dst[i * 2 + 1] += src[i * 2 + 1] * rgain;
+		}
+		else
+		{
+			dst[i * 2 + 0] = src[i * 2 + 0] * lgain;
+			dst[i * 2 + 1] = src[i * 2 + 1] * rgain;
+		}
+	}
+}
+
+void AudioMix::add_scaled(float* dst, const float* src, size_t frames, float gain)
+{
+	size_t i = 0;
+	size_t count = frames * 2;
+#ifdef AUDIO_MIX_SSE
+	__m128 g = _mm_set1_ps(gain);
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 d = _mm_loadu_ps(dst + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+	}
+#endif
+
+	for(; i < count; i++)
+	{
+		dst[i] += src[i] * gain;
+	}
+}
+
+void AudioMix::mix_stereo_ramp(float* dst, const float* src, size_t frames, float lgain0, float rgain0,
+	float lgain1, float rgain1, bool accumulate)
+{
+	float step = frames > 0 ? 1.0f / (float)frames : 0.0f;
+	for(size_t i = 0; i < frames; i++)
+	{
+		float t = (float)i * step;
+		float lgain = lgain0 + (lgain1 - lgain0) * t;
+		float rgain = rgain0 + (rgain1 - rgain0) * t;
+		if(accumulate)
+		{
+			dst[i * 2 + 0] += src[i * 2 + 0] * lgain;
+			dst[i * 2 + 1] += src[i * 2 + 1] * rgain;
+		}
+		else
+		{
+			dst[i * 2 + 0] = src[i * 2 + 0] * lgain;
+			dst[i * 2 + 1] = src[i * 2 + 1] * rgain;
+		}
+	}
+}
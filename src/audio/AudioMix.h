@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+
+// Mixing kernels used by the AudioEngine, all buffers are interleaved stereo f32
+// Uses SSE when available (always on x86-64), otherwise plain loops
+class AudioMix
+{
+public:
+
+	// dst = src * (lgain, rgain), or dst += src * (lgain, rgain) if accumulate
+	static void mix_stereo(float* dst, const float* src, size_t frames, float lgain, float rgain, bool accumulate);
+
+	// dst += src * gain
+	static void add_scaled(float* dst, const float* src, size_t frames, float gain);
+
+	// As mix_stereo, but the gains go linearly from (lgain0, rgain0) to (lgain1, rgain1) over the frames
+	// Plain loop, only used for short fades
+	static void mix_stereo_ramp(float* dst, const float* src, size_t frames, float lgain0, float rgain0,
+		float lgain1, float rgain1, bool accumulate);
+};
@@ -1,9 +1,9 @@
 #include "AudioSource.h"
 #include "AudioEngine.h"
 
-bool AudioSource::mix_samples(void* target, size_t count)
+bool AudioSource::mix_samples(void* target, size_t count, bool is_virtual)
 {
-	if(!sample_source || !playing || pitch <= 0.0f)
+	if(!mix.sample_source || !mix.playing || mix.pitch <= 0.0f)
 	{
 		// this effectively waits for an audio source to be added
 		return false;
@@ -11,46 +11,50 @@ bool AudioSource::mix_samples(void* target, size_t count)
 
 	audio_played = true;
 
-	size_t sample_rate = engine->get_sample_rate() * pitch;
+	uint32_t target_rate = (uint32_t)engine->get_sample_rate();
 
-	int32_t jump = sample_source->mix_samples((float*)target, count, cur_sample, loops, sample_rate, engine->get_sample_rate());
-	if(jump >= 0)
+	double jump;
+	if(is_virtual)
 	{
-		cur_sample = jump;
+		jump = mix.sample_source->skip_samples((float*)target, count, mix.cur_frame, mix.loops, mix.pitch, target_rate);
+	}
+	else
+	{
+		jump = mix.sample_source->mix_samples((float*)target, count, mix.cur_frame, mix.loops, mix.pitch, target_rate);
+	}
+	if(jump >= 0.0)
+	{
+		mix.cur_frame = jump;
 	}
 	else
 	{
 		// Audio playback is finished
-		if(loops)
+		if(mix.loops)
 		{
-			cur_sample = 0;
+			mix.cur_frame = 0.0;
 		}
 		else
 		{
-			playing = false;
-			cur_sample = 0;
+			mix.playing = false;
+			mix.cur_frame = 0.0;
 			audio_played = false;
+			ended_id = mix.play_id;
 
-			if(destroy_when_finished)
+			if(mix.destroy_when_finished)
 			{
-				destroy_from_thread();
+				// We can't free it here, the main thread does
+				engine->unlink_source(this);
+				finished_destroy = true;
 			}
 		}
 	}
 
-	return true;
-}
-
-void AudioSource::destroy_from_thread()
-{
-	marked_for_deletion = true;
+	return !is_virtual;
 }
 
 void AudioSource::destroy()
 {
-	engine->mtx.lock();
-	destroy_from_thread();
-	engine->mtx.unlock();
+	engine->destroy_source(this);
 }
 
 AudioSource::AudioSource(AudioEngine *eng, uint32_t channel)
@@ -62,75 +66,145 @@ AudioSource::AudioSource(AudioEngine *eng, uint32_t channel)
 	playing = false;
 	gain = 1.0f;
 	pitch = 1.0f;
-	sample_source = nullptr;
 	audio_clip_src = AssetHandle<AudioClip>();
 	generic_src = nullptr;
 	loops = false;
-	marked_for_deletion = false;
+	priority = 0;
+	play_id = 0;
+	destroyed = false;
+	pos = glm::dvec3(0.0);
+	vel = glm::dvec3(0.0);
+
 	audio_played = false;
+	ended_id = 0;
+	finished_destroy = false;
+}
 
-	cur_sample = 0;
-	destroy_when_finished = false;
+void AudioSource::set_destroy_when_finished()
+{
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_DESTROY_WHEN_FINISHED;
+	cmd.source = this;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_playing(bool value)
 {
-	engine->mtx.lock();
 	playing = value;
-	if(!value) audio_played = false;
-	engine->mtx.unlock();
+	if(value)
+	{
+		play_id++;
+	}
+	else
+	{
+		audio_played = false;
+	}
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_PLAYING;
+	cmd.source = this;
+	cmd.b = value;
+	cmd.u = play_id;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_3d_source(bool value)
 {
-	engine->mtx.lock();
 	source_3d = value;
-	engine->mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_3D_SOURCE;
+	cmd.source = this;
+	cmd.b = value;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_position(glm::dvec3 pos)
 {
-	engine->mtx.lock();
 	this->pos = pos;
-	engine->mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_POSITION;
+	cmd.source = this;
+	cmd.v[0] = pos;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_gain(float val)
 {
-	engine->mtx.lock();
 	gain = val;
-	engine->mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_GAIN;
+	cmd.source = this;
+	cmd.f = val;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_pitch(float val)
 {
-	engine->mtx.lock();
 	pitch = val;
-	engine->mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_PITCH;
+	cmd.source = this;
+	cmd.f = val;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_source_clip(const AssetHandle<AudioClip>& ast)
 {
+	// Streamed clips need decoding state for every source playing them
+	std::unique_ptr<SampleSource> stream = nullptr;
+	if(ast->is_streamed())
+	{
+		stream = ast->create_stream();
+	}
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_SAMPLE_SOURCE;
+	cmd.source = this;
+	cmd.sample_source = stream ? stream.get() : ast.get_noconst();
+	engine->push_command(cmd);
+
+	// The audio thread may still be using the previous ones
+	engine->retire(std::move(generic_src), std::move(audio_clip_src));
 	// We obtain a new reference
 	audio_clip_src = ast.duplicate();
-	// We can now safely store a pointer
-	engine->mtx.lock();
-	sample_source = ast.get_noconst();
-	generic_src = nullptr;
-	engine->mtx.unlock();
+	generic_src = std::move(stream);
 }
 
 void AudioSource::set_looping(bool val)
 {
-	engine->mtx.lock();
 	loops = val;
-	engine->mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_LOOPING;
+	cmd.source = this;
+	cmd.b = val;
+	engine->push_command(cmd);
 }
 
 void AudioSource::set_source_generic(std::unique_ptr<SampleSource>& src)
 {
-	sample_source = src.get();
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_SAMPLE_SOURCE;
+	cmd.source = this;
+	cmd.sample_source = src.get();
+	engine->push_command(cmd);
+
+	engine->retire(std::move(generic_src), std::move(audio_clip_src));
 	audio_clip_src = AssetHandle<AudioClip>();
 	generic_src = std::move(src);
 }
 
+void AudioSource::set_priority(int val)
+{
+	priority = val;
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::SET_PRIORITY;
+	cmd.source = this;
+	cmd.i = val;
+	engine->push_command(cmd);
+}
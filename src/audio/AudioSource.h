@@ -2,21 +2,24 @@
 #include "SampleSource.h"
 #include "assets/AssetManager.h"
 #include "assets/AudioClip.h"
+#include <atomic>
 
 class AudioEngine;
 // The audio source is the multi-purpose class used for all audio sources
 // It allows both 2D and 3D audio
 // Their lifetime is handled by AudioEngine, std::weak_ptr is recommended
+// All functions must be called from the main thread. Changes are sent to the audio
+// thread through the AudioEngine command ring, so they never wait on it
 class AudioSource
 {
 private:
 
+	friend class AudioEngine;
+
 	// Asset references if using an AudioClip, we actually use the sample_source pointer
 	AssetHandle<AudioClip> audio_clip_src;
 	std::unique_ptr<SampleSource> generic_src;
 
-	SampleSource* sample_source;
-
 	float gain;
 	// Pitch basically means relative play speed.
 	// Values other than 1 involve resampling as all audio is at the same frequency by default
@@ -27,28 +30,67 @@ private:
 	bool source_3d;
 	bool playing;
 	bool loops;
-
-	uint32_t cur_sample;
+	int priority;
+	// Increased every time playback is requested, to tell apart which playback ended
+	uint32_t play_id;
+	// Set once the source is handed to the engine for deletion, no more commands are sent
+	bool destroyed;
 
 	glm::dvec3 pos, vel;
 
-	bool destroy_when_finished = false;
-	bool audio_played;
+	// Audio thread copy of the state, only touched by the audio thread
+	struct MixState
+	{
+		SampleSource* sample_source = nullptr;
+		float gain = 1.0f;
+		float pitch = 1.0f;
+		glm::dvec3 pos = glm::dvec3(0.0);
+		bool source_3d = false;
+		bool playing = false;
+		bool loops = false;
+		bool destroy_when_finished = false;
+		int priority = 0;
+		uint32_t play_id = 0;
+		// Position in the frames of the sample source, fractional when resampling
+		double cur_frame = 0.0;
+
+		// Set by the voice selection every callback
+		bool is_virtual = true;
+		float lgain = 1.0f;
+		float rgain = 1.0f;
+		// Rendered binaurally through the engine HRTFSpatializer, using that voice. The voice
+		// is kept while fading out, hrtf_fade goes from 0 (panned) to 1 (HRTF)
+		bool use_hrtf = false;
+		int hrtf_slot = -1;
+		float hrtf_fade = 0.0f;
+
+		// Sources of each channel are an intrusive list, so adding and removing never allocates
+		bool linked = false;
+		AudioSource* prev = nullptr;
+		AudioSource* next = nullptr;
+	};
+	MixState mix;
+
+	// Written by the audio thread
+	std::atomic<bool> audio_played;
+	std::atomic<uint32_t> ended_id;
+	// Finished with destroy_when_finished, the main thread frees it on AudioEngine::update
+	std::atomic<bool> finished_destroy;
 
 public:
-	bool marked_for_deletion;
 
-	void set_destroy_when_finished(){ destroy_when_finished = true; }
+	void set_destroy_when_finished();
 
 	void set_playing(bool value);
 	// Returns true if the audio is actually generating sound
 	bool is_playing() const { return audio_played; }
 	// Returns true if the audio is playing, or waiting to play (if for
 	// example no source is set, but set_playing(true) has been called)
-	bool is_playing_or_queued() const { return playing; }
+	bool is_playing_or_queued() const { return playing && ended_id != play_id; }
 
-	// Return true if anything was played
-	bool mix_samples(void* target, size_t count);
+	// Audio thread only. Return true if anything was written to target
+	// Virtual sources advance their playback but don't write anything
+	bool mix_samples(void* target, size_t count, bool is_virtual);
 
 	bool is_3d_source() const { return source_3d; }
 	void set_3d_source(bool value);
@@ -66,14 +108,18 @@ public:
 	bool is_looping() const { return loops; }
 	void set_looping(bool val);
 
-	// We duplicate the asset
+	// If there are more audible sources than the voice budget, those with higher
+	// priority are mixed first. The rest keep playing silently
+	int get_priority() const { return priority; }
+	void set_priority(int val);
+
+	// We duplicate the asset. Playback restarts from the beginning of the clip
 	void set_source_clip(const AssetHandle<AudioClip>& ast);
 	// Moves the sample source
 	void set_source_generic(std::unique_ptr<SampleSource>& src);
 
-	// Be aware, all other pointers to this will be invalidated
+	// Be aware, all other pointers to this will be invalidated (once the audio thread is done with it)
 	void destroy();
-	void destroy_from_thread();
 	AudioSource(AudioEngine* eng, uint32_t channel);
 };
 
@@ -0,0 +1,87 @@
+#include "FFT.h"
+#include <util/Logger.h>
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+
+FFT::FFT(size_t size)
+{
+	logger->check(size >= 2 && (size & (size - 1)) == 0, "FFT size must be a power of two");
+	this->size = size;
+
+	twiddles.resize(size / 2);
+	for(size_t i = 0; i < size / 2; i++)
+	{
+		double angle = -glm::two_pi<double>() * (double)i / (double)size;
+		twiddles[i] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+	}
+
+	size_t bits = 0;
+	while(((size_t)1 << bits) < size)
+	{
+		bits++;
+	}
+
+	bit_reverse.resize(size);
+	for(size_t i = 0; i < size; i++)
+	{
+		size_t r = 0;
+		for(size_t b = 0; b < bits; b++)
+		{
+			if(i & ((size_t)1 << b))
+			{
+				r |= (size_t)1 << (bits - 1 - b);
+			}
+		}
+		bit_reverse[i] = r;
+	}
+}
+
+void FFT::transform(std::complex<float>* data, bool inverse) const
+{
+	for(size_t i = 0; i < size; i++)
+	{
+		size_t r = bit_reverse[i];
+		if(r > i)
+		{
+			std::swap(data[i], data[r]);
+		}
+	}
+
+	for(size_t len = 2; len <= size; len *= 2)
+	{
+		size_t half = len / 2;
+		size_t step = size / len;
+		for(size_t start = 0; start < size; start += len)
+		{
+			for(size_t k = 0; k < half; k++)
+			{
+				std::complex<float> w = twiddles[k * step];
+				if(inverse)
+				{
+					w = std::conj(w);
+				}
+
+				std::complex<float> a = data[start + k];
+				std::complex<float> b = mul(data[start + k + half], w);
+				data[start + k] = a + b;
+				data[start + k + half] = a - b;
+			}
+		}
+	}
+}
+
+void FFT::forward(std::complex<float>* data) const
+{
+	transform(data, false);
+}
+
+void FFT::inverse(std::complex<float>* data) const
+{
+	transform(data, true);
+
+	float scale = 1.0f / (float)size;
+	for(size_t i = 0; i < size; i++)
+	{
+		data[i] *= scale;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <complex>
+#include <vector>
+#include <cstddef>
+
+// In-place iterative radix-2 FFT of a fixed power of two size. Twiddles and the
+// bit reversal permutation are precomputed, so transforms don't allocate
+class FFT
+{
+public:
+
+	// std::complex multiplication handles infinities and NaNs, which is a lot slower
+	static std::complex<float> mul(std::complex<float> a, std::complex<float> b)
+	{
+		return std::complex<float>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+	}
+
+private:
+
+	size_t size;
+	std::vector<std::complex<float>> twiddles;
+	std::vector<size_t> bit_reverse;
+
+	void transform(std::complex<float>* data, bool inverse) const;
+
+public:
+
+	size_t get_size() const { return size; }
+
+	void forward(std::complex<float>* data) const;
+	// Scaled by 1 / size, so forward followed by inverse returns the input
+	void inverse(std::complex<float>* data) const;
+
+	explicit FFT(size_t size);
+};
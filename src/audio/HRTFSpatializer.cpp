@@ -0,0 +1,270 @@
+#include "HRTFSpatializer.h"
+#include "Resampler.h"
+#include <assets/HRTFSet.h>
+#include <util/Logger.h>
+#include <algorithm>
+
+HRTFSpatializer::HRTFSpatializer(const HRTFSet& set, uint32_t sample_rate, size_t voice_count) : fft(FFT_SIZE)
+{
+	logger->check(!set.measurements.empty(), "HRTF set has no measurements");
+
+	double ratio = (double)set.sampling_rate / (double)sample_rate;
+	size_t ir_length = (size_t)glm::ceil((double)set.ir_length / ratio);
+	partitions = (uint32_t)glm::max((ir_length + BLOCK - 1) / BLOCK, (size_t)1);
+
+	// Interleaved left + right, so both ears are resampled at once
+	std::vector<float> ir(set.ir_length * 2);
+	std::vector<Complex> partition(FFT_SIZE);
+	filters.resize(set.measurements.size() * partitions * FFT_SIZE);
+	for(size_t m = 0; m < set.measurements.size(); m++)
+	{
+		const HRTFSet::Measurement& meas = set.measurements[m];
+		directions.push_back(glm::normalize(meas.direction));
+
+		for(size_t i = 0; i < set.ir_length; i++)
+		{
+			ir[i * 2 + 0] = meas.left[i];
+			ir[i * 2 + 1] = meas.right[i];
+		}
+
+		for(uint32_t p = 0; p < partitions; p++)
+		{
+			std::fill(partition.begin(), partition.end(), Complex(0.0f, 0.0f));
+			for(uint32_t i = 0; i < BLOCK; i++)
+			{
+				size_t frame = p * BLOCK + i;
+				if(frame >= ir_length)
+				{
+					break;
+				}
+
+				float left, right;
+				if(ratio == 1.0)
+				{
+					left = ir[frame * 2 + 0];
+					right = ir[frame * 2 + 1];
+				}
+				else
+				{
+					Resampler::read_frame(ir.data(), 2, (int64_t)set.ir_length, false, (double)frame * ratio, left, right);
+					// The response has 1 / ratio times as many taps, this keeps its DC gain
+					left *= (float)ratio;
+					right *= (float)ratio;
+				}
+				partition[i] = Complex(left, right);
+			}
+
+			// Second half stays zero, as required by overlap-save
+			fft.forward(partition.data());
+			std::copy(partition.begin(), partition.end(), filters.begin() + (m * partitions + p) * FFT_SIZE);
+		}
+	}
+
+	voices.resize(voice_count);
+	for(Voice& v : voices)
+	{
+		v.used = false;
+		v.fdl.resize(partitions * FFT_SIZE);
+		v.filter.resize(partitions * FFT_SIZE);
+		v.old_filter.resize(partitions * FFT_SIZE);
+		v.input.resize(BLOCK * 2);
+		v.output.resize(BLOCK * 2);
+	}
+
+	work.resize(FFT_SIZE);
+	work_old.resize(FFT_SIZE);
+}
+
+int HRTFSpatializer::acquire_voice()
+{
+	for(size_t i = 0; i < voices.size(); i++)
+	{
+		Voice& v = voices[i];
+		if(!v.used)
+		{
+			v.used = true;
+			std::fill(v.fdl.begin(), v.fdl.end(), Complex(0.0f, 0.0f));
+			std::fill(v.input.begin(), v.input.end(), 0.0f);
+			std::fill(v.output.begin(), v.output.end(), 0.0f);
+			v.fdl_pos = 0;
+			v.fill = 0;
+			v.crossfade = false;
+			v.has_direction = false;
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+void HRTFSpatializer::release_voice(int voice)
+{
+	voices[voice].used = false;
+}
+
+void HRTFSpatializer::interpolate(glm::vec3 dir, Complex* out) const
+{
+	// Three nearest measurements, weighted by inverse angular distance
+	int nearest[3] = {-1, -1, -1};
+	float best[3] = {-2.0f, -2.0f, -2.0f};
+	for(size_t i = 0; i < directions.size(); i++)
+	{
+		float d = glm::dot(directions[i], dir);
+		for(int k = 0; k < 3; k++)
+		{
+			if(d > best[k])
+			{
+				for(int j = 2; j > k; j--)
+				{
+					best[j] = best[j - 1];
+					nearest[j] = nearest[j - 1];
+				}
+				best[k] = d;
+				nearest[k] = (int)i;
+				break;
+			}
+		}
+	}
+
+	float weights[3] = {0.0f, 0.0f, 0.0f};
+	float total = 0.0f;
+	for(int k = 0; k < 3; k++)
+	{
+		if(nearest[k] < 0)
+		{
+			continue;
+		}
+
+		float angle = glm::acos(glm::clamp(best[k], -1.0f, 1.0f));
+		if(angle < 1e-4f)
+		{
+			// Exactly on a measurement
+			weights[0] = weights[1] = weights[2] = 0.0f;
+			weights[k] = 1.0f;
+			total = 1.0f;
+			break;
+		}
+		weights[k] = 1.0f / angle;
+		total += weights[k];
+	}
+
+	size_t size = partitions * FFT_SIZE;
+	std::fill(out, out + size, Complex(0.0f, 0.0f));
+	for(int k = 0; k < 3; k++)
+	{
+		if(nearest[k] < 0 || weights[k] == 0.0f)
+		{
+			continue;
+		}
+
+		float w = weights[k] / total;
+		const Complex* src = &filters[nearest[k] * size];
+		for(size_t i = 0; i < size; i++)
+		{
+			out[i] += src[i] * w;
+		}
+	}
+}
+
+void HRTFSpatializer::set_direction(int voice, glm::vec3 dir)
+{
+	Voice& v = voices[voice];
+	if(!v.has_direction)
+	{
+		interpolate(dir, v.filter.data());
+		v.direction = dir;
+		v.has_direction = true;
+		return;
+	}
+
+	if(glm::dot(dir, v.direction) > glm::cos(UPDATE_ANGLE))
+	{
+		return;
+	}
+
+	// If a crossfade is already pending, it starts from the filter that was last heard
+	if(!v.crossfade)
+	{
+		std::swap(v.filter, v.old_filter);
+		v.crossfade = true;
+	}
+	interpolate(dir, v.filter.data());
+	v.direction = dir;
+}
+
+void HRTFSpatializer::accumulate(const Voice& v, const std::vector<Complex>& filter, Complex* out) const
+{
+	std::fill(out, out + FFT_SIZE, Complex(0.0f, 0.0f));
+	for(uint32_t p = 0; p < partitions; p++)
+	{
+		// Partition p of the filter goes with the input from p blocks ago
+		uint32_t slot = (v.fdl_pos + partitions - p) % partitions;
+		const Complex* x = &v.fdl[slot * FFT_SIZE];
+		const Complex* h = &filter[p * FFT_SIZE];
+		for(uint32_t i = 0; i < FFT_SIZE; i++)
+		{
+			out[i] += FFT::mul(x[i], h[i]);
+		}
+	}
+}
+
+void HRTFSpatializer::process_block(Voice& v)
+{
+	// Spectrum of the previous and current input blocks goes into the delay line
+	v.fdl_pos = (v.fdl_pos + 1) % partitions;
+	Complex* x = &v.fdl[v.fdl_pos * FFT_SIZE];
+	for(uint32_t i = 0; i < FFT_SIZE; i++)
+	{
+		x[i] = Complex(v.input[i], 0.0f);
+	}
+	fft.forward(x);
+
+	accumulate(v, v.filter, work.data());
+	fft.inverse(work.data());
+
+	if(v.crossfade)
+	{
+		accumulate(v, v.old_filter, work_old.data());
+		fft.inverse(work_old.data());
+	}
+
+	// Overlap-save, only the second half is valid
+	for(uint32_t i = 0; i < BLOCK; i++)
+	{
+		Complex y = work[BLOCK + i];
+		if(v.crossfade)
+		{
+			float t = (float)i / (float)BLOCK;
+			y = y * t + work_old[BLOCK + i] * (1.0f - t);
+		}
+		v.output[i * 2 + 0] = y.real();
+		v.output[i * 2 + 1] = y.imag();
+	}
+	v.crossfade = false;
+
+	std::copy(v.input.begin() + BLOCK, v.input.end(), v.input.begin());
+}
+
+void HRTFSpatializer::process(int voice, float* buffer, uint32_t frames)
+{
+	Voice& v = voices[voice];
+	if(!v.has_direction)
+	{
+		return;
+	}
+
+	for(uint32_t i = 0; i < frames; i++)
+	{
+		float mono = (buffer[i * 2 + 0] + buffer[i * 2 + 1]) * 0.5f;
+		buffer[i * 2 + 0] = v.output[v.fill * 2 + 0];
+		buffer[i * 2 + 1] = v.output[v.fill * 2 + 1];
+		v.input[BLOCK + v.fill] = mono;
+
+		v.fill++;
+		if(v.fill == BLOCK)
+		{
+			process_block(v);
+			v.fill = 0;
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "FFT.h"
+#include <glm/glm.hpp>
+#include <complex>
+#include <vector>
+#include <cstdint>
+
+class HRTFSet;
+
+// Binaural rendering of 3D sources through a HRTFSet, using uniformly partitioned
+// convolution (overlap-save, frequency domain delay line). Impulse responses are split
+// into BLOCK sized partitions, so cost grows linearly with their length and latency
+// is a single block.
+// Both ears are convolved at once: the filters hold left + i * right, and as the input
+// is real, the real and imaginary parts of the output are the two ears.
+// Filters for a direction are interpolated from the three nearest measurements, and
+// changes are crossfaded over a block.
+// Voices (convolution state) are preallocated, so nothing is allocated on the audio thread
+class HRTFSpatializer
+{
+public:
+
+	static constexpr uint32_t BLOCK = 128;
+	static constexpr uint32_t FFT_SIZE = BLOCK * 2;
+	// Smaller direction changes (radians) keep the current filter
+	static constexpr float UPDATE_ANGLE = 0.035f;
+
+private:
+
+	using Complex = std::complex<float>;
+
+	FFT fft;
+	uint32_t partitions;
+
+	std::vector<glm::vec3> directions;
+	// directions.size() * partitions * FFT_SIZE
+	std::vector<Complex> filters;
+
+	struct Voice
+	{
+		bool used;
+
+		// partitions spectra of past input blocks, fdl_pos is the newest
+		std::vector<Complex> fdl;
+		uint32_t fdl_pos;
+
+		std::vector<Complex> filter;
+		std::vector<Complex> old_filter;
+		bool crossfade;
+		bool has_direction;
+		glm::vec3 direction;
+
+		// Previous and current input block (mono)
+		std::vector<float> input;
+		// Stereo, BLOCK frames, output of the last processed block
+		std::vector<float> output;
+		uint32_t fill;
+	};
+
+	std::vector<Voice> voices;
+
+	// Reused by every block
+	std::vector<Complex> work;
+	std::vector<Complex> work_old;
+
+	void interpolate(glm::vec3 dir, Complex* out) const;
+	void accumulate(const Voice& v, const std::vector<Complex>& filter, Complex* out) const;
+	void process_block(Voice& v);
+
+public:
+
+	size_t get_voice_count() const { return voices.size(); }
+
+	// Returns -1 if all voices are in use. Voices start silent
+	int acquire_voice();
+	void release_voice(int voice);
+
+	// Direction to the source, in listener space (x right, y up, z forward), normalized
+	void set_direction(int voice, glm::vec3 dir);
+
+	// In place, stereo input is downmixed. Output is delayed by BLOCK frames
+	void process(int voice, float* buffer, uint32_t frames);
+
+	// Impulse responses are resampled to sample_rate if needed
+	HRTFSpatializer(const HRTFSet& set, uint32_t sample_rate, size_t voice_count);
+};
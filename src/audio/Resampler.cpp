@@ -0,0 +1,113 @@
+#include "Resampler.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <array>
+
+namespace
+{
+	struct KernelTable
+	{
+		// One extra phase so frac close to 1 doesn't need wrapping
+		std::array<float, (Resampler::PHASES + 1) * Resampler::TAPS> weights;
+
+		KernelTable()
+		{
+			// Slightly under Nyquist so the transition band doesn't alias
+			constexpr double cutoff = 0.92;
+			for(int p = 0; p <= Resampler::PHASES; p++)
+			{
+				double frac = (double)p / Resampler::PHASES;
+				double sum = 0.0;
+				for(int t = 0; t < Resampler::TAPS; t++)
+				{
+					// Distance from the sampled position to this tap
+					double x = (double)(t - Resampler::HALF_TAPS + 1) - frac;
+					double sinc = x == 0.0 ? 1.0 : glm::sin(glm::pi<double>() * x * cutoff) / (glm::pi<double>() * x * cutoff);
+					// Blackman window over the kernel span
+					double n = (x + Resampler::HALF_TAPS) / Resampler::TAPS;
+					double window = 0.42 - 0.5 * glm::cos(glm::two_pi<double>() * n) + 0.08 * glm::cos(2.0 * glm::two_pi<double>() * n);
+					double w = sinc * glm::max(window, 0.0);
+					weights[p * Resampler::TAPS + t] = (float)w;
+					sum += w;
+				}
+
+				// Unity gain at DC
+				for(int t = 0; t < Resampler::TAPS; t++)
+				{
+					weights[p * Resampler::TAPS + t] /= (float)sum;
+				}
+			}
+		}
+	};
+
+	// Built on startup, so the audio thread never does it
+	const KernelTable table;
+}
+
+const float* Resampler::get_kernel(double frac)
+{
+	int phase = (int)(frac * PHASES + 0.5);
+	return &table.weights[phase * TAPS];
+}
+
+void Resampler::read_frame(const float* data, uint32_t channels, int64_t frame_count, bool loop, double pos,
+	float& left, float& right)
+{
+	int64_t base = (int64_t)pos;
+	const float* kernel = get_kernel(pos - (double)base);
+	int64_t first = base - HALF_TAPS + 1;
+
+	left = 0.0f;
+	right = 0.0f;
+	if(first >= 0 && first + TAPS <= frame_count)
+	{
+		// Fast path, the whole kernel is inside the data
+		if(channels == 1)
+		{
+			const float* src = data + first;
+			for(int t = 0; t < TAPS; t++)
+			{
+				left += src[t] * kernel[t];
+			}
+			right = left;
+		}
+		else
+		{
+			const float* src = data + first * 2;
+			for(int t = 0; t < TAPS; t++)
+			{
+				left += src[t * 2 + 0] * kernel[t];
+				right += src[t * 2 + 1] * kernel[t];
+			}
+		}
+		return;
+	}
+
+	for(int t = 0; t < TAPS; t++)
+	{
+		int64_t f = first + t;
+		if(f < 0 || f >= frame_count)
+		{
+			if(!loop)
+			{
+				continue;
+			}
+			f = ((f % frame_count) + frame_count) % frame_count;
+		}
+
+		if(channels == 1)
+		{
+			left += data[f] * kernel[t];
+		}
+		else
+		{
+			left += data[f * 2 + 0] * kernel[t];
+			right += data[f * 2 + 1] * kernel[t];
+		}
+	}
+
+	if(channels == 1)
+	{
+		right = left;
+	}
+}
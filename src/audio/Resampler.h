@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+// Windowed sinc interpolation, using a precomputed polyphase table so reading a
+// sample at a fractional position is just TAPS multiply-adds.
+// The kernel is low-passed slightly under the source Nyquist frequency. It doesn't
+// adapt its cutoff when speeding up (pitch > 1), which may alias a bit, but pitch
+// changes are expected to be small.
+class Resampler
+{
+public:
+
+	// Frames read around the position: from floor(pos) - HALF_TAPS + 1 to floor(pos) + HALF_TAPS
+	static constexpr int TAPS = 16;
+	static constexpr int HALF_TAPS = TAPS / 2;
+	static constexpr int PHASES = 256;
+
+	// Weights for the TAPS frames around a position with the given fractional part [0, 1)
+	static const float* get_kernel(double frac);
+
+	// Reads a stereo frame at a fractional position from interleaved data with 1 or 2 channels.
+	// Frames outside [0, frame_count) are zero, or wrap around if loop is set
+	static void read_frame(const float* data, uint32_t channels, int64_t frame_count, bool loop, double pos,
+		float& left, float& right);
+};
@@ -12,12 +12,23 @@ public:
 
 	// You must set the values in the target, you dont do the mixing
 	// Return a negative number if the audio is finished (always false if loop is true!)
-	// Otherwise, return current frame position
-	// If you are a generative stream, feel free to ignore cur_sample
+	// Otherwise, return current frame position, which may be fractional if resampling
+	// pitch is the playback speed, output must be at target_sample_rate (resampling if the
+	// source has a different rate, see Resampler)
+	// If you are a generative stream, feel free to ignore cur_frame
 	// If you cannot generate enough samples, make sure to zero-fill the array to avoid artifacts
-	virtual int32_t mix_samples(float* target, uint32_t count, uint32_t cur_frame, bool loop, uint32_t sample_rate,
+	virtual double mix_samples(float* target, uint32_t count, double cur_frame, bool loop, float pitch,
 				uint32_t target_sample_rate) = 0;
 
+	// Used for virtual voices, advances playback as mix_samples would without producing audio
+	// (scratch has room for count frames, but its contents are discarded)
+	// By default we just mix into the scratch buffer, implement if there's a cheaper way
+	virtual double skip_samples(float* scratch, uint32_t count, double cur_frame, bool loop, float pitch,
+				uint32_t target_sample_rate)
+	{
+		return mix_samples(scratch, count, cur_frame, loop, pitch, target_sample_rate);
+	}
+
 	virtual ~SampleSource()=default;
 
 };
\ No newline at end of file
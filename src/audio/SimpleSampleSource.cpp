@@ -1,17 +1,28 @@
 #include "SimpleSampleSource.h"
-#include <util/Logger.h>
+#include "Resampler.h"
+#include <glm/glm.hpp>
 
-int32_t
-SimpleSampleSource::mix_samples(float *target, uint32_t count, uint32_t cur_frame, bool loop, uint32_t sample_rate,
-								uint32_t target_sample_rate)
+double SimpleSampleSource::mix_samples(float *target, uint32_t count, double cur_frame, bool loop, float pitch,
+									   uint32_t target_sample_rate)
 {
 	// May contain one or two samples per frame
 	float* fsamples = (float*)get_samples();
 
-	if(sample_rate == target_sample_rate)
+	if(frame_count == 0)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			target[i * 2 + 0] = 0.0f;
+			target[i * 2 + 1] = 0.0f;
+		}
+		return -1.0;
+	}
+
+	double step = (double)pitch * (double)sample_rate / (double)target_sample_rate;
+	if(step == 1.0 && cur_frame == (double)(uint32_t)cur_frame)
 	{
 		// Simple, we must add the two arrays
-		uint32_t frm_ptr = cur_frame;
+		uint32_t frm_ptr = (uint32_t)cur_frame;
 		for(size_t i = 0; i < count; i++)
 		{
 			if(channel_count == 1)
@@ -34,23 +45,70 @@ SimpleSampleSource::mix_samples(float *target, uint32_t count, uint32_t cur_fram
 				else
 				{
 					// We dont mix nothing more, fill with zeros and early exit
-					for(; i < count; i++)
+					for(i++; i < count; i++)
 					{
 						target[i * 2 + 0] = 0.0f;
 						target[i * 2 + 1] = 0.0f;
 					}
 
-					return -1;
+					return -1.0;
 				}
 			}
 		}
 
-		return (int32_t)frm_ptr;
+		return (double)frm_ptr;
 	}
 	else
 	{
-		logger->fatal("Real-time resampling is not supported");
-		return -1;
+		double pos = cur_frame;
+		for(size_t i = 0; i < count; i++)
+		{
+			Resampler::read_frame(fsamples, (uint32_t)channel_count, (int64_t)frame_count, loop, pos,
+				target[i * 2 + 0], target[i * 2 + 1]);
+
+			pos += step;
+			if(pos >= (double)frame_count)
+			{
+				if(loop)
+				{
+					pos -= (double)frame_count;
+				}
+				else
+				{
+					for(i++; i < count; i++)
+					{
+						target[i * 2 + 0] = 0.0f;
+						target[i * 2 + 1] = 0.0f;
+					}
+
+					return -1.0;
+				}
+			}
+		}
+
+		return pos;
+	}
+
+}
+
+double SimpleSampleSource::skip_samples(float* scratch, uint32_t count, double cur_frame, bool loop,
+										float pitch, uint32_t target_sample_rate)
+{
+	if(frame_count == 0)
+	{
+		return -1.0;
+	}
+
+	double step = (double)pitch * (double)sample_rate / (double)target_sample_rate;
+	double pos = cur_frame + step * count;
+	if(pos >= (double)frame_count)
+	{
+		if(!loop)
+		{
+			return -1.0;
+		}
+		pos = glm::mod(pos, (double)frame_count);
 	}
 
+	return pos;
 }
@@ -10,14 +10,19 @@ public:
 	// WARNING: Externally managed!
 	void* samples;
 	size_t frame_count;
+	// Samples are resampled in real time if this doesn't match the device
+	uint32_t sample_rate;
 
 	~SimpleSampleSource() override = default;
 
-	int32_t mix_samples(float* target, uint32_t count, uint32_t cur_frame, bool loop, uint32_t sample_rate,
+	double mix_samples(float* target, uint32_t count, double cur_frame, bool loop, float pitch,
+						uint32_t target_sample_rate) override;
+	double skip_samples(float* scratch, uint32_t count, double cur_frame, bool loop, float pitch,
 						uint32_t target_sample_rate) override;
 
 	size_t get_channel_count() const { return channel_count; }
 	size_t get_frame_count() const { return frame_count; }
+	uint32_t get_sample_rate() const { return sample_rate; }
 	void* get_samples() const { return samples; }
 
 
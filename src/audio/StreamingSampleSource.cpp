@@ -0,0 +1,273 @@
+#include "StreamingSampleSource.h"
+#include "AudioEngine.h"
+#include <Holmgard.h>
+#include <util/Logger.h>
+#include <cstring>
+#include <algorithm>
+#include "Resampler.h"
+#include <glm/glm.hpp>
+
+void AudioStream::fill()
+{
+	if(!valid)
+	{
+		return;
+	}
+
+	if(restart)
+	{
+		// Only requested once the previous playback was fully read, so the ring is empty
+		ma_decoder_seek_to_pcm_frame(&decoder, 0);
+		finished = false;
+		restart = false;
+	}
+
+	bool rewound = false;
+	while(!finished)
+	{
+		ma_uint32 frames = ma_pcm_rb_available_write(&ring);
+		if(frames == 0)
+		{
+			return;
+		}
+
+		// May return less than available if the write region wraps around
+		void* buffer;
+		ma_pcm_rb_acquire_write(&ring, &frames, &buffer);
+		ma_uint64 read = ma_decoder_read_pcm_frames(&decoder, buffer, frames);
+		ma_pcm_rb_commit_write(&ring, (ma_uint32)read, buffer);
+
+		if(read > 0)
+		{
+			rewound = false;
+		}
+
+		if(read < frames)
+		{
+			// Reading nothing right after rewinding means the clip is empty
+			if(loop && !rewound)
+			{
+				ma_decoder_seek_to_pcm_frame(&decoder, 0);
+				rewound = true;
+			}
+			else
+			{
+				finished = true;
+			}
+		}
+	}
+}
+
+uint32_t AudioStream::read(float* target, uint32_t count)
+{
+	if(!valid)
+	{
+		return 0;
+	}
+
+	uint32_t done = 0;
+	// At most two iterations, as the read region may wrap around
+	while(done < count)
+	{
+		ma_uint32 frames = count - done;
+		void* buffer;
+		ma_pcm_rb_acquire_read(&ring, &frames, &buffer);
+		if(frames == 0)
+		{
+			break;
+		}
+
+		const float* fbuffer = (const float*)buffer;
+		for(ma_uint32 i = 0; i < frames; i++)
+		{
+			if(channel_count == 1)
+			{
+				target[(done + i) * 2 + 0] = fbuffer[i];
+				target[(done + i) * 2 + 1] = fbuffer[i];
+			}
+			else
+			{
+				target[(done + i) * 2 + 0] = fbuffer[i * 2 + 0];
+				target[(done + i) * 2 + 1] = fbuffer[i * 2 + 1];
+			}
+		}
+
+		ma_pcm_rb_commit_read(&ring, frames, buffer);
+		done += frames;
+	}
+
+	return done;
+}
+
+AudioStream::AudioStream(const std::string& path, size_t channel_count, uint32_t sample_rate, uint32_t buffer_frames)
+{
+	this->channel_count = channel_count;
+	loop = false;
+	restart = false;
+	released = false;
+	finished = false;
+	valid = false;
+
+	ma_decoder_config config = ma_decoder_config_init(ma_format_f32, (ma_uint32)channel_count, sample_rate);
+	if(ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS)
+	{
+		logger->error("Miniaudio failed to open {} for streaming", path);
+		return;
+	}
+
+	if(ma_pcm_rb_init(ma_format_f32, (ma_uint32)channel_count, buffer_frames, nullptr, nullptr, &ring) != MA_SUCCESS)
+	{
+		logger->error("Could not allocate the streaming buffer for {}", path);
+		ma_decoder_uninit(&decoder);
+		return;
+	}
+
+	valid = true;
+}
+
+AudioStream::~AudioStream()
+{
+	if(valid)
+	{
+		ma_pcm_rb_uninit(&ring);
+		ma_decoder_uninit(&decoder);
+	}
+}
+
+void StreamingSampleSource::reset_resampler()
+{
+	// Silence as history, so the first frames can be read
+	in_frames = Resampler::HALF_TAPS - 1;
+	std::fill(in_buffer.begin(), in_buffer.begin() + in_frames * 2, 0.0f);
+	in_pos = (double)(Resampler::HALF_TAPS - 1);
+}
+
+double StreamingSampleSource::mix_resampled(float* target, uint32_t count, double step)
+{
+	// Read finished before the ring, so it's not possible to miss the last samples
+	bool was_finished = stream->finished;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		int64_t base = (int64_t)in_pos;
+		if(base + Resampler::HALF_TAPS >= in_frames)
+		{
+			// Drop the frames no longer needed, and fill the rest of the buffer
+			uint32_t drop = (uint32_t)(base - Resampler::HALF_TAPS + 1);
+			memmove(in_buffer.data(), in_buffer.data() + drop * 2, (in_frames - drop) * 2 * sizeof(float));
+			in_frames -= drop;
+			in_pos -= (double)drop;
+			base -= drop;
+
+			uint32_t read = stream->read(in_buffer.data() + in_frames * 2, RESAMPLE_BUFFER_FRAMES - in_frames);
+			in_frames += read;
+			position += read;
+			if(frame_count != 0)
+			{
+				position %= frame_count;
+			}
+
+			if(base + Resampler::HALF_TAPS >= in_frames)
+			{
+				// Either the end of the clip or an underrun, both are silent
+				memset(target + i * 2, 0, (count - i) * 2 * sizeof(float));
+				if(was_finished)
+				{
+					ended = true;
+					stream->restart = true;
+					reset_resampler();
+					return -1.0;
+				}
+				return (double)position;
+			}
+		}
+
+		Resampler::read_frame(in_buffer.data(), 2, in_frames, false, in_pos, target[i * 2 + 0], target[i * 2 + 1]);
+		in_pos += step;
+	}
+
+	return (double)position;
+}
+
+double StreamingSampleSource::mix_samples(float* target, uint32_t count, double cur_frame, bool loop,
+										  float pitch, uint32_t target_sample_rate)
+{
+	if(!stream->is_valid())
+	{
+		memset(target, 0, count * 2 * sizeof(float));
+		return -1.0;
+	}
+
+	stream->loop = loop;
+
+	if(ended)
+	{
+		// Waiting for the stream thread to rewind after we finished
+		if(stream->restart)
+		{
+			memset(target, 0, count * 2 * sizeof(float));
+			return 0.0;
+		}
+		ended = false;
+		position = 0;
+	}
+
+	// The stream is decoded at the device rate, so only pitch needs resampling
+	if(pitch != 1.0f || resampling)
+	{
+		resampling = true;
+		// More would skip past the buffered frames
+		double step = glm::min((double)pitch, (double)Resampler::HALF_TAPS);
+		return mix_resampled(target, count, step);
+	}
+
+	// Read finished before the ring, so it's not possible to miss the last samples
+	bool was_finished = stream->finished;
+	uint32_t read = stream->read(target, count);
+	if(read < count)
+	{
+		// Either the end of the clip or an underrun, both are silent
+		memset(target + read * 2, 0, (count - read) * 2 * sizeof(float));
+
+		if(was_finished)
+		{
+			ended = true;
+			stream->restart = true;
+			return -1.0;
+		}
+	}
+
+	position += read;
+	if(frame_count != 0)
+	{
+		position %= frame_count;
+	}
+
+	return (double)position;
+}
+
+StreamingSampleSource::StreamingSampleSource(const std::string& path, size_t channel_count, size_t frame_count)
+{
+	this->frame_count = frame_count;
+	position = 0;
+	ended = false;
+	resampling = false;
+	in_buffer.resize(RESAMPLE_BUFFER_FRAMES * 2);
+	reset_resampler();
+
+	// One second of audio is plenty to hide disk and decoder hiccups
+	uint32_t rate = (uint32_t)hgr->audio->get_sample_rate();
+	stream = std::make_shared<AudioStream>(path, channel_count, rate, rate);
+
+	if(stream->is_valid())
+	{
+		// Prebuffer so playback can start right away
+		stream->fill();
+		hgr->audio->add_stream(stream);
+	}
+}
+
+StreamingSampleSource::~StreamingSampleSource()
+{
+	// We don't wait for the stream thread here, it drops the stream on its own
+	stream->released = true;
+}
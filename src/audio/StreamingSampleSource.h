@@ -0,0 +1,75 @@
+#pragma once
+#include "SampleSource.h"
+#include <miniaudio/miniaudio.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Decoding state of a streamed AudioClip. The AudioEngine stream thread decodes
+// into the ring buffer, and the audio thread reads from it, so neither blocks the other.
+// The StreamingSampleSource sets released when it's destroyed, and the stream
+// thread drops its reference afterwards.
+class AudioStream
+{
+private:
+
+	ma_decoder decoder;
+	ma_pcm_rb ring;
+	bool valid;
+
+public:
+
+	size_t channel_count;
+
+	// Written by the audio thread
+	std::atomic<bool> loop;
+	std::atomic<bool> restart;
+	std::atomic<bool> released;
+	// Written by the stream thread, set once the decoder reached the end and we don't loop
+	std::atomic<bool> finished;
+
+	bool is_valid() const { return valid; }
+
+	// Decodes until the ring buffer is full (or the file ends). Only called from one thread
+	void fill();
+
+	// Audio thread side, returns number of frames read into target (may be less than count)
+	uint32_t read(float* target, uint32_t count);
+
+	// Decodes straight to f32 at the given sample rate with channel_count channels
+	AudioStream(const std::string& path, size_t channel_count, uint32_t sample_rate, uint32_t buffer_frames);
+	~AudioStream();
+};
+
+// Plays a streamed AudioClip, each AudioSource gets its own as they hold decoding state
+class StreamingSampleSource : public SampleSource
+{
+private:
+
+	std::shared_ptr<AudioStream> stream;
+	// Audio thread only
+	uint32_t position;
+	size_t frame_count;
+	bool ended;
+
+	// Once pitch changes from 1, frames read from the stream go through this buffer so
+	// the resampler has the frames around the read position. Stereo, allocated on creation
+	static constexpr uint32_t RESAMPLE_BUFFER_FRAMES = 2048;
+	bool resampling;
+	std::vector<float> in_buffer;
+	uint32_t in_frames;
+	double in_pos;
+
+	void reset_resampler();
+	double mix_resampled(float* target, uint32_t count, double step);
+
+public:
+
+	double mix_samples(float* target, uint32_t count, double cur_frame, bool loop, float pitch,
+						uint32_t target_sample_rate) override;
+
+	// frame_count may be 0 if the length of the clip is not known
+	StreamingSampleSource(const std::string& path, size_t channel_count, size_t frame_count);
+	~StreamingSampleSource() override;
+};
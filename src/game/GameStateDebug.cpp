@@ -233,6 +233,11 @@ void GameStateDebug::do_renderer()
 		}
 		ImGui::EndCombo();
 	}
+
+	if(ImGui::CollapsingHeader("GPU timings"))
+	{
+		hgr->renderer->gpu_profiler.do_imgui();
+	}
 }
 
 void GameStateDebug::clear()
@@ -1,6 +1,6 @@
 #pragma once
 #include "Scene.h"
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 #include <gui/skins/SimpleSkin.h>
 #include "renderer/camera/LuaCamera.h"
 
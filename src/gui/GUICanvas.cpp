@@ -39,10 +39,11 @@ std::pair<std::shared_ptr<GUICanvas>, std::shared_ptr<GUICanvas>> GUICanvas::div
 	return std::make_pair(child_0, child_1);
 }
 
-void GUICanvas::position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen)
+bool GUICanvas::position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen)
 {
 	// We first position our children (which will do the same)
 	// so the result is the canvas are prepared bottom-to-top
+	bool changed = false;
 	if(child_0 || child_1)
 	{
 		// Apply pixel sizes
@@ -75,8 +76,8 @@ void GUICanvas::position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* scr
 			pos1 = pos + glm::ivec2(0, size0.y);
 			size1 = size - glm::ivec2(0, size0.y);
 		}
-		child_0->position_widgets(pos, size0, screen);
-		child_1->position_widgets(pos1, size1, screen);
+		changed |= child_0->position_widgets(pos, size0, screen);
+		changed |= child_1->position_widgets(pos1, size1, screen);
 	}
 
 	if(layout)
@@ -84,9 +85,10 @@ void GUICanvas::position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* scr
 		glm::ivec2 rpos = pos;
 		glm::ivec2 rsize = size;
 
-		layout->position_wrapper(rpos, rsize, screen);
+		changed |= layout->position_wrapper(rpos, rsize, screen);
 	}
 
+	return changed;
 }
 
 void GUICanvas::prepare(GUIScreen* screen, GUIInput* gui_input) const
@@ -43,7 +43,8 @@ public:
 	std::pair<std::shared_ptr<GUICanvas>, std::shared_ptr<GUICanvas>> divide_v(float factor);
 
 	// Called bottom-to-top to position widgets, same as draw order
-	void position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen);
+	// Returns true if any layout had to position its widgets again
+	bool position_widgets(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen);
 	// Called top-to-bottom to handled input, opposite to draw order
 	void prepare(GUIScreen* screen, GUIInput* gui_input) const;
 	// For widgets that generate overlay canvases
@@ -1,10 +1,12 @@
 #include "GUILayout.h"
 #include <util/Logger.h>
+#include "GUIScreen.h"
 
 void GUILayout::add_widget(std::shared_ptr<GUIWidget> widget)
 {
 	widgets.push_back(widget);
 	on_add_widget(widget.get());
+	layout_dirty = true;
 }
 
 void GUILayout::remove_widget(GUIWidget* widget)
@@ -15,6 +17,7 @@ void GUILayout::remove_widget(GUIWidget* widget)
 		{
 			on_remove_widget(widget);
 			widgets.erase(it);
+			layout_dirty = true;
 			return;
 		}
 	}
@@ -48,12 +51,39 @@ void GUILayout::draw(NVGcontext* ctx, GUISkin* skin)
 	draw_hscrollbar(ctx, skin);
 }
 
-void GUILayout::position_wrapper(glm::ivec2 npos, glm::ivec2 nsize, GUIScreen* screen)
+bool GUILayout::position_wrapper(glm::ivec2 npos, glm::ivec2 nsize, GUIScreen* screen)
 {
+	bool dirty = layout_dirty || npos != last_pos || nsize != last_size || margins != last_margins ||
+		vscrollbar.scroll != last_vscroll || hscrollbar.scroll != last_hscroll || screen->skin.get() != last_skin;
+
+	for(size_t i = 0; i < widgets.size() && !dirty; i++)
+	{
+		dirty = widgets[i]->layout_dirty;
+	}
+
+	if(!dirty)
+	{
+		return false;
+	}
+
 	pos = npos;
 	size = nsize;
 
 	position(pos, size, screen);
+
+	for(auto& widget : widgets)
+	{
+		widget->layout_dirty = false;
+	}
+	layout_dirty = false;
+	last_pos = npos;
+	last_size = nsize;
+	last_margins = margins;
+	last_vscroll = vscrollbar.scroll;
+	last_hscroll = hscrollbar.scroll;
+	last_skin = screen->skin.get();
+
+	return true;
 }
 
 void GUILayout::prepare_wrapper(GUIScreen* screen, GUIInput* gui_input)
@@ -79,6 +109,7 @@ void GUILayout::remove_all_widgets()
 	}
 
 	widgets.clear();
+	layout_dirty = true;
 }
 
 #include <util/InputUtil.h>
@@ -204,6 +235,13 @@ GUILayout::GUILayout()
 	hscrollbar.override_colors = false;
 	hscrollbar.scroll = 0.0;
 	block_mouse = true;
+	layout_dirty = true;
+	last_pos = glm::ivec2(0);
+	last_size = glm::ivec2(0);
+	last_margins = margins;
+	last_vscroll = 0;
+	last_hscroll = 0;
+	last_skin = nullptr;
 }
 
 GUILayout::~GUILayout()
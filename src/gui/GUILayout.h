@@ -26,6 +26,13 @@ protected:
 	
 	glm::ivec2 pos, size;
 
+	// Everything the last position depended on, so it's only done again if needed
+	bool layout_dirty;
+	glm::ivec2 last_pos, last_size;
+	glm::ivec4 last_margins;
+	int last_vscroll, last_hscroll;
+	GUISkin* last_skin;
+
 
 
 public:
@@ -66,7 +73,11 @@ public:
 
 	// By default, the layout will glScissor its area and draw scrollbars if needed
 	void draw(NVGcontext* vg, GUISkin* skin);
-	void position_wrapper(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen);
+	// Returns true if the widgets were positioned again, which is only done if the layout
+	// or any widget is dirty, or the area, margins, scroll or skin changed
+	bool position_wrapper(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen);
+	// Forces the next position_wrapper to position the widgets
+	void mark_dirty() { layout_dirty = true; }
 	virtual void position(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen) = 0;
 	virtual void prepare(GUIInput* gui_input, GUIScreen* screen) = 0;
 	void prepare_wrapper(GUIScreen* screen, GUIInput* gui_input);
@@ -28,6 +28,12 @@ public:
 	// If the widget can block the mouse, this can disable that functionality
 	bool blocks_mouse = true;
 
+	// Layouts only position their widgets again if something changed, call this if
+	// the size the widget wants changes (default_size is handled by the lua setter).
+	// Cleared by the layout once positioned
+	bool layout_dirty = true;
+	void mark_dirty() { layout_dirty = true; }
+
 	glm::ivec2 default_position(glm::ivec2 wpos, glm::ivec2 wsize)
 	{
 		pos = wpos;
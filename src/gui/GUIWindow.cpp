@@ -1,5 +1,8 @@
 #include "GUIWindow.h"
 #include "GUIWindowManager.h"
+#include <renderer/Renderer.h>
+#include <nanovg/nanovg_gl.h>
+#include <util/Logger.h>
 
 void GUIWindow::position(GUIScreen *screen, GUISkin *skin)
 {
@@ -11,7 +14,10 @@ void GUIWindow::position(GUIScreen *screen, GUISkin *skin)
 		return;
 	}
 
-	canvas->position_widgets(pos, size, screen);
+	if(canvas->position_widgets(pos, size, screen) || size != cache_size)
+	{
+		content_dirty = true;
+	}
 }
 
 void GUIWindow::prepare(GUIInput* gui_input, GUIScreen* screen)
@@ -22,6 +28,15 @@ void GUIWindow::prepare(GUIInput* gui_input, GUIScreen* screen)
 	}
 
 	canvas->prepare(screen, gui_input);
+
+	// Widgets react to the mouse (hovering, clicks, scrolling) so we must redraw while it's
+	// over the window, and once more after it leaves
+	bool mouse_inside = gui_input->mouse_inside(pos, size);
+	if(mouse_inside || mouse_was_inside || (focused && gui_input->keyboard_blocked))
+	{
+		content_dirty = true;
+	}
+	mouse_was_inside = mouse_inside;
 }
 
 void GUIWindow::draw(NVGcontext* vg, GUISkin* skin, glm::ivec4 def_scissor)
@@ -31,7 +46,129 @@ void GUIWindow::draw(NVGcontext* vg, GUISkin* skin, glm::ivec4 def_scissor)
 	{
 		return;
 	}
-	canvas->draw(vg, skin, def_scissor);
+
+	if(cache_content && size.x > 0 && size.y > 0)
+	{
+		draw_cached(vg, skin, def_scissor);
+	}
+	else
+	{
+		if(cache_image != 0)
+		{
+			free_cache();
+		}
+		canvas->draw(vg, skin, def_scissor);
+	}
+}
+
+void GUIWindow::draw_cached(NVGcontext* vg, GUISkin* skin, glm::ivec4 def_scissor)
+{
+	cache_age++;
+	if(cache_size != size)
+	{
+		free_cache();
+	}
+
+	if(cache_image == 0)
+	{
+		cache_size = size;
+
+		glGenTextures(1, &cache_tex);
+		glBindTexture(GL_TEXTURE_2D, cache_tex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// nanovg needs the stencil buffer to fill paths
+		glGenRenderbuffers(1, &cache_rbo);
+		glBindRenderbuffer(GL_RENDERBUFFER, cache_rbo);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size.x, size.y);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		GLint old_fbo;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_fbo);
+		glGenFramebuffers(1, &cache_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, cache_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cache_tex, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, cache_rbo);
+		logger->check(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+			"GUIWindow content cache framebuffer is not complete");
+		glBindFramebuffer(GL_FRAMEBUFFER, old_fbo);
+
+		// Created on the main context, as that's where it's drawn
+		cache_image = nvglCreateImageFromHandleGL3(vg, cache_tex, size.x, size.y,
+			NVG_IMAGE_FLIPY | NVG_IMAGE_PREMULTIPLIED | NVG_IMAGE_NODELETE | NVG_IMAGE_NEAREST);
+		content_dirty = true;
+	}
+
+	if(content_dirty || cache_age >= cache_max_frames)
+	{
+		// nanovg frames can't be nested, so the content is drawn through the offscreen context
+		NVGcontext* cvg = hgr->renderer->get_offscreen_vg();
+
+		GLint old_fbo;
+		GLint old_viewport[4];
+		GLfloat old_clear[4];
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_fbo);
+		glGetIntegerv(GL_VIEWPORT, old_viewport);
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, old_clear);
+		GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, cache_fbo);
+		glViewport(0, 0, size.x, size.y);
+		glDisable(GL_SCISSOR_TEST);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+		float w = (float)hgr->renderer->get_width(true);
+		float h = (float)hgr->renderer->get_height(true);
+		nvgBeginFrame(cvg, (float)size.x, (float)size.y, w / h);
+		nvgTranslate(cvg, (float)-pos.x, (float)-pos.y);
+		canvas->draw(cvg, skin, def_scissor);
+		nvgEndFrame(cvg);
+		nvgEndFrameExt(cvg);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, old_fbo);
+		glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+		glClearColor(old_clear[0], old_clear[1], old_clear[2], old_clear[3]);
+		if(scissor_test)
+		{
+			glEnable(GL_SCISSOR_TEST);
+		}
+
+		content_dirty = false;
+		cache_age = 0;
+	}
+
+	nvgSave(vg);
+	if(def_scissor != glm::ivec4(0, 0, 0, 0))
+	{
+		nvgScissor(vg, def_scissor.x, def_scissor.y, def_scissor.z, def_scissor.w);
+	}
+	NVGpaint paint = nvgImagePattern(vg, pos.x, pos.y, size.x, size.y, 0.0f, cache_image, 1.0f);
+	nvgBeginPath(vg);
+	nvgRect(vg, pos.x, pos.y, size.x, size.y);
+	nvgFillPaint(vg, paint);
+	nvgFill(vg);
+	nvgRestore(vg);
+}
+
+void GUIWindow::free_cache()
+{
+	if(cache_image != 0)
+	{
+		nvgDeleteImage(hgr->renderer->vg, cache_image);
+		glDeleteFramebuffers(1, &cache_fbo);
+		glDeleteRenderbuffers(1, &cache_rbo);
+		glDeleteTextures(1, &cache_tex);
+	}
+
+	cache_image = 0;
+	cache_fbo = 0;
+	cache_rbo = 0;
+	cache_tex = 0;
+	cache_size = glm::ivec2(0, 0);
 }
 
 GUIWindow::GUIWindow() 
@@ -52,6 +189,21 @@ GUIWindow::GUIWindow()
 
 	canvas = std::make_shared<GUICanvas>();
 
+	cache_content = false;
+	cache_max_frames = 30;
+	cache_fbo = 0;
+	cache_rbo = 0;
+	cache_tex = 0;
+	cache_image = 0;
+	cache_size = glm::ivec2(0, 0);
+	cache_age = 0;
+	content_dirty = true;
+	mouse_was_inside = false;
+}
+
+GUIWindow::~GUIWindow()
+{
+	free_cache();
 }
 
 void GUIWindow::close()
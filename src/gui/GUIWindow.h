@@ -3,6 +3,7 @@
 #include "GUICanvas.h"
 #include "glm/fwd.hpp"
 #include <universe/Events.h>
+#include <glad/glad.h>
 
 class GUIWindowManager;
 
@@ -26,6 +27,18 @@ private:
 
 	glm::ivec2 next_pos;
 	glm::ivec2 next_size;
+
+	// Content cache, see cache_content
+	GLuint cache_fbo, cache_tex, cache_rbo;
+	int cache_image;
+	glm::ivec2 cache_size;
+	bool content_dirty;
+	bool mouse_was_inside;
+	int cache_age;
+
+	void free_cache();
+	void draw_cached(NVGcontext* vg, GUISkin* skin, glm::ivec4 def_scissor);
+
 public:
 
 	GUISkin::WindowStyle style;
@@ -61,6 +74,14 @@ public:
 
 	std::shared_ptr<GUICanvas> canvas;
 
+	// If true, the contents of the window are drawn to a texture which is reused until
+	// the layout changes, the mouse is over the window, it's being typed into, or
+	// cache_max_frames pass. Decorations are always drawn.
+	// Call redraw() if something else changes the looks of the widgets (for example, label text)
+	bool cache_content;
+	int cache_max_frames;
+	void redraw() { content_dirty = true; }
+
 	// We need the GUISkin on prepare to adjust sizings
 	void position(GUIScreen* screen, GUISkin* skin);
 	void pre_prepare(GUIScreen* screen);
@@ -77,4 +98,5 @@ public:
 	void close();
 
 	GUIWindow();
+	~GUIWindow();
 };
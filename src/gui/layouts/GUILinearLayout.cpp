@@ -27,6 +27,7 @@ void GUILinearLayout::on_add_widget(GUIWidget *widget)
 void GUILinearLayout::mark_same_line()
 {
 	same_line[same_line.size() - 1] = true;
+	layout_dirty = true;
 }
 
 void GUILinearLayout::linear_helper(glm::ivec2 vpos, glm::ivec2 vsize, GUIScreen *screen, bool vertical)
@@ -1,5 +1,142 @@
 #include "GUIListLayout.h"
 #include <gui/GUIScreen.h>
+#include <util/Logger.h>
+
+void GUIListLayout::set_virtual(size_t count, glm::ivec2 nitem_size, CreateFnc create, BindFnc bind)
+{
+	logger->check(nitem_size.y > 0, "Virtual list layouts need a fixed item height");
+
+	remove_all_widgets();
+	widget_items.clear();
+	pool.clear();
+
+	is_virtual = true;
+	item_count = count;
+	item_size = nitem_size;
+	create_fnc = std::move(create);
+	bind_fnc = std::move(bind);
+}
+
+void GUIListLayout::set_item_count(size_t count)
+{
+	item_count = count;
+	refresh_items();
+}
+
+void GUIListLayout::refresh_items()
+{
+	// Everything goes back to the pool, position will bind them again
+	for(auto& widget : widgets)
+	{
+		pool.push_back(widget);
+	}
+	widgets.clear();
+	widget_items.clear();
+	layout_dirty = true;
+}
+
+void GUIListLayout::on_add_widget(GUIWidget* widget)
+{
+	if(is_virtual)
+	{
+		// Undo the add, as the layout owns its widgets in virtual mode
+		widgets.pop_back();
+	}
+	logger->check(!is_virtual, "Widgets can't be added manually to a virtual list layout");
+}
+
+void GUIListLayout::on_remove_widget(GUIWidget* widget)
+{
+	// The items of the widgets are no longer known, position_virtual recycles them all
+	widget_items.clear();
+}
+
+void GUIListLayout::position_virtual(glm::ivec2 vpos, glm::ivec2 vsize, GUIScreen* screen)
+{
+	glm::ivec2 isize = item_size;
+	if(isize.x <= 0)
+	{
+		isize.x = vsize.x;
+	}
+
+	size_t per_row = (size_t)glm::max((vsize.x + element_hmargin) / (isize.x + element_hmargin), 1);
+	size_t rows = (item_count + per_row - 1) / per_row;
+	int pitch = isize.y + element_vmargin;
+
+	// Same as the non-virtual layout, so scrolling behaves the same
+	vscrollbar.max_scroll = margins.z + (int)rows * pitch;
+
+	int first_row = glm::max(vscrollbar.scroll / pitch - overscan_rows, 0);
+	int last_row = (vscrollbar.scroll + glm::max(vsize.y, 0)) / pitch + overscan_rows;
+	size_t first = glm::min((size_t)first_row * per_row, item_count);
+	size_t last = glm::min((size_t)(last_row + 1) * per_row, item_count);
+
+	if(widget_items.size() != widgets.size())
+	{
+		// A widget was removed manually
+		refresh_items();
+	}
+
+	// Recycle the widgets which went out of range
+	item_bound.assign(last - first, false);
+	size_t kept = 0;
+	for(size_t i = 0; i < widgets.size(); i++)
+	{
+		size_t item = widget_items[i];
+		if(item >= first && item < last)
+		{
+			item_bound[item - first] = true;
+			widgets[kept] = widgets[i];
+			widget_items[kept] = item;
+			kept++;
+		}
+		else
+		{
+			pool.push_back(widgets[i]);
+		}
+	}
+	widgets.resize(kept);
+	widget_items.resize(kept);
+
+	for(size_t item = first; item < last; item++)
+	{
+		if(item_bound[item - first])
+		{
+			continue;
+		}
+
+		std::shared_ptr<GUIWidget> widget;
+		if(pool.empty())
+		{
+			widget = create_fnc();
+			if(widget == nullptr)
+			{
+				logger->warn("Virtual list layout could not create a widget");
+				break;
+			}
+		}
+		else
+		{
+			widget = pool.back();
+			pool.pop_back();
+		}
+
+		bind_fnc(widget.get(), item);
+		widgets.push_back(widget);
+		widget_items.push_back(item);
+	}
+
+	for(size_t i = 0; i < widgets.size(); i++)
+	{
+		size_t item = widget_items[i];
+		int row = (int)(item / per_row);
+		int col = (int)(item % per_row);
+		glm::ivec2 wpos = glm::ivec2(vpos.x + col * (isize.x + element_hmargin), vpos.y + row * pitch - vscrollbar.scroll);
+		widgets[i]->position(wpos, isize, screen);
+		// Overscan rows are positioned but not drawn
+		widgets[i]->is_visible = !(wpos.y - vpos.y > vsize.y || wpos.y - vpos.y < -isize.y);
+	}
+}
 
 void GUIListLayout::position(glm::ivec2 vpos, glm::ivec2 vsize, GUIScreen *screen)
 {
@@ -10,6 +147,12 @@ void GUIListLayout::position(glm::ivec2 vpos, glm::ivec2 vsize, GUIScreen *scree
 	vsize -= glm::ivec2(margins.x + margins.y, margins.z + margins.w);
 	vsize.x -= vscrollbar.get_width(screen->skin.get());
 
+	if(is_virtual)
+	{
+		position_virtual(vpos, vsize, screen);
+		return;
+	}
+
 	int y_pos = vpos.y - vscrollbar.scroll;
 	int x_pos = vpos.x;
 	for(auto widget : widgets)
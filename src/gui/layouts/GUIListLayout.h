@@ -1,16 +1,56 @@
 #pragma once
 #include "../GUILayout.h"
+#include <functional>
 
 
+// Lays out widgets left to right, wrapping into new rows, with a vertical scrollbar
+// Virtual mode:
+//	Instead of holding a widget per item, the layout is given an item count, a fixed
+//	item size and two functions: one creates a widget, the other sets a widget up to
+//	show a given item. Only the visible rows (plus overscan_rows above and below) have
+//	widgets, which are recycled as the list scrolls, so lists may have thousands of items.
+//	Widgets must not be added manually to a virtual list, removing one makes all be bound again.
 class GUIListLayout : public GUILayout 
 {
+public:
+
+	using CreateFnc = std::function<std::shared_ptr<GUIWidget>()>;
+	using BindFnc = std::function<void(GUIWidget* widget, size_t item)>;
+
 private:
 
 	int element_vmargin;
 	int element_hmargin;
 
+	bool is_virtual;
+	size_t item_count;
+	glm::ivec2 item_size;
+	CreateFnc create_fnc;
+	BindFnc bind_fnc;
+
+	// Item each widget in widgets is showing (virtual mode only)
+	std::vector<size_t> widget_items;
+	// Widgets not showing any item, ready to be reused
+	std::vector<std::shared_ptr<GUIWidget>> pool;
+	// Reused every position
+	std::vector<bool> item_bound;
+
+	void position_virtual(glm::ivec2 vpos, glm::ivec2 vsize, GUIScreen* screen);
+
+	void on_add_widget(GUIWidget* widget) override;
+	void on_remove_widget(GUIWidget* widget) override;
+
 public:
 
+	int overscan_rows;
+
+	// item_size.x <= 0 makes items take the full width of the list
+	void set_virtual(size_t count, glm::ivec2 item_size, CreateFnc create, BindFnc bind);
+	void set_item_count(size_t count);
+	size_t get_item_count() { return item_count; }
+	bool get_virtual() { return is_virtual; }
+	// Binds all visible widgets again, call if the data of the items changed
+	void refresh_items();
 
 	void position(glm::ivec2 pos, glm::ivec2 size, GUIScreen* screen) override;
 	void prepare(GUIInput* gui_input, GUIScreen* screen) override;
@@ -21,6 +61,11 @@ public:
 		this->element_vmargin = element_vmargin;
 		this->element_hmargin = element_hmargin;
 
+		is_virtual = false;
+		item_count = 0;
+		item_size = glm::ivec2(0, 0);
+		overscan_rows = 1;
+
 		// Set some sane defaults
 		vscrollbar.positive_pos = true;
 		vscrollbar.draw = true;
@@ -1,7 +1,7 @@
 #pragma once
 #include <btBulletDynamicsCommon.h>
 #include <memory>
-#include <sol/sol.hpp>
+#include "LuaGlmInterop.h"
 #include "physics/RigidBodyUserData.h"
 
 // Pointers are held in rigid body to these, for lua usage and
@@ -1,5 +1,6 @@
 #include "LuaCore.h"
 #include <assets/AssetManager.h>
+#include <unordered_map>
 
 #include "libs/LuaLogger.h"
 #include "libs/LuaGlm.h"
@@ -30,47 +31,41 @@ LuaCore* lua_core;
 
 LuaCore::LibraryID LuaCore::name_to_id(const std::string & name)
 {
-	if (name == "logger")
-		return LibraryID::LOGGER;
-	else if (name == "debug_drawer")
-		return LibraryID::DEBUG_DRAWER;
-	else if (name == "glm")
-		return LibraryID::GLM;
-	else if (name == "noise")
-		return LibraryID::NOISE;
-	else if (name == "assets")
-		return LibraryID::ASSETS;
-	else if(name == "bullet")
-		return LibraryID::BULLET;
-	else if(name == "toml")
-		return LibraryID::TOML;
-	else if(name == "universe")
-		return LibraryID::UNIVERSE;
-	else if(name == "nano_vg")
-		return LibraryID::NANO_VG;
-	else if(name == "gui")
-		return LibraryID::GUI;
-	else if(name == "imgui")
-		return LibraryID::IMGUI;
-	else if(name == "scene")
-		return LibraryID::SCENE;
-	else if(name == "renderer")
-		return LibraryID::RENDERER;
-	else if(name == "model")
-		return LibraryID::MODEL;
-	else if(name == "input")
-		return LibraryID::INPUT;
-	else if(name == "orbit")
-		return LibraryID::ORBIT;
-	else if(name == "events")
-		return LibraryID::EVENTS;
-	else if(name == "audio")
-		return LibraryID::AUDIO;
+	// Built once, require is called very often
+	static const std::unordered_map<std::string, LibraryID> ids = []()
+	{
+		std::unordered_map<std::string, LibraryID> ids;
+		ids["logger"] = LibraryID::LOGGER;
+		ids["debug_drawer"] = LibraryID::DEBUG_DRAWER;
+		ids["glm"] = LibraryID::GLM;
+		ids["noise"] = LibraryID::NOISE;
+		ids["assets"] = LibraryID::ASSETS;
+		ids["bullet"] = LibraryID::BULLET;
+		ids["toml"] = LibraryID::TOML;
+		ids["universe"] = LibraryID::UNIVERSE;
+		ids["nano_vg"] = LibraryID::NANO_VG;
+		ids["gui"] = LibraryID::GUI;
+		ids["imgui"] = LibraryID::IMGUI;
+		ids["scene"] = LibraryID::SCENE;
+		ids["renderer"] = LibraryID::RENDERER;
+		ids["model"] = LibraryID::MODEL;
+		ids["input"] = LibraryID::INPUT;
+		ids["orbit"] = LibraryID::ORBIT;
+		ids["events"] = LibraryID::EVENTS;
+		ids["audio"] = LibraryID::AUDIO;
 #ifdef HOLMGARD_PLUGINS
-	HOLMGARD_PLUGINS(HOLMGARD_MAKE_REQUIRE)
+		HOLMGARD_PLUGINS(HOLMGARD_MAKE_REQUIRE)
 #endif
-	else
+		return ids;
+	}();
+
+	auto it = ids.find(name);
+	if(it == ids.end())
+	{
 		return LibraryID::UNKNOWN;
+	}
+
+	return it->second;
 }
 
 void LuaCore::load_library(sol::table& table, LibraryID id)
@@ -262,6 +257,9 @@ LuaCore::LuaCore()
 
 LuaCore::~LuaCore()
 {
+	// Pooled states may still reference the libraries
+	state_pool.clear();
+
 	for (size_t i = 0; i < (size_t)LibraryID::COUNT; i++)
 	{
 		delete libraries[i];
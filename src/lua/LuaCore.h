@@ -1,5 +1,6 @@
 #pragma once
 #include "LuaLib.h"
+#include "LuaStatePool.h"
 #include "PluginMacroHelper.h"
 
 
@@ -65,6 +66,9 @@ public:
 
 	LuaLib* libraries[LibraryID::COUNT];
 
+	// Shared by all systems which create many equivalent states (planet surface scripts...)
+	LuaStatePool state_pool;
+
 	void load_library(sol::table& to, LibraryID id);
 
 	// pkg is the package the lua file is in, this is used by the 
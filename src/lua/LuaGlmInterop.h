@@ -0,0 +1,81 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <glm/glm.hpp>
+
+/*
+	Include this instead of sol/sol.hpp!
+
+	LuaGlm offers FFI cdata versions of the vectors and mat4 ('glm.cvec3', ...), which
+	don't allocate userdata and can be compiled by LuaJIT. The sol interop here allows
+	any C++ function taking a glm::dvec2, dvec3, dvec4 or dmat4 (by value or reference)
+	to receive them too. Their memory layout is the same as the glm types, so they are
+	used in place, without copying.
+
+	The interop functions must be seen by every file using sol, otherwise the
+	functions sol generates for glm types would differ between files.
+*/
+class LuaGlmInterop
+{
+public:
+
+	enum FFIType
+	{
+		VEC2,
+		VEC3,
+		VEC4,
+		MAT4,
+		FFI_TYPE_COUNT
+	};
+
+	// Pointer to the data of the cdata at index, or nullptr if it's not of the given type.
+	// Implemented in LuaGlm.cpp, which registers the types
+	static void* get_ffi_pointer(lua_State* L, int index, FFIType type);
+
+	template<typename T, FFIType type, typename Handler>
+	static bool check(lua_State* L, int index, sol::type index_type, Handler&&, sol::stack::record& tracking)
+	{
+		if(index_type == sol::type::userdata || get_ffi_pointer(L, index, type) == nullptr)
+		{
+			// Let sol check the userdata normally
+			return false;
+		}
+
+		tracking.use(1);
+		return true;
+	}
+
+	template<typename T, FFIType type>
+	static std::pair<bool, T*> get(lua_State* L, int index, sol::stack::record& tracking)
+	{
+		T* ptr = (T*)get_ffi_pointer(L, index, type);
+		if(ptr == nullptr)
+		{
+			return std::pair<bool, T*>(false, nullptr);
+		}
+
+		tracking.use(1);
+		return std::pair<bool, T*>(true, ptr);
+	}
+};
+
+// Found through ADL by sol, so they must be in the namespace of the glm types
+namespace glm
+{
+
+#define LUA_GLM_INTEROP(gtype, ffitype) \
+	template<typename Handler> \
+	inline bool sol_lua_interop_check(sol::types<gtype>, lua_State* L, int index, sol::type index_type, \
+		Handler&& handler, sol::stack::record& tracking) \
+	{ return LuaGlmInterop::check<gtype, LuaGlmInterop::ffitype>(L, index, index_type, std::forward<Handler>(handler), tracking); } \
+	inline std::pair<bool, gtype*> sol_lua_interop_get(sol::types<gtype>, lua_State* L, int index, void*, \
+		sol::stack::record& tracking) \
+	{ return LuaGlmInterop::get<gtype, LuaGlmInterop::ffitype>(L, index, tracking); }
+
+LUA_GLM_INTEROP(glm::dvec2, VEC2)
+LUA_GLM_INTEROP(glm::dvec3, VEC3)
+LUA_GLM_INTEROP(glm::dvec4, VEC4)
+LUA_GLM_INTEROP(glm::dmat4, MAT4)
+
+#undef LUA_GLM_INTEROP
+
+}
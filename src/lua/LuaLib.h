@@ -1,5 +1,5 @@
 #pragma once
-#include <sol/sol.hpp>
+#include "LuaGlmInterop.h"
 
 class LuaLib
 {
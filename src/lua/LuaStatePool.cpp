@@ -0,0 +1,128 @@
+#include "LuaStatePool.h"
+#include <util/Logger.h>
+#include <algorithm>
+
+static const char* SNAPSHOT_KEY = "__pool_globals";
+
+void LuaStatePool::snapshot_globals(sol::state& state)
+{
+	sol::table snapshot = state.create_table();
+	for(auto& pair : state.globals())
+	{
+		snapshot[pair.first] = true;
+	}
+	state.registry()[SNAPSHOT_KEY] = snapshot;
+}
+
+void LuaStatePool::reset_globals(sol::state& state)
+{
+	sol::table snapshot = state.registry()[SNAPSHOT_KEY];
+	sol::table globals = state.globals();
+
+	// Can't be removed while iterating
+	std::vector<sol::object> added;
+	for(auto& pair : globals)
+	{
+		if(snapshot[pair.first] == sol::nil)
+		{
+			added.push_back(pair.first);
+		}
+	}
+
+	for(const sol::object& key : added)
+	{
+		globals[key] = sol::nil;
+	}
+
+	state.collect_garbage();
+}
+
+PooledLuaState LuaStatePool::create_state(const std::string& key, const CreateFnc& create)
+{
+	PooledLuaState out;
+	out.key = key;
+	out.state = std::make_unique<sol::state>();
+	out.ok = create(*out.state);
+	if(out.ok)
+	{
+		snapshot_globals(*out.state);
+	}
+
+	return out;
+}
+
+PooledLuaState LuaStatePool::acquire(const std::string& key, const CreateFnc& create)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = idle.find(key);
+		if(it != idle.end() && !it->second.empty())
+		{
+			PooledLuaState out;
+			out.key = key;
+			out.state = std::move(it->second.back());
+			out.ok = true;
+			it->second.pop_back();
+			return out;
+		}
+	}
+
+	return create_state(key, create);
+}
+
+void LuaStatePool::prewarm(const std::string& key, const CreateFnc& create, size_t count)
+{
+	count = std::min(count, max_idle_per_key);
+	while(get_idle_count(key) < count)
+	{
+		PooledLuaState state = create_state(key, create);
+		if(!state.ok)
+		{
+			logger->warn("Could not prewarm lua state '{}'", key);
+			break;
+		}
+		release(state);
+	}
+}
+
+void LuaStatePool::release(PooledLuaState& state)
+{
+	if(!state.is_valid())
+	{
+		return;
+	}
+
+	if(state.ok)
+	{
+		reset_globals(*state.state);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto& list = idle[state.key];
+		if(list.size() < max_idle_per_key)
+		{
+			list.push_back(std::move(state.state));
+		}
+	}
+
+	// Destroyed here if it was not pooled
+	state.state.reset();
+	state.ok = false;
+}
+
+size_t LuaStatePool::get_idle_count(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = idle.find(key);
+	return it == idle.end() ? 0 : it->second.size();
+}
+
+void LuaStatePool::clear()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	idle.clear();
+}
+
+LuaStatePool::LuaStatePool()
+{
+	max_idle_per_key = 8;
+}
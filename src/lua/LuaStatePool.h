@@ -0,0 +1,65 @@
+#pragma once
+#include "LuaGlmInterop.h"
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+
+// A state taken from a LuaStatePool, give it back with LuaStatePool::release
+struct PooledLuaState
+{
+	std::unique_ptr<sol::state> state;
+	std::string key;
+	// False if the create function failed (for example, a script error), it won't be
+	// pooled again
+	bool ok = false;
+
+	sol::state& operator*() { return *state; }
+	sol::state* operator->() { return state.get(); }
+	bool is_valid() const { return state != nullptr; }
+};
+
+// Keeps ready to use lua states, so systems which need many equivalent states (for example,
+// worker threads running the same planet script) don't pay for loading the libraries,
+// running the script and warming up the JIT every time.
+// States are grouped by a key, which must identify everything the create function does
+// (script, its contents, libraries...). Once created, the globals of a state are remembered,
+// and those added while it's in use are removed when it's released, followed by a garbage
+// collection. Changes to the values of the original globals are NOT undone.
+// All functions are thread safe, but states may only be used by one thread at a time
+class LuaStatePool
+{
+public:
+
+	// Prepares a new state, including any warming up. Returns false if it's not usable
+	using CreateFnc = std::function<bool(sol::state&)>;
+
+private:
+
+	std::unordered_map<std::string, std::vector<std::unique_ptr<sol::state>>> idle;
+	std::mutex mtx;
+
+	static void snapshot_globals(sol::state& state);
+	static void reset_globals(sol::state& state);
+	PooledLuaState create_state(const std::string& key, const CreateFnc& create);
+
+public:
+
+	// Idle states kept for each key, the rest are destroyed on release
+	size_t max_idle_per_key;
+
+	// Creation happens in the calling thread, as create functions usually use the asset
+	// manager, call from the main thread unless it's known to be safe
+	PooledLuaState acquire(const std::string& key, const CreateFnc& create);
+	// Creates states until there are count idle states for key
+	void prewarm(const std::string& key, const CreateFnc& create, size_t count);
+	// Leaves state empty
+	void release(PooledLuaState& state);
+
+	size_t get_idle_count(const std::string& key);
+	void clear();
+
+	LuaStatePool();
+};
@@ -9,8 +9,7 @@
 	libraries[LibraryID::PLUG_##name] = new name();
 
 #define HOLMGARD_MAKE_REQUIRE(qname, reqname) \
-	else if(name == reqname) \
-		return LibraryID::PLUG_##qname;
+	ids[reqname] = LibraryID::PLUG_##qname;
 #endif
 
 
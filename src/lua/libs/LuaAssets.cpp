@@ -44,7 +44,34 @@ void LuaAssets::load_to(sol::table& table)
 		"sample_bilinear", sol::overload(
 			sol::resolve<glm::dvec4(glm::dvec2)>(&Image::sample_bilinear_double),
 			sol::resolve<glm::dvec4(double, double)>(&Image::sample_bilinear_double)
-		)
+		),
+		"sample_bilinear_batch", sol::resolve<void(ImageSampleBatch&)>(&Image::sample_bilinear_batch),
+		"get_memory_size", &Image::get_memory_size
+		);
+
+	// Fill the uvs with set, sample with image:sample_bilinear_batch(batch), and
+	// read the results back with get or the per-channel getters (these avoid
+	// creating a vector per sample)
+	// Lua indices are 1 based, anything out of the batch is an error
+	auto batch_index = [](const ImageSampleBatch& b, size_t i)
+	{
+		logger->check(i >= 1 && i <= b.uvs.size(), "Sample batch index {} out of range (size {})", i, b.uvs.size());
+		return i - 1;
+	};
+
+	table.new_usertype<ImageSampleBatch>("image_sample_batch",
+		sol::constructors<ImageSampleBatch(size_t)>(),
+		"resize", &ImageSampleBatch::resize,
+		"size", [](const ImageSampleBatch& b){ return b.uvs.size(); },
+		"set", sol::overload(
+			[batch_index](ImageSampleBatch& b, size_t i, double x, double y){ b.uvs[batch_index(b, i)] = glm::vec2(x, y); },
+			[batch_index](ImageSampleBatch& b, size_t i, glm::dvec2 uv){ b.uvs[batch_index(b, i)] = glm::vec2(uv); }
+		),
+		"get", [batch_index](const ImageSampleBatch& b, size_t i){ return glm::dvec4(b.results[batch_index(b, i)]); },
+		"get_r", [batch_index](const ImageSampleBatch& b, size_t i){ return (double)b.results[batch_index(b, i)].r; },
+		"get_g", [batch_index](const ImageSampleBatch& b, size_t i){ return (double)b.results[batch_index(b, i)].g; },
+		"get_b", [batch_index](const ImageSampleBatch& b, size_t i){ return (double)b.results[batch_index(b, i)].b; },
+		"get_a", [batch_index](const ImageSampleBatch& b, size_t i){ return (double)b.results[batch_index(b, i)].a; }
 		);
 
 	table.new_usertype<Config>("config",
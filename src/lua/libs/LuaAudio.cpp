@@ -31,6 +31,8 @@ void LuaAudio::load_to(sol::table &table)
 		"set_pitch", &LuaAudioHandler::set_pitch,
 		"is_looping", &LuaAudioHandler::is_looping,
 		"set_looping", &LuaAudioHandler::set_looping,
+		"get_priority", &LuaAudioHandler::get_priority,
+		"set_priority", &LuaAudioHandler::set_priority,
 		"set_source", &LuaAudioHandler::set_source_clip
 		);
 
@@ -58,6 +58,10 @@ struct LuaAudioHandler
 	{ WRAP return l->is_looping(); else return false; }
 	void set_looping(bool val) const
 	{ WRAP l->set_looping(val); }
+	int get_priority() const
+	{ WRAP return l->get_priority(); else return 0; }
+	void set_priority(int val) const
+	{ WRAP l->set_priority(val); }
 	void set_source_clip(const AssetHandle<AudioClip>& ast) const
 	{ WRAP l->set_source_clip(std::move(ast)); }
 
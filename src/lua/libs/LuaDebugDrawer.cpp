@@ -39,4 +39,24 @@ void LuaDebugDrawer::load_to(sol::table& table)
 		debug_drawer->add_box(tform, corner_1, corner_2, (glm::vec3)color);
 	});
 
+	table.set_function("add_triangle", [](glm::dvec3 p0, glm::dvec3 p1, glm::dvec3 p2, glm::dvec3 color)
+	{
+		debug_drawer->add_triangle(p0, p1, p2, (glm::vec3)color);
+	});
+
+	table.set_function("begin_persistent", [](const std::string& name)
+	{
+		debug_drawer->begin_persistent(name);
+	});
+
+	table.set_function("end_persistent", []()
+	{
+		debug_drawer->end_persistent();
+	});
+
+	table.set_function("remove_persistent", [](const std::string& name)
+	{
+		debug_drawer->remove_persistent(name);
+	});
+
 }
\ No newline at end of file
@@ -18,8 +18,27 @@
 #include <gui/widgets/GUILabel.h>
 
 #include <renderer/Renderer.h>
+#include <unordered_map>
 
 
+// Widgets returned from lua functions may be of any widget type
+static std::shared_ptr<GUIWidget> lua_to_widget(const sol::object& obj)
+{
+	if(obj.is<std::shared_ptr<GUIDropDown>>())
+		return obj.as<std::shared_ptr<GUIDropDown>>();
+	else if(obj.is<std::shared_ptr<GUIImageButton>>())
+		return obj.as<std::shared_ptr<GUIImageButton>>();
+	else if(obj.is<std::shared_ptr<GUITextButton>>())
+		return obj.as<std::shared_ptr<GUITextButton>>();
+	else if(obj.is<std::shared_ptr<GUITextField>>())
+		return obj.as<std::shared_ptr<GUITextField>>();
+	else if(obj.is<std::shared_ptr<GUILabel>>())
+		return obj.as<std::shared_ptr<GUILabel>>();
+
+	logger->error("Expected a GUI widget");
+	return nullptr;
+}
+
 void LuaGUI::load_to(sol::table &table)
 {
 	table.new_usertype<GUISkin>("skin",
@@ -162,6 +181,9 @@ void LuaGUI::load_to(sol::table &table)
 			  "title", &GUIWindow::title,
 			  "style", &GUIWindow::style,
 			  "alpha", &GUIWindow::alpha,
+			  "cache_content", &GUIWindow::cache_content,
+			  "cache_max_frames", &GUIWindow::cache_max_frames,
+			  "redraw", &GUIWindow::redraw,
 			  "close", &GUIWindow::close);
 
 	table.new_enum("window_style",
@@ -181,7 +203,8 @@ void LuaGUI::load_to(sol::table &table)
     "remove_widget", WIDGET_HELPER(remove_widget_lua, cname), \
     "get_widget_count", &cname::get_widget_count,    \
 	"margins", sol::property([](const cname& self){ return (glm::dvec4)self.margins; }, \
-	                         [](cname& self, glm::dvec4 m){ self.margins = m; })\
+	                         [](cname& self, glm::dvec4 m){ self.margins = m; }), \
+	"mark_dirty", &cname::mark_dirty\
 
 
 	table.new_usertype<GUISingleLayout>("single_layout",
@@ -203,10 +226,57 @@ void LuaGUI::load_to(sol::table &table)
 											"new", [](sol::optional<int> elem_margin){
 				return std::make_shared<GUIVerticalLayout>(elem_margin.value_or(4)); });
 
+	table.new_usertype<GUIListLayout>("list_layout",
+				sol::base_classes, sol::bases<GUILayout>(),
+				LAYOUT_BASE(GUIListLayout),
+				"overscan_rows", &GUIListLayout::overscan_rows,
+				"get_item_count", &GUIListLayout::get_item_count,
+				"set_item_count", &GUIListLayout::set_item_count,
+				"refresh_items", &GUIListLayout::refresh_items,
+				// create() must return a new widget, bind(widget, item) sets it up to show
+				// the item (starting at 1)
+				"set_virtual", [](GUIListLayout& self, size_t count, glm::dvec2 item_size,
+						sol::protected_function create, sol::protected_function bind)
+				{
+					// Widgets are passed back to lua as the same object create returned
+					auto objects = std::make_shared<std::unordered_map<GUIWidget*, sol::object>>();
+					auto create_fnc = [create, objects]() -> std::shared_ptr<GUIWidget>
+					{
+						sol::protected_function_result res = create();
+						if(!res.valid())
+						{
+							sol::error err = res;
+							logger->error("Error creating virtual list widget:\n{}", err.what());
+							return nullptr;
+						}
+
+						sol::object obj = res;
+						std::shared_ptr<GUIWidget> widget = lua_to_widget(obj);
+						if(widget)
+						{
+							(*objects)[widget.get()] = obj;
+						}
+						return widget;
+					};
+					auto bind_fnc = [bind, objects](GUIWidget* widget, size_t item)
+					{
+						sol::protected_function_result res = bind((*objects)[widget], item + 1);
+						if(!res.valid())
+						{
+							sol::error err = res;
+							logger->error("Error binding virtual list widget:\n{}", err.what());
+						}
+					};
+					self.set_virtual(count, item_size, create_fnc, bind_fnc);
+				},
+				"new", [](sol::optional<int> vmargin, sol::optional<int> hmargin){
+					return std::make_shared<GUIListLayout>(vmargin.value_or(4), hmargin.value_or(4)); });
+
 #define WIDGET_BASE(cname) \
 	"default_size", sol::property([](const cname& self){ return (glm::dvec2)self.default_size; }, \
-	                              [](cname& self, glm::dvec2 val){ self.default_size = val; }),   \
-    "is_visible", sol::readonly(&cname::is_visible)\
+	                              [](cname& self, glm::dvec2 val){ self.default_size = val; self.mark_dirty(); }),   \
+    "is_visible", sol::readonly(&cname::is_visible), \
+    "mark_dirty", &cname::mark_dirty\
 
 	table.new_usertype<GUIImageButton>("image_button",
 		   sol::base_classes, sol::bases<GUIWidget, GUIBaseButton>(),
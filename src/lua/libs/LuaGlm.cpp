@@ -3,6 +3,13 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <util/MathUtil.h>
+#include <util/Logger.h>
+
+// Internal LuaJIT header, only used for LUA_TCDATA and to read the ctype id of cdata
+extern "C"
+{
+#include <lj_obj.h>
+}
 
 
 #define TYPECHECK(a, table, tname, L, errmsg) if constexpr (LUA_GLM_TYPECHECKED) { \
@@ -47,6 +54,407 @@ std::string LuaGlm::glm_quat_to_string(const glm::dquat& v)
 	return fmt::format("q({}, {}, {}, {})", v.w, v.x, v.y, v.z);
 }
 
+// Registry keys, the ctype ids change between lua states
+static char ffi_ids_key;
+static char ffi_types_key;
+
+void* LuaGlmInterop::get_ffi_pointer(lua_State* L, int index, FFIType type)
+{
+	if(lua_type(L, index) != LUA_TCDATA)
+	{
+		return nullptr;
+	}
+
+	void* ptr = (void*)lua_topointer(L, index);
+	lua_pushlightuserdata(L, &ffi_ids_key);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	auto* ids = (uint16_t*)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	// The data of a cdata object follows its header
+	if(ids == nullptr || ((const GCcdata*)ptr - 1)->ctypeid != ids[type])
+	{
+		return nullptr;
+	}
+
+	return ptr;
+}
+
+// Defines cvec2, cvec3, cvec4 and cmat4. Everything is plain lua, so LuaJIT can
+// compile it into traces, and allocations of temporaries are usually sunk
+static const char* ffi_glm_src = R"LUA(
+local glm, assign_mat4 = ...
+local ffi = ffi
+local ffi_new = ffi.new
+local istype = ffi.istype
+local type = type
+local sqrt = math.sqrt
+local tostring = tostring
+
+ffi.cdef[[
+typedef struct { double x, y; } hg_dvec2;
+typedef struct { double x, y, z; } hg_dvec3;
+typedef struct { double x, y, z, w; } hg_dvec4;
+typedef struct { double m[16]; } hg_dmat4;
+]]
+
+local vec2, vec3, vec4, mat4
+local vec2_mt, vec3_mt, vec4_mt, mat4_mt = {}, {}, {}, {}
+vec2_mt.__index = vec2_mt
+vec3_mt.__index = vec3_mt
+vec4_mt.__index = vec4_mt
+mat4_mt.__index = mat4_mt
+
+-- vec2
+
+function vec2_mt.__new(ct, x, y)
+	if x == nil then return ffi_new(ct, 0, 0) end
+	if y == nil then
+		if type(x) == "number" then return ffi_new(ct, x, x) end
+		return ffi_new(ct, x.x, x.y)
+	end
+	return ffi_new(ct, x, y)
+end
+
+function vec2_mt.__add(a, b)
+	if type(a) == "number" then return ffi_new(vec2, a + b.x, a + b.y) end
+	if type(b) == "number" then return ffi_new(vec2, a.x + b, a.y + b) end
+	return ffi_new(vec2, a.x + b.x, a.y + b.y)
+end
+
+function vec2_mt.__sub(a, b)
+	if type(a) == "number" then return ffi_new(vec2, a - b.x, a - b.y) end
+	if type(b) == "number" then return ffi_new(vec2, a.x - b, a.y - b) end
+	return ffi_new(vec2, a.x - b.x, a.y - b.y)
+end
+
+function vec2_mt.__mul(a, b)
+	if type(a) == "number" then return ffi_new(vec2, a * b.x, a * b.y) end
+	if type(b) == "number" then return ffi_new(vec2, a.x * b, a.y * b) end
+	return ffi_new(vec2, a.x * b.x, a.y * b.y)
+end
+
+function vec2_mt.__div(a, b)
+	if type(a) == "number" then return ffi_new(vec2, a / b.x, a / b.y) end
+	if type(b) == "number" then return ffi_new(vec2, a.x / b, a.y / b) end
+	return ffi_new(vec2, a.x / b.x, a.y / b.y)
+end
+
+function vec2_mt.__unm(a) return ffi_new(vec2, -a.x, -a.y) end
+
+function vec2_mt.__eq(a, b)
+	return istype(vec2, a) and istype(vec2, b) and a.x == b.x and a.y == b.y
+end
+
+function vec2_mt.__tostring(a)
+	return "(" .. tostring(a.x) .. ", " .. tostring(a.y) .. ")"
+end
+
+function vec2_mt.dot(a, b) return a.x * b.x + a.y * b.y end
+function vec2_mt.length2(a) return a.x * a.x + a.y * a.y end
+function vec2_mt.length(a) return sqrt(a.x * a.x + a.y * a.y) end
+function vec2_mt.distance(a, b) return (a - b):length() end
+function vec2_mt.normalize(a) return a / a:length() end
+function vec2_mt.unpack(a) return a.x, a.y end
+
+-- vec3
+
+function vec3_mt.__new(ct, x, y, z)
+	if x == nil then return ffi_new(ct, 0, 0, 0) end
+	if y == nil then
+		if type(x) == "number" then return ffi_new(ct, x, x, x) end
+		return ffi_new(ct, x.x, x.y, x.z)
+	end
+	return ffi_new(ct, x, y, z)
+end
+
+function vec3_mt.__add(a, b)
+	if type(a) == "number" then return ffi_new(vec3, a + b.x, a + b.y, a + b.z) end
+	if type(b) == "number" then return ffi_new(vec3, a.x + b, a.y + b, a.z + b) end
+	return ffi_new(vec3, a.x + b.x, a.y + b.y, a.z + b.z)
+end
+
+function vec3_mt.__sub(a, b)
+	if type(a) == "number" then return ffi_new(vec3, a - b.x, a - b.y, a - b.z) end
+	if type(b) == "number" then return ffi_new(vec3, a.x - b, a.y - b, a.z - b) end
+	return ffi_new(vec3, a.x - b.x, a.y - b.y, a.z - b.z)
+end
+
+function vec3_mt.__mul(a, b)
+	if type(a) == "number" then return ffi_new(vec3, a * b.x, a * b.y, a * b.z) end
+	if type(b) == "number" then return ffi_new(vec3, a.x * b, a.y * b, a.z * b) end
+	return ffi_new(vec3, a.x * b.x, a.y * b.y, a.z * b.z)
+end
+
+function vec3_mt.__div(a, b)
+	if type(a) == "number" then return ffi_new(vec3, a / b.x, a / b.y, a / b.z) end
+	if type(b) == "number" then return ffi_new(vec3, a.x / b, a.y / b, a.z / b) end
+	return ffi_new(vec3, a.x / b.x, a.y / b.y, a.z / b.z)
+end
+
+function vec3_mt.__unm(a) return ffi_new(vec3, -a.x, -a.y, -a.z) end
+
+function vec3_mt.__eq(a, b)
+	return istype(vec3, a) and istype(vec3, b) and a.x == b.x and a.y == b.y and a.z == b.z
+end
+
+function vec3_mt.__tostring(a)
+	return "(" .. tostring(a.x) .. ", " .. tostring(a.y) .. ", " .. tostring(a.z) .. ")"
+end
+
+function vec3_mt.dot(a, b) return a.x * b.x + a.y * b.y + a.z * b.z end
+function vec3_mt.cross(a, b)
+	return ffi_new(vec3, a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x)
+end
+function vec3_mt.length2(a) return a.x * a.x + a.y * a.y + a.z * a.z end
+function vec3_mt.length(a) return sqrt(a.x * a.x + a.y * a.y + a.z * a.z) end
+function vec3_mt.distance(a, b) return (a - b):length() end
+function vec3_mt.normalize(a) return a / a:length() end
+function vec3_mt.unpack(a) return a.x, a.y, a.z end
+function vec3_mt.to_vec2(a) return ffi_new(vec2, a.x, a.y) end
+
+-- vec4
+
+function vec4_mt.__new(ct, x, y, z, w)
+	if x == nil then return ffi_new(ct, 0, 0, 0, 0) end
+	if y == nil then
+		if type(x) == "number" then return ffi_new(ct, x, x, x, x) end
+		return ffi_new(ct, x.x, x.y, x.z, x.w)
+	end
+	if z == nil then
+		-- vec3 and w
+		return ffi_new(ct, x.x, x.y, x.z, y)
+	end
+	return ffi_new(ct, x, y, z, w)
+end
+
+function vec4_mt.__add(a, b)
+	if type(a) == "number" then return ffi_new(vec4, a + b.x, a + b.y, a + b.z, a + b.w) end
+	if type(b) == "number" then return ffi_new(vec4, a.x + b, a.y + b, a.z + b, a.w + b) end
+	return ffi_new(vec4, a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w)
+end
+
+function vec4_mt.__sub(a, b)
+	if type(a) == "number" then return ffi_new(vec4, a - b.x, a - b.y, a - b.z, a - b.w) end
+	if type(b) == "number" then return ffi_new(vec4, a.x - b, a.y - b, a.z - b, a.w - b) end
+	return ffi_new(vec4, a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w)
+end
+
+function vec4_mt.__mul(a, b)
+	if type(a) == "number" then return ffi_new(vec4, a * b.x, a * b.y, a * b.z, a * b.w) end
+	if type(b) == "number" then return ffi_new(vec4, a.x * b, a.y * b, a.z * b, a.w * b) end
+	if istype(mat4, b) then
+		-- Row vector times matrix
+		local m = b.m
+		return ffi_new(vec4,
+			a.x * m[0] + a.y * m[1] + a.z * m[2] + a.w * m[3],
+			a.x * m[4] + a.y * m[5] + a.z * m[6] + a.w * m[7],
+			a.x * m[8] + a.y * m[9] + a.z * m[10] + a.w * m[11],
+			a.x * m[12] + a.y * m[13] + a.z * m[14] + a.w * m[15])
+	end
+	return ffi_new(vec4, a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w)
+end
+
+function vec4_mt.__div(a, b)
+	if type(a) == "number" then return ffi_new(vec4, a / b.x, a / b.y, a / b.z, a / b.w) end
+	if type(b) == "number" then return ffi_new(vec4, a.x / b, a.y / b, a.z / b, a.w / b) end
+	return ffi_new(vec4, a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w)
+end
+
+function vec4_mt.__unm(a) return ffi_new(vec4, -a.x, -a.y, -a.z, -a.w) end
+
+function vec4_mt.__eq(a, b)
+	return istype(vec4, a) and istype(vec4, b) and a.x == b.x and a.y == b.y and a.z == b.z and a.w == b.w
+end
+
+function vec4_mt.__tostring(a)
+	return "(" .. tostring(a.x) .. ", " .. tostring(a.y) .. ", " .. tostring(a.z) .. ", " .. tostring(a.w) .. ")"
+end
+
+function vec4_mt.dot(a, b) return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w end
+function vec4_mt.length2(a) return a:dot(a) end
+function vec4_mt.length(a) return sqrt(a:dot(a)) end
+function vec4_mt.distance(a, b) return (a - b):length() end
+function vec4_mt.normalize(a) return a / a:length() end
+function vec4_mt.unpack(a) return a.x, a.y, a.z, a.w end
+function vec4_mt.to_vec2(a) return ffi_new(vec2, a.x, a.y) end
+function vec4_mt.to_vec3(a) return ffi_new(vec3, a.x, a.y, a.z) end
+
+-- mat4, column major like glm. Element (col, row) is m[col * 4 + row]
+
+function mat4_mt.__new(ct, d)
+	local out = ffi_new(ct)
+	if d == nil then d = 1.0 end
+	if type(d) == "number" then
+		out.m[0], out.m[5], out.m[10], out.m[15] = d, d, d, d
+	else
+		-- Another mat4, cdata or userdata
+		assign_mat4(out, d)
+	end
+	return out
+end
+
+local function mat4_binop(a, b, op)
+	local out = ffi_new(mat4)
+	if type(a) == "number" then
+		for i = 0, 15 do out.m[i] = op(a, b.m[i]) end
+	elseif type(b) == "number" then
+		for i = 0, 15 do out.m[i] = op(a.m[i], b) end
+	else
+		for i = 0, 15 do out.m[i] = op(a.m[i], b.m[i]) end
+	end
+	return out
+end
+
+local function add(a, b) return a + b end
+local function sub(a, b) return a - b end
+
+function mat4_mt.__add(a, b) return mat4_binop(a, b, add) end
+function mat4_mt.__sub(a, b) return mat4_binop(a, b, sub) end
+
+function mat4_mt.__mul(a, b)
+	if type(a) == "number" or type(b) == "number" then
+		local s, m = a, b
+		if type(b) == "number" then s, m = b, a end
+		local out = ffi_new(mat4)
+		for i = 0, 15 do out.m[i] = m.m[i] * s end
+		return out
+	end
+
+	local m = a.m
+	if istype(vec4, b) then
+		return ffi_new(vec4,
+			m[0] * b.x + m[4] * b.y + m[8] * b.z + m[12] * b.w,
+			m[1] * b.x + m[5] * b.y + m[9] * b.z + m[13] * b.w,
+			m[2] * b.x + m[6] * b.y + m[10] * b.z + m[14] * b.w,
+			m[3] * b.x + m[7] * b.y + m[11] * b.z + m[15] * b.w)
+	end
+
+	local out = ffi_new(mat4)
+	local n = b.m
+	for c = 0, 3 do
+		for r = 0, 3 do
+			out.m[c * 4 + r] = m[r] * n[c * 4] + m[4 + r] * n[c * 4 + 1] +
+				m[8 + r] * n[c * 4 + 2] + m[12 + r] * n[c * 4 + 3]
+		end
+	end
+	return out
+end
+
+function mat4_mt.__tostring(a)
+	local m = a.m
+	local str = "("
+	for c = 0, 3 do
+		for r = 0, 3 do
+			str = str .. tostring(m[c * 4 + r])
+			if r ~= 3 then str = str .. ", " end
+		end
+		if c ~= 3 then str = str .. " | " end
+	end
+	return str .. ")"
+end
+
+function mat4_mt.get(a, col, row) return a.m[col * 4 + row] end
+function mat4_mt.set(a, col, row, v) a.m[col * 4 + row] = v end
+
+function mat4_mt.transpose(a)
+	local out = ffi_new(mat4)
+	for c = 0, 3 do
+		for r = 0, 3 do
+			out.m[r * 4 + c] = a.m[c * 4 + r]
+		end
+	end
+	return out
+end
+
+-- Same as (m * vec4(p, 1)):to_vec3()
+function mat4_mt.transform_point(a, p)
+	local m = a.m
+	return ffi_new(vec3,
+		m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+		m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+		m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14])
+end
+
+-- Same as (m * vec4(d, 0)):to_vec3()
+function mat4_mt.transform_direction(a, d)
+	local m = a.m
+	return ffi_new(vec3,
+		m[0] * d.x + m[4] * d.y + m[8] * d.z,
+		m[1] * d.x + m[5] * d.y + m[9] * d.z,
+		m[2] * d.x + m[6] * d.y + m[10] * d.z)
+end
+
+vec2 = ffi.metatype("hg_dvec2", vec2_mt)
+vec3 = ffi.metatype("hg_dvec3", vec3_mt)
+vec4 = ffi.metatype("hg_dvec4", vec4_mt)
+mat4 = ffi.metatype("hg_dmat4", mat4_mt)
+
+glm.cvec2 = vec2
+glm.cvec3 = vec3
+glm.cvec4 = vec4
+glm.cmat4 = mat4
+
+-- ctype ids, used by the C++ interop
+return tonumber(vec2), tonumber(vec3), tonumber(vec4), tonumber(mat4)
+)LUA";
+
+void LuaGlm::load_ffi_types(sol::table& table)
+{
+	sol::state_view sview(table.lua_state());
+	lua_State* L = table.lua_state();
+
+	// ctypes may only be defined once per state
+	lua_pushlightuserdata(L, &ffi_types_key);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	if(lua_istable(L, -1))
+	{
+		sol::table types = sol::stack::pop<sol::table>(L);
+		for(const char* name : {"cvec2", "cvec3", "cvec4", "cmat4"})
+		{
+			table[name] = types[name];
+		}
+		return;
+	}
+	lua_pop(L, 1);
+
+	sview.open_libraries(sol::lib::ffi);
+
+	sol::load_result lresult = sview.load(ffi_glm_src, "internal: LuaGlm");
+	logger->check(lresult.valid(), "Could not load LuaGlm FFI types");
+	sol::protected_function fnc = lresult;
+
+	sol::table types = sview.create_table();
+	auto assign_mat4 = [](glm::dmat4& dst, const glm::dmat4& src) { dst = src; };
+	sol::protected_function_result result = fnc(types, assign_mat4);
+	if(!result.valid())
+	{
+		sol::error err = result;
+		logger->fatal("Could not create LuaGlm FFI types: {}", err.what());
+	}
+
+	auto* ids = (uint16_t*)lua_newuserdata(L, sizeof(uint16_t) * LuaGlmInterop::FFI_TYPE_COUNT);
+	for(int i = 0; i < LuaGlmInterop::FFI_TYPE_COUNT; i++)
+	{
+		ids[i] = result.get<uint16_t>(i);
+	}
+	lua_pushlightuserdata(L, &ffi_ids_key);
+	lua_insert(L, -2);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	lua_pushlightuserdata(L, &ffi_types_key);
+	sol::stack::push(L, types);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	for(const char* name : {"cvec2", "cvec3", "cvec4", "cmat4"})
+	{
+		table[name] = types[name];
+	}
+
+	// Unload ffi to avoid security risks
+	sview["ffi"] = sol::nil;
+}
+
 void LuaGlm::load_to(sol::table& table)
 {
 
@@ -683,6 +1091,8 @@ void LuaGlm::load_to(sol::table& table)
 	{
 		return (glm::dvec2)MathUtil::clip_to_screen(clip_pos, viewport);
 	};
+
+	load_ffi_types(table);
 }
 
 LuaGlm::LuaGlm()
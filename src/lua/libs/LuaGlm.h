@@ -20,6 +20,19 @@
 	the lua user will not be able to handle the type!
 
 	As we use a lot of doubles in OSPGL, this will rarely be a problem.
+
+	FFI types:
+
+	'cvec2', 'cvec3', 'cvec4' and 'cmat4' are LuaJIT cdata versions of the types, constructed
+	by calling them directly (ex. 'cvec3(1, 2, 3)', 'cvec3(v)', 'cmat4()' is the identity).
+	They don't allocate userdata and their operators are plain lua, so LuaJIT can compile
+	them, use them for math done at high rates. They support the arithmetic operators,
+	'dot', 'cross' (cvec3), 'length', 'length2', 'distance', 'normalize', 'unpack', and for
+	cmat4 'get(col, row)', 'set(col, row, v)', 'transpose', 'transform_point' and 'transform_direction'.
+	Elements of cmat4 are in '.m', 0 based and column major.
+
+	They may be passed to any C++ function taking the glm type (see LuaGlmInterop.h),
+	functions returning glm types still return the usertypes, 'cvec3(v)' converts them.
 	
 */
 class LuaGlm : public LuaLib
@@ -33,6 +46,9 @@ public:
 	static std::string glm_mat4_to_string(const glm::dmat4& v);
 	static std::string glm_quat_to_string(const glm::dquat& v);
 
+	// Adds the FFI types to table
+	static void load_ffi_types(sol::table& table);
+
 	virtual void load_to(sol::table& table) override;
 
 	LuaGlm();
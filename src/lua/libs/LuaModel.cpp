@@ -38,6 +38,28 @@ void LuaModel::load_to(sol::table &table)
 		  "draw", &Node::draw,
 		  "draw_shadow", &Node::draw_shadow,
 		  "draw_override", &Node::draw_override,
+		  "draw_instanced", [](const Node* n, const CameraUniforms& cu, const sol::table& models, GLint did,
+		  		bool ignore_our_subtform)
+		  {
+			std::vector<glm::dmat4> tforms;
+			tforms.reserve(models.size());
+			for(size_t i = 1; i <= models.size(); i++)
+			{
+				tforms.push_back(models.get<glm::dmat4>(i));
+			}
+			n->draw_instanced(cu, tforms, did, ignore_our_subtform);
+		  },
+		  "draw_shadow_instanced", [](const Node* n, const ShadowCamera& sh_cam, const sol::table& models,
+		  		sol::optional<bool> ignore_our_subtform)
+		  {
+			std::vector<glm::dmat4> tforms;
+			tforms.reserve(models.size());
+			for(size_t i = 1; i <= models.size(); i++)
+			{
+				tforms.push_back(models.get<glm::dmat4>(i));
+			}
+			n->draw_shadow_instanced(sh_cam, tforms, ignore_our_subtform.value_or(false));
+		  },
 		  "children", &Node::children,
 		  "get_children_recursive", &Node::get_children_recursive,
 		  "extract_collider", [](Node* base, Node* n)
@@ -10,6 +10,7 @@
 #include "renderer/lighting/PointLight.h"
 #include "renderer/lighting/SunLight.h"
 #include "renderer/util/Skybox.h"
+#include "renderer/util/InstanceBatch.h"
 #include "universe/predictor/QuickPredictor.h"
 
 #include "LuaAssets.h"
@@ -23,12 +24,27 @@ void LuaRenderer::load_to(sol::table& table)
 				  &Renderer::add_drawable_lua<PlanetarySystem>,
 				  &Renderer::add_drawable_lua<Skybox>,
 				  &Renderer::add_drawable_lua<QuickPredictor>,
+				  &Renderer::add_drawable_lua<InstanceBatch>,
 				  [](Renderer* renderer, sol::table table)
 					{
 						auto drawable = std::make_shared<LuaDrawable>(std::move(table));
 						renderer->add_drawable(drawable, "");
 					}
 				  ),
+		  "register_drawable", sol::overload(
+				  &Renderer::register_drawable_lua<Drawable>,
+				  &Renderer::register_drawable_lua<PlanetarySystem>,
+				  &Renderer::register_drawable_lua<Skybox>,
+				  &Renderer::register_drawable_lua<QuickPredictor>,
+				  &Renderer::register_drawable_lua<InstanceBatch>,
+				  [](Renderer* renderer, sol::table table)
+					{
+						auto drawable = std::make_shared<LuaDrawable>(std::move(table));
+						return renderer->register_drawable(drawable, "");
+					}
+				  ),
+		  "remove_drawable", &Renderer::remove_drawable,
+		  "refresh_drawable", &Renderer::refresh_drawable,
 		  "add_light", sol::overload(
 				  &Renderer::add_light_lua<Light>,
 				  &Renderer::add_light_lua<PointLight>,
@@ -54,6 +70,7 @@ void LuaRenderer::load_to(sol::table& table)
 			rnd->set_ibl_source(cmap.get_asset_handle());
 		  },
 		  "enable_env_sampling", &Renderer::enable_env_sampling,
+		  "gpu_profiler", &Renderer::gpu_profiler,
 		  "vg", sol::property([](Renderer* rnd){ return (void*)rnd->vg; }),
 		  "get_size", sol::overload([](Renderer* rnd){
 		  	auto size = rnd->get_size(false);
@@ -65,6 +82,24 @@ void LuaRenderer::load_to(sol::table& table)
 		  	return std::make_tuple(size.x, size.y);
 		  }));
 
+	table.new_usertype<GPUProfiler>("gpu_profiler", sol::no_constructor,
+			"enabled", &GPUProfiler::enabled,
+			"begin", &GPUProfiler::begin,
+			"end_scope", &GPUProfiler::end,
+			"get_time", &GPUProfiler::get_time,
+			"get_results", [](GPUProfiler* prof, sol::this_state st)
+			{
+				sol::state_view sv(st);
+				sol::table out = sv.create_table();
+				for(const GPUProfiler::Result& r : prof->get_results())
+				{
+					out.add(sv.create_table_with("name", r.name, "depth", r.depth, "last", r.last, "avg", r.avg));
+				}
+				return out;
+			},
+			"start_log", &GPUProfiler::start_log,
+			"stop_log", &GPUProfiler::stop_log);
+
 	// TODO: maybe set to sol::readonly?
 	table.new_usertype<RendererQuality>("renderer_quality", sol::no_constructor,
 		    "sun_shadow_size", &RendererQuality::sun_shadow_size,
@@ -84,6 +119,8 @@ void LuaRenderer::load_to(sol::table& table)
 		    "frames_per_sample", &RendererQuality::PBR::frames_per_sample,
 		    "distance_per_sample", &RendererQuality::PBR::distance_per_sample,
 		    "time_per_sample", &RendererQuality::PBR::time_per_sample,
+		    "sun_angle_per_sample", &RendererQuality::PBR::sun_angle_per_sample,
+		    "ibl_samples_per_frame", &RendererQuality::PBR::ibl_samples_per_frame,
 		    "planet_distance_parameter", &RendererQuality::PBR::planet_distance_parameter,
 		    "simple_sampling", &RendererQuality::PBR::simple_sampling
 			 );
@@ -91,7 +128,8 @@ void LuaRenderer::load_to(sol::table& table)
 	table.new_usertype<RendererQuality::Atmosphere>("renderer_quality_atmosphere", sol::no_constructor,
 			 "low_end", &RendererQuality::Atmosphere::low_end,
 			 "iterations", &RendererQuality::Atmosphere::iterations,
-			 "sub_iterations", &RendererQuality::Atmosphere::sub_iterations
+			 "sub_iterations", &RendererQuality::Atmosphere::sub_iterations,
+			 "use_lut", &RendererQuality::Atmosphere::use_lut
 	);
 
 	table.new_enum("renderer_quality_pbr_quality",
@@ -100,6 +138,8 @@ void LuaRenderer::load_to(sol::table& table)
 		   "simple", RendererQuality::PBR::Quality::SIMPLE);
 
 	table.new_usertype<Drawable>("drawable");
+	table.new_usertype<DrawableHandle>("drawable_handle", sol::no_constructor,
+			"is_valid", &DrawableHandle::is_valid);
 	table.new_usertype<CameraUniforms>("camera_uniforms",
 			"proj", &CameraUniforms::proj,
 			"view", &CameraUniforms::view,
@@ -147,6 +187,10 @@ void LuaRenderer::load_to(sol::table& table)
 			  "color", &SunLight::color,
 			  "spec_color", &SunLight::spec_color,
 			  "ambient_color", &SunLight::ambient_color,
+			  "near_shadow_span", &SunLight::near_shadow_span,
+			  "shadow_distance", &SunLight::shadow_distance,
+			  "far_cache_frames", &SunLight::far_cache_frames,
+			  "far_cache_angle", &SunLight::far_cache_angle,
 			  "new", [](int a, int b)
 			  {
 				return std::make_shared<SunLight>(a, b);
@@ -161,6 +205,37 @@ void LuaRenderer::load_to(sol::table& table)
 				return std::make_shared<Skybox>(std::move(nhandle));
 		   });
 
+	table.new_usertype<InstanceBatch>("instance_batch", sol::base_classes, sol::bases<Drawable>(),
+			"origin", sol::property(&InstanceBatch::get_origin, &InstanceBatch::set_origin),
+			"casts_shadows", &InstanceBatch::casts_shadows,
+			"draw_in_env_map", &InstanceBatch::draw_in_env_map,
+			"get_instance_count", &InstanceBatch::get_instance_count,
+			"set_instances", [](InstanceBatch* self, const sol::table& tforms)
+			{
+				std::vector<glm::mat4> instances;
+				instances.reserve(tforms.size());
+				for(size_t i = 1; i <= tforms.size(); i++)
+				{
+					instances.emplace_back(tforms.get<glm::dmat4>(i));
+				}
+				self->set_instances(std::move(instances));
+			},
+			"set_params", [](InstanceBatch* self, const sol::table& values)
+			{
+				std::vector<glm::vec4> params;
+				params.reserve(values.size());
+				for(size_t i = 1; i <= values.size(); i++)
+				{
+					params.emplace_back(values.get<glm::dvec4>(i));
+				}
+				self->set_params(std::move(params));
+			},
+			"new", [](LuaAssetHandle<Model>& model, sol::optional<std::string> node)
+			{
+				AssetHandle<Model> nhandle = model.get_asset_handle();
+				return std::make_shared<InstanceBatch>(std::move(nhandle), node.value_or(""));
+			});
+
 	table.new_usertype<EnvMap>("envmap", sol::base_classes, sol::bases<Light>(),
 	        "new", []()
 		   {
@@ -9,6 +9,24 @@
  * 		require("universe") -- which contains planetary_system
  * or otherwise you will get a runtime error
  *
+ * add_drawable only draws for the current frame. For drawables that persist, use
+ * 		local handle = renderer:register_drawable(drawable)
+ * and renderer:remove_drawable(handle) once done. Call renderer:refresh_drawable(handle)
+ * if the passes it implements or its forward priority change.
+ *
+ * The passes are timed on the GPU by renderer.gpu_profiler. Drawables may time their own work with
+ * 		renderer.gpu_profiler:begin("name") ... renderer.gpu_profiler:end_scope()
+ * (end is a keyword in lua), get_time("name") returns the average in milliseconds (or -1),
+ * and start_log(path) writes every measured frame as CSV.
+ *
+ * Many copies of the same model are best drawn with an instance batch, which takes the transforms
+ * relative to an origin close to them:
+ * 		local batch = rnd.instance_batch.new(model, "rock")
+ * 		batch.origin = surface_point
+ * 		batch:set_instances(tforms) -- table of mat4
+ * 		local handle = renderer:register_drawable(batch)
+ * Changing casts_shadows or draw_in_env_map needs a refresh_drawable.
+ *
  * Also includes functions to create CameraUniforms (ie, for writing cameras!)
  * but it's a better idea to use the functions in core/scenes/cameras.lua
  * Finally, it includes access to functions to create lights and skyboxes
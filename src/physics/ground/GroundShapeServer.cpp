@@ -25,12 +25,17 @@ GroundShapeServer::GroundShapeServer(SystemElement* body)
 {
 	this->body = body;
 
-	bool wrote_error = false;
-
 	std::string script = AssetManager::load_string_raw(body->config.surface.script_path);
+	const std::string& script_path = body->config.surface.script_path;
+	const std::string& script_package = body->config.surface.script_package;
+	double radius = body->config.radius;
 
-	PlanetTile::prepare_lua(lua);
-	LuaUtil::safe_lua(lua, script, wrote_error, body->config.surface.script_path);
+	// Same key as the PlanetTileServer of the body (both use the resolved path), so states are shared with it
+	lua = lua_core->state_pool.acquire(PlanetTile::get_lua_pool_key(script, script_path),
+		[&script, &script_path, &script_package, radius](sol::state& state)
+		{
+			return PlanetTile::create_lua(state, script, script_path, script_package, radius);
+		});
 
 	PlanetTile::generate_physics_index_array(indices);
 }
@@ -38,6 +43,7 @@ GroundShapeServer::GroundShapeServer(SystemElement* body)
 
 GroundShapeServer::~GroundShapeServer()
 {
+	lua_core->state_pool.release(lua);
 }
 
 GroundShapeServer::TileAndTriangles::TileAndTriangles(PlanetTilePath npath, double time, GroundShapeServer* server) 
@@ -47,7 +53,7 @@ GroundShapeServer::TileAndTriangles::TileAndTriangles(PlanetTilePath npath, doub
 	double growth = -2.5; // A little excessive so vehicles "sink" a little and dont float
 	double planet_radius = server->body->config.radius + growth;
 
-	PlanetTile::generate_physics(npath, server->body->config.radius, server->lua, &server->work_array);
+	PlanetTile::generate_physics(npath, server->body->config.radius, *server->lua, &server->work_array);
 
 	glm::dmat4 model = glm::dmat4(1.0);
 	model = glm::scale(model, glm::dvec3(planet_radius));
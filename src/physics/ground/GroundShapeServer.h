@@ -47,7 +47,8 @@ public:
 
 	PlanetTile::SimpleVertexArray<PlanetTile::PHYSICS_SIZE> work_array;
 
-	sol::state lua;
+	// From LuaCore::state_pool
+	PooledLuaState lua;
 
 	SystemElement* body;
 
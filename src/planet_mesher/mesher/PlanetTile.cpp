@@ -1,6 +1,7 @@
 #include "PlanetTile.h"
 #include <util/Logger.h>
 #include <util/LuaUtil.h>
+#include <util/HashUtil.h>
 
 template<int S>
 constexpr std::array<uint16_t, (S + 2) * (S + 2) * 6> get_nrm_indices()
@@ -433,9 +434,9 @@ bool PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, sol
 	return errors;
 }
 
-void PlanetTile::prepare_lua(sol::state& lua_state)
+void PlanetTile::prepare_lua(sol::state& lua_state, const std::string& script_package)
 {
-	lua_core->load(lua_state, hgr->assets->get_current_package());
+	lua_core->load(lua_state, script_package);
 
 
 	// We must define the little utility struct GeneratorInfo
@@ -450,6 +451,28 @@ void PlanetTile::prepare_lua(sol::state& lua_state)
 		"color", &GeneratorOut::color);
 }
 
+std::string PlanetTile::get_lua_pool_key(const std::string& script, const std::string& script_path)
+{
+	return "planet_surface:" + script_path + ":" + std::to_string(HashUtil::fnv1a(script));
+}
+
+bool PlanetTile::create_lua(sol::state& lua_state, const std::string& script, const std::string& script_path,
+	const std::string& script_package, double planet_radius)
+{
+	bool wrote_error = false;
+	prepare_lua(lua_state, script_package);
+	LuaUtil::safe_lua(lua_state, script, wrote_error, script_path);
+	if(wrote_error)
+	{
+		return false;
+	}
+
+	// Any tile works, generate loops over all its vertices in a single call
+	auto work_array = std::make_unique<SimpleVertexArray<PHYSICS_SIZE>>();
+	PlanetTilePath path = PlanetTilePath(std::vector<QuadTreeQuadrant>(), PX);
+	return !generate_physics(path, planet_radius, lua_state, work_array.get());
+}
+
 void PlanetTile::upload()
 {
 	logger->check(!is_uploaded(), "Tried to upload an already uploaded tile");
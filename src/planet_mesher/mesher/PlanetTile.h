@@ -4,7 +4,7 @@
 #include "PlanetTilePath.h"
 #include <glad/glad.h>
 #include <glm/gtx/normal.hpp>
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 #include <functional>
 #include <lua/LuaCore.h>
 #include <assets/AssetManager.h>
@@ -100,7 +100,16 @@ struct PlanetTile
 	static bool generate_physics(PlanetTilePath path, double planet_radius, sol::state& lua_state,
 		SimpleVertexArray<PHYSICS_SIZE>* work_array);
 
-	static void prepare_lua(sol::state& lua_state);
+	static void prepare_lua(sol::state& lua_state, const std::string& script_package);
+
+	// Key of the states running a surface script in LuaCore::state_pool, includes the script
+	// contents so edited scripts don't reuse old states. Use the resolved script path, which
+	// also identifies the package of the script
+	static std::string get_lua_pool_key(const std::string& script, const std::string& script_path);
+	// Prepares the state for the package of the script, runs the script and warms up the JIT
+	// by generating a physics tile. Returns false if the script has errors
+	static bool create_lua(sol::state& lua_state, const std::string& script, const std::string& script_path,
+		const std::string& script_package, double planet_radius);
 
 	void upload();
 
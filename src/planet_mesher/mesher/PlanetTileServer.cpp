@@ -107,7 +107,7 @@ double PlanetTileServer::get_height(glm::dvec3 pos_3d, size_t depth)
 	glm::dvec2 projected = MathUtil::euclidean_to_spherical_r1(pos_3d);
 
 
-	default_lua(lua_state);
+	default_lua(*lua_state);
 
 	PlanetTile::GeneratorInfo info;
 	info.depth = (int)depth;
@@ -117,7 +117,7 @@ double PlanetTileServer::get_height(glm::dvec3 pos_3d, size_t depth)
 
 	PlanetTile::GeneratorOut out;
 
-	sol::protected_function func = lua_state["generate"];
+	sol::protected_function func = (*lua_state)["generate"];
 	auto result = func(info, &out);
 
 	// We ignore errors here
@@ -142,25 +142,31 @@ PlanetTileServer::PlanetTileServer(const std::string& script, const std::string&
 	depth_for_unload = 0;
 	dirty = false;
 
-	bool wrote_error = false;
+	// States are pooled, so bodies sharing a script, or a server created again for
+	// the same body, don't run and warm up the script again
+	std::string key = PlanetTile::get_lua_pool_key(script, script_path);
+	double radius = config->radius;
+	const std::string& script_package = config->surface.script_package;
+	auto create = [&script, &script_path, &script_package, radius](sol::state& state)
+	{
+		return PlanetTile::create_lua(state, script, script_path, script_package, radius);
+	};
 
-	PlanetTile::prepare_lua(lua_state);
-	LuaUtil::safe_lua(lua_state, script, wrote_error, script_path);
+	lua_state = lua_core->state_pool.acquire(key, create);
+	has_errors = !lua_state.ok;
 
 	threads.resize(thread_count);
 
 	for (size_t i = 0; i < threads.size(); i++)
 	{
-
-		threads[i].thread = new std::thread(thread_func, this, &threads[i]);
-		PlanetTile::prepare_lua(threads[i].lua_state);
-		
-		LuaUtil::safe_lua(threads[i].lua_state, script, wrote_error, script_path);
-
-		if (wrote_error)
+		// Must be ready before the thread starts
+		threads[i].lua_state = lua_core->state_pool.acquire(key, create);
+		if (!threads[i].lua_state.ok)
 		{
 			has_errors = true;
 		}
+
+		threads[i].thread = new std::thread(thread_func, this, &threads[i]);
 	}
 }
 
@@ -177,8 +183,12 @@ PlanetTileServer::~PlanetTileServer()
 
 		threads[i].thread->join();
 		delete threads[i].thread;
+
+		lua_core->state_pool.release(threads[i].lua_state);
 	}
 
+	lua_core->state_pool.release(lua_state);
+
 	// Tiles are now only managed by us so this is actually safe
 	for (auto it = tiles.get_unsafe()->begin(); it != tiles.get_unsafe()->end(); it++)
 	{
@@ -234,7 +244,7 @@ void PlanetTileServer::thread_func(PlanetTileServer* server, PlanetTileThread* t
 			// Work on the target
 			PlanetTile* ntile = new PlanetTile();
 			bool has_errors = ntile->generate(target, server->config->radius, 
-				thread->lua_state, server->has_water, &arrays);
+				*thread->lua_state, server->has_water, &arrays);
 
 			if (has_errors)
 			{
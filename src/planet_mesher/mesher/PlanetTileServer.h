@@ -21,7 +21,8 @@
 
 struct PlanetTileThread
 {
-	sol::state lua_state;
+	// From LuaCore::state_pool, returned once the server is destroyed
+	PooledLuaState lua_state;
 	std::thread* thread;
 };
 
@@ -48,7 +49,7 @@ private:
 
 	// We keep a little state to find height and so 
 	// everybody can query to find stuff about the script
-	sol::state lua_state;
+	PooledLuaState lua_state;
 
 public:
 
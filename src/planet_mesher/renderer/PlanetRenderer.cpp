@@ -5,6 +5,7 @@
 #include <util/DebugDrawer.h>
 #include <imgui/imgui.h>
 #include <renderer/Renderer.h>
+#include <util/MathUtil.h>
 
 void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 							const PlanetRenderer::PlanetRenderTforms &tforms, ElementConfig &config)
@@ -42,6 +43,10 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 		shader->setFloat("sunset_exponent", (float)config.atmo.sunset_exponent);
 		shader->setVec3("light_dir", tforms.light_dir);
 		shader->setMat4("normal_tform", tforms.normal_matrix);
+		// Triplanar textures use the first units
+		glActiveTexture(GL_TEXTURE4);
+		glBindTexture(GL_TEXTURE_2D, tforms.atmo_lut);
+		shader->setInt("atmo_lut", 4);
 
 		// TODO: Handle non-spherical planets with some kind of ellipsoid
 		glm::dvec3 triplanar_up = tforms.camera_pos;
@@ -182,6 +187,7 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			water_shader->setFloat("atmo_exponent", (float)config.atmo.exponent);
 			water_shader->setFloat("sunset_exponent", (float)config.atmo.sunset_exponent);
 			water_shader->setVec3("light_dir", tforms.light_dir);
+			water_shader->setInt("atmo_lut", 4);
 
 			cw_mode = false;
 			glFrontFace(GL_CCW);
@@ -245,6 +251,108 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 }
 
 
+void PlanetRenderer::render_shadow(PlanetTileServer& server, QuadTreePlanet& planet, const glm::dmat4& wmodel,
+								   const ShadowCamera& sh_cam, ElementConfig& config)
+{
+	auto render_tiles = planet.get_all_render_leaf_paths();
+	std::array<glm::dvec4, 6> planes = MathUtil::get_frustum_planes(sh_cam.tform);
+
+	bool coarse = sh_cam.lod > 0;
+	GLuint use_vao = coarse ? lod_vao : vao;
+	GLsizei index_count = (GLsizei)(coarse ? lod_index_count : indices.size());
+
+	auto tiles_w = server.tiles.get();
+
+	shadow_shader->use();
+	shadow_shader->setInt("instanced", 0);
+
+	bool cw_mode = false;
+	glFrontFace(GL_CCW);
+	glBindVertexArray(use_vao);
+
+	for (size_t i = 0; i < render_tiles.size(); i++)
+	{
+		auto it = tiles_w->find(render_tiles[i]);
+		if (it == tiles_w->end() || !it->second->is_uploaded())
+		{
+			continue;
+		}
+		auto tile = it->second;
+		auto path = it->first;
+
+		glm::dmat4 model = wmodel * path.get_model_spheric_matrix();
+
+		// Tiles span 2 units of the cube side at depth 0, generous to include terrain height
+		double tile_radius = config.radius * 2.0 * glm::pow(0.5, (double)path.get_depth());
+		glm::dvec3 tile_center = model * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+		if (!MathUtil::sphere_in_frustum(planes, tile_center, tile_radius))
+		{
+			continue;
+		}
+
+		if (tile->clockwise != cw_mode)
+		{
+			cw_mode = tile->clockwise;
+			glFrontFace(cw_mode ? GL_CW : GL_CCW);
+		}
+
+		shadow_shader->setMat4("tform", (glm::mat4)(sh_cam.tform * model));
+		glBindVertexBuffer(0, tile->vbo, 0, sizeof(PlanetTileVertex));
+		glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_SHORT, (void*)0);
+	}
+
+	glBindVertexArray(0);
+	glFrontFace(GL_CCW);
+}
+
+void PlanetRenderer::generate_and_upload_lod_index_buffer()
+{
+	// Every other vertex, plus the last one so the tile edges are kept
+	std::vector<uint16_t> positions;
+	for (int i = 0; i < PlanetTile::TILE_SIZE - 1; i += 2)
+	{
+		positions.push_back((uint16_t)i);
+	}
+	positions.push_back((uint16_t)(PlanetTile::TILE_SIZE - 1));
+
+	// Same winding as the full detail mesh
+	std::vector<uint16_t> lod_indices;
+	for (size_t y = 0; y < positions.size() - 1; y++)
+	{
+		for (size_t x = 0; x < positions.size() - 1; x++)
+		{
+			uint16_t vi = (uint16_t)(positions[y] * PlanetTile::TILE_SIZE + positions[x]);
+			uint16_t right = (uint16_t)(positions[y] * PlanetTile::TILE_SIZE + positions[x + 1]);
+			uint16_t bottom = (uint16_t)(positions[y + 1] * PlanetTile::TILE_SIZE + positions[x]);
+			uint16_t bottom_right = (uint16_t)(positions[y + 1] * PlanetTile::TILE_SIZE + positions[x + 1]);
+
+			lod_indices.push_back(right);
+			lod_indices.push_back(vi);
+			lod_indices.push_back(bottom);
+
+			lod_indices.push_back(bottom_right);
+			lod_indices.push_back(right);
+			lod_indices.push_back(bottom);
+		}
+	}
+	lod_index_count = lod_indices.size();
+
+	glGenVertexArrays(1, &lod_vao);
+	glGenBuffers(1, &lod_ebo);
+
+	glBindVertexArray(lod_vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * lod_indices.size(), lod_indices.data(), GL_STATIC_DRAW);
+
+	// position
+	glEnableVertexAttribArray(0);
+	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, pos));
+	glVertexAttribBinding(0, 0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
 void PlanetRenderer::generate_and_upload_index_buffer()
 {
 	PlanetTile::generate_index_array_with_skirts(indices, bulk_index_count);
@@ -335,8 +443,10 @@ void PlanetRenderer::generate_and_upload_index_buffer()
 PlanetRenderer::PlanetRenderer()
 {
 	generate_and_upload_index_buffer();
+	generate_and_upload_lod_index_buffer();
 	shader = hgr->assets->get<Shader>("core", "shaders/planet/tile.vs");
 	water_shader = hgr->assets->get<Shader>("core", "shaders/planet/water.vs");
+	shadow_shader = hgr->assets->get<Shader>("core", "shaders/shadow.vs");
 	// TODO: Proper texturing by tiles
 	cliff_tex = AssetHandle<Image>("core:notex.png");
 	top_tex = AssetHandle<Image>("core:notex.png");
@@ -349,7 +459,10 @@ PlanetRenderer::~PlanetRenderer()
 {
 	hgr->assets->free<Shader>("core", "shaders/planet/tile.vs");
 	hgr->assets->free<Shader>("core", "shaders/planet/water.vs");
+	hgr->assets->free<Shader>("core", "shaders/shadow.vs");
 	glDeleteBuffers(1, &ebo);
 	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &lod_ebo);
+	glDeleteVertexArrays(1, &lod_vao);
 }
 
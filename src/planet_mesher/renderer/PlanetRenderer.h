@@ -7,6 +7,7 @@
 // TODO: Integration with an asset manager
 
 #include <assets/Image.h>
+#include <renderer/lighting/ShadowCamera.h>
 class PlanetRenderer
 {
 private:
@@ -18,6 +19,7 @@ private:
 
 	Shader* shader;
 	Shader* water_shader;
+	Shader* shadow_shader;
 
 	// The index buffer is common to all tiles
 	// The VAO is also shaded
@@ -28,7 +30,12 @@ private:
 	// Water only uses a different vao, same index buffer
 	GLuint water_vao;
 
+	// Coarse shadows skip every other vertex, and only need positions
+	size_t lod_index_count;
+	GLuint lod_ebo, lod_vao;
+
 	void generate_and_upload_index_buffer();
+	void generate_and_upload_lod_index_buffer();
 
 
 	// Current detail up means which direction is up pointing
@@ -41,10 +48,17 @@ public:
 		glm::dvec3 camera_pos, light_dir;
 		double rot, time;
 		float far_plane;
+		// AtmosphereLUT of the planet, 0 if it has no atmosphere
+		GLuint atmo_lut = 0;
 	};
 	// Camera position should be given RELATIVE to the planet
 	void render(PlanetTileServer& server, QuadTreePlanet& planet, const PlanetRenderTforms& tforms, ElementConfig& config);
 
+	// Depth only, wmodel is in world coordinates (like the shadow camera). Tiles outside the
+	// shadow camera are skipped, and if its lod is not 0 a coarse mesh is used
+	void render_shadow(PlanetTileServer& server, QuadTreePlanet& planet, const glm::dmat4& wmodel,
+					   const ShadowCamera& sh_cam, ElementConfig& config);
+
 	PlanetRenderer();
 	~PlanetRenderer();
 };
@@ -36,6 +36,10 @@ public:
 	// Objects with higher priority get drawn first
 	virtual int get_forward_priority() { return 0.0; }
 
+	// Bounding sphere in world coordinates, used to skip passes when not visible.
+	// Return false (the default) if the drawable must always be drawn
+	virtual bool get_bounds(glm::dvec3& center, double& radius) { return false; }
+
 	virtual void on_add_to_renderer() {}
 
 	void notify_add_to_renderer(GLint uid)
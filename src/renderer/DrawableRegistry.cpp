@@ -0,0 +1,268 @@
+#include "DrawableRegistry.h"
+#include <algorithm>
+#include <util/HashUtil.h>
+#include <util/MathUtil.h>
+
+void DrawableRegistry::insert_member(int pass, uint32_t index)
+{
+	std::vector<uint32_t>& list = members[pass];
+	if(is_sorted_pass(pass))
+	{
+		// Higher priority drawables go FIRST, equal priorities keep insertion order
+		int priority = entries[index].priority;
+		auto it = std::upper_bound(list.begin(), list.end(), priority, [this](int p, uint32_t other)
+		{
+			return p > entries[other].priority;
+		});
+		list.insert(it, index);
+	}
+	else
+	{
+		list.push_back(index);
+	}
+}
+
+void DrawableRegistry::erase_member(int pass, uint32_t index)
+{
+	std::vector<uint32_t>& list = members[pass];
+	auto it = std::find(list.begin(), list.end(), index);
+	if(it != list.end())
+	{
+		list.erase(it);
+	}
+}
+
+void DrawableRegistry::link(uint32_t index)
+{
+	Entry& e = entries[index];
+	Drawable* d = e.drawable.get();
+
+	e.passes = 0;
+	if(d->needs_deferred_pass()) e.passes |= 1 << DEFERRED;
+	if(d->needs_forward_pass()) e.passes |= 1 << FORWARD;
+	if(d->needs_gui_pass()) e.passes |= 1 << GUI;
+	if(d->needs_shadow_pass()) e.passes |= 1 << SHADOW;
+	if(d->needs_far_shadow_pass()) e.passes |= 1 << FAR_SHADOW;
+	if(d->needs_env_map_pass()) e.passes |= 1 << ENV_MAP;
+
+	if(e.passes & ((1 << FORWARD) | (1 << ENV_MAP)))
+	{
+		e.priority = d->get_forward_priority();
+	}
+
+	for(int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		if(e.passes & (1 << pass))
+		{
+			insert_member(pass, index);
+		}
+	}
+}
+
+void DrawableRegistry::unlink(uint32_t index)
+{
+	Entry& e = entries[index];
+	for(int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		if(e.passes & (1 << pass))
+		{
+			erase_member(pass, index);
+		}
+	}
+	e.passes = 0;
+}
+
+void DrawableRegistry::free_slot(uint32_t index)
+{
+	Entry& e = entries[index];
+	e.drawable.reset();
+	e.alive = false;
+	e.transient = false;
+	e.bounded = false;
+	// Invalidates all handles to the slot
+	e.generation++;
+	free_slots.push_back(index);
+}
+
+DrawableRegistry::Entry* DrawableRegistry::get_entry(DrawableHandle handle)
+{
+	if(handle.index >= entries.size())
+	{
+		return nullptr;
+	}
+
+	Entry& e = entries[handle.index];
+	if(!e.alive || e.generation != handle.generation)
+	{
+		return nullptr;
+	}
+
+	return &e;
+}
+
+DrawableHandle DrawableRegistry::add(std::shared_ptr<Drawable> drawable, bool transient)
+{
+	uint32_t index;
+	if(free_slots.empty())
+	{
+		index = (uint32_t)entries.size();
+		entries.emplace_back();
+	}
+	else
+	{
+		index = free_slots.back();
+		free_slots.pop_back();
+	}
+
+	Entry& e = entries[index];
+	e.drawable = std::move(drawable);
+	e.alive = true;
+	e.transient = transient;
+	e.bounded = e.drawable->get_bounds(e.center, e.radius);
+	if(transient)
+	{
+		transient_count++;
+	}
+
+	link(index);
+
+	DrawableHandle handle;
+	handle.index = index;
+	handle.generation = e.generation;
+	return handle;
+}
+
+bool DrawableRegistry::remove(DrawableHandle handle)
+{
+	Entry* e = get_entry(handle);
+	if(e == nullptr)
+	{
+		return false;
+	}
+
+	if(e->transient)
+	{
+		transient_count--;
+	}
+
+	unlink(handle.index);
+	free_slot(handle.index);
+	return true;
+}
+
+void DrawableRegistry::refresh(DrawableHandle handle)
+{
+	Entry* e = get_entry(handle);
+	if(e == nullptr)
+	{
+		return;
+	}
+
+	unlink(handle.index);
+	link(handle.index);
+}
+
+void DrawableRegistry::begin_frame()
+{
+	for(Entry& e : entries)
+	{
+		if(e.alive)
+		{
+			e.bounded = e.drawable->get_bounds(e.center, e.radius);
+		}
+	}
+}
+
+void DrawableRegistry::end_frame()
+{
+	if(transient_count == 0)
+	{
+		return;
+	}
+
+	// Removed in bulk, which is much cheaper than one by one
+	for(int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		std::vector<uint32_t>& list = members[pass];
+		list.erase(std::remove_if(list.begin(), list.end(), [this](uint32_t index)
+		{
+			return entries[index].transient;
+		}), list.end());
+	}
+
+	for(uint32_t i = 0; i < entries.size(); i++)
+	{
+		if(entries[i].alive && entries[i].transient)
+		{
+			entries[i].passes = 0;
+			free_slot(i);
+		}
+	}
+
+	transient_count = 0;
+}
+
+const std::vector<Drawable*>& DrawableRegistry::get_visible(Pass pass, const glm::dmat4& tform)
+{
+	// The far plane is not tested as the logarithmic depth buffer makes it irrelevant
+	std::array<glm::dvec4, 6> planes = MathUtil::get_frustum_planes(tform);
+
+	std::vector<Drawable*>& out = visible[pass];
+	std::vector<uint32_t>& out_index = visible_index[pass];
+	out.clear();
+	out_index.clear();
+	for(uint32_t index : members[pass])
+	{
+		const Entry& e = entries[index];
+		if(!e.bounded || MathUtil::sphere_in_frustum(planes, e.center, e.radius, 5))
+		{
+			out.push_back(e.drawable.get());
+			out_index.push_back(index);
+		}
+	}
+
+	return out;
+}
+
+uint64_t DrawableRegistry::get_visible_hash(Pass pass, uint64_t hash) const
+{
+	for(uint32_t index : visible_index[pass])
+	{
+		const Entry& e = entries[index];
+		// Transient drawables get a new slot every frame, but are the same object
+		const Drawable* d = e.drawable.get();
+		hash = HashUtil::fnv1a(&d, sizeof(d), hash);
+		if(e.bounded && e.radius > 0.0)
+		{
+			double quantum = e.radius * 0.05;
+			int64_t q[4] = {
+				(int64_t)glm::floor(e.center.x / quantum),
+				(int64_t)glm::floor(e.center.y / quantum),
+				(int64_t)glm::floor(e.center.z / quantum),
+				(int64_t)glm::floor(glm::log2(e.radius) * 16.0)};
+			hash = HashUtil::fnv1a(q, sizeof(q), hash);
+		}
+	}
+
+	return hash;
+}
+
+const std::vector<Drawable*>& DrawableRegistry::get_all(Pass pass)
+{
+	std::vector<Drawable*>& out = visible[pass];
+	std::vector<uint32_t>& out_index = visible_index[pass];
+	out.clear();
+	out_index.clear();
+	for(uint32_t index : members[pass])
+	{
+		out.push_back(entries[index].drawable.get());
+		out_index.push_back(index);
+	}
+
+	return out;
+}
+
+DrawableRegistry::DrawableRegistry()
+{
+	transient_count = 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "Drawable.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Handle to a drawable registered in the renderer. Handles of removed drawables
+// are detected (generation mismatch) and ignored, so they may be kept around safely
+struct DrawableHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool is_valid() const { return index != UINT32_MAX; }
+};
+
+// Retained storage for the drawables of the Renderer. Each drawable is given a slot,
+// and the passes it needs (and its forward priority) are queried only when it's added
+// or refreshed, so passes iterate precomputed member lists instead of rebuilding and
+// sorting them every frame.
+// Drawables which implement get_bounds are frustum culled per pass, the rest are
+// always drawn.
+// Transient drawables (added through Renderer::add_drawable) are removed on end_frame,
+// which keeps the old "add every frame" usage working.
+class DrawableRegistry
+{
+public:
+
+	enum Pass
+	{
+		DEFERRED,
+		FORWARD,
+		GUI,
+		SHADOW,
+		FAR_SHADOW,
+		ENV_MAP,
+		PASS_COUNT
+	};
+
+private:
+
+	struct Entry
+	{
+		std::shared_ptr<Drawable> drawable;
+		uint32_t generation = 0;
+		// Bitmask of (1 << Pass)
+		uint32_t passes = 0;
+		int priority = 0;
+		bool alive = false;
+		bool transient = false;
+
+		// Updated once per frame in begin_frame
+		bool bounded = false;
+		glm::dvec3 center;
+		double radius = 0.0;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<uint32_t> free_slots;
+	size_t transient_count;
+
+	// Indices into entries. FORWARD and ENV_MAP are kept sorted by priority
+	std::vector<uint32_t> members[PASS_COUNT];
+	// Reused every time a pass is culled
+	std::vector<Drawable*> visible[PASS_COUNT];
+	std::vector<uint32_t> visible_index[PASS_COUNT];
+
+	static bool is_sorted_pass(int pass) { return pass == FORWARD || pass == ENV_MAP; }
+
+	void insert_member(int pass, uint32_t index);
+	void erase_member(int pass, uint32_t index);
+	// Queries the passes and priority of the drawable and inserts it in the member lists
+	void link(uint32_t index);
+	void unlink(uint32_t index);
+	void free_slot(uint32_t index);
+
+	Entry* get_entry(DrawableHandle handle);
+
+public:
+
+	DrawableHandle add(std::shared_ptr<Drawable> drawable, bool transient);
+	// Returns false if the handle was not valid (for example, already removed)
+	bool remove(DrawableHandle handle);
+	// Call if the passes the drawable needs or its forward priority changed
+	void refresh(DrawableHandle handle);
+
+	// Updates the bounding volumes, call before any pass is drawn
+	void begin_frame();
+	// Removes transient drawables
+	void end_frame();
+
+	// Members of the pass whose bounds intersect the frustum of tform (world to clip space),
+	// in draw order. The returned vector is overwritten by the next call for the same pass
+	const std::vector<Drawable*>& get_visible(Pass pass, const glm::dmat4& tform);
+	// All members of the pass, in draw order, without culling
+	const std::vector<Drawable*>& get_all(Pass pass);
+
+	// Identifies the result of the last get_visible call for the pass, including the bounds
+	// of the drawables (quantized to a small fraction of their size). Used to detect if
+	// cached results (for example, shadow maps) may be reused
+	uint64_t get_visible_hash(Pass pass, uint64_t hash) const;
+
+	DrawableRegistry();
+};
@@ -13,6 +13,25 @@ LuaDrawable::LuaDrawable(sol::table from_table)
 	this->needs_shadow = table["shadow_pass"].valid() && table["shadow_pass"].get_type() == sol::type::function;
 	this->needs_far_shadow = table["far_shadow_pass"].valid() && table["far_shadow_pass"].get_type() == sol::type::function;
 	this->needs_env_map = table["drawable_env_map_enable"].valid() && table["drawable_env_map_enable"].get_or(false);
+	this->has_bounds = table["get_bounds"].valid() && table["get_bounds"].get_type() == sol::type::function;
+}
+
+bool LuaDrawable::get_bounds(glm::dvec3& center, double& radius)
+{
+	if(!has_bounds)
+	{
+		return false;
+	}
+
+	auto res = LuaUtil::call_function(table["get_bounds"], table);
+	if(!res.valid() || res.return_count() < 2)
+	{
+		return false;
+	}
+
+	center = res.get<glm::dvec3>(0);
+	radius = res.get<double>(1);
+	return true;
 }
 
 int LuaDrawable::get_forward_priority()
@@ -1,6 +1,6 @@
 #pragma once
 #include "Drawable.h"
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 
 // Allows any table as a drawable, it will check if pass functions are present
 // and call them when neccesary. Can be used with great freedom, as it may implement
@@ -11,6 +11,8 @@
 // Furthermore, it will set the following inside the passed table:
 // - drawable_uid: number, set during creation
 // Finally, if you want to be included in env_map passes, include a "drawable_env_map_enable = true" member in the table!
+// If the table has a get_bounds(self) function returning center (dvec3) and radius, passes are
+// skipped while it's outside the view.
 class LuaDrawable : public Drawable
 {
 private:
@@ -21,6 +23,7 @@ private:
 	bool needs_shadow;
 	bool needs_far_shadow;
 	bool needs_env_map;
+	bool has_bounds;
 
 public:
 
@@ -41,6 +44,8 @@ public:
 	// Objects with higher priority get drawn first
 	int get_forward_priority() override;
 
+	bool get_bounds(glm::dvec3& center, double& radius) override;
+
 	explicit LuaDrawable(sol::table from_table);
 
 };
@@ -1,6 +1,7 @@
 #include "PlanetaryBodyRenderer.h"
 #include "../util/DebugDrawer.h"
 #include "../universe/element/SystemElement.h"
+#include "Renderer.h"
 
 
 void PlanetaryBodyRenderer::deferred(const PlanetRenderer::PlanetRenderTforms& tforms, ElementConfig& config, float dot_factor) const
@@ -14,6 +15,14 @@ void PlanetaryBodyRenderer::deferred(const PlanetRenderer::PlanetRenderTforms& t
 	}
 }
 
+void PlanetaryBodyRenderer::shadow(const glm::dmat4& model, const ShadowCamera& sh_cam, ElementConfig& config) const
+{
+	if (rocky != nullptr)
+	{
+		rocky->renderer.render_shadow(*rocky->server, rocky->qtree, model, sh_cam, config);
+	}
+}
+
 void PlanetaryBodyRenderer::forward(glm::dmat4 proj_view, glm::dvec3 camera_pos,
 									ElementConfig& config, double far_plane, glm::vec3 light_dir) const
 {
@@ -24,7 +33,9 @@ void PlanetaryBodyRenderer::forward(glm::dmat4 proj_view, glm::dvec3 camera_pos,
 		glm::vec3 cam_pos_relative = (glm::vec3)(camera_pos / config.atmo.radius);
 
 
+		hgr->renderer->gpu_profiler.begin("atmosphere");
 		atmo->do_pass(proj_view, amodel, (float)far_plane, cam_pos_relative, config, light_dir);
+		hgr->renderer->gpu_profiler.end();
 	}
 }
 
@@ -21,6 +21,9 @@ public:
 
 	void deferred(const PlanetRenderer::PlanetRenderTforms& tforms, ElementConfig& config, float dot_factor) const;
 
+	// Landscape shadows, model is in world coordinates
+	void shadow(const glm::dmat4& model, const ShadowCamera& sh_cam, ElementConfig& config) const;
+
 	void forward(glm::dmat4 proj_view, glm::dvec3 camera_pos,
 				 ElementConfig& config, double far_plane, glm::vec3 light_dir) const;
 
@@ -5,7 +5,11 @@
 #include <nanovg/nanovg_gl.h>
 //?
 #include "../universe/PlanetarySystem.h"
+#include "lighting/SunLight.h"
+#include "lighting/PointLight.h"
+#include "util/TextDrawer.h"
 #include <util/defines.h>
+#include <util/HashUtil.h>
 
 // Enable to have detailed GL debugging. Causes very heavy perfomance hit
 // #define ENABLE_GL_DEBUG
@@ -85,37 +89,50 @@ void Renderer::prepare_deferred()
 
 }
 
-void Renderer::do_shadows(PlanetarySystem* system, glm::dvec3 camera_pos)
+void Renderer::do_shadows(const CameraUniforms& cu)
 {
 	// We disable depth clamping so that objects behind the lights are culled
 	glDisable(GL_DEPTH_CLAMP);
 	//glCullFace(GL_FRONT);
 	for(auto light : lights)
 	{
-		if(light->casts_shadows())
+		if(!light->casts_shadows())
 		{
-			ShadowCamera shadow_cam = light->get_shadow_camera(camera_pos);
+			continue;
+		}
+
+		light->prepare_shadows(cu);
+		for(size_t i = 0; i < light->get_shadow_camera_count(); i++)
+		{
+			ShadowCamera shadow_cam = light->get_shadow_camera(i);
+
+			// Landscape (far shadow) casters are drawn in all shadow cameras, with the
+			// detail the camera requests
+			const std::vector<Drawable*>& casters = drawables.get_visible(DrawableRegistry::SHADOW, shadow_cam.tform);
+			const std::vector<Drawable*>& landscape = drawables.get_visible(DrawableRegistry::FAR_SHADOW, shadow_cam.tform);
+			uint64_t caster_hash = drawables.get_visible_hash(DrawableRegistry::SHADOW, HashUtil::FNV_OFFSET);
+			caster_hash = drawables.get_visible_hash(DrawableRegistry::FAR_SHADOW, caster_hash);
+
+			// The light may keep a cached shadow map
+			if(!light->needs_shadow_update(i, caster_hash))
+			{
+				continue;
+			}
 
 			glBindFramebuffer(GL_FRAMEBUFFER, shadow_cam.fbuffer);
 			glViewport(0, 0, shadow_cam.size, shadow_cam.size);
 			glClear(GL_DEPTH_BUFFER_BIT);
 
-
-			for(Drawable* d : shadow)
+			for(Drawable* d : casters)
 			{
 				d->shadow_pass(shadow_cam);
 			}
 
-			if(light->get_type() == Light::SUN)
+			for(Drawable* d : landscape)
 			{
-				if(system != nullptr)
-				{
-					// Far shadow (TODO)
-				}	
+				d->far_shadow_pass(shadow_cam);
 			}
-
 		}
-	
 	}
 	glEnable(GL_DEPTH_CLAMP);
 	//glCullFace(GL_BACK);
@@ -150,9 +167,16 @@ void Renderer::forward_bind(CameraUniforms& cu, GBuffer* g_buffer, GLuint f_buff
 	}
 	else
 	{
-		// Do a pass for every light
+		// Do a pass for every light, except point lights which are clustered
+		clustered_lighting.clear();
 		for (auto l: lights)
 		{
+			if (quality.clustered_lighting && l->get_type() == Light::POINT)
+			{
+				clustered_lighting.add((PointLight*)l);
+				continue;
+			}
+
 			if (l->needs_fullscreen_viewport())
 			{
 				if (is_env_pass)
@@ -168,6 +192,10 @@ void Renderer::forward_bind(CameraUniforms& cu, GBuffer* g_buffer, GLuint f_buff
 			l->do_pass(cu, g_buffer);
 
 		}
+
+		// Uses the same viewport as the camera projection
+		clustered_lighting.viewport = vport;
+		clustered_lighting.do_pass(cu, g_buffer);
 	}
 
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -276,9 +304,13 @@ void Renderer::render_env_face(glm::dvec3 sample_pos, size_t face)
 	c_uniforms.iscreen_size = glm::ivec2(c_uniforms.screen_size);
 
 
+	update_frame_uniforms(c_uniforms);
+
 	glm::dvec4 vport = glm::dvec4(0, 0, ibl_source->resolution, ibl_source->resolution);
 	deferred_bind(env_gbuffer->g_buffer, vport);
 
+	// Already sorted for the forward pass
+	const std::vector<Drawable*>& env_map = drawables.get_visible(DrawableRegistry::ENV_MAP, c_uniforms.tform);
 	for (Drawable* d : env_map)
 	{
 		d->deferred_pass(c_uniforms, true);
@@ -290,29 +322,48 @@ void Renderer::render_env_face(glm::dvec3 sample_pos, size_t face)
 
 	forward_bind(c_uniforms, env_gbuffer, env_fbuffer->fbuffer, vport, true);
 
-	// Sort forward drawables
-	std::sort(env_map.begin(), env_map.end(), [](Drawable* a, Drawable* b)
-	{
-		// This puts the higher priority drawables FIRST in the array
-		return a->get_forward_priority() > b->get_forward_priority();
-	});
-
 	for (Drawable* d : env_map)
 	{
 		d->forward_pass(c_uniforms, true);
 	}
 
-	// TODO: Find a way to generate the mipmap only for one face
-	// Although the perfomance hit is pretty much negligible on
-	// my laptop's GPUs (GTX 1650 and Intel HD 620)
-	glBindTexture(GL_TEXTURE_CUBE_MAP, ibl_source->id);
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	// Mipmaps of the face and IBL are generated incrementally by env_map_sample
+}
 
-	ibl_source->generate_ibl_irradiance(64, 128, face);
+glm::dvec3 Renderer::get_sun_position()
+{
+	for(Light* l : lights)
+	{
+		if(l->get_type() == Light::SUN)
+		{
+			return ((SunLight*)l)->position;
+		}
+	}
 
+	return star_pos;
 }
 
 
+void Renderer::update_frame_uniforms(const CameraUniforms& cu)
+{
+	glm::dvec3 sun_pos = get_sun_position();
+
+	UniformBlocks::FrameBlock frame;
+	frame.proj = cu.proj;
+	frame.view = cu.view;
+	frame.proj_view = cu.proj_view;
+	frame.camera_relative = cu.cam_pos;
+	frame.far_plane = cu.far_plane;
+	frame.sun_pos = sun_pos - cu.cam_pos;
+	frame.f_coef = 2.0f / glm::log2(cu.far_plane + 1.0f);
+	frame.screen_size = cu.screen_size;
+	frame.pbr_quality = (int)quality.pbr.quality;
+	frame.atmo_iterations = quality.atmosphere.iterations;
+
+	frame_uniforms->set(&frame, sizeof(frame));
+	frame_uniforms->bind(UniformBlocks::FRAME);
+}
+
 void Renderer::render(PlanetarySystem* system)
 {
 	if(!cam)
@@ -344,7 +395,11 @@ void Renderer::render(PlanetarySystem* system)
 		viewport = glm::ivec4(0, 0, swidth, sheight);
 	}
 
+	gpu_profiler.begin_frame();
+	gpu_profiler.begin("frame");
+
 	CameraUniforms c_uniforms = cam->get_camera_uniforms(rswidth, rsheight);
+	drawables.begin_frame();
 	if(ibl_source && ibl_source->irradiance && ibl_source->specular)
 	{
 		c_uniforms.irradiance = ibl_source->irradiance->id;
@@ -360,61 +415,72 @@ void Renderer::render(PlanetarySystem* system)
 
 	if(quality.pbr.quality != RendererQuality::PBR::Quality::SIMPLE && env_enabled && render_enabled)
 	{
+		gpu_profiler.begin("env_map");
 		env_frames++;
 
 		if(env_first)
 		{
+			start_env_sample();
 			env_map_sample();
 			env_first = false;
 		}
-
-		if (env_frames > quality.pbr.frames_per_sample)
+		else
 		{
-			if(quality.pbr.simple_sampling)
+			if(!env_sampling && env_frames > quality.pbr.frames_per_sample && env_needs_sample(system))
 			{
-				env_map_sample();
+				start_env_sample();
 			}
-			else
+
+			if(env_sampling)
 			{
-				logger->fatal("Non-simple envmap sampling is not yet implemented!");
+				env_map_sample();
 			}
-
-			env_frames = 0;
 		}
+		gpu_profiler.end();
 	}
 
+	// After env map sampling, which uses its own cameras
+	update_frame_uniforms(c_uniforms);
+
 	prepare_deferred();
 
 	if (render_enabled)
 	{
-		for (Drawable* d : deferred)
+		gpu_profiler.begin("deferred");
+		for (Drawable* d : drawables.get_visible(DrawableRegistry::DEFERRED, c_uniforms.tform))
 		{
 			d->deferred_pass(c_uniforms);
 		}
+		gpu_profiler.end();
 
-		do_shadows(system, c_uniforms.cam_pos);
-		prepare_forward(c_uniforms);
+		gpu_profiler.begin("shadows");
+		do_shadows(c_uniforms);
+		gpu_profiler.end();
 
-		// Sort forward drawables
-		std::sort(forward.begin(), forward.end(), [](Drawable* a, Drawable* b)
-		{
-			// This puts the higher priority drawables FIRST in the array
-			return a->get_forward_priority() > b->get_forward_priority();
-		});
+		// Lighting is done while binding the forward pass
+		gpu_profiler.begin("lighting");
+		prepare_forward(c_uniforms);
+		gpu_profiler.end();
 
-		for (Drawable* d : forward)
+		// Already sorted by priority
+		gpu_profiler.begin("forward");
+		for (Drawable* d : drawables.get_visible(DrawableRegistry::FORWARD, c_uniforms.tform))
 		{
 			d->forward_pass(c_uniforms);
 		}
+		gpu_profiler.end();
 
 		if (debug_drawer->debug_enabled)
 		{
+			gpu_profiler.begin("debug");
 			do_debug(c_uniforms);
+			gpu_profiler.end();
 		}
 
+		gpu_profiler.begin("gui");
 		prepare_gui();
 
-		for (Drawable* d : gui)
+		for (Drawable* d : drawables.get_all(DrawableRegistry::GUI))
 		{
 			d->gui_pass(c_uniforms);
 		}
@@ -430,19 +496,19 @@ void Renderer::render(PlanetarySystem* system)
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glEnable(GL_CULL_FACE);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		gpu_profiler.end();
 
 		// Draw text_drawer added text
+		text_drawer->flush();
 	}
 
-	// Delete all added drawables for next frame
-	deferred.clear();
-	forward.clear();
-	gui.clear();
-	shadow.clear();
-	far_shadow.clear();
-	env_map.clear();
+	// Delete all added drawables for next frame, registered ones stay
+	drawables.end_frame();
 	lights.clear();
 
+	gpu_profiler.end();
+	gpu_profiler.end_frame();
+
 }
 
 
@@ -459,36 +525,33 @@ void Renderer::add_drawable(std::shared_ptr<Drawable> d, std::string n_id)
 		d->set_drawable_id(n_id);
 	}
 
-	if (d->needs_deferred_pass())
-	{
-		deferred.push_back(d.get());
-	}
-
-	if (d->needs_forward_pass())
-	{
-		forward.push_back(d.get());
-	}
+	drawables.add(std::move(d), true);
+}
 
-	if (d->needs_gui_pass())
+DrawableHandle Renderer::register_drawable(std::shared_ptr<Drawable> d, std::string n_id)
+{
+	if(d->drawable_uid < 0)
 	{
-		gui.push_back(d.get());
+		drawable_uid++;
+		d->notify_add_to_renderer(drawable_uid);
 	}
 
-	if(d->needs_shadow_pass())
+	if (n_id != "")
 	{
-		shadow.push_back(d.get());
+		d->set_drawable_id(n_id);
 	}
 
-	if(d->needs_far_shadow_pass())
-	{
-		far_shadow.push_back(d.get());
-	}
+	return drawables.add(std::move(d), false);
+}
 
-	if(d->needs_env_map_pass())
-	{
-		env_map.push_back(d.get());
-	}
+bool Renderer::remove_drawable(DrawableHandle handle)
+{
+	return drawables.remove(handle);
+}
 
+void Renderer::refresh_drawable(DrawableHandle handle)
+{
+	drawables.refresh(handle);
 }
 
 
@@ -576,11 +639,14 @@ Renderer::Renderer(cpptoml::table& settings)
 {
 	drawable_uid = 0;
 	cam = nullptr;
+	offscreen_vg = nullptr;
 	env_enabled = false;
 	env_frames = 0;
 	env_face = 0;
 	env_first = true;
+	env_sampling = false;
 	env_last_pos = glm::dvec3(0.0, 0.0, 0.0);
+	env_last_sun_dir = glm::dvec3(0.0, 0.0, 0.0);
 	env_last_time = 0.0;
 
 
@@ -678,13 +744,7 @@ Renderer::Renderer(cpptoml::table& settings)
 	nvgCreateExt(vg);
 	//vg = nvgCreateGL3(0);
 
-	// Load the default NVG fonts (TODO: Use generic names for this or move it over to package.lua)
-	nvgCreateFont(vg, "regular", (hgr->assets->res_path + "core/fonts/Roboto-Regular.ttf").c_str());
-	nvgCreateFont(vg, "bold", (hgr->assets->res_path + "core/fonts/Roboto-Bold.ttf").c_str());
-	nvgCreateFont(vg, "light", (hgr->assets->res_path + "core/fonts/Roboto-Light.ttf").c_str());
-	nvgCreateFont(vg, "medium", (hgr->assets->res_path + "core/fonts/Roboto-Medium.ttf").c_str());
-	// This font is meant to be used at exactly size 12
-	nvgCreateFont(vg, "tiny", (hgr->assets->res_path + "core/fonts/ProggyTinySZ.ttf").c_str());
+	load_vg_fonts(vg);
 
 	resize(width, height, scale);
 
@@ -694,10 +754,42 @@ Renderer::Renderer(cpptoml::table& settings)
 	hdr = AssetHandle<Shader>("core:shaders/hdr.vs");
 	brdf = AssetHandle<Image>("core:shaders/ibl/brdf.png");
 
+	frame_uniforms = new UniformBuffer(sizeof(UniformBlocks::FrameBlock));
+	stream_uniforms = new UniformBuffer(1024 * 1024, true);
+
+}
+
+void Renderer::load_vg_fonts(NVGcontext* ctx)
+{
+	// Load the default NVG fonts (TODO: Use generic names for this or move it over to package.lua)
+	nvgCreateFont(ctx, "regular", (hgr->assets->res_path + "core/fonts/Roboto-Regular.ttf").c_str());
+	nvgCreateFont(ctx, "bold", (hgr->assets->res_path + "core/fonts/Roboto-Bold.ttf").c_str());
+	nvgCreateFont(ctx, "light", (hgr->assets->res_path + "core/fonts/Roboto-Light.ttf").c_str());
+	nvgCreateFont(ctx, "medium", (hgr->assets->res_path + "core/fonts/Roboto-Medium.ttf").c_str());
+	// This font is meant to be used at exactly size 12
+	nvgCreateFont(ctx, "tiny", (hgr->assets->res_path + "core/fonts/ProggyTinySZ.ttf").c_str());
+}
+
+NVGcontext* Renderer::get_offscreen_vg()
+{
+	if(offscreen_vg == nullptr)
+	{
+		offscreen_vg = nvgCreateGL3(NVG_ANTIALIAS);
+		nvgCreateExt(offscreen_vg);
+		nvglShareImagesGL3(offscreen_vg, vg);
+		load_vg_fonts(offscreen_vg);
+	}
+
+	return offscreen_vg;
 }
 
 Renderer::~Renderer()
 {
+	if(offscreen_vg != nullptr)
+	{
+		nvgDeleteGL3(offscreen_vg);
+	}
+
 	// Remove images and other assets before deletion as otherwise OpenGL will crash
 	brdf = AssetHandle<Image>();
 	if (gbuffer != nullptr)
@@ -705,6 +797,9 @@ Renderer::~Renderer()
 		delete gbuffer;
 	}
 
+	delete frame_uniforms;
+	delete stream_uniforms;
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
@@ -714,12 +809,21 @@ void Renderer::set_ibl_source(AssetHandle<Cubemap>&& cubemap)
 	if(env_enabled)
 		delete this->ibl_source;
 	env_enabled = false;
+	env_sampling = false;
 	delete env_fbuffer;
 	delete env_gbuffer;
+	env_fbuffer = nullptr;
+	env_gbuffer = nullptr;
 
 	// This works regardless of cubemap being a null asset
 	this->ibl_source = cubemap.get_noconst();
 	this->ibl_source_asset = std::move(cubemap);
+
+	// Static cubemaps are only filtered once
+	if(ibl_source)
+	{
+		ibl_source->generate_ibl_irradiance(64, 128);
+	}
 }
 
 void Renderer::enable_env_sampling()
@@ -730,27 +834,84 @@ void Renderer::enable_env_sampling()
 	env_fbuffer = new Framebuffer(cubemap->resolution, cubemap->resolution, env_gbuffer->rbo);
 	ibl_source = cubemap;
 	env_enabled = true;
+	env_first = true;
 }
 
+bool Renderer::env_needs_sample(PlanetarySystem* system)
+{
+	if(quality.pbr.simple_sampling)
+	{
+		return true;
+	}
 
-void Renderer::env_map_sample()
+	// The nearby planet fills most of the env map, so it's sampled more often the bigger it looks
+	double angular_size = 0.0;
+	if(system)
+	{
+		for(size_t i = 0; i < system->elements.size(); i++)
+		{
+			const SystemElement* body = system->elements[i];
+			if(body->star)
+			{
+				continue;
+			}
+
+			double dist = glm::distance(system->states_now[i].pos, env_sample_pos);
+			double sin_half = glm::min(body->config.radius / glm::max(dist, 1e-6), 1.0);
+			angular_size = glm::max(angular_size, 2.0 * glm::asin(sin_half));
+		}
+	}
+	double p = glm::max(1.0 - quality.pbr.planet_distance_parameter * angular_size, 0.0);
+
+	if(glm::distance(env_sample_pos, env_last_pos) >= quality.pbr.distance_per_sample * p)
+	{
+		return true;
+	}
+
+	glm::dvec3 sun_dir = glm::normalize(get_sun_position() - env_sample_pos);
+	double cos_angle = glm::clamp(glm::dot(sun_dir, env_last_sun_dir), -1.0, 1.0);
+	if(glm::degrees(glm::acos(cos_angle)) >= quality.pbr.sun_angle_per_sample * p)
+	{
+		return true;
+	}
+
+	return quality.pbr.time_per_sample > 0.0 && glfwGetTime() - env_last_time >= quality.pbr.time_per_sample * p;
+}
+
+void Renderer::start_env_sample()
 {
-	glm::dvec3 sample_pos = env_sample_pos;
+	// All faces of a sample are rendered from the same position, even if it takes many frames
+	env_last_pos = env_sample_pos;
+	env_last_sun_dir = glm::normalize(get_sun_position() - env_sample_pos);
+	env_last_time = glfwGetTime();
+	env_face = 0;
+	env_frames = 0;
+	env_sampling = true;
+}
 
-	size_t samples = quality.pbr.faces_per_sample;
+void Renderer::env_map_sample()
+{
+	size_t budget = (size_t)glm::max(quality.pbr.ibl_samples_per_frame, 1);
+	size_t faces = (size_t)glm::max(quality.pbr.faces_per_sample, 1);
 	if(env_first)
 	{
-		samples = 6;
+		budget = SIZE_MAX;
+		faces = 6;
 	}
 
-	for(size_t i = 0; i < samples; i++)
+	// A face is rendered once the previous one is fully filtered, as they share the cubemap
+	size_t rendered = 0;
+	while(ibl_source->step_ibl(budget) && env_face < 6 && rendered < faces && budget > 0)
 	{
-		hgr->renderer->render_env_face(sample_pos, env_face);
+		render_env_face(env_last_pos, env_face);
+		ibl_source->start_ibl_face(env_face, 64, 128);
 		env_face++;
-		if (env_face == 6)
-		{
-			env_face = 0;
-		}
+		rendered++;
+	}
+
+	if(env_face == 6 && ibl_source->is_ibl_done())
+	{
+		env_sampling = false;
 	}
 }
 
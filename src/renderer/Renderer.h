@@ -9,9 +9,12 @@
 #include "util/TextureDrawer.h"
 #include "util/DebugDrawer.h"
 #include "util/GBuffer.h"
+#include "util/UniformBuffer.h"
+#include "util/GPUProfiler.h"
 
 #include "camera/Camera.h"
 #include "Drawable.h"
+#include "DrawableRegistry.h"
 #include "LuaDrawable.h"
 #include "lighting/ShadowCamera.h"
 #include "lighting/Light.h"
@@ -19,6 +22,7 @@
 
 #include <assets/Cubemap.h>
 #include "lighting/DebugGBuffer.h"
+#include "lighting/ClusteredLighting.h"
 
 #include "RendererQuality.h"
 
@@ -75,7 +79,7 @@ private:
 	void prepare_deferred();
 	void deferred_bind(GLuint g_buffer, glm::ivec4 viewport);
 
-	void do_shadows(PlanetarySystem* system, glm::dvec3 cam_pos);
+	void do_shadows(const CameraUniforms& cu);
 
 	// Setups OpenGL to draw to the normal fullscreen fbuffer
 	// and draws the gbuffer to the screen (also updating depth buffer
@@ -89,23 +93,38 @@ private:
 
 	void do_debug(CameraUniforms& cu);
 
-	// We only store drawables for one frame
-	std::vector<Drawable*> deferred;
-	std::vector<Drawable*> forward;
-	std::vector<Drawable*> gui;
-	std::vector<Drawable*> shadow;
-	std::vector<Drawable*> far_shadow;
-	std::vector<Drawable*> env_map;
+	// Uploads and binds UniformBlocks::FrameBlock for the given camera
+	void update_frame_uniforms(const CameraUniforms& cu);
+	// A SunLight (which usually tracks the system star) takes precedence over star_pos
+	glm::dvec3 get_sun_position();
+
+	UniformBuffer* frame_uniforms;
+
+	// Drawables added with add_drawable only last one frame, registered ones
+	// stay until removed
+	DrawableRegistry drawables;
 
 	std::vector<Light*> lights;
 
-	// Used for env_map sampling
+	// Used for env_map sampling. A sample renders the 6 faces from env_last_pos,
+	// each face being filtered (IBL) over as many frames as needed before the next
 	glm::dvec3 env_last_pos;
+	glm::dvec3 env_last_sun_dir;
 	double env_last_time;
 	size_t env_frames;
 	size_t env_face;
 	bool env_first;
 	bool env_enabled;
+	bool env_sampling;
+
+	// Returns true if the sample position or sun moved enough to take a new sample
+	// Thresholds get smaller as the nearest planet grows in the sky, system may be nullptr
+	bool env_needs_sample(PlanetarySystem* system);
+	void start_env_sample();
+
+	// Created on first use, see get_offscreen_vg
+	NVGcontext* offscreen_vg;
+	void load_vg_fonts(NVGcontext* ctx);
 
 public:
 
@@ -116,6 +135,12 @@ public:
 	// This is a light but used only internally for debug
 	DebugGBuffer debug_gbuffer;
 
+	// Also used internally, shades all PointLights at once
+	ClusteredLighting clustered_lighting;
+
+	// Times the passes of render, drawables may add their own scopes
+	GPUProfiler gpu_profiler;
+
 	glm::dvec3 env_sample_pos;
 
 	// Only if using a cubemap as ibl source, to prevent unloading
@@ -130,6 +155,9 @@ public:
 
 	RendererQuality quality;
 
+	// Ring used for per-draw uniform blocks (UniformBlocks::DrawBlock and overriden materials)
+	UniformBuffer* stream_uniforms;
+
 	// If it's not (0,0,1,1), it will apply a glViewport
 	// to forward and deferred (GUI is always full) adjusted
 	// for these coeficitents
@@ -145,16 +173,20 @@ public:
 	GLFWwindow* window;
 
 	NVGcontext* vg;
+	// A second context to draw GUI into render targets while vg is recording the frame
+	// (nanoVG frames can't be nested). It has the same fonts and can draw the images of vg
+	NVGcontext* get_offscreen_vg();
 
 	void resize(int nwidth, int nheight, float scale);
 
-	// We need the PlanetarySystem for advanced shadowing, pass
-	// nullptr if you are not currently on a scene which requires 
-	// complex shadows (landscape shadows)
+	// Landscape shadows are drawn by the far_shadow_pass of drawables (the
+	// PlanetarySystem implements it), system may be nullptr
 	void render(PlanetarySystem* system);
 
 	void render_env_face(glm::dvec3 sample_pos, size_t face);
 
+	// Continues the current sample, rendering at most pbr.faces_per_sample faces and
+	// doing at most pbr.ibl_samples_per_frame of filtering work (everything on the first sample)
 	void env_map_sample();
 
 	// Must always be called (except on headless), even if nothing
@@ -164,8 +196,17 @@ public:
 	void finish();
 
 
+	// The drawable is only drawn this frame, call again every frame
 	void add_drawable(std::shared_ptr<Drawable> d, std::string n_id);
 
+	// The drawable is drawn every frame until removed. Much cheaper than add_drawable
+	// for drawables that persist, but refresh_drawable must be called if the passes
+	// it needs or its forward priority change
+	DrawableHandle register_drawable(std::shared_ptr<Drawable> d, std::string n_id = "");
+	// Returns false if it was already removed
+	bool remove_drawable(DrawableHandle handle);
+	void refresh_drawable(DrawableHandle handle);
+
 	// Lights are different
 	void add_light(std::shared_ptr<Light> light);
 
@@ -173,6 +214,9 @@ public:
 	template<typename T>
 	void add_drawable_lua(std::shared_ptr<T> d){ add_drawable(d, ""); }
 
+	template<typename T>
+	DrawableHandle register_drawable_lua(std::shared_ptr<T> d){ return register_drawable(d, ""); }
+
 	template<typename T>
 	void add_light_lua(std::shared_ptr<T> d){ add_light(d); }
 
@@ -8,6 +8,10 @@ struct RendererQuality
 	int sun_terrain_shadow_size;
 	int secondary_shadow_size;
 	int env_map_size;
+	// KiB of texture data the TextureStreamer may upload every frame
+	int texture_stream_budget;
+	// Shade point lights in a single clustered pass instead of one pass per light
+	bool clustered_lighting;
 
 	bool use_planet_detail_map;
 	bool use_planet_detail_normal;
@@ -21,19 +25,26 @@ struct RendererQuality
 			SIMPLE // (Doesn't use envmapping)
 		};
 
-		// PBR samples are taken in this fashion:
-		// p = 1.0 - planet_distance_parameter * planet_angular_size (radians);
-		// sample   if distance_moved >= distance_per_sample * p
-		// 			or time_per_sample >= time_per_sample * p
-		// 			and frames_passed > frames_per_sample
+		// PBR samples (a full update of the 6 faces) are taken in this fashion:
+		// sample   if frames_passed > frames_per_sample
+		//			and (distance_moved >= distance_per_sample
+		// 			or sun_angle_moved >= sun_angle_per_sample (degrees)
+		// 			or time_passed >= time_per_sample (if > 0))
 		// if simple sampling is enabled,
 		// sample 	if frames_passed > frames_per_sample
+		// At most faces_per_sample faces are rendered per frame, and filtering (IBL) is
+		// spread over frames doing at most ibl_samples_per_frame texture samples per frame
+		// The three thresholds are scaled by
+		// p = max(1.0 - planet_distance_parameter * planet_angular_size (radians), 0.0)
+		// where planet_angular_size is that of the biggest planet seen from the sample position
 		Quality quality;
 		int faces_per_sample;
 		int frames_per_sample;
 		double distance_per_sample;
 		double time_per_sample;
+		double sun_angle_per_sample;
 		double planet_distance_parameter;
+		int ibl_samples_per_frame;
 		bool simple_sampling;
 	};
 
@@ -43,7 +54,10 @@ struct RendererQuality
 	{
 		bool low_end;
 		int iterations;
+		// Not used if use_lut is enabled
 		int sub_iterations;
+		// Use the precomputed AtmosphereLUT instead of ray marching towards the sun
+		bool use_lut;
 	};
 
 	Atmosphere atmosphere;
@@ -74,6 +88,10 @@ struct RendererQuality
 		{
 			out += "#define _ATMO_LOW_END\n";
 		}
+		if(atmosphere.use_lut)
+		{
+			out += "#define _ATMO_LUT\n";
+		}
 
 
 		if(use_planet_detail_map)
@@ -116,6 +134,8 @@ public:
 		SAFE_TOML_GET(to.sun_terrain_shadow_size, "sun_terrain_shadow_size", int);
 		SAFE_TOML_GET(to.secondary_shadow_size, "secondary_shadow_size", int);
 		SAFE_TOML_GET(to.env_map_size, "env_map_size", int);
+		SAFE_TOML_GET_OR(to.texture_stream_budget, "texture_stream_budget", int, 4096);
+		SAFE_TOML_GET_OR(to.clustered_lighting, "clustered_lighting", bool, true);
 
 		std::string pbr_quality;
 		SAFE_TOML_GET(pbr_quality, "pbr.quality", std::string);
@@ -132,12 +152,11 @@ public:
 		{
 			SAFE_TOML_GET_OR(to.pbr.simple_sampling, "pbr.simple_sampling", bool, false);
 
-			if (!to.pbr.simple_sampling)
-			{
-				SAFE_TOML_GET(to.pbr.distance_per_sample, "pbr.distance_per_sample", double);
-				SAFE_TOML_GET(to.pbr.planet_distance_parameter, "pbr.planet_distance_parameter", double);
-				SAFE_TOML_GET(to.pbr.time_per_sample, "pbr.time_per_sample", double);
-			}
+			SAFE_TOML_GET_OR(to.pbr.distance_per_sample, "pbr.distance_per_sample", double, 1.0);
+			SAFE_TOML_GET_OR(to.pbr.planet_distance_parameter, "pbr.planet_distance_parameter", double, 0.0);
+			SAFE_TOML_GET_OR(to.pbr.time_per_sample, "pbr.time_per_sample", double, 0.0);
+			SAFE_TOML_GET_OR(to.pbr.sun_angle_per_sample, "pbr.sun_angle_per_sample", double, 1.0);
+			SAFE_TOML_GET_OR(to.pbr.ibl_samples_per_frame, "pbr.ibl_samples_per_frame", int, 262144);
 
 			SAFE_TOML_GET(to.pbr.faces_per_sample, "pbr.faces_per_sample", int);
 			SAFE_TOML_GET(to.pbr.frames_per_sample, "pbr.frames_per_sample", int);
@@ -147,6 +166,7 @@ public:
 		SAFE_TOML_GET(to.atmosphere.iterations, "atmosphere.iterations", int);
 		SAFE_TOML_GET(to.atmosphere.sub_iterations, "atmosphere.sub_iterations", int);
 		SAFE_TOML_GET(to.atmosphere.low_end, "atmosphere.low_end", bool);
+		SAFE_TOML_GET_OR(to.atmosphere.use_lut, "atmosphere.use_lut", bool, true);
 
 		SAFE_TOML_GET(to.use_planet_detail_normal, "planet.use_detail_normal", bool);
 		SAFE_TOML_GET(to.use_planet_detail_map, "planet.use_detail_map", bool);
@@ -0,0 +1,100 @@
+#include "AtmosphereLUT.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+// These must match core:shaders/atmosphere/atmo_util.fsi
+static double lut_height(const glm::dvec3& p, double planet_radius)
+{
+	return glm::max((glm::length(p) - planet_radius) / (1.0 - planet_radius), 0.0);
+}
+
+static double lut_density(double h, double exponent)
+{
+	return glm::min(glm::exp(-glm::pow(h, exponent) * 8.0), 1.0);
+}
+
+static double lut_soft_sphere_shadow(const glm::dvec3& r0, const glm::dvec3& rd, double sr, double lr)
+{
+	double b = glm::dot(r0, rd);
+	double c = glm::dot(r0, r0) - sr * sr;
+	double h = b * b - c;
+
+	double d = glm::sqrt(glm::max(0.0, sr * sr - h)) - sr;
+	double t = -b - glm::sqrt(glm::max(h, 0.0));
+	return t < 0.0 ? 1.0 : glm::smoothstep(0.0, 1.0, 2.5 * lr * d / t);
+}
+
+void AtmosphereLUT::build()
+{
+	std::vector<glm::vec4> data(SIZE_MU * SIZE_H);
+
+	// Texel centers land exactly on the ends of the ranges, see sampleAtmoLut
+	for(int j = 0; j < SIZE_H; j++)
+	{
+		double r = planet_radius + (1.0 - planet_radius) * (double)j / (double)(SIZE_H - 1);
+		for(int i = 0; i < SIZE_MU; i++)
+		{
+			double mu = -1.0 + 2.0 * (double)i / (double)(SIZE_MU - 1);
+			glm::dvec3 p = glm::dvec3(0.0, r, 0.0);
+			glm::dvec3 sray = glm::dvec3(glm::sqrt(glm::max(1.0 - mu * mu, 0.0)), mu, 0.0);
+
+			// Far intersection with the atmosphere, we always start inside
+			double b = r * mu;
+			double sdr = -b + glm::sqrt(glm::max(b * b - (r * r - 1.0), 0.0));
+
+			glm::dvec4 acc = glm::dvec4(0.0);
+			for(int k = 0; k < STEPS; k++)
+			{
+				glm::dvec3 spos = p + sray * sdr * (((double)k + 0.5) / (double)STEPS);
+				double sh = lut_height(spos, planet_radius);
+				acc.x += lut_density(sh, exponent) * sdr;
+				acc.y += lut_density(sh * 0.5, exponent);
+				acc.z += lut_soft_sphere_shadow(spos, sray, planet_radius, 1.0);
+				acc.w += lut_soft_sphere_shadow(spos, sray, planet_radius * 0.8, 1.0);
+			}
+
+			data[j * SIZE_MU + i] = glm::vec4(acc / (double)STEPS);
+		}
+	}
+
+	if(tex == 0)
+	{
+		glGenTextures(1, &tex);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, SIZE_MU, SIZE_H, 0, GL_RGBA, GL_FLOAT, data.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint AtmosphereLUT::get(const ElementConfig& config)
+{
+	double n_planet_radius = config.radius / config.atmo.radius;
+	if(tex == 0 || n_planet_radius != planet_radius || config.atmo.exponent != exponent)
+	{
+		planet_radius = n_planet_radius;
+		exponent = config.atmo.exponent;
+		build();
+	}
+
+	return tex;
+}
+
+AtmosphereLUT::AtmosphereLUT()
+{
+	tex = 0;
+	planet_radius = 0.0;
+	exponent = 0.0;
+}
+
+AtmosphereLUT::~AtmosphereLUT()
+{
+	if(tex != 0)
+	{
+		glDeleteTextures(1, &tex);
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <glad/glad.h>
+#include <universe/element/config/ElementConfig.h>
+
+// Precomputed sun-ray integrals for the atmosphere shaders, which otherwise ray march
+// towards the sun from every sample of every pixel (the inner loops of atmo.fs and atmo.fsi).
+// The atmosphere is spherically symmetric, so these only depend on the normalized height of
+// the sample and the cosine of the sun zenith angle. Texels contain:
+// 	x: Rayleigh optical depth towards the sun (in atmosphere radii)
+//	y: Mie optical depth towards the sun (same units as the ray marched version)
+//	z: Averaged planet shadow along the sun ray (used by the sky)
+//	w: Same but for the smaller occluder used by the surface shaders
+// Built once on the CPU, and only rebuilt if the configuration it depends on changes
+class AtmosphereLUT
+{
+private:
+
+	GLuint tex;
+
+	// What the LUT depends on, kRlh and kMie are applied in the shader
+	double planet_radius;
+	double exponent;
+
+	void build();
+
+public:
+
+	// Cosine of the sun zenith angle, height
+	static constexpr int SIZE_MU = 64;
+	static constexpr int SIZE_H = 32;
+	static constexpr int STEPS = 64;
+
+	// Builds the LUT if needed
+	GLuint get(const ElementConfig& config);
+
+	AtmosphereLUT();
+	~AtmosphereLUT();
+};
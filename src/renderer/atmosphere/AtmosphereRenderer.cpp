@@ -1,4 +1,5 @@
 #include "AtmosphereRenderer.h"
+#include <renderer/Renderer.h>
 
 
 
@@ -39,6 +40,12 @@ void AtmosphereRenderer::do_pass(glm::dmat4 proj_view, glm::dmat4 model, float f
 	atmo->setFloat("atmo_exponent", (float)config.atmo.exponent);
 	atmo->setFloat("sunset_exponent", (float)config.atmo.sunset_exponent);
 	atmo->setVec3("light_dir", light_dir);
+	if(hgr->renderer->quality.atmosphere.use_lut)
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, lut.get(config));
+		atmo->setInt("atmo_lut", 0);
+	}
 
 	glBindVertexArray(atmo_vao);
 	glDrawElements(GL_TRIANGLES, (GLsizei)index_count, GL_UNSIGNED_INT, 0);
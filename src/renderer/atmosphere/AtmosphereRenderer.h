@@ -3,6 +3,7 @@
 #include <assets/AssetManager.h>
 #include <universe/element/config/ElementConfig.h>
 #include "../geometry/SphereGeometry.h"
+#include "AtmosphereLUT.h"
 
 class AtmosphereRenderer
 {
@@ -16,6 +17,9 @@ public:
 
 	Shader* atmo;
 
+	// Also used by the surface shaders of the planet
+	AtmosphereLUT lut;
+
 	// Atmospheres are rendered in z-sorted passes
 	void do_pass(glm::dmat4 proj_view, glm::dmat4 model, float far_plane, glm::vec3 cam_pos_relative,
 				 ElementConfig& config, glm::vec3 light_dir);
@@ -0,0 +1,193 @@
+#include "ClusteredLighting.h"
+#include "PointLight.h"
+#include "../../assets/AssetManager.h"
+#include <renderer/util/TextureDrawer.h>
+
+ClusteredLighting::ClusteredLighting()
+{
+	shader = nullptr;
+	light_ssbo = 0;
+	grid_ssbo = 0;
+	index_ssbo = 0;
+	viewport = glm::ivec4(0);
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	if(light_ssbo != 0)
+	{
+		glDeleteBuffers(1, &light_ssbo);
+		glDeleteBuffers(1, &grid_ssbo);
+		glDeleteBuffers(1, &index_ssbo);
+	}
+}
+
+int ClusteredLighting::get_slice(float depth, float z_far) const
+{
+	float slice = glm::log(glm::max(depth, Z_NEAR) / Z_NEAR) / glm::log(z_far / Z_NEAR) * (float)CLUSTERS_Z;
+	return glm::clamp((int)glm::floor(slice), 0, CLUSTERS_Z - 1);
+}
+
+bool ClusteredLighting::get_range(size_t light, const CameraUniforms& cu, float z_far, LightRange& out) const
+{
+	glm::vec4 pos_radius = gpu_lights[light].pos_radius;
+	glm::vec3 center = glm::mat3(cu.view) * glm::vec3(pos_radius);
+	float radius = pos_radius.w;
+
+	// View space looks down -Z
+	float min_depth = -center.z - radius;
+	float max_depth = -center.z + radius;
+	if(max_depth < 0.0f)
+	{
+		return false;
+	}
+
+	out.min.z = get_slice(min_depth, z_far);
+	out.max.z = get_slice(max_depth, z_far);
+
+	// Project the corners of the bounding box of the sphere. If any goes behind the camera
+	// the projection is not reliable, so the light covers the whole screen
+	glm::vec2 ndc_min = glm::vec2(1.0f), ndc_max = glm::vec2(-1.0f);
+	bool full_screen = false;
+	glm::mat4 proj = cu.proj;
+	for(int i = 0; i < 8 && !full_screen; i++)
+	{
+		glm::vec3 corner = center + glm::vec3(i & 1 ? radius : -radius, i & 2 ? radius : -radius, i & 4 ? radius : -radius);
+		glm::vec4 clip = proj * glm::vec4(corner, 1.0f);
+		if(clip.w <= Z_NEAR)
+		{
+			full_screen = true;
+			break;
+		}
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndc_min = glm::min(ndc_min, ndc);
+		ndc_max = glm::max(ndc_max, ndc);
+	}
+
+	if(full_screen)
+	{
+		out.min.x = 0; out.min.y = 0;
+		out.max.x = CLUSTERS_X - 1; out.max.y = CLUSTERS_Y - 1;
+		return true;
+	}
+
+	if(ndc_max.x < -1.0f || ndc_max.y < -1.0f || ndc_min.x > 1.0f || ndc_min.y > 1.0f)
+	{
+		return false;
+	}
+
+	glm::vec2 count = glm::vec2(CLUSTERS_X, CLUSTERS_Y);
+	glm::ivec2 tmin = glm::ivec2(glm::floor((ndc_min * 0.5f + 0.5f) * count));
+	glm::ivec2 tmax = glm::ivec2(glm::floor((ndc_max * 0.5f + 0.5f) * count));
+	tmin = glm::clamp(tmin, glm::ivec2(0), glm::ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+	tmax = glm::clamp(tmax, glm::ivec2(0), glm::ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+	out.min.x = tmin.x; out.min.y = tmin.y;
+	out.max.x = tmax.x; out.max.y = tmax.y;
+
+	return true;
+}
+
+void ClusteredLighting::do_pass(CameraUniforms& cu, GBuffer* gbuf)
+{
+	if(point_lights.empty())
+	{
+		return;
+	}
+
+	if(shader == nullptr)
+	{
+		shader = hgr->assets->get<Shader>("core", "shaders/light/clustered.vs");
+		glGenBuffers(1, &light_ssbo);
+		glGenBuffers(1, &grid_ssbo);
+		glGenBuffers(1, &index_ssbo);
+	}
+
+	// Lights are in camera relative space, same as the GBuffer
+	gpu_lights.clear();
+	float z_far = Z_NEAR * 2.0f;
+	for(PointLight* l : point_lights)
+	{
+		GPULight light;
+		glm::vec3 rel_pos = glm::vec3(l->pos - cu.cam_pos);
+		light.pos_radius = glm::vec4(rel_pos, l->get_radius());
+		light.color = glm::vec4(l->color, 1.0f);
+		light.spec_color = glm::vec4(l->spec_color, 1.0f);
+		light.attenuation = glm::vec4(l->get_constant(), l->get_linear(), l->get_quadratic(), 0.0f);
+		gpu_lights.push_back(light);
+
+		float depth = -(glm::mat3(cu.view) * rel_pos).z + l->get_radius();
+		z_far = glm::max(z_far, depth);
+	}
+
+	// Depth slices only span the range lights can reach, so they stay useful no
+	// matter how far the far plane is
+	ranges.resize(point_lights.size());
+	visible.assign(point_lights.size(), false);
+	grid.assign(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z, glm::uvec2(0));
+	auto cluster_index = [](int x, int y, int z) { return (z * CLUSTERS_Y + y) * CLUSTERS_X + x; };
+
+	// Count, prefix sum, and fill, so the light lists are stored contiguously
+	for(size_t i = 0; i < point_lights.size(); i++)
+	{
+		visible[i] = get_range(i, cu, z_far, ranges[i]);
+		if(!visible[i])
+			continue;
+
+		const LightRange& r = ranges[i];
+		for(int z = r.min.z; z <= r.max.z; z++)
+			for(int y = r.min.y; y <= r.max.y; y++)
+				for(int x = r.min.x; x <= r.max.x; x++)
+					grid[cluster_index(x, y, z)].y++;
+	}
+
+	uint32_t offset = 0;
+	for(glm::uvec2& c : grid)
+	{
+		c.x = offset;
+		offset += c.y;
+		c.y = 0;
+	}
+
+	indices.resize(offset);
+	for(size_t i = 0; i < point_lights.size(); i++)
+	{
+		if(!visible[i])
+			continue;
+
+		const LightRange& r = ranges[i];
+		for(int z = r.min.z; z <= r.max.z; z++)
+			for(int y = r.min.y; y <= r.max.y; y++)
+				for(int x = r.min.x; x <= r.max.x; x++)
+				{
+					glm::uvec2& c = grid[cluster_index(x, y, z)];
+					indices[c.x + c.y] = (uint32_t)i;
+					c.y++;
+				}
+	}
+
+	if(indices.empty())
+	{
+		return;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, light_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gpu_lights.size() * sizeof(GPULight), gpu_lights.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, grid.size() * sizeof(glm::uvec2), grid.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, index_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, light_ssbo);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, grid_ssbo);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, index_ssbo);
+
+	// We don't do ibl here
+	prepare_shader(shader, gbuf, 0, 0, 0);
+	glUniform3i(shader->get_uniform_location("cluster_count"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+	shader->setVec4("viewport", glm::vec4(viewport));
+	shader->setVec2("cluster_depth", glm::vec2(Z_NEAR, glm::log(z_far / Z_NEAR)));
+
+	glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+	texture_drawer->issue_fullscreen_rectangle();
+}
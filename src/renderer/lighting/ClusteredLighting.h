@@ -0,0 +1,70 @@
+#pragma once
+#include "Light.h"
+#include <vector>
+#include <cstdint>
+
+class PointLight;
+
+// Shades all point lights in a single fullscreen pass instead of one pass per light.
+// The view frustum is split into clusters (screen tiles times exponential depth slices),
+// every frame the lights are assigned to the clusters they touch on the CPU, and the
+// shader only evaluates the lights of the cluster each pixel falls in.
+// Like DebugGBuffer, it's used internally by the Renderer, set renderer.quality.clustered_lighting
+// to false to go back to the per-light passes.
+class ClusteredLighting : public Light
+{
+private:
+
+	// Must match ClusterLight in core:shaders/light/clustered.fs (std430)
+	struct GPULight
+	{
+		glm::vec4 pos_radius;
+		glm::vec4 color;
+		glm::vec4 spec_color;
+		glm::vec4 attenuation;
+	};
+
+	// Cluster range of a light, inclusive
+	struct LightRange
+	{
+		glm::ivec3 min, max;
+	};
+
+	Shader* shader;
+	GLuint light_ssbo, grid_ssbo, index_ssbo;
+
+	std::vector<PointLight*> point_lights;
+
+	// Reused every frame
+	std::vector<GPULight> gpu_lights;
+	std::vector<LightRange> ranges;
+	std::vector<bool> visible;
+	std::vector<glm::uvec2> grid;
+	std::vector<uint32_t> indices;
+
+	// Returns false if the light is not visible
+	bool get_range(size_t light, const CameraUniforms& cu, float z_far, LightRange& out) const;
+	int get_slice(float depth, float z_far) const;
+
+public:
+
+	static constexpr int CLUSTERS_X = 16;
+	static constexpr int CLUSTERS_Y = 9;
+	static constexpr int CLUSTERS_Z = 24;
+	// Depth of the first slice, anything closer goes into it
+	static constexpr float Z_NEAR = 0.1f;
+
+	// Viewport the camera projection maps to, set by the renderer before do_pass
+	glm::ivec4 viewport;
+
+	void clear() { point_lights.clear(); }
+	void add(PointLight* light) { point_lights.push_back(light); }
+	bool empty() const { return point_lights.empty(); }
+
+	LightType get_type() override { return CLUSTERED; }
+
+	void do_pass(CameraUniforms& cu, GBuffer* gbuf) override;
+
+	ClusteredLighting();
+	~ClusteredLighting();
+};
@@ -4,6 +4,7 @@
 #include "../../assets/Shader.h"
 #include "../camera/CameraUniforms.h"
 #include "ShadowCamera.h"
+#include <cstdint>
 
 // The GBuffer is always in camera relative space
 // (in order to have high-quality floats near the origin)
@@ -20,7 +21,8 @@ public:
 		ENV_MAP,
 		SUN, 
 		PART_ICON,
-		DEBUG_GBUFFER
+		DEBUG_GBUFFER,
+		CLUSTERED
 	};
 
 
@@ -63,8 +65,14 @@ public:
 
 	virtual LightType get_type() = 0;
 
-	virtual ShadowCamera get_shadow_camera(glm::dvec3 camera_pos) { return ShadowCamera(); };
-	virtual ShadowCamera get_far_shadow_camera() { return ShadowCamera(); }; //< Only on SunLight
+	// Shadow casting lights may have many shadow cameras (for example, cascades). Every frame
+	// prepare_shadows is called, and then every camera is drawn if needs_shadow_update returns true
+	virtual void prepare_shadows(const CameraUniforms& cu) {}
+	virtual size_t get_shadow_camera_count() { return 1; }
+	virtual ShadowCamera get_shadow_camera(size_t i) { return ShadowCamera(); }
+	// caster_hash identifies the casters visible to the camera (and their bounds), return false
+	// to keep the shadow map drawn on a previous frame
+	virtual bool needs_shadow_update(size_t i, uint64_t caster_hash) { return true; }
 	virtual bool casts_shadows() { return false; }
 
 	virtual bool needs_fullscreen_viewport() { return true; }
@@ -40,7 +40,7 @@ float PointLight::calculate_radius(float min_brightness)
 	float B = linear;
 	float C = constant - bright * (1.0f / min_brightness);
 
-	return (-B + sqrt(B *  -4.0f * A * C)) / (2.0f * A);
+	return (-B + sqrt(B * B - 4.0f * A * C)) / (2.0f * A);
 }
 
 void PointLight::set_parameters(float constant, float linear, float quadratic, float min_brightness)
@@ -11,6 +11,11 @@ struct ShadowCamera
 	int size;
 	float far_plane;
 
+	// World to clip space
 	glm::dmat4 tform;
 	glm::dvec3 cam_pos;
+
+	// Detail drawables should use, 0 is full detail and higher is coarser. Far
+	// cascades cover big areas so they don't need much
+	int lod = 0;
 };
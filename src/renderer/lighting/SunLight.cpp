@@ -5,24 +5,36 @@
 #include <universe/Universe.h>
 #include <universe/PlanetarySystem.h>
 
-static void make_shadow_fbuffer(GLuint& fbo, GLuint& tex, int SIZE)
+static void make_shadow_array(GLuint* fbos, GLuint& tex, int size, int layers)
 {
-	glGenFramebuffers(1, &fbo);
 	glGenTextures(1, &tex);
-	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SIZE, SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER); 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-  	float border_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color);  
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);  
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float border_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// One framebuffer per layer
+	glGenFramebuffers(layers, fbos);
+	for(int i = 0; i < layers; i++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, tex, 0, i);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
+// Rotation of the shadow cameras, dir points from the sun towards the scene
+static glm::dmat4 get_sun_rotation(glm::dvec3 dir)
+{
+	glm::dvec3 up = glm::abs(dir.y) > 0.99 ? glm::dvec3(1.0, 0.0, 0.0) : glm::dvec3(0.0, 1.0, 0.0);
+	return glm::lookAt(glm::dvec3(0.0, 0.0, 0.0), dir, up);
 }
 
 
@@ -37,19 +49,38 @@ SunLight::SunLight(int far_size, int near_size)
 	ambient_color = glm::vec3(0.1f, 0.1f, 0.1f);
 
 	// Create the shadow framebuffers
-	make_shadow_fbuffer(far_shadow_fbo, far_shadow_tex, far_size);
-	make_shadow_fbuffer(near_shadow_fbo, near_shadow_tex, near_size);
+	make_shadow_array(&shadow_fbo[0], near_shadow_tex, near_size, NEAR_CASCADES);
+	make_shadow_array(&shadow_fbo[NEAR_CASCADES], far_shadow_tex, far_size, FAR_CASCADES);
 
 	// Reasonable value
 	position = glm::dvec3(0, 0, 0);
 	track_star = false;
-	near_shadow_span = 50.0;	
+	near_shadow_span = 50.0;
+	shadow_distance = 20000.0;
+	far_cache_frames = 60;
+	far_cache_angle = glm::radians(0.1);
+
+	for(size_t i = 0; i < CASCADE_COUNT; i++)
+	{
+		Cascade& c = cascades[i];
+		c.center = glm::dvec3(0.0);
+		c.radius = 1.0;
+		c.dir = glm::dvec3(0.0, -1.0, 0.0);
+		c.end = 0.0;
+		c.valid = false;
+		c.dirty = true;
+		// Staggered so far cascades don't expire on the same frame
+		c.age = (int)(i * far_cache_frames / CASCADE_COUNT);
+		c.caster_hash = 0;
+	}
 }
 
 
 SunLight::~SunLight()
 {
-
+	glDeleteFramebuffers(CASCADE_COUNT, shadow_fbo);
+	glDeleteTextures(1, &near_shadow_tex);
+	glDeleteTextures(1, &far_shadow_tex);
 }
 
 void SunLight::do_pass(CameraUniforms& cu, GBuffer* gbuf)
@@ -66,38 +97,129 @@ void SunLight::do_pass(CameraUniforms& cu, GBuffer* gbuf)
 	shader->setVec3("sun_pos", sun_pos);
 	shader->setVec3("color", color);
 
-//	glm::dmat4 pos_mat = glm::translate(glm::dmat4(1.0), -position);
-	glm::dmat4 pos_mat = glm::dmat4(1.0);
-
-	glm::dmat4 near_shadow_tform = near_shadow_cam.tform * pos_mat * glm::inverse(cu.c_model);
+	// Shadow cameras are in world space, the GBuffer is camera relative
+	glm::dmat4 to_world = glm::inverse(cu.c_model);
+	for(size_t i = 0; i < CASCADE_COUNT; i++)
+	{
+		std::string idx = "[" + std::to_string(i) + "]";
+		shader->setMat4("shadow_tform" + idx, cascades[i].cam.tform * to_world);
+		shader->setFloat("cascade_end" + idx, (float)cascades[i].end);
+	}
+	// View depth is measured along the camera forward
+	shader->setVec3("camera_fw", -glm::dvec3(glm::inverse(cu.view)[2]));
 
-	shader->setMat4("near_shadow_tform", near_shadow_tform);
 	// Keep in mind space used by gbuffer textures
 	glActiveTexture(GL_TEXTURE7);
-	glBindTexture(GL_TEXTURE_2D, near_shadow_tex);
-	shader->setInt("near_shadow_map", 7);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, near_shadow_tex);
+	shader->setInt("near_shadow_maps", 7);
+	glActiveTexture(GL_TEXTURE8);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, far_shadow_tex);
+	shader->setInt("far_shadow_maps", 8);
 
 	texture_drawer->issue_fullscreen_rectangle();
 }
 
+void SunLight::update_camera(Cascade& c, size_t i)
+{
+	double r = c.radius;
+	double far_plane = r * 4.0;
+	// Casters up to one radius between the sun and the covered sphere are included
+	glm::dvec3 eye = c.center - c.dir * r * 2.0;
+
+	ShadowCamera& cam = c.cam;
+	cam.proj = glm::ortho(-r, r, -r, r, 0.0, far_plane);
+	cam.view = get_sun_rotation(c.dir);
+	cam.c_camera = glm::translate(glm::dmat4(1.0), -eye);
+	cam.tform = cam.proj * cam.view * cam.c_camera;
+	cam.cam_pos = eye;
+	cam.far_plane = (float)far_plane;
+	cam.fbuffer = shadow_fbo[i];
+	cam.size = i < NEAR_CASCADES ? near_shadow_size : far_shadow_size;
+	cam.lod = i < NEAR_CASCADES ? 0 : 1;
+}
 
-ShadowCamera SunLight::get_shadow_camera(glm::dvec3 camera_pos)
+void SunLight::prepare_shadows(const CameraUniforms& cu)
 {
-	float far_plane = near_shadow_span * 4.0;
-	near_shadow_cam.proj = glm::ortho(-near_shadow_span, near_shadow_span, -near_shadow_span, near_shadow_span, 1.0, (double)far_plane);
-	// TODO: Maybe a fix for when the camera is on the positive y position? Rare but could happen!
-	glm::dvec3 dir = glm::normalize(camera_pos - position);
-	glm::dvec3 sun_pos = camera_pos - dir * near_shadow_span * 2.0;
-	near_shadow_cam.view = glm::lookAt(glm::dvec3(0, 0, 0), dir, glm::dvec3(0.0, 1.0, 0.0));
+	if(track_star)
+	{
+		position = hgr->universe->system.states_now[hgr->universe->system.star].pos;
+	}
+
+	glm::dmat4 inv_view = glm::inverse(cu.view);
+	glm::dvec3 forward = -glm::dvec3(inv_view[2]);
+	double tan_x = 1.0 / cu.proj[0][0];
+	double tan_y = 1.0 / cu.proj[1][1];
+	// Squared tangent of the half diagonal field of view
+	double k2 = tan_x * tan_x + tan_y * tan_y;
 
-	near_shadow_cam.c_camera = glm::translate(glm::dmat4(1.0), -sun_pos);
-	near_shadow_cam.fbuffer = near_shadow_fbo;
-	near_shadow_cam.size = near_shadow_size;
-	near_shadow_cam.far_plane = far_plane;	
-	near_shadow_cam.cam_pos = sun_pos;
+	glm::dvec3 dir = glm::normalize(cu.cam_pos - position);
+	double start = 0.0;
 
-	near_shadow_cam.tform = near_shadow_cam.proj * near_shadow_cam.view * near_shadow_cam.c_camera;
+	for(size_t i = 0; i < CASCADE_COUNT; i++)
+	{
+		Cascade& c = cascades[i];
+		double t = (double)i / (double)(CASCADE_COUNT - 1);
+		double end = near_shadow_span * glm::pow(shadow_distance / near_shadow_span, t);
+		c.end = end;
+
+		// Minimal bounding sphere of the frustum slice. It only depends on the field of
+		// view, so its size doesn't change as the camera rotates
+		double z = glm::min((start + end) * 0.5 * (1.0 + k2), end);
+		double radius = glm::sqrt((end - z) * (end - z) + end * end * k2);
+		// Rounded up so floating point noise can't change the texel size
+		radius = glm::ceil(radius * 16.0) / 16.0;
+		glm::dvec3 center = cu.cam_pos + forward * z;
+		start = end;
+
+		bool is_far = i >= NEAR_CASCADES;
+		if(is_far)
+		{
+			// Far cascades cover a bigger sphere so they can stay in place while the camera moves
+			radius *= 1.25;
+			bool contained = glm::distance(center, c.center) + radius / 1.25 <= c.radius;
+			double angle = glm::acos(glm::clamp(glm::dot(dir, c.dir), -1.0, 1.0));
+			c.age++;
+
+			if(c.valid && contained && angle <= far_cache_angle)
+			{
+				continue;
+			}
+
+			c.valid = true;
+			c.dirty = true;
+		}
+
+		// Snap the center to shadow map texels, so the same world positions always
+		// land on the same texels
+		int size = is_far ? far_shadow_size : near_shadow_size;
+		double texel = 2.0 * radius / (double)size;
+		glm::dmat4 rot = get_sun_rotation(dir);
+		glm::dvec3 light_space = rot * glm::dvec4(center, 1.0);
+		light_space.x = glm::floor(light_space.x / texel) * texel;
+		light_space.y = glm::floor(light_space.y / texel) * texel;
+
+		c.center = glm::dvec3(glm::transpose(rot) * glm::dvec4(light_space, 1.0));
+		c.radius = radius;
+		c.dir = dir;
+		update_camera(c, i);
+	}
+}
 
-	return near_shadow_cam;
+bool SunLight::needs_shadow_update(size_t i, uint64_t caster_hash)
+{
+	if(i < NEAR_CASCADES)
+	{
+		return true;
+	}
+
+	Cascade& c = cascades[i];
+	if(c.dirty || c.caster_hash != caster_hash || c.age >= far_cache_frames)
+	{
+		c.dirty = false;
+		c.caster_hash = caster_hash;
+		c.age = 0;
+		return true;
+	}
 
+	return false;
 }
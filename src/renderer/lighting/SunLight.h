@@ -3,20 +3,51 @@
 // It's actually a point-light but always renders a fullscreen quad. It also allows setting ambient light
 // Used for stars
 // Shadows:
-// 	We need to render two shadow maps.
-// 	- FAR: Renders just the closest planetary surface to the camera,
-// 		it casts landscape shadows. Projection depends on distance to surface
-//	- NEAR: Renders the closest planetary surface and vehicles,
-//		uses a way smaller frustrum
+// 	The view frustum is split into cascades, each covered by its own shadow map. Cascades are
+//	fitted to the bounding sphere of their frustum slice and snapped to shadow map texels, so
+//	they don't shimmer as the camera moves or rotates.
+// 	- NEAR: The first cascades, re-rendered every frame as they contain vehicles
+//	- FAR: Render the planetary surface (landscape shadows) and distant casters. They are
+//		cached, and only re-rendered when the sun direction, the casters inside them,
+//		or their position change, or every far_cache_frames at most
 class SunLight : public Light
 {
+public:
+
+	static constexpr size_t NEAR_CASCADES = 2;
+	static constexpr size_t FAR_CASCADES = 2;
+	static constexpr size_t CASCADE_COUNT = NEAR_CASCADES + FAR_CASCADES;
+
 private:
 
+	struct Cascade
+	{
+		ShadowCamera cam;
+
+		// Covered sphere in world coordinates and sun direction used to render
+		glm::dvec3 center;
+		double radius;
+		glm::dvec3 dir;
+
+		// View depth where the cascade ends
+		double end;
+
+		// Only used by far cascades
+		bool valid;
+		bool dirty;
+		int age;
+		uint64_t caster_hash;
+	};
+
 	int near_shadow_size;
 	int far_shadow_size;
 
 	Shader* shader;
 
+	Cascade cascades[CASCADE_COUNT];
+
+	void update_camera(Cascade& c, size_t i);
+
 public:
 
 	glm::dvec3 position;
@@ -26,19 +57,20 @@ public:
 	glm::vec3 spec_color;
 	glm::vec3 ambient_color;
 
-
-	GLuint far_shadow_fbo;
-	GLuint near_shadow_fbo;
-	GLuint far_shadow_tex;
+	GLuint shadow_fbo[CASCADE_COUNT];
+	// Texture arrays, with NEAR_CASCADES and FAR_CASCADES layers
 	GLuint near_shadow_tex;
+	GLuint far_shadow_tex;
 
-	// User set
+	// User set. View depth where the first cascade ends, and where the last one does.
+	// Cascades in between are distributed geometrically
 	double near_shadow_span;
-	// Set by the renderer
-	double far_shadow_span;
-
-	ShadowCamera near_shadow_cam;
-	ShadowCamera far_shadow_cam;
+	double shadow_distance;
+	// Far cascades are re-rendered at least this often, as not all casters can
+	// report changes (for example, terrain as it subdivides)
+	int far_cache_frames;
+	// Angle (in radians) the sun direction may change before far cascades are re-rendered
+	double far_cache_angle;
 
 	explicit SunLight(int far_shadow_size = 512, int near_shadow_size = 512);
 	~SunLight();
@@ -46,7 +78,11 @@ public:
 	LightType get_type () override { return SUN; }
 
 	void do_pass(CameraUniforms& cu, GBuffer * gbuf) override;
-	ShadowCamera get_shadow_camera(glm::dvec3 camera_pos) override;
+
+	void prepare_shadows(const CameraUniforms& cu) override;
+	size_t get_shadow_camera_count() override { return CASCADE_COUNT; }
+	ShadowCamera get_shadow_camera(size_t i) override { return cascades[i].cam; }
+	bool needs_shadow_update(size_t i, uint64_t caster_hash) override;
 
 	bool casts_shadows () override { return true; }
 	bool is_planetary_light() override { return true; }
@@ -0,0 +1,236 @@
+#include "GPUProfiler.h"
+#include <util/Logger.h>
+#include <imgui/imgui.h>
+
+GLuint GPUProfiler::get_query()
+{
+	if(free_queries.empty())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		return query;
+	}
+
+	GLuint query = free_queries.back();
+	free_queries.pop_back();
+	return query;
+}
+
+void GPUProfiler::read_frame(Frame& frame)
+{
+	if(frame.scopes.empty())
+	{
+		return;
+	}
+
+	// Queries complete in order, so checking the last issued one is enough
+	GLint available = 0;
+	glGetQueryObjectiv(frame.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if(available)
+	{
+		results.clear();
+		for(const Scope& scope : frame.scopes)
+		{
+			GLuint64 t0, t1;
+			glGetQueryObjectui64v(scope.begin_query, GL_QUERY_RESULT, &t0);
+			glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &t1);
+			double ms = (double)(t1 - t0) * 1e-6;
+
+			if(log_file.is_open())
+			{
+				log_file << frame.number << "," << scope.name << "," << scope.depth << "," << ms << "\n";
+			}
+
+			bool found = false;
+			for(Result& r : results)
+			{
+				if(r.name == scope.name)
+				{
+					r.last += ms;
+					found = true;
+					break;
+				}
+			}
+
+			if(!found)
+			{
+				Result r;
+				r.name = scope.name;
+				r.depth = scope.depth;
+				r.last = ms;
+				results.push_back(r);
+			}
+		}
+
+		for(Result& r : results)
+		{
+			auto it = averages.find(r.name);
+			if(it == averages.end())
+			{
+				it = averages.emplace(r.name, r.last).first;
+			}
+			else
+			{
+				it->second = it->second * 0.9 + r.last * 0.1;
+			}
+			r.avg = it->second;
+		}
+	}
+
+	for(const Scope& scope : frame.scopes)
+	{
+		free_queries.push_back(scope.begin_query);
+		free_queries.push_back(scope.end_query);
+	}
+	frame.scopes.clear();
+	frame.last_query = 0;
+}
+
+void GPUProfiler::begin_frame()
+{
+	frame_index = (frame_index + 1) % LATENCY;
+	frame_number++;
+
+	// The slot we reuse was recorded LATENCY frames ago
+	Frame& frame = frames[frame_index];
+	read_frame(frame);
+	frame.number = frame_number;
+
+	stack.clear();
+	in_frame = enabled;
+}
+
+void GPUProfiler::end_frame()
+{
+	if(!in_frame)
+	{
+		return;
+	}
+
+	// Don't throw, a lua error could have skipped the end call
+	while(!stack.empty())
+	{
+		logger->warn("GPU profiler scope '{}' was not closed", frames[frame_index].scopes[stack.back()].name);
+		end();
+	}
+	in_frame = false;
+}
+
+void GPUProfiler::begin(const std::string& name)
+{
+	if(!in_frame)
+	{
+		return;
+	}
+
+	Frame& frame = frames[frame_index];
+	Scope scope;
+	scope.name = name;
+	scope.depth = (int)stack.size();
+	scope.begin_query = get_query();
+	scope.end_query = get_query();
+	glQueryCounter(scope.begin_query, GL_TIMESTAMP);
+
+	stack.push_back(frame.scopes.size());
+	frame.scopes.push_back(std::move(scope));
+}
+
+void GPUProfiler::end()
+{
+	if(!in_frame)
+	{
+		return;
+	}
+
+	logger->check(!stack.empty(), "Tried to end a GPU profiler scope but none was open");
+	Frame& frame = frames[frame_index];
+	frame.last_query = frame.scopes[stack.back()].end_query;
+	glQueryCounter(frame.last_query, GL_TIMESTAMP);
+	stack.pop_back();
+}
+
+double GPUProfiler::get_time(const std::string& name) const
+{
+	auto it = averages.find(name);
+	if(it == averages.end())
+	{
+		return -1.0;
+	}
+
+	return it->second;
+}
+
+bool GPUProfiler::start_log(const std::string& path)
+{
+	stop_log();
+	log_file.open(path, std::ios::out | std::ios::trunc);
+	if(!log_file.is_open())
+	{
+		logger->warn("Could not open GPU profiler log '{}'", path);
+		return false;
+	}
+
+	log_file << "frame,scope,depth,ms\n";
+	return true;
+}
+
+void GPUProfiler::stop_log()
+{
+	if(log_file.is_open())
+	{
+		log_file.close();
+	}
+}
+
+void GPUProfiler::do_imgui()
+{
+	ImGui::Checkbox("Enabled", &enabled);
+	if(results.empty())
+	{
+		ImGui::Text("No GPU timings yet");
+		return;
+	}
+
+	ImGui::Columns(3);
+	ImGui::Text("Scope"); ImGui::NextColumn();
+	ImGui::Text("Last (ms)"); ImGui::NextColumn();
+	ImGui::Text("Avg (ms)"); ImGui::NextColumn();
+	ImGui::Separator();
+	for(const Result& r : results)
+	{
+		ImGui::Indent((float)r.depth * 10.0f + 1.0f);
+		ImGui::Text("%s", r.name.c_str());
+		ImGui::Unindent((float)r.depth * 10.0f + 1.0f);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", r.last); ImGui::NextColumn();
+		ImGui::Text("%.3f", r.avg); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+}
+
+GPUProfiler::GPUProfiler()
+{
+	frame_index = 0;
+	frame_number = 0;
+	in_frame = false;
+	enabled = true;
+}
+
+GPUProfiler::~GPUProfiler()
+{
+	stop_log();
+	for(Frame& frame : frames)
+	{
+		for(const Scope& scope : frame.scopes)
+		{
+			free_queries.push_back(scope.begin_query);
+			free_queries.push_back(scope.end_query);
+		}
+	}
+
+	if(!free_queries.empty())
+	{
+		glDeleteQueries((GLsizei)free_queries.size(), free_queries.data());
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <cstdint>
+
+// Measures the GPU time of named scopes (render passes) with timestamp queries, which
+// unlike GL_TIME_ELAPSED queries may be nested. Results are read back LATENCY frames
+// later, and if they are still not available the frame is dropped instead of waiting,
+// so it never stalls the pipeline.
+// Scopes with the same name in a frame (for example, every env map face) are added up.
+// Scopes may only be opened between begin_frame and end_frame (during Renderer::render),
+// calls outside are ignored.
+class GPUProfiler
+{
+public:
+
+	static constexpr size_t LATENCY = 4;
+
+	struct Result
+	{
+		std::string name;
+		int depth;
+		// In milliseconds
+		double last;
+		double avg;
+	};
+
+private:
+
+	struct Scope
+	{
+		std::string name;
+		int depth;
+		GLuint begin_query, end_query;
+	};
+
+	struct Frame
+	{
+		std::vector<Scope> scopes;
+		uint64_t number = 0;
+		// End query issued last (scopes close in reverse order, so it's not the last scope's)
+		GLuint last_query = 0;
+	};
+
+	Frame frames[LATENCY];
+	size_t frame_index;
+	uint64_t frame_number;
+	bool in_frame;
+
+	std::vector<GLuint> free_queries;
+	// Indices into the scopes of the current frame
+	std::vector<size_t> stack;
+
+	std::vector<Result> results;
+	std::unordered_map<std::string, double> averages;
+
+	std::ofstream log_file;
+
+	GLuint get_query();
+	void read_frame(Frame& frame);
+
+public:
+
+	bool enabled;
+
+	void begin_frame();
+	void end_frame();
+
+	void begin(const std::string& name);
+	void end();
+
+	// Average time of the scope in milliseconds, or -1 if it has not been measured
+	double get_time(const std::string& name) const;
+	// Scopes of the last frame read back, in the order they were opened
+	const std::vector<Result>& get_results() const { return results; }
+
+	// Appends every frame read back as "frame,scope,depth,ms" lines to the file
+	bool start_log(const std::string& path);
+	void stop_log();
+
+	void do_imgui();
+
+	GPUProfiler();
+	~GPUProfiler();
+};
@@ -0,0 +1,124 @@
+#include "InstanceBatch.h"
+
+void InstanceBatch::rebuild()
+{
+	world.resize(instances.size());
+	glm::dmat4 base = glm::translate(glm::dmat4(1.0), origin);
+	for(size_t i = 0; i < instances.size(); i++)
+	{
+		world[i] = base * glm::dmat4(instances[i]);
+	}
+
+	dirty = false;
+}
+
+void InstanceBatch::set_origin(glm::dvec3 norigin)
+{
+	origin = norigin;
+	dirty = true;
+}
+
+void InstanceBatch::set_instances(std::vector<glm::mat4>&& ninstances)
+{
+	instances = std::move(ninstances);
+	dirty = true;
+
+	// The extent of the model is scaled by the largest scale of every instance
+	bound_center = glm::dvec3(0.0);
+	for(const glm::mat4& m : instances)
+	{
+		bound_center += glm::dvec3(m[3]);
+	}
+	if(!instances.empty())
+	{
+		bound_center /= (double)instances.size();
+	}
+
+	bound_radius = 0.0;
+	for(const glm::mat4& m : instances)
+	{
+		double scale = glm::max(glm::length(glm::vec3(m[0])), glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+		bound_radius = glm::max(bound_radius, glm::distance(glm::dvec3(m[3]), bound_center) + model_extent * scale);
+	}
+}
+
+void InstanceBatch::set_params(std::vector<glm::vec4>&& nparams)
+{
+	params = std::move(nparams);
+}
+
+void InstanceBatch::deferred_pass(CameraUniforms& cu, bool is_env_map)
+{
+	if(instances.empty())
+	{
+		return;
+	}
+
+	if(dirty)
+	{
+		rebuild();
+	}
+
+	node->draw_instanced(cu, world, drawable_uid, true, params.empty() ? nullptr : &params);
+}
+
+void InstanceBatch::shadow_pass(ShadowCamera& cu)
+{
+	if(instances.empty())
+	{
+		return;
+	}
+
+	if(dirty)
+	{
+		rebuild();
+	}
+
+	node->draw_shadow_instanced(cu, world, true);
+}
+
+bool InstanceBatch::get_bounds(glm::dvec3& center, double& radius)
+{
+	if(instances.empty())
+	{
+		return false;
+	}
+
+	center = origin + bound_center;
+	radius = bound_radius;
+	return true;
+}
+
+InstanceBatch::InstanceBatch(AssetHandle<Model>&& nmodel, const std::string& node_name) : model(std::move(nmodel))
+{
+	if(node_name.empty())
+	{
+		node = model.get_root_node();
+	}
+	else
+	{
+		node = model.get_node(node_name);
+	}
+	logger->check(node != nullptr, "Model has no node named {}", node_name);
+
+	// Node bounds only cover its own meshes, so all the drawn meshes are measured instead
+	model_extent = 0.0;
+	for(const PreparedDraw& d : node->draw_list)
+	{
+		for(int i = 0; i < 8; i++)
+		{
+			glm::dvec3 corner = glm::dvec3(
+				i & 1 ? d.mesh->max_bound.x : d.mesh->min_bound.x,
+				i & 2 ? d.mesh->max_bound.y : d.mesh->min_bound.y,
+				i & 4 ? d.mesh->max_bound.z : d.mesh->min_bound.z);
+			model_extent = glm::max(model_extent, glm::length(glm::dvec3(d.sub_transform * glm::dvec4(corner, 1.0))));
+		}
+	}
+
+	origin = glm::dvec3(0.0);
+	bound_center = glm::dvec3(0.0);
+	bound_radius = 0.0;
+	dirty = false;
+	casts_shadows = true;
+	draw_in_env_map = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "../Drawable.h"
+#include <assets/Model.h>
+#include <vector>
+
+// Draws many copies of a model node (rocks, debris, a fleet of identical satellites...) with one
+// instanced draw per mesh in the deferred, shadow and env map passes, instead of a material setup
+// and draw per copy.
+// Instance transforms are relative to origin, so they can be stored as floats and stay precise
+// as long as the origin is near them (for example, a point on the surface the scenery is scattered on).
+// Optional per-instance parameters reach the material shader as vInstParams (see pbr.vs)
+class InstanceBatch : public Drawable
+{
+private:
+
+	GPUModelPointer model;
+	Node* node;
+
+	glm::dvec3 origin;
+	std::vector<glm::mat4> instances;
+	std::vector<glm::vec4> params;
+
+	// Rebuilt when the instances or origin change, so passes only combine them with the camera
+	std::vector<glm::dmat4> world;
+	bool dirty;
+
+	// Distance from the node origin to its furthest vertex
+	double model_extent;
+	// Relative to origin
+	glm::dvec3 bound_center;
+	double bound_radius;
+
+	void rebuild();
+
+public:
+
+	bool casts_shadows;
+	bool draw_in_env_map;
+
+	void set_origin(glm::dvec3 norigin);
+	glm::dvec3 get_origin() const { return origin; }
+	void set_instances(std::vector<glm::mat4>&& ninstances);
+	// One per instance, missing ones are zero. Pass an empty vector to disable
+	void set_params(std::vector<glm::vec4>&& nparams);
+	size_t get_instance_count() const { return instances.size(); }
+
+	void deferred_pass(CameraUniforms& cu, bool is_env_map) override;
+	void shadow_pass(ShadowCamera& cu) override;
+
+	bool needs_deferred_pass() override { return true; }
+	bool needs_shadow_pass() override { return casts_shadows; }
+	bool needs_env_map_pass() override { return draw_in_env_map; }
+
+	bool get_bounds(glm::dvec3& center, double& radius) override;
+
+	// node may be empty to use the root node
+	InstanceBatch(AssetHandle<Model>&& nmodel, const std::string& node_name);
+};
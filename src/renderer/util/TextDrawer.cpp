@@ -1,77 +1,157 @@
 #include "TextDrawer.h"
 #include <codecvt>
 #include <utf8/utf8.h>
+#include <util/HashUtil.h>
 #include "../../assets/AssetManager.h"
 
 TextDrawer* text_drawer;
 
-void TextDrawer::draw_glyphs(const std::vector<BitmapFont::Glyph>& ps, BitmapFont * font, glm::vec2 pos, 
-	glm::ivec2 screen, glm::vec4 color, glm::vec2 scale)
+size_t TextDrawer::ShapeKeyHasher::operator()(const ShapeKey& key) const
 {
-	glDisable(GL_DEPTH_TEST);
-	glm::vec3 spos = glm::vec3(pos.x, pos.y, 0.0f);
-	glm::mat4 view = glm::ortho(0.0f, (float)screen.x, (float)screen.y, 0.0f, -1.0f, 1.0f);
-
-	shader->use();
+	uint64_t hash = HashUtil::fnv1a(&key.font, sizeof(key.font));
+	return (size_t)HashUtil::fnv1a(key.text, hash);
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, font->img->id);
-	glBindVertexArray(vao);
+void TextDrawer::queue_glyphs(const ShapedText& shaped, BitmapFont* font, glm::vec2 pos,
+	glm::ivec2 screen, glm::vec4 color, glm::vec2 scale)
+{
+	TextBatch* batch = nullptr;
+	for(TextBatch& b : batches)
+	{
+		if(b.tex == font->img->id)
+		{
+			batch = &b;
+			break;
+		}
+	}
 
-	shader->setInt("tex", 0);
-	shader->setVec4("color", color);
+	if(batch == nullptr)
+	{
+		batches.emplace_back();
+		batch = &batches.back();
+		batch->tex = font->img->id;
+	}
 
 	float iwidth = (float)font->img->get_width();
 	float iheight = (float)font->img->get_height();
+	// Same as glm::ortho(0, screen.x, screen.y, 0)
+	glm::vec2 to_ndc = glm::vec2(2.0f / (float)screen.x, -2.0f / (float)screen.y);
 
-	for(size_t i = 0; i < ps.size(); i++)
+	glm::vec2 spos = pos;
+	for(const BitmapFont::Glyph& gl : shaped.glyphs)
 	{
-		BitmapFont::Glyph gl = ps[i];
-
+		glm::vec2 size = glm::vec2((float)gl.width * glm::abs(scale.x), (float)gl.height * glm::abs(scale.y));
+		glm::vec2 offset = glm::vec2((float)gl.xoffset * scale.x, (float)gl.yoffset * scale.y);
+		glm::vec2 p0 = (spos + offset) * to_ndc + glm::vec2(-1.0f, 1.0f);
+		glm::vec2 p1 = (spos + offset + size) * to_ndc + glm::vec2(-1.0f, 1.0f);
+
+		glm::vec2 t0 = glm::vec2((float)gl.x / iwidth, (float)gl.y / iheight);
+		glm::vec2 t1 = t0 + glm::vec2((float)gl.width / iwidth, (float)gl.height / iheight);
+		// Negative scales mirror the glyph
+		if(scale.x < 0.0f) std::swap(t0.x, t1.x);
+		if(scale.y < 0.0f) std::swap(t0.y, t1.y);
+
+		batch->verts.push_back({glm::vec2(p0.x, p1.y), glm::vec2(t0.x, t1.y), color});
+		batch->verts.push_back({glm::vec2(p1.x, p0.y), glm::vec2(t1.x, t0.y), color});
+		batch->verts.push_back({p0, t0, color});
+		batch->verts.push_back({glm::vec2(p0.x, p1.y), glm::vec2(t0.x, t1.y), color});
+		batch->verts.push_back({p1, t1, color});
+		batch->verts.push_back({glm::vec2(p1.x, p0.y), glm::vec2(t1.x, t0.y), color});
 
-		glm::vec3 gscale = glm::vec3((float)gl.width * glm::abs(scale.x), (float)gl.height * glm::abs(scale.y), 1.0f);
+		spos.x += (float)gl.xadvance * scale.x;
+	}
+}
 
-		glm::vec2 offset = glm::vec2((float)gl.xoffset * scale.x, (float)gl.yoffset * scale.y);
+void TextDrawer::flush()
+{
+	frame++;
 
-		glm::mat4 model = glm::mat4(1.0);
-		model = glm::translate(model, glm::vec3(offset, 0.0f));
-		model = glm::translate(model, spos);
-		model = glm::scale(model, gscale);
-		glm::mat4 tform = view * model;
+	// Aging the cache is cheap, but no need to do it every frame
+	if(frame % 60 == 0)
+	{
+		for(auto it = cache.begin(); it != cache.end();)
+		{
+			if(frame - it->second.last_used > CACHE_FRAMES)
+			{
+				it = cache.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+	}
 
-		glm::vec2 tex_off = glm::vec2((float)gl.x / iwidth, (float)gl.y / iheight);
-		glm::vec2 tex_size = glm::vec2((float)gl.width / iwidth, (float)gl.height / iheight);
+	size_t count = 0;
+	for(const TextBatch& b : batches)
+	{
+		count += b.verts.size();
+	}
 
+	if(count == 0)
+	{
+		batches.clear();
+		return;
+	}
 
-		shader->setMat4("tform", tform);
-		shader->setVec4("texoff", glm::vec4(tex_off.x, tex_off.y, tex_size.x, tex_size.y));
-		shader->setVec2("scale", scale);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	if(count * sizeof(TextVertex) > vbo_size)
+	{
+		vbo_size = glm::max(count * sizeof(TextVertex), vbo_size * 2);
+	}
+	// Orphaned so we don't wait on the previous frame
+	glBufferData(GL_ARRAY_BUFFER, vbo_size, nullptr, GL_STREAM_DRAW);
+	size_t offset = 0;
+	for(const TextBatch& b : batches)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(TextVertex), b.verts.size() * sizeof(TextVertex), b.verts.data());
+		offset += b.verts.size();
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		spos.x += (float)gl.xadvance * scale.x;
+	glDisable(GL_DEPTH_TEST);
+	shader->use();
+	shader->setInt("tex", 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vao);
 
+	GLint first = 0;
+	for(const TextBatch& b : batches)
+	{
+		glBindTexture(GL_TEXTURE_2D, b.tex);
+		glDrawArrays(GL_TRIANGLES, first, (GLsizei)b.verts.size());
+		first += (GLint)b.verts.size();
 	}
 
 	glBindVertexArray(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
-
 	glEnable(GL_DEPTH_TEST);
+
+	batches.clear();
 }
 
-std::pair<std::vector<BitmapFont::Glyph>, float> TextDrawer::get_glyphs_and_size(const std::string& text,
-		BitmapFont* font, glm::vec2 scale)
+const TextDrawer::ShapedText& TextDrawer::shape(const std::string& text, BitmapFont* font)
 {
-	float x_off = 0;
+	ShapeKey key;
+	key.font = font;
+	key.text = text;
 
-	auto it = text.begin();
+	auto found = cache.find(key);
+	if(found != cache.end())
+	{
+		found->second.last_used = frame;
+		return found->second;
+	}
 
-	std::vector<BitmapFont::Glyph> glyphs;
+	ShapedText shaped;
+	shaped.width = 0;
+	shaped.last_used = frame;
 
+	auto it = text.begin();
 	while (it != text.end())
 	{
 		uint32_t code_point = utf8::unchecked::next(it);
 
-		// TODO: Optimize this
 		BitmapFont::Glyph gl;
 		auto cit = font->chars.find(code_point);
 		if (cit == font->chars.end())
@@ -84,13 +164,33 @@ std::pair<std::vector<BitmapFont::Glyph>, float> TextDrawer::get_glyphs_and_size
 			gl = cit->second;
 		}
 
-		glyphs.push_back(gl);
+		shaped.glyphs.push_back(gl);
+		shaped.width += gl.xadvance;
+	}
 
-		x_off += gl.xadvance * scale.x;
+	return cache.emplace(std::move(key), std::move(shaped)).first->second;
+}
 
+void TextDrawer::forget_font(const BitmapFont* font)
+{
+	for(auto it = cache.begin(); it != cache.end();)
+	{
+		if(it->first.font == font)
+		{
+			it = cache.erase(it);
+		}
+		else
+		{
+			it++;
+		}
 	}
+}
 
-	return std::make_pair(glyphs, x_off);
+std::pair<std::vector<BitmapFont::Glyph>, float> TextDrawer::get_glyphs_and_size(const std::string& text,
+		BitmapFont* font, glm::vec2 scale)
+{
+	const ShapedText& shaped = text_drawer->shape(text, font);
+	return std::make_pair(shaped.glyphs, (float)shaped.width * scale.x);
 }
 
 void TextDrawer::draw_text(const std::string& text, BitmapFont* font, glm::vec2 pos,
@@ -102,8 +202,8 @@ void TextDrawer::draw_text(const std::string& text, BitmapFont* font, glm::vec2
 void TextDrawer::draw_text_aligned(const std::string& text, BitmapFont* font, glm::vec2 pos, Alignment alig,
 	 glm::ivec2 screen, glm::vec4 color, glm::vec2 scale)
 {
-
-	auto[glyphs, x_off] =  get_glyphs_and_size(text, font, scale);
+	const ShapedText& shaped = shape(text, font);
+	float x_off = (float)shaped.width * scale.x;
 
 	glm::vec2 npos = pos;
 
@@ -116,64 +216,31 @@ void TextDrawer::draw_text_aligned(const std::string& text, BitmapFont* font, gl
 		npos.x -= x_off;
 	}
 
-	draw_glyphs(glyphs, font, npos, screen, color, scale);
+	queue_glyphs(shaped, font, npos, screen, color, scale);
 }
 
 int TextDrawer::get_size(const std::string & text, BitmapFont * font)
 {
-	int x_off = 0;
-
-	auto it = text.begin();
-
-	while (it != text.end())
-	{
-		uint32_t code_point = utf8::unchecked::next(it);
-
-		// TODO: Optimize this
-		BitmapFont::Glyph gl;
-		auto cit = font->chars.find(code_point);
-		if (cit == font->chars.end())
-		{
-			// Question mark
-			gl = font->chars[63];
-		}
-		else
-		{
-			gl = cit->second;
-		}
-
-		x_off += gl.xadvance;
-
-	}
-
-	return x_off;
+	return shape(text, font).width;
 }
 
 TextDrawer::TextDrawer()
 {
-	float vertices[] = {
-		// Pos      // Tex
-		0.0f, 1.0f, 0.0f, 1.0f,
-		1.0f, 0.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 0.0f,
-
-		0.0f, 1.0f, 0.0f, 1.0f,
-		1.0f, 1.0f, 1.0f, 1.0f,
-		1.0f, 0.0f, 1.0f, 0.0f
-	};
-
+	frame = 0;
+	vbo_size = 0;
 
 	glGenVertexArrays(1, &vao);
 	glGenBuffers(1, &vbo);
 
 	glBindVertexArray(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)0);
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(4 * sizeof(float)));
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -184,6 +251,8 @@ TextDrawer::TextDrawer()
 
 TextDrawer::~TextDrawer()
 {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
 }
 
 void create_global_text_drawer()
@@ -194,4 +263,6 @@ void create_global_text_drawer()
 void destroy_global_text_drawer()
 {
 	delete text_drawer;
+	// Fonts released afterwards (by the asset manager) check it
+	text_drawer = nullptr;
 }
@@ -16,20 +16,69 @@
 // (Looks way better than NanoVG text, but sizes are fixed)
 // (Used by the nanoVG extension so layering works)
 //
+// Text is decoded and measured once, and kept in a cache keyed by string and font
+// (entries not used for a while are dropped).
+// draw_text only queues the glyph quads, every string of the frame is drawn on flush
+// (called by the renderer after the GUI) with a single draw call per font atlas.
+//
 // TODO: Add TrueType (FreeType?) font support
 //
 class TextDrawer
 {
+public:
+
+	struct ShapedText
+	{
+		std::vector<BitmapFont::Glyph> glyphs;
+		// Sum of the advances, in pixels, unscaled
+		int width;
+		uint64_t last_used;
+	};
+
 private:
 
-	// We draw every letter with a single quad
-	// If perfomance is bad I will write a new 
-	// faster method (hopefully only 1 draw call per text)
+	struct ShapeKey
+	{
+		const BitmapFont* font;
+		std::string text;
+
+		bool operator==(const ShapeKey& other) const { return font == other.font && text == other.text; }
+	};
+
+	struct ShapeKeyHasher
+	{
+		size_t operator()(const ShapeKey& key) const;
+	};
+
+	struct TextVertex
+	{
+		// In NDC
+		glm::vec2 pos;
+		glm::vec2 uv;
+		glm::vec4 color;
+	};
+
+	struct TextBatch
+	{
+		GLuint tex;
+		std::vector<TextVertex> verts;
+	};
+
+	// Entries not used for this many frames are dropped
+	static constexpr uint64_t CACHE_FRAMES = 120;
+
+	std::unordered_map<ShapeKey, ShapedText, ShapeKeyHasher> cache;
+	uint64_t frame;
+
+	// One per font atlas used this frame
+	std::vector<TextBatch> batches;
+
 	GLuint vao, vbo;
+	size_t vbo_size;
 
 	Shader* shader;
 
-	void draw_glyphs(const std::vector<BitmapFont::Glyph>& ps, BitmapFont* font, glm::vec2 pos, glm::ivec2 screen,
+	void queue_glyphs(const ShapedText& shaped, BitmapFont* font, glm::vec2 pos, glm::ivec2 screen,
 		glm::vec4 color, glm::vec2 scale);
 
 
@@ -51,6 +100,14 @@ public:
 	void draw_text_aligned(const std::string& text, BitmapFont* font, glm::vec2 pos, Alignment alig, 
 		glm::ivec2 screen, glm::vec4 color = glm::vec4(1.0, 1.0, 1.0, 1.0), glm::vec2 scale = glm::vec2(1.0f, 1.0f));
 
+	// Draws all queued text, and ages the cache
+	void flush();
+
+	// The returned reference is valid until the next flush
+	const ShapedText& shape(const std::string& text, BitmapFont* font);
+	// Drops the cached text of a font, called when it's unloaded
+	void forget_font(const BitmapFont* font);
+
 	static std::pair<std::vector<BitmapFont::Glyph>, float> get_glyphs_and_size(const std::string& text,
 		BitmapFont* font, glm::vec2 scale);
 
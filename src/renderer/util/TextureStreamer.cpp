@@ -0,0 +1,59 @@
+#include "TextureStreamer.h"
+#include <assets/Image.h>
+#include <renderer/Renderer.h>
+#include <algorithm>
+
+TextureStreamer* texture_streamer;
+
+void create_global_texture_streamer()
+{
+	texture_streamer = new TextureStreamer();
+}
+
+void destroy_global_texture_streamer()
+{
+	delete texture_streamer;
+	texture_streamer = nullptr;
+}
+
+void TextureStreamer::add(Image* img)
+{
+	queue.push_back(img);
+}
+
+void TextureStreamer::remove(Image* img)
+{
+	queue.erase(std::remove(queue.begin(), queue.end(), img), queue.end());
+}
+
+void TextureStreamer::update()
+{
+	if(queue.empty())
+	{
+		return;
+	}
+
+	size_t budget = (size_t)hgr->renderer->quality.texture_stream_budget * 1024;
+
+	// Low mips first, across every image
+	std::stable_sort(queue.begin(), queue.end(), [](Image* a, Image* b)
+	{
+		return a->get_stream_level_width() < b->get_stream_level_width();
+	});
+
+	size_t used = 0;
+	for(Image* img : queue)
+	{
+		if(used >= budget)
+		{
+			break;
+		}
+
+		used += img->stream_step(budget - used);
+	}
+
+	queue.erase(std::remove_if(queue.begin(), queue.end(), [](Image* img)
+	{
+		return !img->is_streaming();
+	}), queue.end());
+}
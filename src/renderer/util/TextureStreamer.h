@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+class Image;
+
+// Progressively uploads the big mip levels of streaming images, under a
+// per-frame byte budget (renderer.quality.texture_stream_budget, in KiB).
+// Pending levels are served smallest first across all images, so every
+// texture gets usable detail before any of them gets its full resolution.
+class TextureStreamer
+{
+private:
+
+	std::vector<Image*> queue;
+
+public:
+
+	void add(Image* img);
+	// Called by the Image if it's destroyed before finishing streaming
+	void remove(Image* img);
+
+	// Call once per frame with the GL context current
+	void update();
+
+	bool is_idle() const { return queue.empty(); }
+};
+
+extern TextureStreamer* texture_streamer;
+
+void create_global_texture_streamer();
+void destroy_global_texture_streamer();
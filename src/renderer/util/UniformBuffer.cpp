@@ -0,0 +1,67 @@
+#include "UniformBuffer.h"
+#include <util/Logger.h>
+#include <cstring>
+
+void UniformBuffer::set(const void* data, size_t data_size)
+{
+	logger->check(!streamed, "Use stream() on streamed uniform buffers");
+	logger->check(data_size <= size, "Uniform buffer data is too big ({} > {})", data_size, size);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)data_size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::bind(GLuint binding) const
+{
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+}
+
+void UniformBuffer::stream(const void* data, size_t data_size, GLuint binding)
+{
+	logger->check(streamed, "Use set() on static uniform buffers");
+	logger->check(data_size <= size, "Uniform buffer data is too big ({} > {})", data_size, size);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+
+	if(head + data_size > size)
+	{
+		// Orphan, the driver keeps the old storage alive until the GPU is done with it
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_DRAW);
+		head = 0;
+	}
+
+	// Ranges are never reused before orphaning, so there's no need to synchronize
+	void* ptr = glMapBufferRange(GL_UNIFORM_BUFFER, (GLintptr)head, (GLsizeiptr)data_size,
+								 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	memcpy(ptr, data, data_size);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ubo, (GLintptr)head, (GLsizeiptr)data_size);
+
+	head += ((data_size + align - 1) / align) * align;
+}
+
+UniformBuffer::UniformBuffer(size_t size, bool streamed)
+{
+	this->size = size;
+	this->streamed = streamed;
+	head = 0;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	if(align <= 0)
+	{
+		align = 256;
+	}
+
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, streamed ? GL_STREAM_DRAW : GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &ubo);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Uniform blocks shared by every shader, the layouts are std140 and must match
+// core:shaders/uniform_blocks.fsi. Shaders are bound to these blocks automatically
+// when they are linked (see Shader), so declaring the block is enough to use it.
+// Binding 0 is not used as nanoVG binds its own uniform buffer there.
+namespace UniformBlocks
+{
+	enum Binding : GLuint
+	{
+		FRAME = 1,
+		MATERIAL = 2,
+		DRAW = 3
+	};
+
+	// Updated by the Renderer every time the camera changes (main view and env map faces)
+	struct FrameBlock
+	{
+		glm::mat4 proj;
+		glm::mat4 view;
+		glm::mat4 proj_view;
+		glm::vec3 camera_relative;
+		float far_plane;
+		// Camera relative
+		glm::vec3 sun_pos;
+		float f_coef;
+		glm::vec2 screen_size;
+		// RendererQuality::PBR::Quality and RendererQuality::Atmosphere::iterations
+		int pbr_quality;
+		int atmo_iterations;
+	};
+
+	// Written for every draw call of a material whose shader uses it
+	struct DrawBlock
+	{
+		glm::mat4 final_tform;
+		glm::mat4 deferred_tform;
+		// mat3 columns are padded to vec4 in std140
+		glm::vec4 normal_model[3];
+		int drawable_id;
+		int pad[3];
+	};
+
+	static_assert(sizeof(FrameBlock) == 240, "FrameBlock does not match its std140 layout");
+	static_assert(sizeof(DrawBlock) == 192, "DrawBlock does not match its std140 layout");
+}
+
+// A std140 uniform buffer object. Static buffers hold a single block which is
+// replaced with set(). Streamed buffers hold many small blocks one after the
+// other (per-draw data), every stream() call writes to a fresh range so we never
+// touch data the GPU may still be reading, and the whole buffer is orphaned
+// once it's full.
+class UniformBuffer
+{
+private:
+
+	GLuint ubo;
+	size_t size;
+	bool streamed;
+
+	size_t head;
+	GLint align;
+
+public:
+
+	// Replaces the contents of a static buffer, size must be at most the buffer size
+	void set(const void* data, size_t data_size);
+	void bind(GLuint binding) const;
+
+	// Writes the data to the next free range and binds it to given binding
+	void stream(const void* data, size_t data_size, GLuint binding);
+
+	size_t get_size() const { return size; }
+
+	UniformBuffer(size_t size, bool streamed = false);
+	~UniformBuffer();
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+};
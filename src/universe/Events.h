@@ -1,6 +1,6 @@
 #pragma once
 #include <variant>
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 #include <util/defines.h>
 #include <unordered_set>
 
@@ -58,6 +58,10 @@ void PlanetarySystem::render_body(CartesianState state, SystemElement* body, glm
 	tforms.rot = body->get_small_rotation_angle(t0, t);
 	tforms.rot_tform = glm::transpose(glm::inverse(rot_matrix));
 	tforms.proj_view = proj_view;
+	if(body->renderer.atmo != nullptr && hgr->renderer->quality.atmosphere.use_lut)
+	{
+		tforms.atmo_lut = body->renderer.atmo->lut.get(body->config);
+	}
 
 	body->renderer.deferred(tforms, body->config, body->dot_factor);
 
@@ -82,6 +86,25 @@ void PlanetarySystem::render_body_atmosphere(CartesianState state, SystemElement
 static double zoom = 1.0;
 
 
+void PlanetarySystem::far_shadow_pass(ShadowCamera& sh_cam)
+{
+	for (size_t i = 0; i < elements.size(); i++)
+	{
+		SystemElement* body = elements[i];
+		// Bodies drawn as dots are not loaded, and too far to cast shadows anyway
+		if (!body->render_enabled || body->renderer.rocky == nullptr || body->dot_factor == 1.0f)
+		{
+			continue;
+		}
+
+		glm::dmat4 model = glm::translate(glm::dmat4(1.0), states_now[i].pos);
+		model = glm::scale(model, glm::dvec3(body->config.radius));
+		model = model * body->build_rotation_matrix(t0, t);
+
+		body->renderer.shadow(model, sh_cam, body->config);
+	}
+}
+
 void PlanetarySystem::deferred_pass(CameraUniforms& cu, bool is_env_map)
 {
 	// TODO: Don't have this fixed
@@ -243,7 +266,7 @@ static void load_body(SystemElement* body)
 
 		std::string script = AssetManager::load_string_raw(body->config.surface.script_path);
 
-		body->renderer.rocky->load(script, body->config.surface.script_path_raw, body->config);
+		body->renderer.rocky->load(script, body->config.surface.script_path, body->config);
 	}
 	else
 	{
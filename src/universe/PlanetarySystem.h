@@ -92,6 +92,9 @@ public:
 	bool needs_deferred_pass() override { return true; }
 	bool needs_forward_pass() override { return true; }
 	bool needs_env_map_pass() override { return true; }
+	// Landscape shadows of the rocky bodies
+	void far_shadow_pass(ShadowCamera& sh_cam) override;
+	bool needs_far_shadow_pass() override { return true; }
 
 	void update(double dt, btDynamicsWorld* world, bool bullet);
 
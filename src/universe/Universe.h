@@ -9,7 +9,7 @@
 #pragma warning(pop)
 
 #include <physics/debug/BulletDebugDrawer.h>
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 
 // The Universe is the central class of the game. It stores both the system
 // and everything else in the system (buildings and vehicles).
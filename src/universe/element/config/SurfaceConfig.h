@@ -13,6 +13,8 @@ struct SurfaceConfig
 {
 	std::string script_path;
 	std::string script_path_raw;
+	// Package the script belongs to, its lua state loads it
+	std::string script_package;
 	int max_depth;
 	double coef_a;
 	double coef_b;
@@ -49,5 +51,6 @@ public:
 		SAFE_TOML_GET(to.max_height, "max_height", double);
 
 		to.script_path = hgr->assets->resolve_path(to.script_path_raw);
+		to.script_package = hgr->assets->get_package_and_name(to.script_path_raw, "").first;
 	}
 };
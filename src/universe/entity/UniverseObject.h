@@ -3,7 +3,7 @@
 #pragma warning(push, 0)
 #include <btBulletDynamicsCommon.h>
 #pragma warning(pop)
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 
 #include <renderer/Drawable.h>
 #include <util/defines.h>
@@ -0,0 +1,69 @@
+#include "Prediction.h"
+
+void Prediction::convert_points(const std::vector<const std::vector<glm::dvec3>*>& chunks,
+	const std::vector<CartesianState>* elem_points, double scale, double max_angle, std::vector<glm::vec4>& out)
+{
+	out.clear();
+
+	size_t total = 0;
+	for(const std::vector<glm::dvec3>* chunk : chunks)
+	{
+		total += chunk->size();
+	}
+
+	if(total == 0)
+	{
+		return;
+	}
+
+	size_t i = 0;
+	auto get_point = [elem_points, &i](glm::dvec3 p)
+	{
+		if(elem_points && i < elem_points->size())
+		{
+			p -= (*elem_points)[i].pos;
+		}
+		i++;
+		return p;
+	};
+
+	double cos_max = glm::cos(max_angle);
+	glm::dvec3 last_kept, prev;
+	bool has_prev = false;
+	for(const std::vector<glm::dvec3>* chunk : chunks)
+	{
+		for(const glm::dvec3& raw : *chunk)
+		{
+			glm::dvec3 p = get_point(raw);
+
+			if(out.empty())
+			{
+				out.emplace_back(glm::vec3(p * scale), 1.0f);
+				last_kept = p;
+			}
+			else if(has_prev)
+			{
+				// prev is kept if the path turns too much after it, measured from the last kept
+				// point, so slow turns accumulate until they are noticeable
+				glm::dvec3 d0 = prev - last_kept;
+				glm::dvec3 d1 = p - prev;
+				double l0 = glm::length(d0);
+				double l1 = glm::length(d1);
+				if(l0 > 0.0 && l1 > 0.0 && glm::dot(d0, d1) < cos_max * l0 * l1)
+				{
+					out.emplace_back(glm::vec3(prev * scale), 1.0f);
+					last_kept = prev;
+				}
+			}
+
+			prev = p;
+			has_prev = true;
+		}
+	}
+
+	// The end of the prediction is always kept
+	if(total > 1)
+	{
+		out.emplace_back(glm::vec3(prev * scale), 1.0f);
+	}
+}
@@ -4,12 +4,21 @@
 class Prediction
 {
 private:
-	// If positive, the prediction needs to be sent to the GPU starting
-	// at index dirty in returned ptr from get_prediction_point
+	// If positive, ready_points changed and need to be sent to the GPU
+	// starting at point dirty
 	int dirty;
 public:
 	std::mutex lock;
 
+	// Points converted to float (scaled by upload_scale) and decimated, ready to be copied
+	// to the GPU. Built by the predictor thread (see convert_points) and taken (swapped out)
+	// by the drawer, so it holds the lock only for the swap
+	std::vector<glm::vec4> ready_points;
+	// Set by the drawer, the predictor must convert points with these
+	double upload_scale;
+	// Angle (radians) the path may turn before a point is kept
+	double decimate_angle;
+
 	virtual FrameOfReference get_ref() = 0;
 	// Return true as long as there are more points to draw, set *ptr = &points
 	// Will always be called to completion
@@ -18,14 +27,25 @@ public:
 	// actual value of points to pre-allocate space if you know num of points is going to grow
 	virtual size_t get_num_points() = 0;
 	// Return nullptr if points are already transformed into FrameOfReference
+	// Otherwise, contains the state of the reference body for every point
 	virtual std::vector<CartesianState>* get_element_points() = 0;
 	bool is_dirty(){ return dirty >= 0; }
 	int get_dirty_level() {return dirty; }
 	void unset_dirty() { dirty = -1; }
 	void set_dirty(int depth){ dirty = depth;}
 
+	// Converts the chunks of prediction points into the format used by the drawer, call from the
+	// predictor thread without the lock held. Points are transformed into the frame of reference
+	// if elem_points is given, and decimated: straight-ish parts of the path keep few points, while
+	// tight turns (periapsis, close encounters) keep all of them
+	static void convert_points(const std::vector<const std::vector<glm::dvec3>*>& chunks,
+		const std::vector<CartesianState>* elem_points, double scale, double max_angle,
+		std::vector<glm::vec4>& out);
+
 	Prediction()
 	{
 		dirty = -1;
+		upload_scale = 1.0;
+		decimate_angle = 0.01;
 	}
 };
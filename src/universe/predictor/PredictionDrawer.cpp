@@ -9,78 +9,100 @@ PredictionDrawer::PredictionDrawer(Prediction* pred, double nscale)
 	pr = pred;
 	ssbo = 0;
 	vao = 0;
+	points_in_ssbo = 0;
+	size_of_ssbo = 0;
 	scale = nscale;
-	rebuild = false;
+	ssbo_scale = nscale;
 	line_shader = AssetHandle<Shader>("core:shaders/lines/lines.vs");
+
+	pr->lock.lock();
+	pr->upload_scale = nscale;
+	pr->lock.unlock();
 }
 
 
 PredictionDrawer::~PredictionDrawer()
-= default;
+{
+	if(ssbo != 0)
+	{
+		glDeleteBuffers(1, &ssbo);
+		glDeleteVertexArrays(1, &vao);
+	}
+}
 
 void PredictionDrawer::update()
 {
-	// TODO: This lock could be more "localized"
+	// Only the swap is done with the lock held
 	pr->lock.lock();
 	int dirty = pr->get_dirty_level();
-
 	if(dirty >= 0)
 	{
-		size_t points = pr->get_num_points();
-		if(ssbo == 0)
-		{
-			create_buffers();
-			resize_buffers();
-		}
-		else
-		{
-			if(points > size_of_ssbo)
-			{
-				resize_buffers();
-			}
-		}
-		int num = 0;
-		size_t put_points = 0;
+		staging.swap(pr->ready_points);
+		ssbo_scale = pr->upload_scale;
+		pr->unset_dirty();
+	}
+	pr->lock.unlock();
 
-		std::vector<glm::dvec3>* pred_points;
+	if(dirty < 0)
+	{
+		return;
+	}
+
+	if(ssbo == 0)
+	{
+		create_buffers();
+	}
+
+	if(staging.size() > size_of_ssbo)
+	{
+		// Grow with some margin, as predictions tend to grow
+		size_t old = size_of_ssbo;
+		size_of_ssbo = glm::max(staging.size(), size_of_ssbo + size_of_ssbo / 2);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-		while(pr->get_prediction_points(&pred_points))
+		glBufferData(GL_SHADER_STORAGE_BUFFER, size_of_ssbo * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// Contents are lost
+		if(old != 0)
 		{
-			num++;
-			if(num - 1 < dirty)
-			{
-				// We "put" all previous points
-				put_points += pred_points->size();
-				continue;
-			}
-
-			FrameOfReference ref = pr->get_ref();
-			std::vector<CartesianState>* elem_points = pr->get_element_points();
-			// We have to use vec4 for memory alignment reasons
-			std::vector<glm::vec4> final_points;
-			final_points.resize(pred_points->size());
-			for(size_t i = 0; i < pred_points->size(); i++)
-			{
-				glm::dvec3 point = (*pred_points)[i];
-				if (elem_points)
-				{
-					// TODO: Transform points with ref and elem_points
-				}
-				glm::vec3 vec = (glm::vec3)(point * scale);
-				final_points[i] = glm::vec4(vec, 1.0f);
-			}
-
-			// Send to the GPU
-			size_t size = final_points.size();
-			glBufferSubData(GL_SHADER_STORAGE_BUFFER, put_points * sizeof(float) * 4, size * sizeof(float) * 4, (float*)final_points.data());
-
-			put_points += size;
+			dirty = 0;
 		}
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-		points_in_ssbo = put_points;
 	}
 
-	pr->lock.unlock();
+	upload(glm::min((size_t)dirty, staging.size()));
+}
+
+void PredictionDrawer::upload(size_t first)
+{
+	points_in_ssbo = staging.size();
+	if(first >= staging.size())
+	{
+		return;
+	}
+
+	// A full upload lets the driver orphan the buffer instead of waiting for the GPU
+	// to finish drawing the previous points
+	GLbitfield flags = GL_MAP_WRITE_BIT;
+	flags |= first == 0 ? GL_MAP_INVALIDATE_BUFFER_BIT : GL_MAP_INVALIDATE_RANGE_BIT;
+
+	size_t size = (staging.size() - first) * sizeof(glm::vec4);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	void* ptr = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, first * sizeof(glm::vec4), size, flags);
+	if(ptr != nullptr)
+	{
+		memcpy(ptr, staging.data() + first, size);
+		if(glUnmapBuffer(GL_SHADER_STORAGE_BUFFER) == GL_FALSE)
+		{
+			// Contents were corrupted (rare, for example on a mode switch), draw nothing until
+			// the next prediction arrives
+			points_in_ssbo = 0;
+		}
+	}
+	else
+	{
+		logger->warn("Could not map prediction SSBO");
+		points_in_ssbo = 0;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 
@@ -92,24 +114,38 @@ void PredictionDrawer::create_buffers()
 
 void PredictionDrawer::resize_buffers()
 {
-	size_t points = pr->get_num_points();
+	if(ssbo == 0)
+	{
+		return;
+	}
+
+	size_of_ssbo = staging.size();
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, points * sizeof(float) * 4, nullptr, GL_DYNAMIC_DRAW);
-	// Later on glBufferSubData is used to fill it up
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size_of_ssbo * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-	size_of_ssbo = points;
+	upload(0);
 }
 
 void PredictionDrawer::set_scale(double nval)
 {
 	// Tiny scale changes are ignored for performance
-	if(scale / nval < 1.01 || scale / nval > 0.999)
+	double ratio = scale / nval;
+	if(ratio > 0.99 && ratio < 1.01)
 		return;
 
 	scale = nval;
-	rebuild = true;
+	pr->lock.lock();
+	pr->upload_scale = nval;
+	pr->lock.unlock();
+}
+
+void PredictionDrawer::set_decimate_angle(double nval)
+{
+	pr->lock.lock();
+	pr->decimate_angle = nval;
+	pr->lock.unlock();
 }
 
 void PredictionDrawer::forward_pass(CameraUniforms &cu)
@@ -127,7 +163,7 @@ void PredictionDrawer::forward_pass(CameraUniforms &cu)
 	line_shader->setFloat("f_coef", 2.0f / glm::log2(cu.far_plane + 1.0f));
 	line_shader->setFloat("thickness", 3.0f);
 	line_shader->setVec4("color", glm::vec4(1.0, 0.0, 1.0, 1.0));
-	line_shader->setFloat("inv_scale", (float)(1.0 / scale));
+	line_shader->setFloat("inv_scale", (float)(1.0 / ssbo_scale));
 
 	// Bind the buffers and draw
 	glBindVertexArray(vao);
@@ -13,7 +13,8 @@ private:
 
 	Prediction* pr;
 	// We use a SSBO to store the points, and a dummy VAO to draw them
-	// This means we only need to do partial updates which is fast
+	// The predictor thread converts (and decimates) the points, so update only swaps
+	// them out of the prediction and copies them into the mapped SSBO, without the lock held.
 	// Note that an overfull SSBO is no problem, and for performance we don't
 	// downsize. A downsize can be trigged by manually calling resize_buffers
 	// Finally, we use a scale to store the points as floats, they are later
@@ -22,11 +23,16 @@ private:
 	size_t size_of_ssbo;
 	GLuint ssbo;
 	GLuint vao;
+	// Scale the points in the SSBO were converted with, may lag behind scale
+	double ssbo_scale;
 
-	bool rebuild;
-
+	// Last points taken from the prediction, given back on the next swap so
+	// the predictor reuses the memory
+	std::vector<glm::vec4> staging;
 
 	void create_buffers();
+	// Copies staging[first, end) to the SSBO
+	void upload(size_t first);
 
 public:
 	// Appropiate value depends on the orbit plotting frame and size
@@ -37,12 +43,13 @@ public:
 	// Should be very cheap to call as it checks dirty flag!
 	void update();
 
-	// Sets scale for next update, EXPENSIVE on next update as it rebuilds the whole orbit
+	// Sets scale for next prediction, EXPENSIVE as the predictor converts the whole orbit again
 	void set_scale(double nval);
+	// Sets how much the path may turn (radians) before a point is kept, 0 keeps every point
+	void set_decimate_angle(double nval);
 
 	void forward_pass(CameraUniforms& cu);
 
 	explicit PredictionDrawer(Prediction* pred, double scale);
 	~PredictionDrawer();
 };
-
@@ -38,6 +38,8 @@ void QuickPredictor::sterm_predict(glm::dvec3 spos, glm::dvec3 svel)
 	// Fetch prediction
 	pred.lock.lock();
 	FrameOfReference pred_ref = pred.ref;
+	double scale = pred.upload_scale;
+	double decimate_angle = pred.decimate_angle;
 	pred.lock.unlock();
 
 	RK4Propagator prop;
@@ -64,13 +66,22 @@ void QuickPredictor::sterm_predict(glm::dvec3 spos, glm::dvec3 svel)
 
 
 
+	// Converted here so the drawer only has to copy the points to the GPU
+	std::vector<const std::vector<glm::dvec3>*> chunks;
+	size_t points = 0;
+	for(const QuickPredictedInterval& inter : intervals)
+	{
+		chunks.push_back(&inter.pred);
+		points += inter.pred.size();
+	}
+	Prediction::convert_points(chunks, pred.get_element_points(), scale, decimate_angle, converted);
+
 	pred.lock.lock();
 	pred.intervals = std::move(intervals);
+	pred.points = points;
+	// The previous buffer is kept to reuse its memory
+	pred.ready_points.swap(converted);
 	pred.set_dirty(0);
-	for(size_t i = 0; i < pred.intervals.size(); i++)
-	{
-		pred.points = pred.points + pred.intervals[i].pred.size();
-	}
 	pred.lock.unlock();
 
 }
@@ -60,6 +60,8 @@ private:
 
 	glm::dvec3 pos, vel;
 	std::mutex mtx;
+	// Only used by the thread
+	std::vector<glm::vec4> converted;
 	bool kill_thread;
 
 
@@ -2,101 +2,163 @@
 
 DebugDrawer* debug_drawer;
 
-void DebugDrawer::render(glm::dmat4 proj_view, glm::dmat4 c_model, float far_plane)
+void DebugDrawer::ensure_capacity(size_t count)
 {
+	if(count <= section_size)
+	{
+		return;
+	}
 
-	if (draw_list.size() > 0)
+	// Orphans the old buffer, so no fences are needed for it anymore
+	for(GLsync& fence : fences)
 	{
-		if (points_vbo != 0)
+		if(fence != nullptr)
 		{
-			glDeleteBuffers(1, &points_vbo);
-			glDeleteBuffers(1, &lines_vbo);
-			glDeleteVertexArrays(1, &points_vao);
-			glDeleteVertexArrays(1, &lines_vao);
+			glDeleteSync(fence);
+			fence = nullptr;
 		}
+	}
 
-		glGenBuffers(1, &points_vbo);
-		glGenBuffers(1, &lines_vbo);
-		glGenVertexArrays(1, &points_vao);
-		glGenVertexArrays(1, &lines_vao);
-
-		std::vector<DebugVertexf> points;
-		std::vector<DebugVertexf> lines; //< Lines go in pairs
+	section_size = glm::max(count, section_size * 2);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertexf) * section_size * RING_SECTIONS, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-		for (size_t i = 0; i < draw_list.size(); i++)
+void DebugDrawer::render(glm::dmat4 proj_view, glm::dmat4 c_model, float far_plane)
+{
+	size_t counts[PRIMITIVE_COUNT] = {0, 0, 0};
+	size_t total = 0;
+	for(int prim = 0; prim < PRIMITIVE_COUNT; prim++)
+	{
+		counts[prim] += immediate.verts[prim].size();
+		for(const auto& pair : persistent)
 		{
-			if (draw_list[i].verts.size() == 1)
-			{
-				points.push_back(draw_list[i].verts[0].transform(c_model));
-			}
-			else
-			{
-				for (size_t j = 0; j < draw_list[i].verts.size(); j++)
-				{
-					lines.push_back(draw_list[i].verts[j].transform(c_model));
-				}
-			}
+			counts[prim] += pair.second.verts[prim].size();
 		}
+		total += counts[prim];
+	}
 
+	if(total == 0)
+	{
+		return;
+	}
 
-		glBindVertexArray(points_vao);
-
-		glBindBuffer(GL_ARRAY_BUFFER, points_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertexf) * points.size(), points.data(), GL_STATIC_DRAW);
+	if(vbo == 0)
+	{
+		glGenBuffers(1, &vbo);
+		glGenVertexArrays(1, &vao);
 
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
 		// pos
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertexf), (void*)0);
 		// color
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertexf), (void*)(3 * sizeof(float)));
 		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-		glBindVertexArray(lines_vao);
+	ensure_capacity(total);
 
-		glBindBuffer(GL_ARRAY_BUFFER, lines_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(DebugVertexf) * lines.size(), lines.data(), GL_STATIC_DRAW);
+	section = (section + 1) % RING_SECTIONS;
+	if(fences[section] != nullptr)
+	{
+		// Written RING_SECTIONS frames ago, so this should never actually wait
+		glClientWaitSync(fences[section], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(fences[section]);
+		fences[section] = nullptr;
+	}
 
-		// pos
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-		// color
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	auto* out = (DebugVertexf*)glMapBufferRange(GL_ARRAY_BUFFER,
+		sizeof(DebugVertexf) * section_size * section, sizeof(DebugVertexf) * total,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// c_model is only a translation, so we avoid the full matrix product
+	glm::dvec3 offset = glm::dvec3(c_model[3]);
+	auto write = [&out, offset](const std::vector<DebugVertex>& verts)
+	{
+		for(const DebugVertex& v : verts)
+		{
+			out->pos = glm::vec3(v.pos + offset);
+			out->color = v.color;
+			out++;
+		}
+	};
 
+	// Grouped by primitive, so each is drawn in one call
+	for(int prim = 0; prim < PRIMITIVE_COUNT; prim++)
+	{
+		write(immediate.verts[prim]);
+		for(const auto& pair : persistent)
+		{
+			write(pair.second.verts[prim]);
+		}
+	}
 
-		glPointSize(point_size);
-		glLineWidth(line_size);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		shader->use();
-		shader->setMat4("tform", proj_view);
-		shader->setFloat("f_coef", 2.0f / glm::log2(far_plane + 1.0f));
+	glPointSize(point_size);
+	glLineWidth(line_size);
 
-		// Draw them
-		glBindVertexArray(points_vao);
-		glDrawArrays(GL_POINTS, 0, (GLsizei)points.size());
-		glBindVertexArray(0);
+	shader->use();
+	shader->setMat4("tform", proj_view);
+	shader->setFloat("f_coef", 2.0f / glm::log2(far_plane + 1.0f));
 
-		glBindVertexArray(lines_vao);
-		glDrawArrays(GL_LINES, 0, (GLsizei)lines.size());
-		glBindVertexArray(0);
+	static const GLenum modes[PRIMITIVE_COUNT] = {GL_POINTS, GL_LINES, GL_TRIANGLES};
+	GLint first = (GLint)(section_size * section);
+	glBindVertexArray(vao);
+	glDisable(GL_CULL_FACE);
+	for(int prim = 0; prim < PRIMITIVE_COUNT; prim++)
+	{
+		if(counts[prim] > 0)
+		{
+			glDrawArrays(modes[prim], first, (GLsizei)counts[prim]);
+		}
+		first += (GLint)counts[prim];
+	}
+	glEnable(GL_CULL_FACE);
+	glBindVertexArray(0);
+
+	fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	immediate.clear();
+}
 
-		draw_list.clear();
+void DebugDrawer::begin_persistent(const std::string& name)
+{
+	target = &persistent[name];
+	target->clear();
+}
+
+void DebugDrawer::end_persistent()
+{
+	target = &immediate;
+}
 
+void DebugDrawer::remove_persistent(const std::string& name)
+{
+	auto it = persistent.find(name);
+	if(it == persistent.end())
+	{
+		return;
 	}
 
+	if(target == &it->second)
+	{
+		target = &immediate;
+	}
+	persistent.erase(it);
 }
 
 void DebugDrawer::add_cone(glm::dvec3 base, glm::dvec3 tip, double radius, glm::vec3 color, int verts)
 {
 	// We want lines from the tip to every single vertex in the 
 	// base, and from every single vertex in the base to the next one
-	DebugShape shape;
 
 	glm::dvec3 up = glm::dvec3(0.0, 1.0, 0.0);
 	double dot = glm::abs(glm::dot(glm::normalize(base - tip), glm::dvec3(0.0, 1.0, 0.0)));
@@ -129,28 +191,24 @@ void DebugDrawer::add_cone(glm::dvec3 base, glm::dvec3 tip, double radius, glm::
 
 		if (v < verts)
 		{
-			shape.verts.push_back(DebugVertex(tip, color));
-			shape.verts.push_back(DebugVertex(dim, color));
+			push(LINES, tip, color);
+			push(LINES, dim, color);
 		}
 
 		if (has_prev)
 		{
 			// To previous
-			shape.verts.push_back(DebugVertex(dim, color));
-			shape.verts.push_back(DebugVertex(prev, color));
+			push(LINES, dim, color);
+			push(LINES, prev, color);
 		}
 
 		prev = dim;
 		has_prev = true;
 	}
-
-
-	draw_list.push_back(shape);
 }
 
 void DebugDrawer::add_orbit(glm::dvec3 origin, KeplerOrbit orbit, glm::vec3 color, bool striped, int verts)
 {
-	DebugShape shape;
 
 	KeplerElements elems = KeplerElements();
 	elems.orbit = orbit;
@@ -168,31 +226,32 @@ void DebugDrawer::add_orbit(glm::dvec3 origin, KeplerOrbit orbit, glm::vec3 colo
 
 		if (v % 2 == 0 || !striped)
 		{
-			shape.verts.push_back(DebugVertex(prev + origin, color));
-			shape.verts.push_back(DebugVertex(pos + origin, color));
+			push(LINES, prev + origin, color);
+			push(LINES, pos + origin, color);
 		}
 
 
 		prev = pos;
 	}
-
-	draw_list.push_back(shape);
 }
 
 void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
 {
-	DebugShape shape;
-	shape.verts.push_back(DebugVertex(a, color));
-	shape.verts.push_back(DebugVertex(b, color));
-	draw_list.push_back(shape);
+	push(LINES, a, color);
+	push(LINES, b, color);
 }
 
 void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 acolor, glm::vec3 bcolor)
 {
-	DebugShape shape;
-	shape.verts.push_back(DebugVertex(a, acolor));
-	shape.verts.push_back(DebugVertex(b, bcolor));
-	draw_list.push_back(shape);
+	push(LINES, a, acolor);
+	push(LINES, b, bcolor);
+}
+
+void DebugDrawer::add_triangle(glm::dvec3 a, glm::dvec3 b, glm::dvec3 c, glm::vec3 color)
+{
+	push(TRIANGLES, a, color);
+	push(TRIANGLES, b, color);
+	push(TRIANGLES, c, color);
 }
 
 void DebugDrawer::add_arrow(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
@@ -206,9 +265,7 @@ void DebugDrawer::add_arrow(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
 
 void DebugDrawer::add_point(glm::dvec3 a, glm::vec3 color)
 {
-	DebugShape shape;
-	shape.verts.push_back(DebugVertex(a, color));
-	draw_list.push_back(shape);
+	push(POINTS, a, color);
 }
 
 void DebugDrawer::add_transform(glm::dvec3 origin, glm::dmat4 tform, double length)
@@ -224,10 +281,15 @@ void DebugDrawer::add_transform(glm::dvec3 origin, glm::dmat4 tform, double leng
 
 DebugDrawer::DebugDrawer()
 {
-	points_vbo = 0;
-	points_vao = 0;
-	lines_vbo = 0;
-	lines_vao = 0;
+	vbo = 0;
+	vao = 0;
+	section_size = 0;
+	section = 0;
+	for(GLsync& fence : fences)
+	{
+		fence = nullptr;
+	}
+	target = &immediate;
 
 	shader = hgr->assets->get<Shader>("core", "shaders/debug.vs");
 	point_size = 4.0f;
@@ -239,6 +301,19 @@ DebugDrawer::DebugDrawer()
 
 DebugDrawer::~DebugDrawer()
 {
+	for(GLsync fence : fences)
+	{
+		if(fence != nullptr)
+		{
+			glDeleteSync(fence);
+		}
+	}
+
+	if(vbo != 0)
+	{
+		glDeleteBuffers(1, &vbo);
+		glDeleteVertexArrays(1, &vao);
+	}
 }
 
 void DebugDrawer::add_aabb(glm::dmat4 tranform, glm::dvec3 half_extents, glm::vec3 color)
@@ -2,12 +2,21 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
+#include <unordered_map>
+#include <string>
 #include <glad/glad.h>
 #include <assets/Shader.h>
 #include <assets/AssetManager.h>
 #include "MathUtil.h"
 #include <universe/kepler/KeplerElements.h>
 
+// Shapes are stored as flat vertex lists per primitive type, and every frame all of them
+// are written (camera relative, in floats) into one section of a triple buffered vertex ring
+// and drawn with a single draw call per primitive type. Each section is protected by a fence,
+// so we never write to memory the GPU may still be reading.
+// Shapes are only drawn for the current frame, unless they are added between
+// begin_persistent and end_persistent, in which case they stay until removed.
+// (OpenGL 4.3 has no persistent mapping, so sections are mapped unsynchronized every frame)
 class DebugDrawer
 {
 private:
@@ -24,27 +33,45 @@ private:
 		glm::vec3 color;
 
 		DebugVertex(glm::dvec3 p, glm::vec3 c) : pos(p), color(c) {};
-		DebugVertexf transform(glm::dmat4 c_model)
-		{
-			DebugVertexf out;
-			out.color = color;
-			out.pos = glm::vec3(c_model * glm::dvec4(pos, 1.0));
-			return out;
-		}
 	};
 
-	struct DebugShape
+	enum Primitive
 	{
-		std::vector<DebugVertex> verts;
+		POINTS,
+		LINES,
+		TRIANGLES,
+		PRIMITIVE_COUNT
 	};
 
-	std::vector<DebugShape> draw_list;
+	struct DebugBatch
+	{
+		std::vector<DebugVertex> verts[PRIMITIVE_COUNT];
+		void clear() { for(auto& v : verts) v.clear(); }
+	};
+
+	static constexpr size_t RING_SECTIONS = 3;
+
+	DebugBatch immediate;
+	std::unordered_map<std::string, DebugBatch> persistent;
+	// Where shapes are currently being added
+	DebugBatch* target;
 
-	GLuint points_vbo, points_vao;
-	GLuint lines_vbo, lines_vao;
+	GLuint vbo, vao;
+	// In vertices
+	size_t section_size;
+	size_t section;
+	GLsync fences[RING_SECTIONS];
 
 	Shader* shader;
 
+	void push(Primitive prim, glm::dvec3 pos, glm::vec3 color)
+	{
+		target->verts[prim].emplace_back(pos, color);
+	}
+
+	// Makes sure every section can hold count vertices
+	void ensure_capacity(size_t count);
+
 public:
 
 	// NOTE: Flag does nothing functionally unless implemented 
@@ -57,10 +84,18 @@ public:
 
 	void render(glm::dmat4 proj_view, glm::dmat4 c_model, float far_plane);
 
+	// Shapes added between these calls are drawn every frame until remove_persistent is
+	// called. Calling begin_persistent with a name already in use replaces its shapes
+	void begin_persistent(const std::string& name);
+	void end_persistent();
+	void remove_persistent(const std::string& name);
+
 	void add_point(glm::dvec3 a, glm::vec3 color);
 	void add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 color);
 	void add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 acolor, glm::vec3 bcolor);
 	void add_arrow(glm::dvec3 a, glm::dvec3 b, glm::vec3 color);
+	// Filled, drawn without face culling
+	void add_triangle(glm::dvec3 a, glm::dvec3 b, glm::dvec3 c, glm::vec3 color);
 	// Adds an axis-aligned box in transform axes, with given half_extents and color
 	// (half-extents are also scaled by the transform matrix!)
 	void add_aabb(glm::dmat4 tranform, glm::dvec3 half_extents, glm::vec3 color);
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Non-cryptographic hashes, used to key on-disk caches (cooked models, shader binaries...)
+class HashUtil
+{
+public:
+
+	static constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+	// 64 bit FNV-1a, pass a previous result as hash to chain several buffers
+	static uint64_t fnv1a(const void* data, size_t size, uint64_t hash = FNV_OFFSET)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+		for(size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static uint64_t fnv1a(const std::string& str, uint64_t hash = FNV_OFFSET)
+	{
+		return fnv1a(str.data(), str.size(), hash);
+	}
+};
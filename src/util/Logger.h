@@ -2,7 +2,7 @@
 #include <fmt/core.h>
 #include <vector>
 #include <mutex>
-#include <sol/sol.hpp>
+#include <lua/LuaGlmInterop.h>
 
 // Comment to disable "debug" logging in Release
 #define LOG_DEBUG_ALWAYS
@@ -242,4 +242,34 @@ std::pair<glm::dvec2, bool> MathUtil::world_to_clip(glm::dmat4 proj_view, glm::d
 	return std::make_pair(glm::dvec2(clip_pos.x, clip_pos.y), clip_pos.z < 1.0);
 }
 
+// Gribb-Hartmann method
+std::array<glm::dvec4, 6> MathUtil::get_frustum_planes(const glm::dmat4& tform)
+{
+	glm::dvec4 row0 = glm::dvec4(tform[0][0], tform[1][0], tform[2][0], tform[3][0]);
+	glm::dvec4 row1 = glm::dvec4(tform[0][1], tform[1][1], tform[2][1], tform[3][1]);
+	glm::dvec4 row2 = glm::dvec4(tform[0][2], tform[1][2], tform[2][2], tform[3][2]);
+	glm::dvec4 row3 = glm::dvec4(tform[0][3], tform[1][3], tform[2][3], tform[3][3]);
+
+	std::array<glm::dvec4, 6> planes = {row3 + row0, row3 - row0, row3 + row1, row3 - row1,
+		row3 + row2, row3 - row2};
+	for(glm::dvec4& p : planes)
+	{
+		p /= glm::length(glm::dvec3(p));
+	}
+
+	return planes;
+}
 
+bool MathUtil::sphere_in_frustum(const std::array<glm::dvec4, 6>& planes, glm::dvec3 center, double radius,
+	size_t plane_count)
+{
+	for(size_t i = 0; i < plane_count; i++)
+	{
+		if(glm::dot(glm::dvec3(planes[i]), center) + planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
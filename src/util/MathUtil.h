@@ -6,6 +6,7 @@
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <tuple>
+#include <array>
 
 class MathUtil
 {
@@ -56,6 +57,14 @@ public:
 	// Viewport is (x0, y0, w, h), as used everywhere
 	// Returns the coordinates to be fed into NanoVG
 	static glm::vec2 clip_to_screen(glm::dvec2 clip_pos, glm::vec4 viewport);
+
+	// Normalized planes (xyz = inwards normal, w = distance) of the frustum of a
+	// world to clip matrix. Order is left, right, bottom, top, near, far
+	static std::array<glm::dvec4, 6> get_frustum_planes(const glm::dmat4& tform);
+
+	// Only the first plane_count planes are tested, use 5 to ignore the far plane
+	static bool sphere_in_frustum(const std::array<glm::dvec4, 6>& planes, glm::dvec3 center, double radius,
+		size_t plane_count = 6);
 };
 
 class ProjectionUtil